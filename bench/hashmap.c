@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <time.h>
+#include "type_checker.h"
+#include "old_hashmap.h"
+
+// Inserts, gets and removes n keys shaped like the symbol table's, in
+// the old chained map and in VariableMap, and prints how many millions
+// of each they do a second. Every size is repeated until it comes to
+// about the same number of operations.
+
+#define BENCH_OPERATIONS 2000000
+
+static uint32_t old_variable_id_hash(const void *id)
+{
+    return variable_id_hash(id);
+}
+
+static bool old_variable_id_equals(const void *lhs, const void *rhs)
+{
+    return variable_id_equals(lhs, rhs);
+}
+
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (double) time.tv_sec + (double) time.tv_nsec * 1e-9;
+}
+
+static VariableID key(size_t i)
+{
+    return (VariableID) { .scope_id = i % 7, .symbol = (Symbol) i };
+}
+
+int main(void)
+{
+    static const size_t SIZES[] = { 100, 5000, 100000 };
+
+    // so the gets aren't optimized out
+    volatile size_t found = 0;
+
+    for (size_t i = 0; i < ARRAY_LEN(SIZES); ++i) {
+        const size_t n = SIZES[i];
+        const size_t repeats = n < BENCH_OPERATIONS ? BENCH_OPERATIONS / n : 1;
+
+        double old_times[3] = { 0 };
+        double new_times[3] = { 0 };
+
+        for (size_t r = 0; r < repeats; ++r) {
+            OldHashMap old = old_hashmap_new(old_variable_id_hash, old_variable_id_equals, sizeof(VariableID), sizeof(Variable));
+
+            double start = now();
+            for (size_t j = 0; j < n; ++j) {
+                const VariableID id = key(j);
+                const Variable variable = { .binding = j };
+                old_hashmap_insert(&old, &id, &variable);
+            }
+
+            double end = now();
+            old_times[0] += end - start;
+
+            start = end;
+            for (size_t j = 0; j < n; ++j) {
+                const VariableID id = key(j);
+                found += ((Variable *) old_hashmap_get(&old, &id))->binding == j;
+            }
+
+            end = now();
+            old_times[1] += end - start;
+
+            start = end;
+            for (size_t j = 0; j < n; ++j) {
+                const VariableID id = key(j);
+                old_hashmap_remove(&old, &id);
+            }
+
+            old_times[2] += now() - start;
+            old_hashmap_free(&old);
+
+            VariableMap map = variable_map_new();
+
+            start = now();
+            for (size_t j = 0; j < n; ++j) {
+                const VariableID id = key(j);
+                const Variable variable = { .binding = j };
+                variable_map_insert(&map, &id, &variable);
+            }
+
+            end = now();
+            new_times[0] += end - start;
+
+            start = end;
+            for (size_t j = 0; j < n; ++j) {
+                const VariableID id = key(j);
+                found += variable_map_get(&map, &id)->binding == j;
+            }
+
+            end = now();
+            new_times[1] += end - start;
+
+            start = end;
+            for (size_t j = 0; j < n; ++j) {
+                const VariableID id = key(j);
+                variable_map_remove(&map, &id);
+            }
+
+            new_times[2] += now() - start;
+            variable_map_free(&map);
+        }
+
+        const double operations = (double) (n * repeats) / 1e6;
+
+        printf(
+            "n=%-7zu insert %6.1f -> %6.1f   get %6.1f -> %6.1f   remove %6.1f -> %6.1f   (old -> new, Mops/s)\n",
+            n,
+            operations / old_times[0], operations / new_times[0],
+            operations / old_times[1], operations / new_times[1],
+            operations / old_times[2], operations / new_times[2]
+        );
+    }
+
+    return found == 0;
+}
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "old_hashmap.h"
+#include "utils.h"
+
+OldHashMap old_hashmap_new(OldHashFn hash_fn, OldEqualsFn equals_fn, const size_t key_size, const size_t value_size)
+{
+    OldHashMap hashmap = {
+        .hash_fn = hash_fn,
+        .equals_fn = equals_fn,
+        .key_size = key_size,
+        .value_size = value_size,
+    };
+
+    // clear the memory (init to NULL)
+    hashmap.buckets = malloc(sizeof(*hashmap.buckets) * OLD_HASHMAP_SIZE);
+
+    if (hashmap.buckets == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    memset(hashmap.buckets, 0, sizeof(*hashmap.buckets) * OLD_HASHMAP_SIZE);
+
+    return hashmap;
+}
+
+void old_hashmap_insert(OldHashMap *hashmap, const void *key, const void *value)
+{
+    // hash the key
+    const uint32_t index = (*hashmap->hash_fn)(key) % OLD_HASHMAP_SIZE;
+
+    // allocate an entry
+    OldHashMapEntry *entry = malloc(sizeof(OldHashMapEntry));
+
+    if (entry == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    entry->key = malloc(hashmap->key_size);
+
+    if (entry->key == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    // copy the key
+    memcpy(entry->key, key, hashmap->key_size);
+
+    entry->value = malloc(hashmap->value_size);
+
+    if (entry->value == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    // copy the value
+    memcpy(entry->value, value, hashmap->value_size);
+
+    entry->next = NULL;
+
+    OldHashMapEntry *iter = hashmap->buckets[index];
+
+    if (iter == NULL) {
+        hashmap->buckets[index] = entry;
+        return;
+    }
+
+    // find the item in the hashmap (in case of collisions)
+    while (iter->next != NULL && !(*hashmap->equals_fn)(iter->next->key, entry->key)) {
+        iter = iter->next;
+    }
+
+    if (iter->next != NULL) {
+        entry->next = iter->next->next;
+        free(iter->next->key);
+        free(iter->next->value);
+        free(iter->next);
+    }
+    iter->next = entry;
+}
+
+void *old_hashmap_get(const OldHashMap *hashmap, const void *key)
+{
+    // hash the key
+    const uint32_t index = (*hashmap->hash_fn)(key) % OLD_HASHMAP_SIZE;
+
+    OldHashMapEntry *iter = hashmap->buckets[index];
+
+    // find the item in the hashmap (in case of collisions)
+    while (iter != NULL && !(*hashmap->equals_fn)(iter->key, key)) {
+        iter = iter->next;
+    }
+
+    if (iter == NULL) {
+        return NULL;
+    }
+
+    return iter->value;
+}
+
+void old_hashmap_remove(OldHashMap *hashmap, const void *key)
+{
+    const uint32_t index = (*hashmap->hash_fn)(key) % OLD_HASHMAP_SIZE;
+
+    OldHashMapEntry *prev = NULL;
+    OldHashMapEntry *iter = hashmap->buckets[index];
+
+    // find the item in the hashmap
+    while (iter != NULL && !(*hashmap->equals_fn)(iter->key, key)) {
+        prev = iter;
+        iter = iter->next;
+    }
+
+    if (iter == NULL) {
+        return; // Key not found
+    }
+
+    if (prev != NULL) {
+        prev->next = iter->next;
+    } else {
+        hashmap->buckets[index] = iter->next;
+    }
+
+    free(iter->key);
+    free(iter->value);
+    free(iter);
+}
+
+void old_hashmap_free(OldHashMap *hashmap)
+{
+    for (size_t i = 0; i < OLD_HASHMAP_SIZE; ++i) {
+        OldHashMapEntry *iter = hashmap->buckets[i];
+
+        // free every item
+        while (iter != NULL) {
+            OldHashMapEntry *next = iter->next;
+
+            free(iter->key);
+            free(iter->value);
+            free(iter);
+
+            iter = next;
+        }
+    }
+
+    free(hashmap->buckets);
+}
@@ -0,0 +1,44 @@
+#ifndef OLD_HASHMAP_H_
+#define OLD_HASHMAP_H_
+
+// The chained HashMap that hashmap_template.h replaced, as it was
+// apart from the names, so bench/hashmap.c has something to compare to.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// prime number not close to 1024 or 2048
+#define OLD_HASHMAP_SIZE 1669
+
+// don't judge
+typedef uint32_t (*OldHashFn)(const void *);
+typedef bool (*OldEqualsFn)(const void *, const void *);
+
+// An entry to the hashmap
+typedef struct OldHashMapEntry
+{
+    void *key;
+    void *value;
+    struct OldHashMapEntry *next;
+} OldHashMapEntry;
+
+typedef struct OldHashMap
+{
+    OldHashFn hash_fn;
+    OldEqualsFn equals_fn;
+
+    size_t key_size;
+    size_t value_size;
+
+    OldHashMapEntry **buckets;
+} OldHashMap;
+
+OldHashMap old_hashmap_new(OldHashFn hash_fn, OldEqualsFn equals_fn, const size_t key_size, const size_t value_size);
+
+void old_hashmap_insert(OldHashMap *hashmap, const void *key, const void *value);
+void *old_hashmap_get(const OldHashMap *hashmap, const void *key);
+void old_hashmap_remove(OldHashMap *hashmap, const void *key);
+
+void old_hashmap_free(OldHashMap *hashmap);
+
+#endif // OLD_HASHMAP_H_
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "utils.h"
+
+static ArenaChunk *arena_chunk_new(size_t cap)
+{
+    ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + cap);
+
+    if (chunk == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    chunk->next = NULL;
+    chunk->len  = 0;
+    chunk->cap  = cap;
+
+    return chunk;
+}
+
+Arena arena_new(void)
+{
+    Arena arena = {
+        .chunks     = arena_chunk_new(ARENA_CHUNK_SIZE),
+        .chunks_len = 1,
+        .bytes_used = 0
+    };
+
+    return arena;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    // round up so the next allocation stays aligned
+    size = (size + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+
+    ArenaChunk *chunk = arena->chunks;
+
+    if (chunk->len + size > chunk->cap) {
+        if (size > ARENA_CHUNK_SIZE / 4) {
+            // give big allocations their own chunk, and keep
+            // bumping from the current one afterwards
+            ArenaChunk *big = arena_chunk_new(size);
+
+            big->len  = size;
+            big->next = chunk->next;
+            chunk->next = big;
+
+            ++arena->chunks_len;
+            arena->bytes_used += size;
+
+            return big->data;
+        }
+
+        chunk = arena_chunk_new(ARENA_CHUNK_SIZE);
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+
+        ++arena->chunks_len;
+    }
+
+    void *data = chunk->data + chunk->len;
+
+    chunk->len += size;
+    arena->bytes_used += size;
+
+    return data;
+}
+
+void *arena_copy(Arena *arena, const void *data, size_t size)
+{
+    void *copy = arena_alloc(arena, size);
+
+    memcpy(copy, data, size);
+
+    return copy;
+}
+
+void arena_print_stats(FILE *file, const Arena *arena, const char *phase)
+{
+    fprintf(
+        file,
+        "arena: %-12s %10zu bytes used, %4zu chunks\n",
+        phase,
+        arena->bytes_used,
+        arena->chunks_len
+    );
+}
+
+void arena_free(Arena *arena)
+{
+    ArenaChunk *chunk = arena->chunks;
+
+    while (chunk != NULL) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    arena->chunks     = NULL;
+    arena->chunks_len = 0;
+    arena->bytes_used = 0;
+}
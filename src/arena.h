@@ -0,0 +1,41 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+// big enough that a typical file fits in a handful of chunks
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+// every allocation is aligned to this
+#define ARENA_ALIGNMENT 16
+
+typedef struct ArenaChunk
+{
+    struct ArenaChunk *next;
+    size_t len;
+    size_t cap;
+    char data[];
+} ArenaChunk;
+
+// A bump-pointer allocator: everything allocated from an arena
+// lives until the arena itself is freed.
+typedef struct Arena
+{
+    // the chunk being allocated from is always first
+    ArenaChunk *chunks;
+    size_t chunks_len;
+
+    size_t bytes_used;
+} Arena;
+
+Arena arena_new(void);
+
+void *arena_alloc(Arena *arena, size_t size);
+void *arena_copy(Arena *arena, const void *data, size_t size);
+
+void arena_print_stats(FILE *file, const Arena *arena, const char *phase);
+
+void arena_free(Arena *arena);
+
+#endif // ARENA_H_
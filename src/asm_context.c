@@ -1,11 +1,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include "asm_context.h"
+#include "asm_nasm.h"
+#include "asm_elf.h"
+#include "asm_regalloc.h"
+#include "asm_peephole.h"
 #include "types.h"
 #include "type_checker.h"
 #include "utils.h"
 
-AsmData asm_data_register(AsmRegister asm_register, DataType *data_type)
+AsmData asm_data_register(AsmRegister asm_register, const DataType *data_type)
 {
     return (AsmData) {
         .storage = STORAGE_REGISTER,
@@ -14,7 +18,16 @@ AsmData asm_data_register(AsmRegister asm_register, DataType *data_type)
     };
 }
 
-AsmData asm_data_stack(int stack_location, DataType *data_type)
+AsmData asm_data_virtual(size_t virtual_register, const DataType *data_type)
+{
+    return (AsmData) {
+        .storage = STORAGE_VIRTUAL,
+        .data_type = data_type,
+        .virtual_register = virtual_register
+    };
+}
+
+AsmData asm_data_stack(int stack_location, const DataType *data_type)
 {
     return (AsmData) {
         .storage = STORAGE_STACK,
@@ -23,7 +36,7 @@ AsmData asm_data_stack(int stack_location, DataType *data_type)
     };
 }
 
-AsmData asm_data_stack_variable(int stack_location, DataType *data_type)
+AsmData asm_data_stack_variable(int stack_location, const DataType *data_type)
 {
     return (AsmData) {
         .storage = STORAGE_STACK_VARIABLE,
@@ -32,7 +45,7 @@ AsmData asm_data_stack_variable(int stack_location, DataType *data_type)
     };
 }
 
-AsmData asm_data_function(size_t name_len, const char *name, DataType *data_type)
+AsmData asm_data_function(size_t name_len, const char *name, const DataType *data_type)
 {
     return (AsmData) {
         .storage = STORAGE_FUNCTION,
@@ -42,87 +55,213 @@ AsmData asm_data_function(size_t name_len, const char *name, DataType *data_type
     };
 }
 
-AsmContext asm_context_new(FILE *file)
+AsmData asm_data_constant(uint64_t constant, const DataType *data_type)
+{
+    return (AsmData) {
+        .storage = STORAGE_CONSTANT,
+        .data_type = data_type,
+        .constant = constant
+    };
+}
+
+AsmOperand asm_operand_register(AsmRegister asm_register, AsmSize size)
+{
+    return (AsmOperand) {
+        .type = OPERAND_REGISTER,
+        .size = size,
+        .base = asm_register,
+        .index = REGISTER_NONE
+    };
+}
+
+AsmOperand asm_operand_memory(AsmRegister base, AsmRegister index, int32_t displacement, AsmSize size)
+{
+    return (AsmOperand) {
+        .type = OPERAND_MEMORY,
+        .size = size,
+        .base = base,
+        .index = index,
+        .displacement = displacement
+    };
+}
+
+AsmOperand asm_operand_immediate(uint64_t value, AsmSize size)
+{
+    return (AsmOperand) {
+        .type = OPERAND_IMMEDIATE,
+        .size = size,
+        .base = REGISTER_NONE,
+        .index = REGISTER_NONE,
+        .value = value
+    };
+}
+
+AsmOperand asm_operand_label(size_t label_id)
+{
+    return (AsmOperand) {
+        .type = OPERAND_LABEL,
+        .size = SIZE_QWORD,
+        .base = REGISTER_NONE,
+        .index = REGISTER_NONE,
+        .value = label_id
+    };
+}
+
+AsmOperand asm_operand_symbol(size_t symbol_id)
+{
+    return (AsmOperand) {
+        .type = OPERAND_SYMBOL,
+        .size = SIZE_QWORD,
+        .base = REGISTER_NONE,
+        .index = REGISTER_NONE,
+        .value = symbol_id
+    };
+}
+
+void asm_context_instruction(AsmContext *context, AsmOpcode opcode, size_t operands_len, const AsmOperand *operands)
+{
+    if (context->instructions_len >= context->instructions_cap) {
+        while (context->instructions_len >= context->instructions_cap) {
+            context->instructions_cap *= 2;
+        }
+
+        context->instructions = realloc(
+            context->instructions,
+            sizeof(*context->instructions) * context->instructions_cap
+        );
+
+        if (context->instructions == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    AsmInstruction *instruction = &context->instructions[context->instructions_len++];
+
+    instruction->opcode = opcode;
+    instruction->operands_len = operands_len;
+
+    for (size_t i = 0; i < operands_len; ++i) {
+        instruction->operands[i] = operands[i];
+    }
+}
+
+static void asm_context_instruction0(AsmContext *context, AsmOpcode opcode)
+{
+    asm_context_instruction(context, opcode, 0, NULL);
+}
+
+static void asm_context_instruction1(AsmContext *context, AsmOpcode opcode, AsmOperand operand)
+{
+    asm_context_instruction(context, opcode, 1, &operand);
+}
+
+static void asm_context_instruction2(AsmContext *context, AsmOpcode opcode, AsmOperand dst, AsmOperand src)
+{
+    const AsmOperand operands[] = { dst, src };
+    asm_context_instruction(context, opcode, ARRAY_LEN(operands), operands);
+}
+
+// the runtime every program starts with
+static void asm_context_prelude(AsmContext *context)
+{
+    const AsmOperand rax = asm_operand_register(REGISTER_RAX, SIZE_QWORD);
+    const AsmOperand rdx = asm_operand_register(REGISTER_RDX, SIZE_QWORD);
+    const AsmOperand rsi = asm_operand_register(REGISTER_RSI, SIZE_QWORD);
+    const AsmOperand rdi = asm_operand_register(REGISTER_RDI, SIZE_QWORD);
+
+    // print(string), which only uses registers a call is allowed to change
+    asm_context_instruction1(context, ASM_LABEL, asm_operand_symbol(asm_context_symbol(context, 5, "print")));
+
+    // strlen
+    const size_t strlen_label = asm_context_label_new(context);
+
+    asm_context_instruction2(context, ASM_MOV, rsi, rdi);
+    asm_context_instruction2(context, ASM_XOR, rdx, rdx);
+    asm_context_instruction1(context, ASM_DEC, rdx);
+    asm_context_label(context, strlen_label);
+    asm_context_instruction1(context, ASM_INC, rdx);
+    asm_context_instruction2(
+        context,
+        ASM_CMP,
+        asm_operand_memory(REGISTER_RSI, REGISTER_RDX, 0, SIZE_BYTE),
+        asm_operand_immediate(0, SIZE_BYTE)
+    );
+    asm_context_jnz(context, strlen_label);
+
+    // write
+    asm_context_instruction2(context, ASM_MOV, rax, asm_operand_immediate(1, SIZE_QWORD));
+    asm_context_instruction2(context, ASM_MOV, rdi, asm_operand_immediate(1, SIZE_QWORD));
+    asm_context_instruction0(context, ASM_SYSCALL);
+    asm_context_instruction0(context, ASM_RET);
+}
+
+AsmContext asm_context_new(FILE *file, AsmOutput output)
 {
     AsmContext context = {
         .file = file,
+        .output = output,
+
+        .instructions_len = 0,
+        .instructions_cap = 1024,
 
         .data_section_len = 0,
         .data_section_cap = 512,
 
         .label_count = 0,
 
-        .variable_stack_positions = hashmap_new(
-            variable_id_hash,
-            variable_id_equals,
-            sizeof(VariableID),
-            sizeof(size_t)
-        ),
+        .symbols_len = 0,
+        .symbols_cap = 16,
+
+        .variables_cap = 256,
+
+        .virtual_registers_len = 0,
+
+        .frames_len = 0,
+        .frames_cap = 16,
 
-        .stack_frame_size        = 0,
-        .stack_register_pool_len = 0,
-        .stack_register_pool_cap = 512,
+        .frame_pointer = true,
 
-        .registers_len = ARRAY_LEN(usable_registers)
+        .peephole_window = PEEPHOLE_DEFAULT_WINDOW,
+
+        .avx2 = false
     };
 
+    context.instructions = malloc(sizeof(*context.instructions) * context.instructions_cap);
+
+    if (context.instructions == NULL) {
+        ALLOCATION_ERROR();
+    }
+
     context.data_section = malloc(sizeof(*context.data_section) * context.data_section_cap);
 
     if (context.data_section == NULL) {
         ALLOCATION_ERROR();
     }
 
-    context.stack_register_pool = malloc(sizeof(*context.stack_register_pool) * context.stack_register_pool_cap);
+    context.symbols = malloc(sizeof(*context.symbols) * context.symbols_cap);
 
-    if (context.stack_register_pool == NULL) {
+    if (context.symbols == NULL) {
         ALLOCATION_ERROR();
     }
 
-    context.registers = malloc(sizeof(usable_registers));
+    context.variables = malloc(sizeof(*context.variables) * context.variables_cap);
 
-    if (context.registers == NULL) {
+    if (context.variables == NULL) {
         ALLOCATION_ERROR();
     }
 
-    memcpy(context.registers, usable_registers, sizeof(usable_registers));
-
-    fprintf(
-        context.file,
-        "[BITS 64]\n"
-        "global _start\n"
-        "section .text\n"
-        "print:\n"
-        "    enter 0, 0\n"
-        "    push rsi\n"
-        "    push rdi\n"
-        "    push rax\n"
-        "    push rdx\n"
-        "    ; strlen\n"
-        "    mov rsi, QWORD [rbp + 16]\n"
-        "    xor rdx, rdx\n"
-        "    dec rdx\n"
-        ".L0:\n"
-        "    inc rdx\n"
-        "    cmp BYTE [rsi + rdx], 0\n"
-        "    jne .L0\n"
-        "    ; write\n"
-        "    mov rax, 1\n"
-        "    mov rdi, 1\n"
-        "    syscall\n"
-        "    pop rdx\n"
-        "    pop rax\n"
-        "    pop rdi\n"
-        "    pop rsi\n"
-        "    leave\n"
-        "    ret\n"
-        "_start:\n"
-        "    enter 0, 0\n"
-    );
+    context.frames = malloc(sizeof(*context.frames) * context.frames_cap);
+
+    if (context.frames == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    asm_context_prelude(&context);
 
     return context;
 }
 
-AsmData asm_context_add_to_data_section(AsmContext *context, char *data, size_t data_len, DataType *data_type)
+AsmData asm_context_add_to_data_section(AsmContext *context, char *data, size_t data_len, const DataType *data_type)
 {
     if (context->data_section_len >= context->data_section_cap) {
         while (context->data_section_len >= context->data_section_cap) {
@@ -166,47 +305,109 @@ size_t asm_context_label_new(AsmContext *context)
     return context->label_count++;
 }
 
+size_t asm_context_symbol(AsmContext *context, size_t name_len, const char *name)
+{
+    // there are only ever a few of these
+    for (size_t i = 0; i < context->symbols_len; ++i) {
+        const AsmSymbol *symbol = &context->symbols[i];
+
+        if (symbol->name_len == name_len && memcmp(symbol->name, name, name_len) == 0) {
+            return i;
+        }
+    }
+
+    if (context->symbols_len >= context->symbols_cap) {
+        while (context->symbols_len >= context->symbols_cap) {
+            context->symbols_cap *= 2;
+        }
+
+        context->symbols = realloc(context->symbols, sizeof(*context->symbols) * context->symbols_cap);
+
+        if (context->symbols == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    context->symbols[context->symbols_len] = (AsmSymbol) {
+        .name_len = name_len,
+        .name = name
+    };
+
+    return context->symbols_len++;
+}
+
 void asm_context_change_stack(AsmContext *context, int bytes)
 {
-    context->stack_frame_size += bytes;
+    const AsmOperand rsp = asm_operand_register(REGISTER_RSP, SIZE_QWORD);
 
     if (bytes >= 0) {
-        fprintf(context->file, "    sub rsp, %zu\n", (size_t) bytes);
+        asm_context_instruction2(context, ASM_SUB, rsp, asm_operand_immediate(bytes, SIZE_QWORD));
     } else {
-        fprintf(context->file, "    add rsp, %zu\n", (size_t) -bytes);
+        asm_context_instruction2(context, ASM_ADD, rsp, asm_operand_immediate(-bytes, SIZE_QWORD));
+    }
+}
+
+void asm_context_add_variable(AsmContext *context, size_t binding, AsmData data)
+{
+    if (binding >= context->variables_cap) {
+        while (binding >= context->variables_cap) {
+            context->variables_cap *= 2;
+        }
+
+        context->variables = realloc(context->variables, sizeof(*context->variables) * context->variables_cap);
+
+        if (context->variables == NULL) {
+            ALLOCATION_ERROR();
+        }
     }
+
+    context->variables[binding] = data;
 }
 
-void asm_context_add_variable_stack_position(AsmContext *context, VariableID id, size_t position)
+AsmData asm_context_variable(AsmContext *context, size_t binding)
 {
-    hashmap_insert(&context->variable_stack_positions, &id, &position);
+    return context->variables[binding];
 }
 
-size_t asm_context_variable_stack_position(AsmContext *context, VariableID id)
+AsmData asm_context_data_alloc(AsmContext *context, const DataType *data_type)
 {
-    return *(size_t *)hashmap_get(&context->variable_stack_positions, &id);
+    return asm_data_virtual(context->virtual_registers_len++, data_type);
 }
 
-AsmData asm_context_data_alloc(AsmContext *context, DataType *data_type)
+// registers and virtual registers, but not what they point to
+static bool asm_data_is_register(AsmData data)
 {
-    if (context->registers_len > 0) {
-        return asm_data_register(context->registers[--context->registers_len], data_type);
-    }
+    return (data.storage == STORAGE_REGISTER || data.storage == STORAGE_VIRTUAL) && !data.auto_deref;
+}
 
-    if (context->stack_register_pool_len > 0) {
-        return asm_data_stack(context->stack_register_pool[--context->stack_register_pool_len], data_type);
+// what can be the source of an instruction whose destination is in memory
+static bool asm_data_is_register_or_constant(AsmData data)
+{
+    return asm_data_is_register(data) || data.storage == STORAGE_CONSTANT;
+}
+
+// for the instructions that can't take an immediate
+static AsmData asm_context_no_constant(AsmContext *context, AsmData data)
+{
+    if (data.storage != STORAGE_CONSTANT) {
+        return data;
     }
 
-    asm_context_change_stack(context, 8);
+    AsmData scratch = asm_context_data_alloc(context, data.data_type);
 
-    return asm_data_stack(context->stack_frame_size, data_type);
+    asm_context_instruction2(
+        context,
+        ASM_MOV,
+        asm_context_operand(context, scratch),
+        asm_context_operand(context, data)
+    );
+
+    return scratch;
 }
 
-void asm_context_data_name(AsmContext *context, AsmData data)
+AsmOperand asm_context_operand(AsmContext *context, AsmData data)
 {
-    if (data.auto_deref) {
-        fprintf(context->file, "%s [", INT_TYPE_ASM[data.data_type->type]);
-    }
+    const AsmSize size = asm_data_type_size(data.data_type);
 
     switch (data.storage) {
         case STORAGE_NULL: {
@@ -215,21 +416,41 @@ void asm_context_data_name(AsmContext *context, AsmData data)
         }
 
         case STORAGE_STATIC: {
+            if (data.auto_deref) {
+                UNREACHABLE();
+            }
+
             if (data.data_type->type == TYPE_REFERENCE) {
-                fprintf(context->file, "D%zu", data.static_variable_id);
-            } else {
-                fprintf(context->file, "%s [D%zu]", INT_TYPE_ASM[data.data_type->dereference->type], data.static_variable_id);
+                AsmOperand operand = asm_operand_immediate(data.static_variable_id, SIZE_QWORD);
+                operand.type = OPERAND_DATA;
+                return operand;
             }
-            break;
+
+            AsmOperand operand = asm_operand_memory(
+                REGISTER_NONE,
+                REGISTER_NONE,
+                0,
+                DATA_TYPE_TO_ASM_SIZE[data.data_type->dereference->type]
+            );
+            operand.value = data.static_variable_id;
+            return operand;
         }
 
         case STORAGE_REGISTER: {
             if (data.auto_deref) {
-                fprintf(context->file, "%s", REGISTER_TO_STRING[data.asm_register][TYPE_REFERENCE]);
-            } else {
-                fprintf(context->file, "%s", REGISTER_TO_STRING[data.asm_register][data.data_type->type]);
+                return asm_operand_memory(data.asm_register, REGISTER_NONE, 0, size);
             }
-            break;
+
+            return asm_operand_register(data.asm_register, size);
+        }
+
+        case STORAGE_VIRTUAL: {
+            AsmOperand operand = data.auto_deref
+                ? asm_operand_memory(REGISTER_VIRTUAL, REGISTER_NONE, 0, size)
+                : asm_operand_register(REGISTER_VIRTUAL, size);
+
+            operand.value = data.virtual_register;
+            return operand;
         }
 
         case STORAGE_STACK:
@@ -238,172 +459,228 @@ void asm_context_data_name(AsmContext *context, AsmData data)
                 UNREACHABLE();
             }
 
-            if (data.stack_location >= 0) {
-                fprintf(context->file, "%s [rbp + %zu]", INT_TYPE_ASM[data.data_type->type], (size_t) data.stack_location);
-            } else {
-                fprintf(context->file, "%s [rsp - %zu]", INT_TYPE_ASM[data.data_type->type], (size_t) -data.stack_location);
-            }
-            break;
+            return asm_operand_memory(REGISTER_RBP, REGISTER_NONE, data.stack_location, size);
         }
 
         case STORAGE_FUNCTION: {
-            fprintf(context->file, "%.*s", (int) data.function.name_len, data.function.name);
-            break;
+            return asm_operand_symbol(asm_context_symbol(context, data.function.name_len, data.function.name));
         }
-    }
 
-    if (data.auto_deref) {
-        fprintf(context->file, "]");
+        case STORAGE_CONSTANT: {
+            return asm_operand_immediate(data.constant, size);
+        }
     }
+
+    UNREACHABLE();
 }
 
-void asm_context_data_free(AsmContext *context, AsmData data)
+static void asm_context_data1(AsmContext *context, AsmOpcode opcode, AsmData operand)
 {
-    switch (data.storage) {
-        case STORAGE_REGISTER: {
-            context->registers[context->registers_len++] = data.asm_register;
-            if (context->registers_len > ARRAY_LEN(usable_registers)) {
-                UNREACHABLE();
-            }
-            break;
-        }
-
-        case STORAGE_STACK: {
-            if (context->stack_register_pool_len >= context->stack_register_pool_cap) {
-                while (context->stack_register_pool_len >= context->stack_register_pool_cap) {
-                    context->stack_register_pool_cap *= 2;
-                }
-
-                context->stack_register_pool = realloc(
-                    context->stack_register_pool,
-                    sizeof(*context->stack_register_pool) * context->stack_register_pool_cap
-                );
-
-                if (context->stack_register_pool == NULL) {
-                    ALLOCATION_ERROR();
-                }
-            }
-
-            context->stack_register_pool[context->stack_register_pool_len++] = data.stack_location;
-            break;
-        }
+    asm_context_instruction1(context, opcode, asm_context_operand(context, operand));
+}
 
-        default: {
-            break;
-        }
-    }
+static void asm_context_data2(AsmContext *context, AsmOpcode opcode, AsmData dst, AsmData src)
+{
+    asm_context_instruction2(context, opcode, asm_context_operand(context, dst), asm_context_operand(context, src));
 }
 
 void asm_context_mov(AsmContext *context, AsmData dst, AsmData src)
 {
-    if (src.storage != STORAGE_REGISTER && dst.storage != STORAGE_REGISTER) {
-        fprintf(context->file, "    mov ");
-        asm_context_data_name(context, asm_data_register(REGISTER_RAX, src.data_type));
-        fprintf(context->file, ", ");
-        asm_context_data_name(context, src);
-        fprintf(context->file, "\n");
-
-        fprintf(context->file, "    mov ");
-        asm_context_data_name(context, dst);
-        fprintf(context->file, ", ");
-        asm_context_data_name(context, asm_data_register(REGISTER_RAX, src.data_type));
-        fprintf(context->file, "\n");
+    // a vector is only ever loaded into a register or stored from one
+    if (asm_data_type_size(dst.data_type) >= SIZE_XMM) {
+        asm_context_data2(context, ASM_MOVDQU, dst, src);
+        return;
+    }
+
+    if (!asm_data_is_register_or_constant(src) && !asm_data_is_register(dst)) {
+        AsmData scratch = asm_context_data_alloc(context, src.data_type);
+
+        asm_context_data2(context, ASM_MOV, scratch, src);
+        asm_context_data2(context, ASM_MOV, dst, scratch);
     } else {
-        fprintf(context->file, "    mov ");
-        asm_context_data_name(context, dst);
-        fprintf(context->file, ", ");
-        asm_context_data_name(context, src);
-        fprintf(context->file, "\n");
+        asm_context_data2(context, ASM_MOV, dst, src);
     }
 }
 
 void asm_context_mov_constant(AsmContext *context, AsmData dst, size_t constant)
 {
-    fprintf(context->file, "    mov ");
-    asm_context_data_name(context, dst);
-    fprintf(context->file, ", %zu\n", constant);
+    const AsmOperand operand = asm_context_operand(context, dst);
+
+    // only a register can take a 64 bit immediate
+    if (operand.type != OPERAND_REGISTER && operand.size == SIZE_QWORD && constant > INT32_MAX) {
+        AsmData scratch = asm_context_data_alloc(context, dst.data_type);
+
+        asm_context_instruction2(context, ASM_MOV, asm_context_operand(context, scratch), asm_operand_immediate(constant, SIZE_QWORD));
+        asm_context_instruction2(context, ASM_MOV, operand, asm_context_operand(context, scratch));
+        return;
+    }
+
+    asm_context_instruction2(context, ASM_MOV, operand, asm_operand_immediate(constant, operand.size));
 }
 
-void asm_context_add(AsmContext *context, AsmData dst, AsmData src)
+// an instruction that can only take one memory operand
+static void asm_context_binary(AsmContext *context, AsmOpcode opcode, AsmData dst, AsmData src)
 {
-    if (src.storage != STORAGE_REGISTER) {
-        asm_context_mov(context, asm_data_register(REGISTER_RAX, src.data_type), src);
+    if (!asm_data_is_register_or_constant(src) && !asm_data_is_register(dst)) {
+        AsmData scratch = asm_context_data_alloc(context, src.data_type);
 
-        fprintf(context->file, "    add ");
-        asm_context_data_name(context, dst);
-        fprintf(context->file, ", ");
-        asm_context_data_name(context, asm_data_register(REGISTER_RAX, src.data_type));
-        fprintf(context->file, "\n");
+        asm_context_data2(context, ASM_MOV, scratch, src);
+        asm_context_data2(context, opcode, dst, scratch);
     } else {
-        fprintf(context->file, "    add ");
-        asm_context_data_name(context, dst);
-        fprintf(context->file, ", ");
-        asm_context_data_name(context, src);
-        fprintf(context->file, "\n");
+        asm_context_data2(context, opcode, dst, src);
     }
 }
 
-void asm_context_sub(AsmContext *context, AsmData dst, AsmData src)
+void asm_context_add(AsmContext *context, AsmData dst, AsmData src)
 {
-    if (src.storage != STORAGE_REGISTER) {
-        asm_context_mov(context, asm_data_register(REGISTER_RAX, src.data_type), src);
+    asm_context_binary(context, ASM_ADD, dst, src);
+}
 
-        fprintf(context->file, "    sub ");
-        asm_context_data_name(context, dst);
-        fprintf(context->file, ", ");
-        asm_context_data_name(context, asm_data_register(REGISTER_RAX, src.data_type));
-        fprintf(context->file, "\n");
-    } else {
-        fprintf(context->file, "    sub ");
-        asm_context_data_name(context, dst);
-        fprintf(context->file, ", ");
-        asm_context_data_name(context, src);
-        fprintf(context->file, "\n");
-    }
+void asm_context_sub(AsmContext *context, AsmData dst, AsmData src)
+{
+    asm_context_binary(context, ASM_SUB, dst, src);
 }
 
 void asm_context_mul(AsmContext *context, AsmData dst, AsmData src)
 {
-    asm_context_mov(context, asm_data_register(REGISTER_RAX, dst.data_type), dst);
+    if (!asm_data_is_register(dst)) {
+        AsmData scratch = asm_context_data_alloc(context, dst.data_type);
 
-    fprintf(context->file, "    mul ");
-    asm_context_data_name(context, src);
-    fprintf(context->file, "\n");
+        asm_context_mov(context, scratch, dst);
+        asm_context_mul(context, scratch, src);
+        asm_context_mov(context, dst, scratch);
+        return;
+    }
 
-    asm_context_mov(context, dst, asm_data_register(REGISTER_RAX, dst.data_type));
+    AsmOperand lhs = asm_context_operand(context, dst);
+
+    // there's no byte imul with two operands, but the bottom byte of the
+    // product only depends on the bottom bytes of what's multiplied
+    if (lhs.size == SIZE_BYTE) {
+        if (src.storage != STORAGE_CONSTANT && !asm_data_is_register(src)) {
+            AsmData scratch = asm_context_data_alloc(context, src.data_type);
+
+            asm_context_mov(context, scratch, src);
+            src = scratch;
+        }
+
+        AsmOperand rhs = asm_context_operand(context, src);
+
+        lhs.size = SIZE_DWORD;
+        rhs.size = SIZE_DWORD;
+
+        if (rhs.type == OPERAND_IMMEDIATE) {
+            rhs.value = (uint64_t) (int64_t) (int8_t) rhs.value;
+        }
+
+        asm_context_instruction2(context, ASM_IMUL, lhs, rhs);
+        return;
+    }
+
+    asm_context_instruction2(context, ASM_IMUL, lhs, asm_context_operand(context, src));
 }
 
 void asm_context_div(AsmContext *context, AsmData dst, AsmData src)
 {
+    // what sign extends the dividend into the top half, at each size
+    static const AsmOpcode extend[ASM_SIZES] = {
+        [SIZE_BYTE]  = ASM_CBW,
+        [SIZE_WORD]  = ASM_CWD,
+        [SIZE_DWORD] = ASM_CDQ,
+        [SIZE_QWORD] = ASM_CQO
+    };
+
+    src = asm_context_no_constant(context, src);
+
     asm_context_mov(context, asm_data_register(REGISTER_RAX, dst.data_type), dst);
 
-    fprintf(context->file, "    div ");
-    asm_context_data_name(context, src);
-    fprintf(context->file, "\n");
+    asm_context_instruction0(context, extend[DATA_TYPE_TO_ASM_SIZE[dst.data_type->type]]);
+    asm_context_data1(context, ASM_IDIV, src);
 
     asm_context_mov(context, dst, asm_data_register(REGISTER_RAX, dst.data_type));
 }
 
+void asm_context_shift(AsmContext *context, AsmOpcode opcode, AsmData dst, uint8_t amount)
+{
+    asm_context_instruction2(context, opcode, asm_context_operand(context, dst), asm_operand_immediate(amount, SIZE_BYTE));
+}
+
+void asm_context_movsx(AsmContext *context, AsmData dst, AsmData src)
+{
+    AsmOperand operand = asm_context_operand(context, dst);
+    operand.size = SIZE_QWORD;
+
+    src = asm_context_no_constant(context, src);
+
+    asm_context_instruction2(context, ASM_MOVSX, operand, asm_context_operand(context, src));
+}
+
+void asm_context_vector(AsmContext *context, AsmOpcode opcode, AsmData dst, AsmData src)
+{
+    asm_context_data2(context, opcode, dst, src);
+}
+
+// The element goes in the bottom of an xmm register, from a general
+// purpose one, and then gets copied up. Bytes and words are repeated
+// in a dword first, so it's the same as broadcasting that.
+void asm_context_broadcast(AsmContext *context, AsmData dst, AsmData src)
+{
+    const AsmOperand vector = asm_context_operand(context, dst);
+
+    AsmOperand xmm = vector;
+    xmm.size = SIZE_XMM;
+
+    const size_t element_size = data_type_size(dst.data_type->array.element);
+
+    if (element_size == 8) {
+        src = asm_context_no_constant(context, src);
+
+        asm_context_instruction2(context, ASM_MOVQ, xmm, asm_context_operand(context, src));
+
+        if (context->avx2) {
+            asm_context_instruction2(context, ASM_PBROADCASTQ, vector, xmm);
+        } else {
+            asm_context_instruction2(context, ASM_PUNPCKLQDQ, xmm, xmm);
+        }
+        return;
+    }
+
+    // the element repeated in every part of a dword
+    static const uint32_t repeat[] = { [1] = 0x01010101, [2] = 0x00010001, [4] = 1 };
+    const uint32_t mask = element_size == 4 ? UINT32_MAX : ((uint32_t) 1 << (element_size * 8)) - 1;
+
+    const AsmData dword = asm_context_data_alloc(context, data_type_type(TYPE_INT32));
+    const AsmOperand operand = asm_context_operand(context, dword);
+
+    if (src.storage == STORAGE_CONSTANT) {
+        asm_context_mov_constant(context, dword, (src.constant & mask) * repeat[element_size]);
+    } else if (element_size == 4) {
+        asm_context_mov(context, dword, src);
+    } else {
+        asm_context_movsx(context, dword, src);
+        asm_context_instruction2(context, ASM_AND, operand, asm_operand_immediate(mask, SIZE_DWORD));
+        asm_context_instruction2(context, ASM_IMUL, operand, asm_operand_immediate(repeat[element_size], SIZE_DWORD));
+    }
+
+    asm_context_instruction2(context, ASM_MOVD, xmm, operand);
+
+    if (context->avx2) {
+        asm_context_instruction2(context, ASM_PBROADCASTD, vector, xmm);
+    } else {
+        asm_context_instruction2(context, ASM_PUNPCKLDQ, xmm, xmm);
+        asm_context_instruction2(context, ASM_PUNPCKLQDQ, xmm, xmm);
+    }
+}
+
 void asm_context_reference(AsmContext *context, AsmData dst, AsmData src)
 {
-    if (dst.storage != STORAGE_REGISTER) {
-        fprintf(context->file, "    lea ");
-        asm_context_data_name(context, asm_data_register(REGISTER_RAX, src.data_type));
-        fprintf(context->file, ", ");
-        asm_context_data_name(context, src);
-        fprintf(context->file, "\n");
-
-        fprintf(context->file, "    lea ");
-        asm_context_data_name(context, dst);
-        fprintf(context->file, ", ");
-        asm_context_data_name(context, asm_data_register(REGISTER_RAX, src.data_type));
-        fprintf(context->file, "\n");
+    if (!asm_data_is_register(dst)) {
+        AsmData scratch = asm_context_data_alloc(context, dst.data_type);
+
+        asm_context_data2(context, ASM_LEA, scratch, src);
+        asm_context_data2(context, ASM_MOV, dst, scratch);
     } else {
-        fprintf(context->file, "    lea ");
-        asm_context_data_name(context, dst);
-        fprintf(context->file, ", ");
-        asm_context_data_name(context, src);
-        fprintf(context->file, "\n");
+        asm_context_data2(context, ASM_LEA, dst, src);
     }
 }
 
@@ -418,168 +695,433 @@ AsmData asm_context_dereference(AsmContext *context, AsmData dst)
 
 void asm_context_negate(AsmContext *context, AsmData dst)
 {
-    fprintf(context->file, "    neg ");
-    asm_context_data_name(context, dst);
-    fprintf(context->file, "\n");
+    asm_context_data1(context, ASM_NEG, dst);
 }
 
 void asm_context_cmp(AsmContext *context, AsmData lhs, AsmData rhs)
 {
-    if (lhs.storage != STORAGE_REGISTER) {
-        asm_context_mov(context, asm_data_register(REGISTER_RAX, lhs.data_type), lhs);
-
-        fprintf(context->file, "    cmp ");
-        asm_context_data_name(context, asm_data_register(REGISTER_RAX, lhs.data_type));
-        fprintf(context->file, ", ");
-        asm_context_data_name(context, rhs);
-        fprintf(context->file, "\n");
-    } else {
-        fprintf(context->file, "    cmp ");
-        asm_context_data_name(context, lhs);
-        fprintf(context->file, ", ");
-        asm_context_data_name(context, rhs);
-        fprintf(context->file, "\n");
-    }
+    asm_context_binary(context, ASM_CMP, lhs, rhs);
 }
 
 void asm_context_test(AsmContext *context, AsmData lhs, AsmData rhs)
 {
-    if (lhs.storage != STORAGE_REGISTER) {
-        asm_context_mov(context, asm_data_register(REGISTER_RAX, lhs.data_type), lhs);
+    asm_context_binary(context, ASM_TEST, lhs, rhs);
+}
 
-        fprintf(context->file, "    test ");
-        asm_context_data_name(context, asm_data_register(REGISTER_RAX, lhs.data_type));
-        fprintf(context->file, ", ");
-        asm_context_data_name(context, rhs);
-        fprintf(context->file, "\n");
-    } else {
-        fprintf(context->file, "    test ");
-        asm_context_data_name(context, lhs);
-        fprintf(context->file, ", ");
-        asm_context_data_name(context, rhs);
-        fprintf(context->file, "\n");
+// materializes a flag as 0 or 1 in `dst`
+static void asm_context_set(AsmContext *context, AsmOpcode opcode, AsmData dst)
+{
+    AsmData flag = asm_data_is_register(dst) ? dst : asm_context_data_alloc(context, dst.data_type);
+
+    AsmOperand operand = asm_context_operand(context, flag);
+
+    operand.size = SIZE_BYTE;
+    asm_context_instruction1(context, opcode, operand);
+
+    operand.size = SIZE_QWORD;
+    asm_context_instruction2(context, ASM_AND, operand, asm_operand_immediate(0xff, SIZE_QWORD));
+
+    if (!asm_data_is_register(dst)) {
+        asm_context_mov(context, dst, flag);
     }
 }
 
 void asm_context_setz(AsmContext *context, AsmData dst)
 {
-    fprintf(context->file, "    setz al\n");
-    fprintf(context->file, "    and rax, 0xff\n");
-    asm_context_mov(context, dst, asm_data_register(REGISTER_RAX, dst.data_type));
+    asm_context_set(context, ASM_SETZ, dst);
 }
 
 void asm_context_setnz(AsmContext *context, AsmData dst)
 {
-    fprintf(context->file, "    setnz al\n");
-    fprintf(context->file, "    and rax, 0xff\n");
-    asm_context_mov(context, dst, asm_data_register(REGISTER_RAX, dst.data_type));
+    asm_context_set(context, ASM_SETNZ, dst);
 }
 
 void asm_context_setl(AsmContext *context, AsmData dst)
 {
-    fprintf(context->file, "    setl al\n");
-    fprintf(context->file, "    and rax, 0xff\n");
-    asm_context_mov(context, dst, asm_data_register(REGISTER_RAX, dst.data_type));
+    asm_context_set(context, ASM_SETL, dst);
 }
 
 void asm_context_setg(AsmContext *context, AsmData dst)
 {
-    fprintf(context->file, "    setg al\n");
-    fprintf(context->file, "    and rax, 0xff\n");
-    asm_context_mov(context, dst, asm_data_register(REGISTER_RAX, dst.data_type));
+    asm_context_set(context, ASM_SETG, dst);
 }
 
 void asm_context_setle(AsmContext *context, AsmData dst)
 {
-    fprintf(context->file, "    setle al\n");
-    fprintf(context->file, "    and rax, 0xff\n");
-    asm_context_mov(context, dst, asm_data_register(REGISTER_RAX, dst.data_type));
+    asm_context_set(context, ASM_SETLE, dst);
 }
 
 void asm_context_setge(AsmContext *context, AsmData dst)
 {
-    fprintf(context->file, "    setge al\n");
-    fprintf(context->file, "    and rax, 0xff\n");
-    asm_context_mov(context, dst, asm_data_register(REGISTER_RAX, dst.data_type));
+    asm_context_set(context, ASM_SETGE, dst);
 }
 
 void asm_context_push(AsmContext *context, AsmData data)
 {
-    fprintf(context->file, "    push ");
-    asm_context_data_name(context, data);
-    fprintf(context->file, "\n");
+    AsmOperand operand = asm_context_operand(context, data);
+
+    // push only takes whole registers
+    if (operand.type == OPERAND_REGISTER) {
+        operand.size = SIZE_QWORD;
+    }
 
-    context->stack_frame_size += 8;
+    asm_context_instruction1(context, ASM_PUSH, operand);
 }
 
-void asm_context_call_function(AsmContext *context, AsmData function, AsmData return_value)
+// rsp is 16 byte aligned at every call, so an odd number of arguments
+// on the stack goes below 8 bytes of padding
+void asm_context_call_function(
+    AsmContext *context,
+    AsmData function,
+    size_t arguments_len,
+    const AsmData *arguments,
+    AsmData return_value
+)
 {
-    if (return_value.data_type->type == TYPE_VOID) {
-        fprintf(context->file, "    call ");
-        asm_context_data_name(context, function);
-        fprintf(context->file, "\n");
-        return;
+    const size_t registers_len = arguments_len < ARRAY_LEN(ARGUMENT_REGISTERS) ? arguments_len : ARRAY_LEN(ARGUMENT_REGISTERS);
+    const size_t pushed = arguments_len - registers_len;
+    const int stack_size = (int) ((pushed + pushed % 2) * 8);
+
+    if (pushed % 2 != 0) {
+        asm_context_change_stack(context, 8);
+    }
+
+    // all of a qword, whatever the argument's size
+    for (size_t i = arguments_len; i-- > registers_len;) {
+        const AsmData qword = asm_context_data_alloc(context, data_type_type(TYPE_INT64));
+
+        if (asm_data_type_size(arguments[i].data_type) == SIZE_QWORD) {
+            asm_context_mov(context, qword, arguments[i]);
+        } else {
+            asm_context_movsx(context, qword, arguments[i]);
+        }
+
+        asm_context_push(context, qword);
     }
 
-    asm_context_change_stack(context, 8);
+    for (size_t i = 0; i < registers_len; ++i) {
+        asm_context_mov(context, asm_data_register(ARGUMENT_REGISTERS[i], arguments[i].data_type), arguments[i]);
+    }
 
-    AsmData data = asm_data_stack_variable(context->stack_frame_size, function.data_type->function.return_type);
-    fprintf(context->file, "    call ");
-    asm_context_data_name(context, function);
-    fprintf(context->file, "\n");
+    const AsmOperand operands[] = {
+        asm_context_operand(context, function),
+        asm_operand_immediate(registers_len, SIZE_BYTE)
+    };
+
+    asm_context_instruction(context, ASM_CALL, ARRAY_LEN(operands), operands);
+
+    if (stack_size > 0) {
+        asm_context_change_stack(context, -stack_size);
+    }
+
+    if (return_value.data_type->type != TYPE_VOID) {
+        asm_context_mov(context, return_value, asm_data_register(REGISTER_RAX, return_value.data_type));
+    }
+}
+
+void asm_context_tail_call(AsmContext *context, AsmData function, size_t arguments_len, const AsmData *arguments)
+{
+    for (size_t i = 0; i < arguments_len; ++i) {
+        asm_context_mov(context, asm_data_register(ARGUMENT_REGISTERS[i], arguments[i].data_type), arguments[i]);
+    }
+
+    const AsmOperand operands[] = {
+        asm_context_operand(context, function),
+        asm_operand_immediate(arguments_len, SIZE_BYTE)
+    };
 
-    asm_context_mov(context, return_value, data);
-    asm_context_change_stack(context, -8);
+    asm_context_instruction(context, ASM_JMP, ARRAY_LEN(operands), operands);
+}
+
+void asm_context_ret(AsmContext *context)
+{
+    asm_context_instruction0(context, ASM_RET);
 }
 
 void asm_context_jmp(AsmContext *context, size_t label_id)
 {
-    fprintf(context->file, "    jmp .L%zu\n", label_id);
+    asm_context_instruction1(context, ASM_JMP, asm_operand_label(label_id));
 }
 
 void asm_context_jz(AsmContext *context, size_t label_id)
 {
-    fprintf(context->file, "    jz .L%zu\n", label_id);
+    asm_context_instruction1(context, ASM_JZ, asm_operand_label(label_id));
 }
 
 void asm_context_jnz(AsmContext *context, size_t label_id)
 {
-    fprintf(context->file, "    jnz .L%zu\n", label_id);
+    asm_context_instruction1(context, ASM_JNZ, asm_operand_label(label_id));
+}
+
+void asm_context_jl(AsmContext *context, size_t label_id)
+{
+    asm_context_instruction1(context, ASM_JL, asm_operand_label(label_id));
+}
+
+void asm_context_jg(AsmContext *context, size_t label_id)
+{
+    asm_context_instruction1(context, ASM_JG, asm_operand_label(label_id));
+}
+
+void asm_context_jle(AsmContext *context, size_t label_id)
+{
+    asm_context_instruction1(context, ASM_JLE, asm_operand_label(label_id));
+}
+
+void asm_context_jge(AsmContext *context, size_t label_id)
+{
+    asm_context_instruction1(context, ASM_JGE, asm_operand_label(label_id));
 }
 
 void asm_context_label(AsmContext *context, size_t label_id)
 {
-    fprintf(context->file, ".L%zu:\n", label_id);
+    asm_context_instruction1(context, ASM_LABEL, asm_operand_label(label_id));
 }
 
-void asm_context_free(AsmContext *context)
+void asm_context_begin_function(AsmContext *context, size_t name_len, const char *name, bool entry)
 {
-    fprintf(
-        context->file,
-        "    leave\n"
-        "exit:\n"
-        "    mov rdi, rax\n"
-        "    mov rax, 60\n"
-        "    syscall\n"
-        "section .data\n"
-    );
+    context->function_start = context->instructions_len;
+    context->function_entry = entry;
+    context->virtual_registers_len = 0;
 
-    for (size_t i = 0; i < context->data_section_len; ++i) {
-        fprintf(context->file, "D%zu: db ", i);
-        DataSectionThing thing = context->data_section[i];
-        for (size_t j = 0; j < thing.data_len; ++j) {
-            fprintf(context->file, "0x%02x", thing.data[j]);
-            if (j + 1 < thing.data_len) {
-                fprintf(context->file, ", ");
+    asm_context_instruction1(context, ASM_LABEL, asm_operand_symbol(asm_context_symbol(context, name_len, name)));
+}
+
+// [rbp + displacement] as an offset from rsp, in a function that
+// doesn't set up rbp, `depth` is what's been pushed since the prologue
+static AsmOperand asm_context_from_rsp(AsmOperand operand, const AsmFrame *frame, size_t depth)
+{
+    if (frame->frame_pointer || operand.type != OPERAND_MEMORY || operand.base != REGISTER_RBP) {
+        return operand;
+    }
+
+    // there's no saved rbp between the frame and the return address
+    if (operand.displacement > 0) {
+        operand.displacement -= 8;
+    }
+
+    operand.base = REGISTER_RSP;
+    operand.displacement += (int32_t) (frame->size + depth);
+
+    return operand;
+}
+
+static void asm_context_frame_instruction(AsmContext *context, const AsmFrame *frame, AsmInstruction instruction, size_t depth)
+{
+    for (size_t i = 0; i < instruction.operands_len; ++i) {
+        instruction.operands[i] = asm_context_from_rsp(instruction.operands[i], frame, depth);
+    }
+
+    asm_context_instruction(context, instruction.opcode, instruction.operands_len, instruction.operands);
+}
+
+// the mov to or from the slot below the spills that a callee saved register is kept in
+static AsmInstruction asm_context_save(const AsmFrame *frame, size_t slot, AsmRegister asm_register, bool restore)
+{
+    const int32_t offset = (int32_t) (frame->locals_size + frame->spill_slots * 8 + (slot + 1) * 8);
+
+    AsmOperand operands[] = {
+        asm_operand_memory(REGISTER_RBP, REGISTER_NONE, -offset, SIZE_QWORD),
+        asm_operand_register(asm_register, SIZE_QWORD)
+    };
+
+    if (restore) {
+        operands[0] = operands[1];
+        operands[1] = asm_operand_memory(REGISTER_RBP, REGISTER_NONE, -offset, SIZE_QWORD);
+    }
+
+    return (AsmInstruction) {
+        .opcode = ASM_MOV,
+        .operands_len = 2,
+        .operands = { operands[0], operands[1] }
+    };
+}
+
+// Only now is it known how many spill slots there are, which callee
+// saved registers are used, and whether the function calls anything.
+// One that doesn't is left alone by everything it could call, so rsp
+// doesn't have to be aligned, and if it doesn't need a frame either
+// it gets no prologue at all.
+static void asm_context_frame(AsmContext *context)
+{
+    const size_t start = context->function_start + 1;
+    const size_t end = context->instructions_len;
+
+    bool leaf = true;
+    uint32_t used = 0;
+
+    for (size_t i = start; i < end; ++i) {
+        const AsmInstruction *instruction = &context->instructions[i];
+
+        leaf = leaf && instruction->opcode != ASM_CALL;
+
+        for (size_t j = 0; j < instruction->operands_len; ++j) {
+            const AsmOperand *operand = &instruction->operands[j];
+
+            if (operand->type == OPERAND_REGISTER || operand->type == OPERAND_MEMORY) {
+                if (operand->base < REGISTER_TYPES) {
+                    used |= REGISTER_MASK(operand->base);
+                }
+                if (operand->index < REGISTER_TYPES) {
+                    used |= REGISTER_MASK(operand->index);
+                }
             }
         }
-        fprintf(context->file, "\n");
-        free(thing.data);
     }
 
-    hashmap_free(&context->variable_stack_positions);
+    AsmFrame frame = {
+        .symbol = context->instructions[context->function_start].operands[0].value,
+
+        .locals = context->locals_len,
+        .locals_size = context->locals_size,
+        .arrays_size = context->arrays_size,
+        .spill_slots = context->spill_slots,
+
+        .saved = 0
+    };
+
+    AsmRegister saved[ARRAY_LEN(CALLEE_SAVED_REGISTERS)];
+
+    for (size_t i = 0; i < ARRAY_LEN(CALLEE_SAVED_REGISTERS) && !context->function_entry; ++i) {
+        if (used & REGISTER_MASK(CALLEE_SAVED_REGISTERS[i])) {
+            saved[frame.saved++] = CALLEE_SAVED_REGISTERS[i];
+        }
+    }
 
+    const size_t needed = frame.locals_size + frame.spill_slots * 8 + frame.saved * 8;
+
+    frame.frame_pointer = context->frame_pointer && !(leaf && needed == 0);
+
+    // rsp is 16 byte aligned at every call, after the return address and rbp
+    const size_t pushed = (context->function_entry ? 0 : 8) + (frame.frame_pointer ? 8 : 0);
+
+    frame.size = leaf ? needed : ((needed + pushed + 15) & ~(size_t) 15) - pushed;
+
+    const size_t body_len = end - start;
+    AsmInstruction *body = malloc(sizeof(*body) * (body_len + 1));
+
+    if (body == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    memcpy(body, &context->instructions[start], sizeof(*body) * body_len);
+    context->instructions_len = start;
+
+    const AsmOperand rsp = asm_operand_register(REGISTER_RSP, SIZE_QWORD);
+    const AsmOperand rbp = asm_operand_register(REGISTER_RBP, SIZE_QWORD);
+    const AsmOperand size = asm_operand_immediate(frame.size, SIZE_QWORD);
+
+    // not enter, whose size only has 16 bits
+    if (frame.frame_pointer) {
+        asm_context_instruction1(context, ASM_PUSH, rbp);
+        asm_context_instruction2(context, ASM_MOV, rbp, rsp);
+    }
+
+    if (frame.size > 0) {
+        asm_context_instruction2(context, ASM_SUB, rsp, size);
+    }
+
+    for (size_t i = 0; i < frame.saved; ++i) {
+        asm_context_frame_instruction(context, &frame, asm_context_save(&frame, i, saved[i], false), 0);
+    }
+
+    size_t depth = 0;
+
+    for (size_t i = 0; i < body_len; ++i) {
+        const AsmInstruction *instruction = &body[i];
+
+        if (instruction->opcode != ASM_RET && !asm_instruction_is_tail_call(instruction)) {
+            asm_context_frame_instruction(context, &frame, *instruction, depth);
+        } else if (context->function_entry) {
+            // exits with whatever is in rax
+            const AsmOperand rax = asm_operand_register(REGISTER_RAX, SIZE_QWORD);
+
+            asm_context_instruction2(context, ASM_MOV, asm_operand_register(REGISTER_RDI, SIZE_QWORD), rax);
+            asm_context_instruction2(context, ASM_MOV, rax, asm_operand_immediate(60, SIZE_QWORD));
+            asm_context_instruction0(context, ASM_SYSCALL);
+        } else {
+            for (size_t j = 0; j < frame.saved; ++j) {
+                asm_context_frame_instruction(context, &frame, asm_context_save(&frame, j, saved[j], true), depth);
+            }
+
+            if (frame.frame_pointer) {
+                asm_context_instruction0(context, ASM_LEAVE);
+            } else if (frame.size > 0) {
+                asm_context_instruction2(context, ASM_ADD, rsp, size);
+            }
+
+            asm_context_instruction(context, instruction->opcode, instruction->operands_len, instruction->operands);
+        }
+
+        // what the calls and the register allocator push around single instructions
+        if (instruction->opcode == ASM_PUSH) {
+            depth += 8;
+        } else if (instruction->opcode == ASM_POP) {
+            depth -= 8;
+        } else if ((instruction->opcode == ASM_SUB || instruction->opcode == ASM_ADD)
+            && instruction->operands[0].type == OPERAND_REGISTER && instruction->operands[0].base == REGISTER_RSP) {
+            depth = instruction->opcode == ASM_SUB ? depth + instruction->operands[1].value : depth - instruction->operands[1].value;
+        }
+    }
+
+    free(body);
+
+    if (context->frames_len >= context->frames_cap) {
+        context->frames_cap *= 2;
+        context->frames = realloc(context->frames, sizeof(*context->frames) * context->frames_cap);
+
+        if (context->frames == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    context->frames[context->frames_len++] = frame;
+}
+
+void asm_context_end_function(AsmContext *context)
+{
+    asm_regalloc(context);
+    asm_peephole(context);
+    asm_context_frame(context);
+}
+
+void asm_context_free(AsmContext *context)
+{
+    switch (context->output) {
+        case OUTPUT_NASM: {
+            asm_nasm_write(context, context->file);
+            break;
+        }
+
+        case OUTPUT_ELF: {
+            asm_elf_write(context, context->file);
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < context->data_section_len; ++i) {
+        free(context->data_section[i].data);
+    }
+
+    free(context->variables);
+    free(context->frames);
+
+    free(context->instructions);
+    free(context->symbols);
     free(context->data_section);
-    free(context->stack_register_pool);
-    free(context->registers);
+}
+
+void asm_context_print_frame(FILE *file, const AsmContext *context)
+{
+    for (size_t i = 0; i < context->frames_len; ++i) {
+        const AsmFrame *frame = &context->frames[i];
+        const AsmSymbol *symbol = &context->symbols[frame->symbol];
+
+        fprintf(file, "frame: %.*s%s\n", (int) symbol->name_len, symbol->name, frame->frame_pointer ? "" : " (no rbp)");
+        fprintf(file, "frame: %-14s %10zu in %zu slots\n", "locals", frame->locals, (frame->locals_size - frame->arrays_size) / 8);
+        fprintf(file, "frame: %-14s %10zu bytes\n", "arrays", frame->arrays_size);
+        fprintf(file, "frame: %-14s %10zu slots\n", "spills", frame->spill_slots);
+        fprintf(file, "frame: %-14s %10zu registers\n", "saved", frame->saved);
+        fprintf(file, "frame: %-14s %10zu bytes\n", "peak", frame->size);
+    }
 }
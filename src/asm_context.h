@@ -2,6 +2,7 @@
 #define ASM_CONTEXT_H_
 
 #include <stdio.h>
+#include <stdint.h>
 #include "types.h"
 #include "type_checker.h"
 
@@ -11,9 +12,14 @@ typedef enum AsmStorageType
 
     STORAGE_STATIC,
     STORAGE_REGISTER,
+    STORAGE_VIRTUAL,
     STORAGE_STACK,
     STORAGE_STACK_VARIABLE,
-    STORAGE_FUNCTION
+    STORAGE_FUNCTION,
+
+    // an immediate, which has to fit in 32 bits
+    // sign extended if it's a qword
+    STORAGE_CONSTANT
 } AsmStorageType;
 
 typedef enum AsmRegister
@@ -28,128 +34,115 @@ typedef enum AsmRegister
     REGISTER_R9,
     REGISTER_R10,
     REGISTER_R11,
+    REGISTER_R12,
+    REGISTER_R13,
+    REGISTER_R14,
+    REGISTER_R15,
     REGISTER_RSP,
     REGISTER_RBP,
 
-    REGISTER_TYPES
+    // xmm, or ymm when the operand is 32 bytes
+    REGISTER_XMM0,
+    REGISTER_XMM1,
+    REGISTER_XMM2,
+    REGISTER_XMM3,
+    REGISTER_XMM4,
+    REGISTER_XMM5,
+    REGISTER_XMM6,
+    REGISTER_XMM7,
+    REGISTER_XMM8,
+    REGISTER_XMM9,
+    REGISTER_XMM10,
+    REGISTER_XMM11,
+    REGISTER_XMM12,
+    REGISTER_XMM13,
+    REGISTER_XMM14,
+    REGISTER_XMM15,
+
+    REGISTER_TYPES,
+
+    // for memory operands without a base or an index
+    REGISTER_NONE = REGISTER_TYPES,
+
+    // the virtual register in the operand's `value`,
+    // until the register allocator picks a real one,
+    // as an index it's the same one as the base
+    REGISTER_VIRTUAL
 } AsmRegister;
 
-static const AsmRegister usable_registers[] = {
-    REGISTER_R11,
-    REGISTER_R10,
-    REGISTER_R9,
-    REGISTER_R8,
-    REGISTER_RSI,
+#define REGISTER_MASK(_register) (1u << (_register))
+
+// what a call may change, so nothing lives in these across one
+static const uint32_t CALLER_SAVED_REGISTERS =
+    REGISTER_MASK(REGISTER_RAX) | REGISTER_MASK(REGISTER_RCX) | REGISTER_MASK(REGISTER_RDX)
+    | REGISTER_MASK(REGISTER_RSI) | REGISTER_MASK(REGISTER_RDI) | REGISTER_MASK(REGISTER_R8)
+    | REGISTER_MASK(REGISTER_R9) | REGISTER_MASK(REGISTER_R10) | REGISTER_MASK(REGISTER_R11)
+    // and all 16 xmm registers
+    | (0xffffu << REGISTER_XMM0);
+
+// what a function has to put back before it returns, besides rbp
+static const AsmRegister CALLEE_SAVED_REGISTERS[] = {
+    REGISTER_RBX,
+    REGISTER_R12,
+    REGISTER_R13,
+    REGISTER_R14,
+    REGISTER_R15
+};
+
+// where the first integer arguments of a call go, in order, the rest
+// are pushed from the last one to the first
+static const AsmRegister ARGUMENT_REGISTERS[] = {
     REGISTER_RDI,
-    REGISTER_RCX
+    REGISTER_RSI,
+    REGISTER_RDX,
+    REGISTER_RCX,
+    REGISTER_R8,
+    REGISTER_R9
+};
+
+typedef enum AsmSize
+{
+    SIZE_BYTE,
+    SIZE_WORD,
+    SIZE_DWORD,
+    SIZE_QWORD,
+
+    // a whole xmm or ymm register
+    SIZE_XMM,
+    SIZE_YMM,
+
+    ASM_SIZES
+} AsmSize;
+
+static const int32_t ASM_SIZE_TO_BYTES[ASM_SIZES] = {
+    [SIZE_BYTE]  = 1,
+    [SIZE_WORD]  = 2,
+    [SIZE_DWORD] = 4,
+    [SIZE_QWORD] = 8,
+    [SIZE_XMM]   = 16,
+    [SIZE_YMM]   = 32
 };
 
-static const char *INT_TYPE_ASM[DATA_TYPES] = {
-    [TYPE_INT64]     = "QWORD",
-    [TYPE_REFERENCE] = "QWORD",
-    [TYPE_INT32]     = "DWORD",
-    [TYPE_INT16]     = "WORD",
-    [TYPE_INT8]      = "BYTE"
+static const AsmSize DATA_TYPE_TO_ASM_SIZE[DATA_TYPES] = {
+    [TYPE_NULL]      = SIZE_QWORD,
+    [TYPE_VOID]      = SIZE_QWORD,
+    [TYPE_FUNCTION]  = SIZE_QWORD,
+    [TYPE_REFERENCE] = SIZE_QWORD,
+    [TYPE_INT64]     = SIZE_QWORD,
+    [TYPE_INT32]     = SIZE_DWORD,
+    [TYPE_INT16]     = SIZE_WORD,
+    [TYPE_INT8]      = SIZE_BYTE
 };
 
-static const char *REGISTER_TO_STRING[REGISTER_TYPES][DATA_TYPES] = {
-    [REGISTER_RAX] = {
-        [TYPE_INT64]     = "rax",
-        [TYPE_REFERENCE] = "rax",
-        [TYPE_FUNCTION]  = "rax",
-        [TYPE_INT32]     = "eax",
-        [TYPE_INT16]     = "ax",
-        [TYPE_INT8]      = "al",
-    },
-    [REGISTER_RBX] = {
-        [TYPE_INT64]     = "rbx",
-        [TYPE_REFERENCE] = "rbx",
-        [TYPE_FUNCTION]  = "rbx",
-        [TYPE_INT32]     = "ebx",
-        [TYPE_INT16]     = "bx",
-        [TYPE_INT8]      = "bl",
-    },
-    [REGISTER_RCX] = {
-        [TYPE_INT64]     = "rcx",
-        [TYPE_REFERENCE] = "rcx",
-        [TYPE_FUNCTION]  = "rcx",
-        [TYPE_INT32]     = "ecx",
-        [TYPE_INT16]     = "cx",
-        [TYPE_INT8]      = "cl",
-    },
-    [REGISTER_RDX] = {
-        [TYPE_INT64]     = "rdx",
-        [TYPE_REFERENCE] = "rdx",
-        [TYPE_FUNCTION]  = "rdx",
-        [TYPE_INT32]     = "edx",
-        [TYPE_INT16]     = "dx",
-        [TYPE_INT8]      = "dl",
-    },
-    [REGISTER_RSI] = {
-        [TYPE_INT64]     = "rsi",
-        [TYPE_REFERENCE] = "rsi",
-        [TYPE_FUNCTION]  = "rsi",
-        [TYPE_INT32]     = "esi",
-        [TYPE_INT16]     = "si",
-        [TYPE_INT8]      = "sil",
-    },
-    [REGISTER_RDI] = {
-        [TYPE_INT64]     = "rdi",
-        [TYPE_REFERENCE] = "rdi",
-        [TYPE_FUNCTION]  = "rdi",
-        [TYPE_INT32]     = "edi",
-        [TYPE_INT16]     = "di",
-        [TYPE_INT8]      = "dil",
-    },
-    [REGISTER_R8] = {
-        [TYPE_INT64]     = "r8",
-        [TYPE_REFERENCE] = "r8",
-        [TYPE_FUNCTION]  = "r8",
-        [TYPE_INT32]     = "r8d",
-        [TYPE_INT16]     = "r8w",
-        [TYPE_INT8]      = "r8b",
-    },
-    [REGISTER_R9] = {
-        [TYPE_INT64]     = "r9",
-        [TYPE_REFERENCE] = "r9",
-        [TYPE_FUNCTION]  = "r9",
-        [TYPE_INT32]     = "r9d",
-        [TYPE_INT16]     = "r9w",
-        [TYPE_INT8]      = "r9b",
-    },
-    [REGISTER_R10] = {
-        [TYPE_INT64]     = "r10",
-        [TYPE_REFERENCE] = "r10",
-        [TYPE_FUNCTION]  = "r10",
-        [TYPE_INT32]     = "r10d",
-        [TYPE_INT16]     = "r10w",
-        [TYPE_INT8]      = "r10b",
-    },
-    [REGISTER_R11] = {
-        [TYPE_INT64]     = "r11",
-        [TYPE_REFERENCE] = "r11",
-        [TYPE_FUNCTION]  = "r11",
-        [TYPE_INT32]     = "r11d",
-        [TYPE_INT16]     = "r11w",
-        [TYPE_INT8]      = "r11b",
-    },
-    [REGISTER_RSP] = {
-        [TYPE_INT64]     = "rsp",
-        [TYPE_REFERENCE] = "rsp",
-        [TYPE_FUNCTION]  = "rsp",
-        [TYPE_INT32]     = "esp",
-        [TYPE_INT16]     = "sp",
-        [TYPE_INT8]      = "spl",
-    },
-    [REGISTER_RBP] = {
-        [TYPE_INT64]     = "rbp",
-        [TYPE_REFERENCE] = "rbp",
-        [TYPE_FUNCTION]  = "rbp",
-        [TYPE_INT32]     = "ebp",
-        [TYPE_INT16]     = "bp",
-        [TYPE_INT8]      = "bpl",
+// arrays are only ever in a register as a vector, which is all of it
+static inline AsmSize asm_data_type_size(const DataType *data_type)
+{
+    if (data_type->type == TYPE_ARRAY) {
+        return data_type_size(data_type) > (size_t) ASM_SIZE_TO_BYTES[SIZE_XMM] ? SIZE_YMM : SIZE_XMM;
     }
-};
+
+    return DATA_TYPE_TO_ASM_SIZE[data_type->type];
+}
 
 typedef struct AsmData
 {
@@ -157,7 +150,7 @@ typedef struct AsmData
 
     AsmStorageType storage;
 
-    DataType *data_type;
+    const DataType *data_type;
 
     union {
         struct {
@@ -165,26 +158,352 @@ typedef struct AsmData
             const char *name;
         } function;
         AsmRegister asm_register;
+        size_t virtual_register;
         int stack_location;
         size_t static_variable_id;
+        uint64_t constant;
     };
 } AsmData;
 
-AsmData asm_data_register(AsmRegister asm_register, DataType *data_type);
-AsmData asm_data_stack(int stack_location, DataType *data_type);
-AsmData asm_data_stack_variable(int stack_location, DataType *data_type);
-AsmData asm_data_function(size_t name_len, const char *name, DataType *data_type);
+AsmData asm_data_register(AsmRegister asm_register, const DataType *data_type);
+AsmData asm_data_virtual(size_t virtual_register, const DataType *data_type);
+AsmData asm_data_stack(int stack_location, const DataType *data_type);
+AsmData asm_data_stack_variable(int stack_location, const DataType *data_type);
+AsmData asm_data_function(size_t name_len, const char *name, const DataType *data_type);
+AsmData asm_data_constant(uint64_t constant, const DataType *data_type);
 AsmData asm_data_auto_deref(AsmData data);
 
+typedef enum AsmOpcode
+{
+    // not an instruction, defines its label or symbol operand
+    ASM_LABEL,
+
+    ASM_MOV,
+    ASM_LEA,
+
+    // sign extends into a qword register, movsxd from a dword
+    ASM_MOVSX,
+    ASM_ADD,
+    ASM_SUB,
+    ASM_AND,
+    ASM_XOR,
+    ASM_CMP,
+    ASM_TEST,
+    ASM_MUL,
+    ASM_DIV,
+
+    // `imul r, r/m` and `imul r, imm`, which is really `imul r, r, imm`
+    ASM_IMUL,
+
+    // the one operand forms, through rdx:rax
+    ASM_IMUL_WIDE,
+    ASM_IDIV,
+
+    // sign extend rax into itself or into rdx, for idiv
+    ASM_CBW,
+    ASM_CWD,
+    ASM_CDQ,
+    ASM_CQO,
+
+    // by an immediate
+    ASM_SHL,
+    ASM_SHR,
+    ASM_SAR,
+
+    ASM_NEG,
+    ASM_INC,
+    ASM_DEC,
+
+    ASM_SETZ,
+    ASM_SETNZ,
+    ASM_SETL,
+    ASM_SETG,
+    ASM_SETLE,
+    ASM_SETGE,
+
+    // Packed integers in xmm registers, or ymm ones with avx2. The moves
+    // are from a general purpose register or memory to a vector register,
+    // except movdqu, which can also store one.
+    ASM_MOVDQU,
+    ASM_MOVD,
+    ASM_MOVQ,
+    ASM_PADDB,
+    ASM_PADDW,
+    ASM_PADDD,
+    ASM_PADDQ,
+    ASM_PSUBB,
+    ASM_PSUBW,
+    ASM_PSUBD,
+    ASM_PSUBQ,
+    ASM_PMULLW,
+    ASM_PMULLD,
+    ASM_PUNPCKLDQ,
+    ASM_PUNPCKLQDQ,
+
+    // only with avx2, from the bottom of an xmm register
+    ASM_PBROADCASTD,
+    ASM_PBROADCASTQ,
+
+    ASM_PUSH,
+    ASM_POP,
+    ASM_CALL,
+    ASM_RET,
+    ASM_ENTER,
+    ASM_LEAVE,
+    ASM_SYSCALL,
+
+    ASM_JMP,
+    ASM_JZ,
+    ASM_JNZ,
+    ASM_JL,
+    ASM_JG,
+    ASM_JLE,
+    ASM_JGE,
+
+    ASM_OPCODES
+} AsmOpcode;
+
+typedef enum AsmAccess
+{
+    ACCESS_READ  = 1,
+    ACCESS_WRITE = 2
+} AsmAccess;
+
+// how each instruction uses its explicit operands
+static const uint8_t ASM_OPCODE_ACCESS[ASM_OPCODES][2] = {
+    [ASM_LABEL]       = { 0, 0 },
+    [ASM_MOV]         = { ACCESS_WRITE, ACCESS_READ },
+    [ASM_LEA]         = { ACCESS_WRITE, 0 },
+    [ASM_MOVSX]       = { ACCESS_WRITE, ACCESS_READ },
+    [ASM_ADD]         = { ACCESS_READ | ACCESS_WRITE, ACCESS_READ },
+    [ASM_SUB]         = { ACCESS_READ | ACCESS_WRITE, ACCESS_READ },
+    [ASM_AND]         = { ACCESS_READ | ACCESS_WRITE, ACCESS_READ },
+    [ASM_XOR]         = { ACCESS_READ | ACCESS_WRITE, ACCESS_READ },
+    [ASM_CMP]         = { ACCESS_READ, ACCESS_READ },
+    [ASM_TEST]        = { ACCESS_READ, ACCESS_READ },
+    [ASM_MUL]         = { ACCESS_READ, 0 },
+    [ASM_DIV]         = { ACCESS_READ, 0 },
+    [ASM_IMUL]        = { ACCESS_READ | ACCESS_WRITE, ACCESS_READ },
+    [ASM_IMUL_WIDE]   = { ACCESS_READ, 0 },
+    [ASM_IDIV]        = { ACCESS_READ, 0 },
+    [ASM_CBW]         = { 0, 0 },
+    [ASM_CWD]         = { 0, 0 },
+    [ASM_CDQ]         = { 0, 0 },
+    [ASM_CQO]         = { 0, 0 },
+    [ASM_SHL]         = { ACCESS_READ | ACCESS_WRITE, ACCESS_READ },
+    [ASM_SHR]         = { ACCESS_READ | ACCESS_WRITE, ACCESS_READ },
+    [ASM_SAR]         = { ACCESS_READ | ACCESS_WRITE, ACCESS_READ },
+    [ASM_NEG]         = { ACCESS_READ | ACCESS_WRITE, 0 },
+    [ASM_INC]         = { ACCESS_READ | ACCESS_WRITE, 0 },
+    [ASM_DEC]         = { ACCESS_READ | ACCESS_WRITE, 0 },
+    [ASM_SETZ]        = { ACCESS_WRITE, 0 },
+    [ASM_SETNZ]       = { ACCESS_WRITE, 0 },
+    [ASM_SETL]        = { ACCESS_WRITE, 0 },
+    [ASM_SETG]        = { ACCESS_WRITE, 0 },
+    [ASM_SETLE]       = { ACCESS_WRITE, 0 },
+    [ASM_SETGE]       = { ACCESS_WRITE, 0 },
+    [ASM_MOVDQU]      = { ACCESS_WRITE, ACCESS_READ },
+    [ASM_MOVD]        = { ACCESS_WRITE, ACCESS_READ },
+    [ASM_MOVQ]        = { ACCESS_WRITE, ACCESS_READ },
+    [ASM_PADDB]       = { ACCESS_READ | ACCESS_WRITE, ACCESS_READ },
+    [ASM_PADDW]       = { ACCESS_READ | ACCESS_WRITE, ACCESS_READ },
+    [ASM_PADDD]       = { ACCESS_READ | ACCESS_WRITE, ACCESS_READ },
+    [ASM_PADDQ]       = { ACCESS_READ | ACCESS_WRITE, ACCESS_READ },
+    [ASM_PSUBB]       = { ACCESS_READ | ACCESS_WRITE, ACCESS_READ },
+    [ASM_PSUBW]       = { ACCESS_READ | ACCESS_WRITE, ACCESS_READ },
+    [ASM_PSUBD]       = { ACCESS_READ | ACCESS_WRITE, ACCESS_READ },
+    [ASM_PSUBQ]       = { ACCESS_READ | ACCESS_WRITE, ACCESS_READ },
+    [ASM_PMULLW]      = { ACCESS_READ | ACCESS_WRITE, ACCESS_READ },
+    [ASM_PMULLD]      = { ACCESS_READ | ACCESS_WRITE, ACCESS_READ },
+    [ASM_PUNPCKLDQ]   = { ACCESS_READ | ACCESS_WRITE, ACCESS_READ },
+    [ASM_PUNPCKLQDQ]  = { ACCESS_READ | ACCESS_WRITE, ACCESS_READ },
+    [ASM_PBROADCASTD] = { ACCESS_WRITE, ACCESS_READ },
+    [ASM_PBROADCASTQ] = { ACCESS_WRITE, ACCESS_READ },
+    [ASM_PUSH]        = { ACCESS_READ, 0 },
+    [ASM_POP]         = { ACCESS_WRITE, 0 },
+    [ASM_CALL]        = { ACCESS_READ, 0 },
+    [ASM_RET]         = { 0, 0 },
+    [ASM_ENTER]       = { 0, 0 },
+    [ASM_LEAVE]       = { 0, 0 },
+    [ASM_SYSCALL]     = { 0, 0 },
+    [ASM_JMP]         = { 0, 0 },
+    [ASM_JZ]          = { 0, 0 },
+    [ASM_JNZ]         = { 0, 0 },
+    [ASM_JL]          = { 0, 0 },
+    [ASM_JG]          = { 0, 0 },
+    [ASM_JLE]         = { 0, 0 },
+    [ASM_JGE]         = { 0, 0 }
+};
+
+// jmp and the conditional jumps
+static inline bool asm_opcode_is_jump(AsmOpcode opcode)
+{
+    return opcode >= ASM_JMP && opcode <= ASM_JGE;
+}
+
+static inline bool asm_opcode_is_vector(AsmOpcode opcode)
+{
+    return opcode >= ASM_MOVDQU && opcode <= ASM_PBROADCASTQ;
+}
+
+// registers an instruction reads or writes without naming them
+static const uint32_t ASM_OPCODE_IMPLICIT_READS[ASM_OPCODES] = {
+    [ASM_MUL]       = REGISTER_MASK(REGISTER_RAX),
+    [ASM_DIV]       = REGISTER_MASK(REGISTER_RAX) | REGISTER_MASK(REGISTER_RDX),
+    [ASM_IMUL_WIDE] = REGISTER_MASK(REGISTER_RAX),
+    [ASM_IDIV]      = REGISTER_MASK(REGISTER_RAX) | REGISTER_MASK(REGISTER_RDX),
+    [ASM_CBW]       = REGISTER_MASK(REGISTER_RAX),
+    [ASM_CWD]       = REGISTER_MASK(REGISTER_RAX),
+    [ASM_CDQ]       = REGISTER_MASK(REGISTER_RAX),
+    [ASM_CQO]       = REGISTER_MASK(REGISTER_RAX),
+    [ASM_RET]       = REGISTER_MASK(REGISTER_RAX),
+    [ASM_SYSCALL]   = REGISTER_MASK(REGISTER_RAX) | REGISTER_MASK(REGISTER_RDI) | REGISTER_MASK(REGISTER_RSI)
+        | REGISTER_MASK(REGISTER_RDX) | REGISTER_MASK(REGISTER_R10) | REGISTER_MASK(REGISTER_R8)
+        | REGISTER_MASK(REGISTER_R9)
+};
+
+static const uint32_t ASM_OPCODE_IMPLICIT_WRITES[ASM_OPCODES] = {
+    [ASM_MUL]       = REGISTER_MASK(REGISTER_RAX) | REGISTER_MASK(REGISTER_RDX),
+    [ASM_DIV]       = REGISTER_MASK(REGISTER_RAX) | REGISTER_MASK(REGISTER_RDX),
+    [ASM_IMUL_WIDE] = REGISTER_MASK(REGISTER_RAX) | REGISTER_MASK(REGISTER_RDX),
+    [ASM_IDIV]      = REGISTER_MASK(REGISTER_RAX) | REGISTER_MASK(REGISTER_RDX),
+    [ASM_CBW]       = REGISTER_MASK(REGISTER_RAX),
+    [ASM_CWD]       = REGISTER_MASK(REGISTER_RDX),
+    [ASM_CDQ]       = REGISTER_MASK(REGISTER_RDX),
+    [ASM_CQO]       = REGISTER_MASK(REGISTER_RDX),
+    [ASM_CALL]      = CALLER_SAVED_REGISTERS,
+    [ASM_SYSCALL]   = REGISTER_MASK(REGISTER_RAX) | REGISTER_MASK(REGISTER_RCX) | REGISTER_MASK(REGISTER_R11)
+};
+
+typedef enum AsmOperandType
+{
+    OPERAND_NULL,
+
+    OPERAND_REGISTER,
+
+    // [base + index * (1 << scale) + displacement], or the data
+    // section entry `value` if there's no base
+    OPERAND_MEMORY,
+
+    OPERAND_IMMEDIATE,
+
+    // the address of the data section entry `value`
+    OPERAND_DATA,
+
+    // `value` is a label from asm_context_label_new
+    OPERAND_LABEL,
+
+    // `value` is a named label from asm_context_symbol
+    OPERAND_SYMBOL
+} AsmOperandType;
+
+typedef struct AsmOperand
+{
+    AsmOperandType type;
+    AsmSize size;
+
+    // also the register of a register operand
+    AsmRegister base;
+    AsmRegister index;
+    uint8_t scale;
+    int32_t displacement;
+
+    uint64_t value;
+} AsmOperand;
+
+// a call's second operand is an immediate, how many of
+// the ARGUMENT_REGISTERS it passes arguments in, and so
+// is a tail call's
+typedef struct AsmInstruction
+{
+    AsmOpcode opcode;
+    size_t operands_len;
+    AsmOperand operands[2];
+} AsmInstruction;
+
+// a jmp to a function instead of a label, which it returns from
+// straight to whoever called the function that's jumping
+static inline bool asm_instruction_is_tail_call(const AsmInstruction *instruction)
+{
+    return instruction->opcode == ASM_JMP && instruction->operands[0].type == OPERAND_SYMBOL;
+}
+
+// the implicit reads of the instruction's opcode, and a call's arguments
+static inline uint32_t asm_instruction_implicit_reads(const AsmInstruction *instruction)
+{
+    uint32_t reads = ASM_OPCODE_IMPLICIT_READS[instruction->opcode];
+
+    if (instruction->opcode == ASM_CALL || asm_instruction_is_tail_call(instruction)) {
+        for (size_t i = 0; i < instruction->operands[1].value; ++i) {
+            reads |= REGISTER_MASK(ARGUMENT_REGISTERS[i]);
+        }
+    }
+
+    return reads;
+}
+
 typedef struct DataSectionThing
 {
     size_t data_len;
     char *data;
 } DataSectionThing;
 
+typedef enum AsmOutput
+{
+    // assembly for nasm
+    OUTPUT_NASM,
+
+    // a static executable, assembled and linked by us
+    OUTPUT_ELF
+} AsmOutput;
+
+#define PEEPHOLE_DEFAULT_WINDOW 8
+
+typedef enum AsmPeepholeRule
+{
+    PEEPHOLE_SELF_MOVE,
+    PEEPHOLE_STORE_TO_LOAD,
+    PEEPHOLE_REDUNDANT_TEST,
+
+    PEEPHOLE_RULES
+} AsmPeepholeRule;
+
+typedef struct AsmSymbol
+{
+    size_t name_len;
+    const char *name;
+} AsmSymbol;
+
+// what ended up in a function's frame, for the frame report
+typedef struct AsmFrame
+{
+    size_t symbol;
+
+    size_t locals;
+    size_t locals_size;
+    size_t arrays_size;
+    size_t spill_slots;
+
+    // callee saved registers, which get slots below the spills
+    size_t saved;
+
+    // what rsp goes down by besides the return address and rbp
+    size_t size;
+
+    bool frame_pointer;
+} AsmFrame;
+
+// Collects the program as a list of instructions, which are only
+// turned into the output at the end. Functions are added one at a
+// time, and get their registers and frame as each one is finished.
 typedef struct AsmContext
 {
     FILE *file;
+    AsmOutput output;
+
+    size_t instructions_len;
+    size_t instructions_cap;
+    AsmInstruction *instructions;
 
     size_t data_section_len;
     size_t data_section_cap;
@@ -192,30 +511,85 @@ typedef struct AsmContext
 
     size_t label_count;
 
-    HashMap variable_stack_positions;
+    size_t symbols_len;
+    size_t symbols_cap;
+    AsmSymbol *symbols;
+
+    // indexed by the variable's binding
+    size_t variables_cap;
+    AsmData *variables;
+
+    // every value gets its own, the register allocator
+    // maps them to real registers at the end
+    size_t virtual_registers_len;
+
+    // where the function that's being added starts, its label
+    size_t function_start;
+
+    // _start, which is entered with rsp 16 byte aligned and exits
+    // instead of returning, so it has no registers to put back
+    bool function_entry;
+
+    // bytes below rbp that ir_lower laid out for the IR_LOCALs,
+    // the spill slots go below them
+    size_t locals_size;
+    size_t locals_len;
+    size_t arrays_size;
+
+    // how many the register allocator needed
+    size_t spill_slots;
+
+    // every function's frame, in order
+    size_t frames_len;
+    size_t frames_cap;
+    AsmFrame *frames;
+
+    // false to address the frame from rsp instead, which saves the
+    // push, mov and leave, functions that don't call anything and
+    // need no frame never set up rbp either way
+    bool frame_pointer;
 
-    size_t stack_frame_size;
-    size_t stack_register_pool_len;
-    size_t stack_register_pool_cap;
-    size_t *stack_register_pool;
+    // how many instructions the peephole pass looks across, 0 turns it off
+    size_t peephole_window;
 
-    size_t registers_len;
-    AsmRegister *registers;
+    // the vector instructions are the vex encoded ones, which
+    // can be on ymm registers and don't overwrite their source
+    bool avx2;
+
+    // how many times each peephole rule was applied
+    size_t peephole_hits[PEEPHOLE_RULES];
 } AsmContext;
 
-AsmContext asm_context_new(FILE *file);
+AsmOperand asm_operand_register(AsmRegister asm_register, AsmSize size);
+AsmOperand asm_operand_memory(AsmRegister base, AsmRegister index, int32_t displacement, AsmSize size);
+AsmOperand asm_operand_immediate(uint64_t value, AsmSize size);
+AsmOperand asm_operand_label(size_t label_id);
+AsmOperand asm_operand_symbol(size_t symbol_id);
+
+AsmContext asm_context_new(FILE *file, AsmOutput output);
 
-AsmData asm_context_add_to_data_section(AsmContext *context, char *data, size_t data_len, DataType *data_type);
+AsmData asm_context_add_to_data_section(AsmContext *context, char *data, size_t data_len, const DataType *data_type);
 
 size_t asm_context_label_new(AsmContext *context);
+size_t asm_context_symbol(AsmContext *context, size_t name_len, const char *name);
+
+void asm_context_instruction(AsmContext *context, AsmOpcode opcode, size_t operands_len, const AsmOperand *operands);
+
+// The function's label, which is where its instructions start. A ret
+// is where it returns from, with the return value in rax.
+void asm_context_begin_function(AsmContext *context, size_t name_len, const char *name, bool entry);
+
+// Allocates the function's registers, then puts the prologue after
+// its label and the epilogue in place of every ret, and in front of
+// every tail call.
+void asm_context_end_function(AsmContext *context);
 
 void asm_context_change_stack(AsmContext *context, int bytes);
-void asm_context_add_variable_stack_position(AsmContext *context, VariableID id, size_t position);
-size_t asm_context_variable_stack_position(AsmContext *context, VariableID id);
+void asm_context_add_variable(AsmContext *context, size_t binding, AsmData data);
+AsmData asm_context_variable(AsmContext *context, size_t binding);
 
-AsmData asm_context_data_alloc(AsmContext *context, DataType *data_type);
-void asm_context_data_name(AsmContext *context, AsmData data);
-void asm_context_data_free(AsmContext *context, AsmData data);
+AsmData asm_context_data_alloc(AsmContext *context, const DataType *data_type);
+AsmOperand asm_context_operand(AsmContext *context, AsmData data);
 
 void asm_context_mov(AsmContext *context, AsmData dst, AsmData src);
 void asm_context_mov_constant(AsmContext *context, AsmData dst, size_t constant);
@@ -223,6 +597,18 @@ void asm_context_add(AsmContext *context, AsmData dst, AsmData src);
 void asm_context_sub(AsmContext *context, AsmData dst, AsmData src);
 void asm_context_mul(AsmContext *context, AsmData dst, AsmData src);
 void asm_context_div(AsmContext *context, AsmData dst, AsmData src);
+
+// shl, shr or sar by a constant
+void asm_context_shift(AsmContext *context, AsmOpcode opcode, AsmData dst, uint8_t amount);
+
+// sign extends `src` into all of the qword `dst`
+void asm_context_movsx(AsmContext *context, AsmData dst, AsmData src);
+
+// a packed integer instruction on vectors
+void asm_context_vector(AsmContext *context, AsmOpcode opcode, AsmData dst, AsmData src);
+
+// every element of the vector `dst` set to the integer `src`
+void asm_context_broadcast(AsmContext *context, AsmData dst, AsmData src);
 void asm_context_negate(AsmContext *context, AsmData dst);
 
 void asm_context_reference(AsmContext *context, AsmData dst, AsmData src);
@@ -239,13 +625,35 @@ void asm_context_setle(AsmContext *context, AsmData dst);
 void asm_context_setge(AsmContext *context, AsmData dst);
 
 void asm_context_push(AsmContext *context, AsmData data);
-void asm_context_call_function(AsmContext *context, AsmData function, AsmData return_value);
+// the arguments go where the System V ABI has them, then the
+// return value is copied out of rax, unless it's void
+void asm_context_call_function(
+    AsmContext *context,
+    AsmData function,
+    size_t arguments_len,
+    const AsmData *arguments,
+    AsmData return_value
+);
+
+// Jumps to the function instead of calling it, with every argument in a
+// register. The frame is taken down right before it, like before a ret.
+void asm_context_tail_call(AsmContext *context, AsmData function, size_t arguments_len, const AsmData *arguments);
+
+// returns from the function with what's in rax
+void asm_context_ret(AsmContext *context);
 
 void asm_context_jmp(AsmContext *context, size_t label_id);
 void asm_context_jz(AsmContext *context, size_t label_id);
 void asm_context_jnz(AsmContext *context, size_t label_id);
+void asm_context_jl(AsmContext *context, size_t label_id);
+void asm_context_jg(AsmContext *context, size_t label_id);
+void asm_context_jle(AsmContext *context, size_t label_id);
+void asm_context_jge(AsmContext *context, size_t label_id);
 void asm_context_label(AsmContext *context, size_t label_id);
 
+// writes the output, then frees the context
 void asm_context_free(AsmContext *context);
 
+void asm_context_print_frame(FILE *file, const AsmContext *context);
+
 #endif // ASM_CONTEXT_H_
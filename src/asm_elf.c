@@ -0,0 +1,981 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <elf.h>
+#include "asm_elf.h"
+#include "utils.h"
+
+typedef enum AsmElfFixupType
+{
+    // rel32 to a label or a symbol, always the last thing in its instruction
+    FIXUP_LABEL,
+    FIXUP_SYMBOL,
+
+    // abs32 address of a data section entry or a symbol, plus the addend
+    FIXUP_DATA,
+    FIXUP_SYMBOL_ADDRESS
+} AsmElfFixupType;
+
+typedef struct AsmElfFixup
+{
+    AsmElfFixupType type;
+
+    // where the 4 bytes are in the text
+    size_t offset;
+
+    size_t target;
+    int64_t addend;
+} AsmElfFixup;
+
+typedef struct AsmElfBuffer
+{
+    size_t len;
+    size_t cap;
+    uint8_t *data;
+} AsmElfBuffer;
+
+typedef struct AsmElf
+{
+    const AsmContext *context;
+
+    AsmElfBuffer text;
+    AsmElfBuffer data;
+
+    size_t fixups_len;
+    size_t fixups_cap;
+    AsmElfFixup *fixups;
+
+    // offsets into the text and the data, known after everything is encoded
+    size_t *label_offsets;
+    size_t *symbol_offsets;
+    size_t *data_offsets;
+} AsmElf;
+
+static AsmElfBuffer asm_elf_buffer_new(size_t cap)
+{
+    AsmElfBuffer buffer = {
+        .len = 0,
+        .cap = cap
+    };
+
+    buffer.data = malloc(buffer.cap);
+
+    if (buffer.data == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    return buffer;
+}
+
+static void asm_elf_buffer_write(AsmElfBuffer *buffer, const void *data, size_t len)
+{
+    if (buffer->len + len > buffer->cap) {
+        while (buffer->len + len > buffer->cap) {
+            buffer->cap *= 2;
+        }
+
+        buffer->data = realloc(buffer->data, buffer->cap);
+
+        if (buffer->data == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+}
+
+static void asm_elf_byte(AsmElf *elf, uint8_t byte)
+{
+    asm_elf_buffer_write(&elf->text, &byte, 1);
+}
+
+// little endian, which is also what the host is
+static void asm_elf_immediate(AsmElf *elf, uint64_t value, size_t len)
+{
+    uint8_t bytes[8];
+
+    for (size_t i = 0; i < len; ++i) {
+        bytes[i] = value >> (i * 8);
+    }
+
+    asm_elf_buffer_write(&elf->text, bytes, len);
+}
+
+static void asm_elf_fixup(AsmElf *elf, AsmElfFixupType type, size_t target, int64_t addend)
+{
+    if (elf->fixups_len >= elf->fixups_cap) {
+        while (elf->fixups_len >= elf->fixups_cap) {
+            elf->fixups_cap *= 2;
+        }
+
+        elf->fixups = realloc(elf->fixups, sizeof(*elf->fixups) * elf->fixups_cap);
+
+        if (elf->fixups == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    elf->fixups[elf->fixups_len++] = (AsmElfFixup) {
+        .type = type,
+        .offset = elf->text.len,
+        .target = target,
+        .addend = addend
+    };
+
+    // patched once everything has an address
+    asm_elf_immediate(elf, 0, 4);
+}
+
+// the immediate as the signed value nasm would see at that size
+static int64_t asm_elf_signed(uint64_t value, AsmSize size)
+{
+    switch (size) {
+        case SIZE_BYTE:  return (int8_t) value;
+        case SIZE_WORD:  return (int16_t) value;
+        case SIZE_DWORD: return (int32_t) value;
+        case SIZE_QWORD: return (int64_t) value;
+        default: UNREACHABLE();
+    }
+}
+
+static bool asm_elf_fits_int8(uint64_t value, AsmSize size)
+{
+    const int64_t signed_value = asm_elf_signed(value, size);
+    return signed_value >= INT8_MIN && signed_value <= INT8_MAX;
+}
+
+static bool asm_elf_fits_int32(uint64_t value, AsmSize size)
+{
+    const int64_t signed_value = asm_elf_signed(value, size);
+    return signed_value >= INT32_MIN && signed_value <= INT32_MAX;
+}
+
+// bytes of a full sized immediate, which is never more than 4 outside of mov
+static size_t asm_elf_immediate_len(AsmSize size)
+{
+    switch (size) {
+        case SIZE_BYTE: return 1;
+        case SIZE_WORD: return 2;
+        default:        return 4;
+    }
+}
+
+// spl, bpl, sil and dil only exist with a rex prefix
+static bool asm_elf_needs_rex(uint8_t machine_register, AsmSize size)
+{
+    return size == SIZE_BYTE && machine_register >= 4 && machine_register <= 7;
+}
+
+// the R, X and B bits of a rex prefix, for the top bit of each register
+static uint8_t asm_elf_rex_bits(uint8_t reg, const AsmOperand *rm)
+{
+    uint8_t bits = 0;
+
+    if (reg & 8) {
+        bits |= 0x04;
+    }
+
+    if (rm->type == OPERAND_REGISTER) {
+        if (REGISTER_TO_MACHINE[rm->base] & 8) {
+            bits |= 0x01;
+        }
+    } else if (rm->base != REGISTER_NONE) {
+        if (REGISTER_TO_MACHINE[rm->base] & 8) {
+            bits |= 0x01;
+        }
+
+        if (rm->index != REGISTER_NONE && (REGISTER_TO_MACHINE[rm->index] & 8)) {
+            bits |= 0x02;
+        }
+    }
+
+    return bits;
+}
+
+// the ModRM, with its SIB and displacement
+static void asm_elf_modrm_operand(AsmElf *elf, uint8_t reg, const AsmOperand *rm)
+{
+    const uint8_t reg_bits = (reg & 7) << 3;
+
+    if (rm->type == OPERAND_REGISTER) {
+        asm_elf_byte(elf, 0xc0 | reg_bits | (REGISTER_TO_MACHINE[rm->base] & 7));
+        return;
+    }
+
+    // a data section entry, or its address for lea
+    if (rm->base == REGISTER_NONE) {
+        asm_elf_byte(elf, reg_bits | 4);
+        asm_elf_byte(elf, 0x25);
+        asm_elf_fixup(elf, FIXUP_DATA, rm->value, rm->displacement);
+        return;
+    }
+
+    const uint8_t base = REGISTER_TO_MACHINE[rm->base] & 7;
+
+    uint8_t mod;
+    if (rm->displacement == 0 && base != 5) {
+        mod = 0x00;
+    } else if (rm->displacement >= INT8_MIN && rm->displacement <= INT8_MAX) {
+        mod = 0x40;
+    } else {
+        mod = 0x80;
+    }
+
+    if (rm->index != REGISTER_NONE || base == 4) {
+        const uint8_t index = rm->index == REGISTER_NONE ? 4 : REGISTER_TO_MACHINE[rm->index] & 7;
+
+        asm_elf_byte(elf, mod | reg_bits | 4);
+        asm_elf_byte(elf, (rm->scale << 6) | (index << 3) | base);
+    } else {
+        asm_elf_byte(elf, mod | reg_bits | base);
+    }
+
+    if (mod == 0x40) {
+        asm_elf_immediate(elf, rm->displacement, 1);
+    } else if (mod == 0x80) {
+        asm_elf_immediate(elf, rm->displacement, 4);
+    }
+}
+
+// Writes the prefixes, the opcode and the ModRM (with its SIB and
+// displacement) for an instruction with a reg field and an r/m operand.
+// `reg` is either a /digit or the machine number of a register operand.
+static void asm_elf_modrm(
+    AsmElf *elf,
+    const uint8_t *opcode,
+    size_t opcode_len,
+    AsmSize size,
+    bool rex_w,
+    uint8_t reg,
+    bool reg_is_register,
+    const AsmOperand *rm
+)
+{
+    uint8_t rex = 0x40 | asm_elf_rex_bits(reg, rm);
+    bool force_rex = reg_is_register && asm_elf_needs_rex(reg, size);
+
+    if (rex_w && size == SIZE_QWORD) {
+        rex |= 0x08;
+    }
+
+    if (rm->type == OPERAND_REGISTER) {
+        force_rex = force_rex || asm_elf_needs_rex(REGISTER_TO_MACHINE[rm->base], size);
+    }
+
+    if (size == SIZE_WORD) {
+        asm_elf_byte(elf, 0x66);
+    }
+
+    if (rex != 0x40 || force_rex) {
+        asm_elf_byte(elf, rex);
+    }
+
+    asm_elf_buffer_write(&elf->text, opcode, opcode_len);
+
+    asm_elf_modrm_operand(elf, reg, rm);
+}
+
+// An sse instruction, whose mandatory prefix (66 or F3) goes before
+// the rex prefix, then 0F and `opcode`, which can be longer.
+static void asm_elf_sse(AsmElf *elf, uint8_t prefix, const uint8_t *opcode, size_t opcode_len, bool rex_w, uint8_t reg, const AsmOperand *rm)
+{
+    uint8_t bytes[3] = { 0x0f };
+
+    for (size_t i = 0; i < opcode_len; ++i) {
+        bytes[i + 1] = opcode[i];
+    }
+
+    asm_elf_byte(elf, prefix);
+    asm_elf_modrm(elf, bytes, opcode_len + 1, rex_w ? SIZE_QWORD : SIZE_XMM, rex_w, reg, false, rm);
+}
+
+// The three byte vex prefix, then the opcode and the ModRM. `map` is 1
+// for 0F and 2 for 0F38, `prefix` is 1 for 66 and 2 for F3, and `source`
+// is the register that's read besides r/m, 0 if there isn't one.
+static void asm_elf_vex(
+    AsmElf *elf,
+    uint8_t map,
+    uint8_t prefix,
+    bool w,
+    uint8_t source,
+    AsmSize size,
+    uint8_t opcode,
+    uint8_t reg,
+    const AsmOperand *rm
+)
+{
+    const uint8_t bits = asm_elf_rex_bits(reg, rm);
+
+    asm_elf_byte(elf, 0xc4);
+    asm_elf_byte(elf, ((~bits & 7) << 5) | map);
+    asm_elf_byte(elf, (w ? 0x80 : 0) | ((~source & 15) << 3) | (size == SIZE_YMM ? 0x04 : 0) | prefix);
+    asm_elf_byte(elf, opcode);
+
+    asm_elf_modrm_operand(elf, reg, rm);
+}
+
+// the sse or avx2 form of a vector instruction
+static void asm_elf_vector(AsmElf *elf, const AsmInstruction *instruction)
+{
+    const AsmOperand *dst = &instruction->operands[0];
+    const AsmOperand *src = &instruction->operands[1];
+
+    const bool vex = elf->context->avx2;
+    const uint8_t machine = REGISTER_TO_MACHINE[dst->base];
+
+    switch (instruction->opcode) {
+        case ASM_MOVDQU: {
+            // a load, or a store with the register the other way round
+            const bool load = dst->type == OPERAND_REGISTER;
+
+            const uint8_t opcode = load ? 0x6f : 0x7f;
+            const AsmOperand *reg = load ? dst : src;
+            const AsmOperand *rm = load ? src : dst;
+
+            if (vex) {
+                asm_elf_vex(elf, 1, 2, false, 0, reg->size, opcode, REGISTER_TO_MACHINE[reg->base], rm);
+            } else {
+                asm_elf_sse(elf, 0xf3, &opcode, 1, false, REGISTER_TO_MACHINE[reg->base], rm);
+            }
+            break;
+        }
+
+        case ASM_MOVD:
+        case ASM_MOVQ: {
+            const uint8_t opcode = 0x6e;
+            const bool w = instruction->opcode == ASM_MOVQ;
+
+            if (vex) {
+                asm_elf_vex(elf, 1, 1, w, 0, SIZE_XMM, opcode, machine, src);
+            } else {
+                asm_elf_sse(elf, 0x66, &opcode, 1, w, machine, src);
+            }
+            break;
+        }
+
+        case ASM_PMULLD: {
+            const uint8_t opcode[] = { 0x38, 0x40 };
+
+            if (vex) {
+                asm_elf_vex(elf, 2, 1, false, machine, dst->size, opcode[1], machine, src);
+            } else {
+                asm_elf_sse(elf, 0x66, opcode, ARRAY_LEN(opcode), false, machine, src);
+            }
+            break;
+        }
+
+        case ASM_PBROADCASTD:
+        case ASM_PBROADCASTQ: {
+            if (!vex) {
+                UNREACHABLE();
+            }
+
+            const uint8_t opcode = instruction->opcode == ASM_PBROADCASTD ? 0x58 : 0x59;
+            asm_elf_vex(elf, 2, 1, false, 0, dst->size, opcode, machine, src);
+            break;
+        }
+
+        default: {
+            const uint8_t opcode = ASM_OPCODE_TO_PACKED[instruction->opcode];
+
+            if (vex) {
+                asm_elf_vex(elf, 1, 1, false, machine, dst->size, opcode, machine, src);
+            } else {
+                asm_elf_sse(elf, 0x66, &opcode, 1, false, machine, src);
+            }
+            break;
+        }
+    }
+}
+
+// an opcode of one byte, then the usual ModRM
+static void asm_elf_modrm1(AsmElf *elf, uint8_t opcode, AsmSize size, uint8_t reg, bool reg_is_register, const AsmOperand *rm)
+{
+    asm_elf_modrm(elf, &opcode, 1, size, true, reg, reg_is_register, rm);
+}
+
+// the address of something that isn't in the text yet, as an imm32
+static void asm_elf_address(AsmElf *elf, const AsmOperand *operand)
+{
+    if (operand->type == OPERAND_DATA) {
+        asm_elf_fixup(elf, FIXUP_DATA, operand->value, 0);
+    } else {
+        asm_elf_fixup(elf, FIXUP_SYMBOL_ADDRESS, operand->value, 0);
+    }
+}
+
+static bool asm_elf_is_address(const AsmOperand *operand)
+{
+    return operand->type == OPERAND_DATA || operand->type == OPERAND_SYMBOL;
+}
+
+static void asm_elf_mov(AsmElf *elf, const AsmOperand *dst, const AsmOperand *src)
+{
+    const AsmSize size = dst->size;
+
+    if (src->type == OPERAND_IMMEDIATE && dst->type == OPERAND_REGISTER) {
+        const uint8_t machine = REGISTER_TO_MACHINE[dst->base];
+
+        if (size == SIZE_QWORD && asm_elf_fits_int32(src->value, size) && asm_elf_signed(src->value, size) < 0) {
+            asm_elf_modrm1(elf, 0xc7, size, 0, false, dst);
+            asm_elf_immediate(elf, src->value, 4);
+            return;
+        }
+
+        // writing the 32 bit register clears the top half anyway
+        const bool wide = size == SIZE_QWORD && src->value > UINT32_MAX;
+
+        if (size == SIZE_WORD) {
+            asm_elf_byte(elf, 0x66);
+        }
+
+        if (wide || (machine & 8) || asm_elf_needs_rex(machine, size)) {
+            asm_elf_byte(elf, 0x40 | (wide ? 0x08 : 0) | (machine >> 3));
+        }
+
+        if (size == SIZE_BYTE) {
+            asm_elf_byte(elf, 0xb0 + (machine & 7));
+            asm_elf_immediate(elf, src->value, 1);
+        } else {
+            asm_elf_byte(elf, 0xb8 + (machine & 7));
+            asm_elf_immediate(elf, src->value, wide ? 8 : asm_elf_immediate_len(size));
+        }
+        return;
+    }
+
+    if (src->type == OPERAND_IMMEDIATE) {
+        if (size == SIZE_QWORD && !asm_elf_fits_int32(src->value, size)) {
+            UNREACHABLE();
+        }
+
+        asm_elf_modrm1(elf, size == SIZE_BYTE ? 0xc6 : 0xc7, size, 0, false, dst);
+        asm_elf_immediate(elf, src->value, asm_elf_immediate_len(size));
+        return;
+    }
+
+    if (asm_elf_is_address(src)) {
+        asm_elf_modrm1(elf, 0xc7, SIZE_QWORD, 0, false, dst);
+        asm_elf_address(elf, src);
+        return;
+    }
+
+    if (src->type == OPERAND_REGISTER) {
+        asm_elf_modrm1(elf, size == SIZE_BYTE ? 0x88 : 0x89, size, REGISTER_TO_MACHINE[src->base], true, dst);
+    } else {
+        asm_elf_modrm1(elf, size == SIZE_BYTE ? 0x8a : 0x8b, size, REGISTER_TO_MACHINE[dst->base], true, src);
+    }
+}
+
+static void asm_elf_arithmetic(AsmElf *elf, AsmOpcode opcode, const AsmOperand *dst, const AsmOperand *src)
+{
+    const AsmSize size = dst->size;
+    const uint8_t digit = ASM_OPCODE_TO_ARITHMETIC[opcode];
+
+    if (src->type == OPERAND_IMMEDIATE) {
+        if (size == SIZE_BYTE) {
+            asm_elf_modrm1(elf, 0x80, size, digit, false, dst);
+            asm_elf_immediate(elf, src->value, 1);
+        } else if (asm_elf_fits_int8(src->value, size)) {
+            asm_elf_modrm1(elf, 0x83, size, digit, false, dst);
+            asm_elf_immediate(elf, src->value, 1);
+        } else {
+            if (size == SIZE_QWORD && !asm_elf_fits_int32(src->value, size)) {
+                UNREACHABLE();
+            }
+
+            asm_elf_modrm1(elf, 0x81, size, digit, false, dst);
+            asm_elf_immediate(elf, src->value, asm_elf_immediate_len(size));
+        }
+        return;
+    }
+
+    if (asm_elf_is_address(src)) {
+        asm_elf_modrm1(elf, 0x81, SIZE_QWORD, digit, false, dst);
+        asm_elf_address(elf, src);
+        return;
+    }
+
+    const uint8_t base = digit * 8 + (size == SIZE_BYTE ? 0 : 1);
+
+    if (src->type == OPERAND_REGISTER) {
+        asm_elf_modrm1(elf, base, size, REGISTER_TO_MACHINE[src->base], true, dst);
+    } else {
+        asm_elf_modrm1(elf, base + 2, size, REGISTER_TO_MACHINE[dst->base], true, src);
+    }
+}
+
+static void asm_elf_test(AsmElf *elf, const AsmOperand *dst, const AsmOperand *src)
+{
+    const AsmSize size = dst->size;
+
+    if (src->type == OPERAND_IMMEDIATE) {
+        asm_elf_modrm1(elf, size == SIZE_BYTE ? 0xf6 : 0xf7, size, 0, false, dst);
+        asm_elf_immediate(elf, src->value, asm_elf_immediate_len(size));
+        return;
+    }
+
+    // test doesn't care which way round its operands are
+    const AsmOperand *reg = src->type == OPERAND_REGISTER ? src : dst;
+    const AsmOperand *rm = src->type == OPERAND_REGISTER ? dst : src;
+
+    asm_elf_modrm1(elf, size == SIZE_BYTE ? 0x84 : 0x85, size, REGISTER_TO_MACHINE[reg->base], true, rm);
+}
+
+static void asm_elf_branch(AsmElf *elf, const AsmOperand *target)
+{
+    if (target->type == OPERAND_LABEL) {
+        asm_elf_fixup(elf, FIXUP_LABEL, target->value, 0);
+    } else {
+        asm_elf_fixup(elf, FIXUP_SYMBOL, target->value, 0);
+    }
+}
+
+static void asm_elf_instruction(AsmElf *elf, const AsmInstruction *instruction)
+{
+    const AsmOperand *dst = &instruction->operands[0];
+    const AsmOperand *src = &instruction->operands[1];
+
+    switch (instruction->opcode) {
+        case ASM_LABEL: {
+            if (dst->type == OPERAND_LABEL) {
+                elf->label_offsets[dst->value] = elf->text.len;
+            } else {
+                elf->symbol_offsets[dst->value] = elf->text.len;
+            }
+            break;
+        }
+
+        case ASM_MOV: {
+            asm_elf_mov(elf, dst, src);
+            break;
+        }
+
+        case ASM_LEA: {
+            AsmOperand address = *src;
+
+            // the address of a data entry is also a memory operand's address
+            if (address.type == OPERAND_DATA) {
+                address = asm_operand_memory(REGISTER_NONE, REGISTER_NONE, 0, dst->size);
+                address.value = src->value;
+            }
+
+            asm_elf_modrm1(elf, 0x8d, dst->size, REGISTER_TO_MACHINE[dst->base], true, &address);
+            break;
+        }
+
+        case ASM_ADD:
+        case ASM_SUB:
+        case ASM_AND:
+        case ASM_XOR:
+        case ASM_CMP: {
+            asm_elf_arithmetic(elf, instruction->opcode, dst, src);
+            break;
+        }
+
+        case ASM_TEST: {
+            asm_elf_test(elf, dst, src);
+            break;
+        }
+
+        case ASM_IMUL: {
+            const uint8_t machine = REGISTER_TO_MACHINE[dst->base];
+
+            if (src->type != OPERAND_IMMEDIATE) {
+                const uint8_t opcode[] = { 0x0f, 0xaf };
+                asm_elf_modrm(elf, opcode, ARRAY_LEN(opcode), dst->size, true, machine, true, src);
+            } else if (asm_elf_fits_int8(src->value, dst->size)) {
+                asm_elf_modrm1(elf, 0x6b, dst->size, machine, true, dst);
+                asm_elf_immediate(elf, src->value, 1);
+            } else {
+                asm_elf_modrm1(elf, 0x69, dst->size, machine, true, dst);
+                asm_elf_immediate(elf, src->value, asm_elf_immediate_len(dst->size));
+            }
+            break;
+        }
+
+        case ASM_MOVSX: {
+            // movsxd, or movsx from a byte or a word
+            const uint8_t machine = REGISTER_TO_MACHINE[dst->base];
+
+            if (src->size == SIZE_DWORD) {
+                asm_elf_modrm1(elf, 0x63, SIZE_QWORD, machine, true, src);
+            } else {
+                const uint8_t opcode[] = { 0x0f, src->size == SIZE_BYTE ? 0xbe : 0xbf };
+                asm_elf_modrm(elf, opcode, ARRAY_LEN(opcode), SIZE_QWORD, true, machine, true, src);
+            }
+            break;
+        }
+
+        case ASM_CBW:
+        case ASM_CWD: {
+            asm_elf_byte(elf, 0x66);
+            asm_elf_byte(elf, instruction->opcode == ASM_CBW ? 0x98 : 0x99);
+            break;
+        }
+
+        case ASM_CDQ: {
+            asm_elf_byte(elf, 0x99);
+            break;
+        }
+
+        case ASM_CQO: {
+            asm_elf_byte(elf, 0x48);
+            asm_elf_byte(elf, 0x99);
+            break;
+        }
+
+        case ASM_SHL:
+        case ASM_SHR:
+        case ASM_SAR: {
+            asm_elf_modrm1(
+                elf,
+                dst->size == SIZE_BYTE ? 0xc0 : 0xc1,
+                dst->size,
+                ASM_OPCODE_TO_SHIFT[instruction->opcode],
+                false,
+                dst
+            );
+            asm_elf_immediate(elf, src->value, 1);
+            break;
+        }
+
+        case ASM_MUL:
+        case ASM_DIV:
+        case ASM_IMUL_WIDE:
+        case ASM_IDIV:
+        case ASM_NEG: {
+            asm_elf_modrm1(
+                elf,
+                dst->size == SIZE_BYTE ? 0xf6 : 0xf7,
+                dst->size,
+                ASM_OPCODE_TO_UNARY[instruction->opcode],
+                false,
+                dst
+            );
+            break;
+        }
+
+        case ASM_INC:
+        case ASM_DEC: {
+            asm_elf_modrm1(
+                elf,
+                dst->size == SIZE_BYTE ? 0xfe : 0xff,
+                dst->size,
+                instruction->opcode == ASM_INC ? 0 : 1,
+                false,
+                dst
+            );
+            break;
+        }
+
+        case ASM_SETZ:
+        case ASM_SETNZ:
+        case ASM_SETL:
+        case ASM_SETG:
+        case ASM_SETLE:
+        case ASM_SETGE: {
+            const uint8_t opcode[] = { 0x0f, 0x90 + ASM_OPCODE_TO_CONDITION[instruction->opcode] };
+            asm_elf_modrm(elf, opcode, ARRAY_LEN(opcode), SIZE_BYTE, false, 0, false, dst);
+            break;
+        }
+
+        case ASM_PUSH: {
+            if (dst->type == OPERAND_REGISTER) {
+                const uint8_t machine = REGISTER_TO_MACHINE[dst->base];
+
+                if (machine & 8) {
+                    asm_elf_byte(elf, 0x41);
+                }
+                asm_elf_byte(elf, 0x50 + (machine & 7));
+            } else if (dst->type == OPERAND_MEMORY) {
+                const uint8_t opcode = 0xff;
+                asm_elf_modrm(elf, &opcode, 1, SIZE_QWORD, false, 6, false, dst);
+            } else if (dst->type == OPERAND_IMMEDIATE) {
+                asm_elf_byte(elf, 0x68);
+                asm_elf_immediate(elf, dst->value, 4);
+            } else {
+                asm_elf_byte(elf, 0x68);
+                asm_elf_address(elf, dst);
+            }
+            break;
+        }
+
+        case ASM_POP: {
+            const uint8_t machine = REGISTER_TO_MACHINE[dst->base];
+
+            if (machine & 8) {
+                asm_elf_byte(elf, 0x41);
+            }
+            asm_elf_byte(elf, 0x58 + (machine & 7));
+            break;
+        }
+
+        case ASM_CALL: {
+            if (dst->type == OPERAND_SYMBOL) {
+                asm_elf_byte(elf, 0xe8);
+                asm_elf_branch(elf, dst);
+            } else {
+                const uint8_t opcode = 0xff;
+                asm_elf_modrm(elf, &opcode, 1, SIZE_QWORD, false, 2, false, dst);
+            }
+            break;
+        }
+
+        case ASM_RET: {
+            asm_elf_byte(elf, 0xc3);
+            break;
+        }
+
+        case ASM_ENTER: {
+            asm_elf_byte(elf, 0xc8);
+            asm_elf_immediate(elf, dst->value, 2);
+            asm_elf_immediate(elf, src->value, 1);
+            break;
+        }
+
+        case ASM_LEAVE: {
+            asm_elf_byte(elf, 0xc9);
+            break;
+        }
+
+        case ASM_SYSCALL: {
+            asm_elf_byte(elf, 0x0f);
+            asm_elf_byte(elf, 0x05);
+            break;
+        }
+
+        case ASM_JMP: {
+            asm_elf_byte(elf, 0xe9);
+            asm_elf_branch(elf, dst);
+            break;
+        }
+
+        case ASM_JZ:
+        case ASM_JNZ:
+        case ASM_JL:
+        case ASM_JG:
+        case ASM_JLE:
+        case ASM_JGE: {
+            asm_elf_byte(elf, 0x0f);
+            asm_elf_byte(elf, 0x80 + ASM_OPCODE_TO_CONDITION[instruction->opcode]);
+            asm_elf_branch(elf, dst);
+            break;
+        }
+
+        default: {
+            if (!asm_opcode_is_vector(instruction->opcode)) {
+                UNREACHABLE();
+            }
+
+            asm_elf_vector(elf, instruction);
+            break;
+        }
+    }
+}
+
+static uint64_t asm_elf_align(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static void asm_elf_patch(AsmElf *elf, size_t offset, uint32_t value)
+{
+    for (size_t i = 0; i < 4; ++i) {
+        elf->text.data[offset + i] = value >> (i * 8);
+    }
+}
+
+static void asm_elf_file_write(FILE *file, const void *data, size_t len)
+{
+    if (len > 0 && fwrite(data, 1, len, file) != len) {
+        ERROR("Could not write the output file.");
+    }
+}
+
+static size_t asm_elf_find_symbol(const AsmContext *context, const char *name)
+{
+    const size_t name_len = strlen(name);
+
+    for (size_t i = 0; i < context->symbols_len; ++i) {
+        const AsmSymbol *symbol = &context->symbols[i];
+
+        if (symbol->name_len == name_len && memcmp(symbol->name, name, name_len) == 0) {
+            return i;
+        }
+    }
+
+    UNREACHABLE();
+}
+
+static const char ASM_ELF_SECTION_NAMES[] = "\0.text\0.data\0.shstrtab";
+
+void asm_elf_write(const AsmContext *context, FILE *file)
+{
+    AsmElf elf = {
+        .context = context,
+
+        .text = asm_elf_buffer_new(4096),
+        .data = asm_elf_buffer_new(4096),
+
+        .fixups_len = 0,
+        .fixups_cap = 256
+    };
+
+    elf.fixups = malloc(sizeof(*elf.fixups) * elf.fixups_cap);
+
+    if (elf.fixups == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    // calloc so that there's always something to free
+    elf.label_offsets = calloc(context->label_count + 1, sizeof(*elf.label_offsets));
+    elf.symbol_offsets = calloc(context->symbols_len + 1, sizeof(*elf.symbol_offsets));
+    elf.data_offsets = calloc(context->data_section_len + 1, sizeof(*elf.data_offsets));
+
+    if (elf.label_offsets == NULL || elf.symbol_offsets == NULL || elf.data_offsets == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (size_t i = 0; i < context->instructions_len; ++i) {
+        asm_elf_instruction(&elf, &context->instructions[i]);
+    }
+
+    for (size_t i = 0; i < context->data_section_len; ++i) {
+        elf.data_offsets[i] = elf.data.len;
+        asm_elf_buffer_write(&elf.data, context->data_section[i].data, context->data_section[i].data_len);
+    }
+
+    // text right after the headers, data on the next page at the same offset within it
+    const size_t headers_size = sizeof(Elf64_Ehdr) + 2 * sizeof(Elf64_Phdr);
+
+    const uint64_t text_offset = headers_size;
+    const uint64_t text_address = ASM_ELF_BASE_ADDRESS + text_offset;
+
+    const uint64_t data_offset = text_offset + elf.text.len;
+    const uint64_t data_address = asm_elf_align(ASM_ELF_BASE_ADDRESS + data_offset, ASM_ELF_PAGE_SIZE)
+        + (data_offset & (ASM_ELF_PAGE_SIZE - 1));
+
+    const uint64_t names_offset = data_offset + elf.data.len;
+    const uint64_t sections_offset = asm_elf_align(names_offset + sizeof(ASM_ELF_SECTION_NAMES), 8);
+
+    for (size_t i = 0; i < elf.fixups_len; ++i) {
+        const AsmElfFixup *fixup = &elf.fixups[i];
+
+        // rel32 is from the end of the instruction, which is right after it
+        const int64_t next = fixup->offset + 4;
+
+        switch (fixup->type) {
+            case FIXUP_LABEL: {
+                asm_elf_patch(&elf, fixup->offset, elf.label_offsets[fixup->target] - next);
+                break;
+            }
+
+            case FIXUP_SYMBOL: {
+                asm_elf_patch(&elf, fixup->offset, elf.symbol_offsets[fixup->target] - next);
+                break;
+            }
+
+            case FIXUP_DATA: {
+                asm_elf_patch(&elf, fixup->offset, data_address + elf.data_offsets[fixup->target] + fixup->addend);
+                break;
+            }
+
+            case FIXUP_SYMBOL_ADDRESS: {
+                asm_elf_patch(&elf, fixup->offset, text_address + elf.symbol_offsets[fixup->target] + fixup->addend);
+                break;
+            }
+        }
+    }
+
+    const size_t start = asm_elf_find_symbol(context, "_start");
+
+    const Elf64_Ehdr header = {
+        .e_ident = {
+            ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3,
+            ELFCLASS64, ELFDATA2LSB, EV_CURRENT, ELFOSABI_SYSV
+        },
+        .e_type = ET_EXEC,
+        .e_machine = EM_X86_64,
+        .e_version = EV_CURRENT,
+        .e_entry = text_address + elf.symbol_offsets[start],
+        .e_phoff = sizeof(Elf64_Ehdr),
+        .e_shoff = sections_offset,
+        .e_ehsize = sizeof(Elf64_Ehdr),
+        .e_phentsize = sizeof(Elf64_Phdr),
+        .e_phnum = 2,
+        .e_shentsize = sizeof(Elf64_Shdr),
+        .e_shnum = 4,
+        .e_shstrndx = 3
+    };
+
+    const Elf64_Phdr segments[] = {
+        {
+            .p_type = PT_LOAD,
+            .p_flags = PF_R | PF_X,
+            .p_offset = 0,
+            .p_vaddr = ASM_ELF_BASE_ADDRESS,
+            .p_paddr = ASM_ELF_BASE_ADDRESS,
+            .p_filesz = data_offset,
+            .p_memsz = data_offset,
+            .p_align = ASM_ELF_PAGE_SIZE
+        },
+        {
+            .p_type = PT_LOAD,
+            .p_flags = PF_R | PF_W,
+            .p_offset = data_offset,
+            .p_vaddr = data_address,
+            .p_paddr = data_address,
+            .p_filesz = elf.data.len,
+            .p_memsz = elf.data.len,
+            .p_align = ASM_ELF_PAGE_SIZE
+        }
+    };
+
+    // only for objdump and friends, the loader just wants the segments
+    const Elf64_Shdr sections[] = {
+        { 0 },
+        {
+            .sh_name = 1,
+            .sh_type = SHT_PROGBITS,
+            .sh_flags = SHF_ALLOC | SHF_EXECINSTR,
+            .sh_addr = text_address,
+            .sh_offset = text_offset,
+            .sh_size = elf.text.len,
+            .sh_addralign = 1
+        },
+        {
+            .sh_name = 7,
+            .sh_type = SHT_PROGBITS,
+            .sh_flags = SHF_ALLOC | SHF_WRITE,
+            .sh_addr = data_address,
+            .sh_offset = data_offset,
+            .sh_size = elf.data.len,
+            .sh_addralign = 1
+        },
+        {
+            .sh_name = 13,
+            .sh_type = SHT_STRTAB,
+            .sh_offset = names_offset,
+            .sh_size = sizeof(ASM_ELF_SECTION_NAMES),
+            .sh_addralign = 1
+        }
+    };
+
+    const uint8_t padding[8] = { 0 };
+
+    asm_elf_file_write(file, &header, sizeof(header));
+    asm_elf_file_write(file, segments, sizeof(segments));
+    asm_elf_file_write(file, elf.text.data, elf.text.len);
+    asm_elf_file_write(file, elf.data.data, elf.data.len);
+    asm_elf_file_write(file, ASM_ELF_SECTION_NAMES, sizeof(ASM_ELF_SECTION_NAMES));
+    asm_elf_file_write(file, padding, sections_offset - names_offset - sizeof(ASM_ELF_SECTION_NAMES));
+    asm_elf_file_write(file, sections, sizeof(sections));
+
+    free(elf.label_offsets);
+    free(elf.symbol_offsets);
+    free(elf.data_offsets);
+    free(elf.fixups);
+    free(elf.data.data);
+    free(elf.text.data);
+}
@@ -0,0 +1,113 @@
+#ifndef ASM_ELF_H_
+#define ASM_ELF_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "asm_context.h"
+
+// where the executable is loaded, the text starts right after the headers
+#define ASM_ELF_BASE_ADDRESS 0x400000
+#define ASM_ELF_PAGE_SIZE    0x1000
+
+// the numbers the cpu uses for each register in ModRM, SIB and REX
+static const uint8_t REGISTER_TO_MACHINE[REGISTER_TYPES] = {
+    [REGISTER_RAX] = 0,
+    [REGISTER_RCX] = 1,
+    [REGISTER_RDX] = 2,
+    [REGISTER_RBX] = 3,
+    [REGISTER_RSP] = 4,
+    [REGISTER_RBP] = 5,
+    [REGISTER_RSI] = 6,
+    [REGISTER_RDI] = 7,
+    [REGISTER_R8]  = 8,
+    [REGISTER_R9]  = 9,
+    [REGISTER_R10] = 10,
+    [REGISTER_R11] = 11,
+    [REGISTER_R12] = 12,
+    [REGISTER_R13] = 13,
+    [REGISTER_R14] = 14,
+    [REGISTER_R15] = 15,
+
+    [REGISTER_XMM0]  = 0,
+    [REGISTER_XMM1]  = 1,
+    [REGISTER_XMM2]  = 2,
+    [REGISTER_XMM3]  = 3,
+    [REGISTER_XMM4]  = 4,
+    [REGISTER_XMM5]  = 5,
+    [REGISTER_XMM6]  = 6,
+    [REGISTER_XMM7]  = 7,
+    [REGISTER_XMM8]  = 8,
+    [REGISTER_XMM9]  = 9,
+    [REGISTER_XMM10] = 10,
+    [REGISTER_XMM11] = 11,
+    [REGISTER_XMM12] = 12,
+    [REGISTER_XMM13] = 13,
+    [REGISTER_XMM14] = 14,
+    [REGISTER_XMM15] = 15
+};
+
+// condition codes, added to the base of setcc and jcc
+static const uint8_t ASM_OPCODE_TO_CONDITION[ASM_OPCODES] = {
+    [ASM_SETZ]  = 0x4,
+    [ASM_SETNZ] = 0x5,
+    [ASM_SETL]  = 0xc,
+    [ASM_SETGE] = 0xd,
+    [ASM_SETLE] = 0xe,
+    [ASM_SETG]  = 0xf,
+
+    [ASM_JZ]    = 0x4,
+    [ASM_JNZ]   = 0x5,
+    [ASM_JL]    = 0xc,
+    [ASM_JGE]   = 0xd,
+    [ASM_JLE]   = 0xe,
+    [ASM_JG]    = 0xf
+};
+
+// the /digit of the immediate forms of the arithmetic instructions,
+// and opcode base of the register forms is eight times that
+static const uint8_t ASM_OPCODE_TO_ARITHMETIC[ASM_OPCODES] = {
+    [ASM_ADD] = 0,
+    [ASM_AND] = 4,
+    [ASM_SUB] = 5,
+    [ASM_XOR] = 6,
+    [ASM_CMP] = 7
+};
+
+// the /digit of the F6 and F7 group
+static const uint8_t ASM_OPCODE_TO_UNARY[ASM_OPCODES] = {
+    [ASM_TEST]      = 0,
+    [ASM_NEG]       = 3,
+    [ASM_MUL]       = 4,
+    [ASM_IMUL_WIDE] = 5,
+    [ASM_DIV]       = 6,
+    [ASM_IDIV]      = 7
+};
+
+// the /digit of the C0 and C1 group
+static const uint8_t ASM_OPCODE_TO_SHIFT[ASM_OPCODES] = {
+    [ASM_SHL] = 4,
+    [ASM_SHR] = 5,
+    [ASM_SAR] = 7
+};
+
+// the 66 0F opcode of the packed integer instructions,
+// which is the same one after a vex prefix
+static const uint8_t ASM_OPCODE_TO_PACKED[ASM_OPCODES] = {
+    [ASM_PADDB]      = 0xfc,
+    [ASM_PADDW]      = 0xfd,
+    [ASM_PADDD]      = 0xfe,
+    [ASM_PADDQ]      = 0xd4,
+    [ASM_PSUBB]      = 0xf8,
+    [ASM_PSUBW]      = 0xf9,
+    [ASM_PSUBD]      = 0xfa,
+    [ASM_PSUBQ]      = 0xfb,
+    [ASM_PMULLW]     = 0xd5,
+    [ASM_PUNPCKLDQ]  = 0x62,
+    [ASM_PUNPCKLQDQ] = 0x6c
+};
+
+// Encodes the context's program as x86-64 machine code and
+// writes it as a static ELF64 executable, without an assembler.
+void asm_elf_write(const AsmContext *context, FILE *file);
+
+#endif // ASM_ELF_H_
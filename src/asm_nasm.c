@@ -0,0 +1,160 @@
+#include "asm_nasm.h"
+#include "utils.h"
+
+// the immediate as a signed value of its size, so nasm doesn't warn about it
+static int64_t asm_nasm_signed(uint64_t value, AsmSize size)
+{
+    switch (size) {
+        case SIZE_BYTE:  return (int8_t) value;
+        case SIZE_WORD:  return (int16_t) value;
+        case SIZE_DWORD: return (int32_t) value;
+        case SIZE_QWORD: return (int64_t) value;
+        default: UNREACHABLE();
+    }
+}
+
+static void asm_nasm_operand(AsmWriter *writer, const AsmContext *context, const AsmOperand *operand)
+{
+    switch (operand->type) {
+        case OPERAND_NULL: {
+            UNREACHABLE();
+            break;
+        }
+
+        case OPERAND_REGISTER: {
+            asm_writer_string(writer, REGISTER_TO_STRING[operand->base][operand->size]);
+            break;
+        }
+
+        case OPERAND_MEMORY: {
+            asm_writer_string(writer, ASM_SIZE_TO_MEMORY[operand->size]);
+
+            if (operand->base == REGISTER_NONE) {
+                asm_writer_char(writer, 'D');
+                asm_writer_unsigned(writer, operand->value);
+                asm_writer_char(writer, ']');
+                break;
+            }
+
+            asm_writer_string(writer, REGISTER_TO_STRING[operand->base][SIZE_QWORD]);
+
+            if (operand->index != REGISTER_NONE) {
+                ASM_WRITER_LITERAL(writer, " + ");
+                asm_writer_string(writer, REGISTER_TO_STRING[operand->index][SIZE_QWORD]);
+
+                if (operand->scale > 0) {
+                    asm_writer_char(writer, '*');
+                    asm_writer_unsigned(writer, 1u << operand->scale);
+                }
+            }
+
+            if (operand->displacement > 0) {
+                ASM_WRITER_LITERAL(writer, " + ");
+                asm_writer_unsigned(writer, operand->displacement);
+            } else if (operand->displacement < 0) {
+                ASM_WRITER_LITERAL(writer, " - ");
+                asm_writer_unsigned(writer, -(int64_t) operand->displacement);
+            }
+
+            asm_writer_char(writer, ']');
+            break;
+        }
+
+        case OPERAND_IMMEDIATE: {
+            asm_writer_signed(writer, asm_nasm_signed(operand->value, operand->size));
+            break;
+        }
+
+        case OPERAND_DATA: {
+            asm_writer_char(writer, 'D');
+            asm_writer_unsigned(writer, operand->value);
+            break;
+        }
+
+        case OPERAND_LABEL: {
+            ASM_WRITER_LITERAL(writer, ".L");
+            asm_writer_unsigned(writer, operand->value);
+            break;
+        }
+
+        case OPERAND_SYMBOL: {
+            const AsmSymbol *symbol = &context->symbols[operand->value];
+            asm_writer_write(writer, symbol->name, symbol->name_len);
+            break;
+        }
+    }
+}
+
+void asm_nasm_write(const AsmContext *context, FILE *file)
+{
+    AsmWriter writer = asm_writer_new(file);
+
+    ASM_WRITER_LITERAL(
+        &writer,
+        "[BITS 64]\n"
+        "global _start\n"
+        "section .text\n"
+    );
+
+    for (size_t i = 0; i < context->instructions_len; ++i) {
+        const AsmInstruction *instruction = &context->instructions[i];
+
+        if (instruction->opcode == ASM_LABEL) {
+            asm_nasm_operand(&writer, context, &instruction->operands[0]);
+            ASM_WRITER_LITERAL(&writer, ":\n");
+            continue;
+        }
+
+        ASM_WRITER_LITERAL(&writer, "    ");
+
+        const bool vex = context->avx2 && asm_opcode_is_vector(instruction->opcode);
+
+        if (vex) {
+            asm_writer_char(&writer, 'v');
+        }
+
+        asm_writer_string(&writer, ASM_OPCODE_TO_STRING[instruction->opcode]);
+
+        // movsxd is its own mnemonic
+        if (instruction->opcode == ASM_MOVSX && instruction->operands[1].size == SIZE_DWORD) {
+            asm_writer_char(&writer, 'd');
+        }
+
+        // a call's other operand is only for the register allocator
+        const size_t operands_len = instruction->opcode == ASM_CALL || asm_instruction_is_tail_call(instruction)
+            ? 1
+            : instruction->operands_len;
+
+        for (size_t j = 0; j < operands_len; ++j) {
+            if (j == 0) {
+                asm_writer_char(&writer, ' ');
+            } else {
+                ASM_WRITER_LITERAL(&writer, ", ");
+            }
+
+            asm_nasm_operand(&writer, context, &instruction->operands[j]);
+
+            // the vex forms write somewhere other than what they read, which is the same here
+            if (j == 0 && vex && ASM_OPCODE_ACCESS[instruction->opcode][0] == (ACCESS_READ | ACCESS_WRITE)) {
+                ASM_WRITER_LITERAL(&writer, ", ");
+                asm_nasm_operand(&writer, context, &instruction->operands[0]);
+            }
+        }
+
+        asm_writer_char(&writer, '\n');
+    }
+
+    ASM_WRITER_LITERAL(&writer, "section .data\n");
+
+    for (size_t i = 0; i < context->data_section_len; ++i) {
+        const DataSectionThing *thing = &context->data_section[i];
+
+        asm_writer_char(&writer, 'D');
+        asm_writer_unsigned(&writer, i);
+        ASM_WRITER_LITERAL(&writer, ":\n");
+
+        asm_writer_bytes(&writer, thing->data, thing->data_len);
+    }
+
+    asm_writer_free(&writer);
+}
@@ -0,0 +1,126 @@
+#ifndef ASM_NASM_H_
+#define ASM_NASM_H_
+
+#include <stdio.h>
+#include "asm_context.h"
+#include "asm_writer.h"
+
+static const AsmString REGISTER_TO_STRING[REGISTER_TYPES][ASM_SIZES] = {
+    [REGISTER_RAX]   = { ASM_STRING("al"),   ASM_STRING("ax"),   ASM_STRING("eax"),  ASM_STRING("rax") },
+    [REGISTER_RBX]   = { ASM_STRING("bl"),   ASM_STRING("bx"),   ASM_STRING("ebx"),  ASM_STRING("rbx") },
+    [REGISTER_RCX]   = { ASM_STRING("cl"),   ASM_STRING("cx"),   ASM_STRING("ecx"),  ASM_STRING("rcx") },
+    [REGISTER_RDX]   = { ASM_STRING("dl"),   ASM_STRING("dx"),   ASM_STRING("edx"),  ASM_STRING("rdx") },
+    [REGISTER_RSI]   = { ASM_STRING("sil"),  ASM_STRING("si"),   ASM_STRING("esi"),  ASM_STRING("rsi") },
+    [REGISTER_RDI]   = { ASM_STRING("dil"),  ASM_STRING("di"),   ASM_STRING("edi"),  ASM_STRING("rdi") },
+    [REGISTER_R8]    = { ASM_STRING("r8b"),  ASM_STRING("r8w"),  ASM_STRING("r8d"),  ASM_STRING("r8")  },
+    [REGISTER_R9]    = { ASM_STRING("r9b"),  ASM_STRING("r9w"),  ASM_STRING("r9d"),  ASM_STRING("r9")  },
+    [REGISTER_R10]   = { ASM_STRING("r10b"), ASM_STRING("r10w"), ASM_STRING("r10d"), ASM_STRING("r10") },
+    [REGISTER_R11]   = { ASM_STRING("r11b"), ASM_STRING("r11w"), ASM_STRING("r11d"), ASM_STRING("r11") },
+    [REGISTER_R12]   = { ASM_STRING("r12b"), ASM_STRING("r12w"), ASM_STRING("r12d"), ASM_STRING("r12") },
+    [REGISTER_R13]   = { ASM_STRING("r13b"), ASM_STRING("r13w"), ASM_STRING("r13d"), ASM_STRING("r13") },
+    [REGISTER_R14]   = { ASM_STRING("r14b"), ASM_STRING("r14w"), ASM_STRING("r14d"), ASM_STRING("r14") },
+    [REGISTER_R15]   = { ASM_STRING("r15b"), ASM_STRING("r15w"), ASM_STRING("r15d"), ASM_STRING("r15") },
+    [REGISTER_RSP]   = { ASM_STRING("spl"),  ASM_STRING("sp"),   ASM_STRING("esp"),  ASM_STRING("rsp") },
+    [REGISTER_RBP]   = { ASM_STRING("bpl"),  ASM_STRING("bp"),   ASM_STRING("ebp"),  ASM_STRING("rbp") },
+
+    [REGISTER_XMM0]  = { [SIZE_XMM] = ASM_STRING("xmm0"),  [SIZE_YMM] = ASM_STRING("ymm0") },
+    [REGISTER_XMM1]  = { [SIZE_XMM] = ASM_STRING("xmm1"),  [SIZE_YMM] = ASM_STRING("ymm1") },
+    [REGISTER_XMM2]  = { [SIZE_XMM] = ASM_STRING("xmm2"),  [SIZE_YMM] = ASM_STRING("ymm2") },
+    [REGISTER_XMM3]  = { [SIZE_XMM] = ASM_STRING("xmm3"),  [SIZE_YMM] = ASM_STRING("ymm3") },
+    [REGISTER_XMM4]  = { [SIZE_XMM] = ASM_STRING("xmm4"),  [SIZE_YMM] = ASM_STRING("ymm4") },
+    [REGISTER_XMM5]  = { [SIZE_XMM] = ASM_STRING("xmm5"),  [SIZE_YMM] = ASM_STRING("ymm5") },
+    [REGISTER_XMM6]  = { [SIZE_XMM] = ASM_STRING("xmm6"),  [SIZE_YMM] = ASM_STRING("ymm6") },
+    [REGISTER_XMM7]  = { [SIZE_XMM] = ASM_STRING("xmm7"),  [SIZE_YMM] = ASM_STRING("ymm7") },
+    [REGISTER_XMM8]  = { [SIZE_XMM] = ASM_STRING("xmm8"),  [SIZE_YMM] = ASM_STRING("ymm8") },
+    [REGISTER_XMM9]  = { [SIZE_XMM] = ASM_STRING("xmm9"),  [SIZE_YMM] = ASM_STRING("ymm9") },
+    [REGISTER_XMM10] = { [SIZE_XMM] = ASM_STRING("xmm10"), [SIZE_YMM] = ASM_STRING("ymm10") },
+    [REGISTER_XMM11] = { [SIZE_XMM] = ASM_STRING("xmm11"), [SIZE_YMM] = ASM_STRING("ymm11") },
+    [REGISTER_XMM12] = { [SIZE_XMM] = ASM_STRING("xmm12"), [SIZE_YMM] = ASM_STRING("ymm12") },
+    [REGISTER_XMM13] = { [SIZE_XMM] = ASM_STRING("xmm13"), [SIZE_YMM] = ASM_STRING("ymm13") },
+    [REGISTER_XMM14] = { [SIZE_XMM] = ASM_STRING("xmm14"), [SIZE_YMM] = ASM_STRING("ymm14") },
+    [REGISTER_XMM15] = { [SIZE_XMM] = ASM_STRING("xmm15"), [SIZE_YMM] = ASM_STRING("ymm15") }
+};
+
+// the start of a memory operand of each size
+static const AsmString ASM_SIZE_TO_MEMORY[ASM_SIZES] = {
+    [SIZE_BYTE]  = ASM_STRING("BYTE ["),
+    [SIZE_WORD]  = ASM_STRING("WORD ["),
+    [SIZE_DWORD] = ASM_STRING("DWORD ["),
+    [SIZE_QWORD] = ASM_STRING("QWORD ["),
+    [SIZE_XMM]   = ASM_STRING("OWORD ["),
+    [SIZE_YMM]   = ASM_STRING("YWORD [")
+};
+
+static const AsmString ASM_OPCODE_TO_STRING[ASM_OPCODES] = {
+    [ASM_MOV]         = ASM_STRING("mov"),
+    [ASM_LEA]         = ASM_STRING("lea"),
+    [ASM_MOVSX]       = ASM_STRING("movsx"),
+    [ASM_ADD]         = ASM_STRING("add"),
+    [ASM_SUB]         = ASM_STRING("sub"),
+    [ASM_AND]         = ASM_STRING("and"),
+    [ASM_XOR]         = ASM_STRING("xor"),
+    [ASM_CMP]         = ASM_STRING("cmp"),
+    [ASM_TEST]        = ASM_STRING("test"),
+    [ASM_MUL]         = ASM_STRING("mul"),
+    [ASM_DIV]         = ASM_STRING("div"),
+    [ASM_IMUL]        = ASM_STRING("imul"),
+    [ASM_IMUL_WIDE]   = ASM_STRING("imul"),
+    [ASM_IDIV]        = ASM_STRING("idiv"),
+    [ASM_CBW]         = ASM_STRING("cbw"),
+    [ASM_CWD]         = ASM_STRING("cwd"),
+    [ASM_CDQ]         = ASM_STRING("cdq"),
+    [ASM_CQO]         = ASM_STRING("cqo"),
+    [ASM_SHL]         = ASM_STRING("shl"),
+    [ASM_SHR]         = ASM_STRING("shr"),
+    [ASM_SAR]         = ASM_STRING("sar"),
+    [ASM_NEG]         = ASM_STRING("neg"),
+    [ASM_INC]         = ASM_STRING("inc"),
+    [ASM_DEC]         = ASM_STRING("dec"),
+
+    [ASM_SETZ]        = ASM_STRING("setz"),
+    [ASM_SETNZ]       = ASM_STRING("setnz"),
+    [ASM_SETL]        = ASM_STRING("setl"),
+    [ASM_SETG]        = ASM_STRING("setg"),
+    [ASM_SETLE]       = ASM_STRING("setle"),
+    [ASM_SETGE]       = ASM_STRING("setge"),
+
+    // with a v in front of them for avx2
+    [ASM_MOVDQU]      = ASM_STRING("movdqu"),
+    [ASM_MOVD]        = ASM_STRING("movd"),
+    [ASM_MOVQ]        = ASM_STRING("movq"),
+    [ASM_PADDB]       = ASM_STRING("paddb"),
+    [ASM_PADDW]       = ASM_STRING("paddw"),
+    [ASM_PADDD]       = ASM_STRING("paddd"),
+    [ASM_PADDQ]       = ASM_STRING("paddq"),
+    [ASM_PSUBB]       = ASM_STRING("psubb"),
+    [ASM_PSUBW]       = ASM_STRING("psubw"),
+    [ASM_PSUBD]       = ASM_STRING("psubd"),
+    [ASM_PSUBQ]       = ASM_STRING("psubq"),
+    [ASM_PMULLW]      = ASM_STRING("pmullw"),
+    [ASM_PMULLD]      = ASM_STRING("pmulld"),
+    [ASM_PUNPCKLDQ]   = ASM_STRING("punpckldq"),
+    [ASM_PUNPCKLQDQ]  = ASM_STRING("punpcklqdq"),
+    [ASM_PBROADCASTD] = ASM_STRING("pbroadcastd"),
+    [ASM_PBROADCASTQ] = ASM_STRING("pbroadcastq"),
+
+    [ASM_PUSH]        = ASM_STRING("push"),
+    [ASM_POP]         = ASM_STRING("pop"),
+    [ASM_CALL]        = ASM_STRING("call"),
+    [ASM_RET]         = ASM_STRING("ret"),
+    [ASM_ENTER]       = ASM_STRING("enter"),
+    [ASM_LEAVE]       = ASM_STRING("leave"),
+    [ASM_SYSCALL]     = ASM_STRING("syscall"),
+
+    [ASM_JMP]         = ASM_STRING("jmp"),
+    [ASM_JZ]          = ASM_STRING("jz"),
+    [ASM_JNZ]         = ASM_STRING("jnz"),
+    [ASM_JL]          = ASM_STRING("jl"),
+    [ASM_JG]          = ASM_STRING("jg"),
+    [ASM_JLE]         = ASM_STRING("jle"),
+    [ASM_JGE]         = ASM_STRING("jge")
+};
+
+// writes the context's program as assembly for nasm
+void asm_nasm_write(const AsmContext *context, FILE *file);
+
+#endif // ASM_NASM_H_
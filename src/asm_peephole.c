@@ -0,0 +1,341 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include "asm_peephole.h"
+#include "utils.h"
+
+// a stack slot whose value is known to be somewhere else too
+typedef struct SlotCopy
+{
+    int32_t displacement;
+    AsmSize size;
+
+    // a register or an immediate
+    AsmOperand value;
+
+    // where it became known
+    size_t instruction;
+} SlotCopy;
+
+typedef struct Peephole
+{
+    AsmContext *context;
+    size_t window;
+
+    // indexed by instruction
+    bool *removed;
+
+    // never more than `window`, oldest first
+    size_t copies_len;
+    SlotCopy *copies;
+} Peephole;
+
+// [rbp + displacement], what the stack variables and spills are
+static bool peephole_is_slot(const AsmOperand *operand)
+{
+    return operand->type == OPERAND_MEMORY && operand->base == REGISTER_RBP && operand->index == REGISTER_NONE;
+}
+
+static bool peephole_is_register(const AsmOperand *operand, AsmRegister asm_register)
+{
+    return operand->type == OPERAND_REGISTER && operand->base == asm_register;
+}
+
+// anything after it could have been jumped to, or has
+// a different frame, or memory changed under it
+static bool peephole_is_barrier(AsmOpcode opcode)
+{
+    if (asm_opcode_is_jump(opcode)) {
+        return true;
+    }
+
+    switch (opcode) {
+        case ASM_LABEL:
+        case ASM_CALL:
+        case ASM_RET:
+        case ASM_ENTER:
+        case ASM_LEAVE:
+        case ASM_SYSCALL: {
+            return true;
+        }
+
+        default: {
+            return false;
+        }
+    }
+}
+
+static void peephole_forget(Peephole *peephole, size_t copy)
+{
+    for (size_t i = copy + 1; i < peephole->copies_len; ++i) {
+        peephole->copies[i - 1] = peephole->copies[i];
+    }
+
+    --peephole->copies_len;
+}
+
+static void peephole_forget_register(Peephole *peephole, AsmRegister asm_register)
+{
+    for (size_t i = peephole->copies_len; i-- > 0;) {
+        if (peephole_is_register(&peephole->copies[i].value, asm_register)) {
+            peephole_forget(peephole, i);
+        }
+    }
+}
+
+static void peephole_forget_slot(Peephole *peephole, const AsmOperand *slot)
+{
+    const int32_t start = slot->displacement;
+    const int32_t end = start + ASM_SIZE_TO_BYTES[slot->size];
+
+    for (size_t i = peephole->copies_len; i-- > 0;) {
+        const SlotCopy *copy = &peephole->copies[i];
+
+        if (copy->displacement < end && copy->displacement + ASM_SIZE_TO_BYTES[copy->size] > start) {
+            peephole_forget(peephole, i);
+        }
+    }
+}
+
+static void peephole_remember(Peephole *peephole, const AsmOperand *slot, AsmOperand value, size_t instruction)
+{
+    if (peephole->copies_len >= peephole->window) {
+        peephole_forget(peephole, 0);
+    }
+
+    peephole->copies[peephole->copies_len++] = (SlotCopy) {
+        .displacement = slot->displacement,
+        .size = slot->size,
+        .value = value,
+        .instruction = instruction
+    };
+}
+
+static const SlotCopy *peephole_find(const Peephole *peephole, const AsmOperand *slot, size_t instruction)
+{
+    for (size_t i = peephole->copies_len; i-- > 0;) {
+        const SlotCopy *copy = &peephole->copies[i];
+
+        if (instruction - copy->instruction > peephole->window) {
+            break;
+        }
+
+        if (copy->displacement == slot->displacement && copy->size == slot->size) {
+            return copy;
+        }
+    }
+
+    return NULL;
+}
+
+// the instructions whose source can be an immediate
+static bool peephole_takes_immediate(AsmOpcode opcode)
+{
+    switch (opcode) {
+        case ASM_MOV:
+        case ASM_ADD:
+        case ASM_SUB:
+        case ASM_AND:
+        case ASM_XOR:
+        case ASM_CMP:
+        case ASM_TEST: {
+            return true;
+        }
+
+        default: {
+            return false;
+        }
+    }
+}
+
+static void peephole_store_to_load(Peephole *peephole, AsmInstruction *instruction, size_t index)
+{
+    // push only takes whole registers
+    if (instruction->opcode == ASM_PUSH) {
+        return;
+    }
+
+    for (size_t i = 0; i < instruction->operands_len; ++i) {
+        AsmOperand *operand = &instruction->operands[i];
+
+        if (ASM_OPCODE_ACCESS[instruction->opcode][i] != ACCESS_READ || !peephole_is_slot(operand)) {
+            continue;
+        }
+
+        const SlotCopy *copy = peephole_find(peephole, operand, index);
+
+        if (copy == NULL) {
+            continue;
+        }
+
+        if (copy->value.type == OPERAND_IMMEDIATE && (i != 1 || !peephole_takes_immediate(instruction->opcode))) {
+            continue;
+        }
+
+        *operand = copy->value;
+        ++peephole->context->peephole_hits[PEEPHOLE_STORE_TO_LOAD];
+    }
+}
+
+// what the stack slots hold after the instruction
+static void peephole_update(Peephole *peephole, const AsmInstruction *instruction, size_t index)
+{
+    if (peephole_is_barrier(instruction->opcode)) {
+        peephole->copies_len = 0;
+        return;
+    }
+
+    const uint32_t implicit_writes = ASM_OPCODE_IMPLICIT_WRITES[instruction->opcode];
+
+    for (AsmRegister asm_register = 0; asm_register < REGISTER_TYPES; ++asm_register) {
+        if (implicit_writes & REGISTER_MASK(asm_register)) {
+            peephole_forget_register(peephole, asm_register);
+        }
+    }
+
+    for (size_t i = 0; i < instruction->operands_len; ++i) {
+        const AsmOperand *operand = &instruction->operands[i];
+
+        if (!(ASM_OPCODE_ACCESS[instruction->opcode][i] & ACCESS_WRITE)) {
+            continue;
+        }
+
+        if (operand->type == OPERAND_REGISTER) {
+            peephole_forget_register(peephole, operand->base);
+        } else if (peephole_is_slot(operand)) {
+            peephole_forget_slot(peephole, operand);
+        } else if (operand->type == OPERAND_MEMORY) {
+            // could be a pointer to any of them
+            peephole->copies_len = 0;
+        }
+    }
+
+    if (instruction->opcode != ASM_MOV) {
+        return;
+    }
+
+    const AsmOperand *dst = &instruction->operands[0];
+    const AsmOperand *src = &instruction->operands[1];
+
+    if (peephole_is_slot(dst) && (src->type == OPERAND_REGISTER || src->type == OPERAND_IMMEDIATE)) {
+        peephole_remember(peephole, dst, *src, index);
+    } else if (peephole_is_slot(src) && dst->type == OPERAND_REGISTER) {
+        peephole_remember(peephole, src, *dst, index);
+    }
+}
+
+static bool peephole_self_move(const AsmInstruction *instruction)
+{
+    const AsmOperand *dst = &instruction->operands[0];
+    const AsmOperand *src = &instruction->operands[1];
+
+    return (instruction->opcode == ASM_MOV || instruction->opcode == ASM_MOVDQU)
+        && dst->type == OPERAND_REGISTER
+        && peephole_is_register(src, dst->base)
+        && src->size == dst->size;
+}
+
+static bool peephole_redundant_test(const AsmInstruction *instruction, const AsmInstruction *previous)
+{
+    const AsmOperand *operand = &instruction->operands[0];
+
+    if (instruction->opcode != ASM_TEST
+     || operand->type != OPERAND_REGISTER
+     || !peephole_is_register(&instruction->operands[1], operand->base)) {
+        return false;
+    }
+
+    if (previous == NULL || (previous->opcode != ASM_AND && previous->opcode != ASM_XOR)) {
+        return false;
+    }
+
+    const AsmOperand *dst = &previous->operands[0];
+    const AsmOperand *src = &previous->operands[1];
+
+    if (!peephole_is_register(dst, operand->base)) {
+        return false;
+    }
+
+    if (dst->size == operand->size) {
+        return true;
+    }
+
+    // like the `and r, 255` after a setcc, which the sign
+    // bit of a smaller test can't see either
+    const uint64_t sign_bit = (uint64_t) 1 << (ASM_SIZE_TO_BYTES[operand->size] * 8 - 1);
+
+    return dst->size > operand->size
+        && previous->opcode == ASM_AND
+        && src->type == OPERAND_IMMEDIATE
+        && src->value < sign_bit;
+}
+
+void asm_peephole(AsmContext *context)
+{
+    if (context->peephole_window == 0) {
+        return;
+    }
+
+    Peephole peephole = {
+        .context = context,
+        .window = context->peephole_window,
+
+        .copies_len = 0
+    };
+
+    peephole.removed = calloc(context->instructions_len + 1, sizeof(*peephole.removed));
+    peephole.copies = malloc(sizeof(*peephole.copies) * peephole.window);
+
+    if (peephole.removed == NULL || peephole.copies == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    const AsmInstruction *previous = NULL;
+
+    for (size_t i = context->function_start; i < context->instructions_len; ++i) {
+        AsmInstruction *instruction = &context->instructions[i];
+
+        if (peephole.removed[i]) {
+            continue;
+        }
+
+        peephole_store_to_load(&peephole, instruction, i);
+
+        if (peephole_self_move(instruction)) {
+            peephole.removed[i] = true;
+            ++context->peephole_hits[PEEPHOLE_SELF_MOVE];
+            continue;
+        }
+
+        if (peephole_redundant_test(instruction, previous)) {
+            peephole.removed[i] = true;
+            ++context->peephole_hits[PEEPHOLE_REDUNDANT_TEST];
+            continue;
+        }
+
+        peephole_update(&peephole, instruction, i);
+
+        previous = instruction->opcode == ASM_LABEL ? NULL : instruction;
+    }
+
+    size_t len = context->function_start;
+
+    for (size_t i = context->function_start; i < context->instructions_len; ++i) {
+        if (peephole.removed[i]) {
+            continue;
+        }
+
+        context->instructions[len++] = context->instructions[i];
+    }
+
+    context->instructions_len = len;
+
+    free(peephole.removed);
+    free(peephole.copies);
+}
+
+void asm_peephole_print_stats(FILE *file, const AsmContext *context)
+{
+    for (size_t i = 0; i < PEEPHOLE_RULES; ++i) {
+        fprintf(file, "peephole: %-14s %10zu hits\n", PEEPHOLE_RULE_TO_STRING[i], context->peephole_hits[i]);
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef ASM_PEEPHOLE_H_
+#define ASM_PEEPHOLE_H_
+
+#include <stdio.h>
+#include "asm_context.h"
+
+static const char *const PEEPHOLE_RULE_TO_STRING[PEEPHOLE_RULES] = {
+    [PEEPHOLE_SELF_MOVE]       = "self move",
+    [PEEPHOLE_STORE_TO_LOAD]   = "store to load",
+    [PEEPHOLE_REDUNDANT_TEST]  = "redundant test"
+};
+
+// Cleans up the instructions of the function that's being added
+// to the context once they have real registers, looking
+// at most `peephole_window` instructions back or ahead:
+//
+// - self move: `mov r, r` is removed
+// - store to load: a read of a stack slot that was just stored to or
+//   loaded from reads the register or immediate that's in it instead
+// - redundant test: `test r, r` right after an `and` or `xor` of r,
+//   which already set the flags the same way
+//
+// Only address-taken locals and spills are in stack slots, so store to
+// load and redundant test mostly fire on the loads of a local that was
+// passed by address, see tests/peephole.oil.
+void asm_peephole(AsmContext *context);
+
+void asm_peephole_print_stats(FILE *file, const AsmContext *context);
+
+#endif // ASM_PEEPHOLE_H_
@@ -0,0 +1,941 @@
+#define _GNU_SOURCE // needed for qsort_r
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "asm_regalloc.h"
+#include "utils.h"
+
+#define POSITION_NONE UINT32_MAX
+#define LOOP_NONE     UINT32_MAX
+
+// Every instruction has two positions, reads happen at the
+// first one and writes at the second, so a value can take
+// over the register of one that dies in the same instruction.
+static inline uint32_t position_read(size_t instruction)
+{
+    return instruction * 2;
+}
+
+static inline uint32_t position_write(size_t instruction)
+{
+    return instruction * 2 + 1;
+}
+
+typedef struct Interval
+{
+    uint32_t start;
+    uint32_t end;
+
+    // uses weighted by loop depth, then divided by the length
+    float weight;
+
+    // REGISTER_NONE if it lives in `slot`
+    AsmRegister asm_register;
+    uint32_t slot;
+
+    // gets one of the VECTOR_REGISTERS, and never a slot
+    bool vector;
+} Interval;
+
+typedef struct Loop
+{
+    // from the label to the jump back to it
+    uint32_t start;
+    uint32_t end;
+
+    uint32_t parent;
+    uint32_t depth;
+} Loop;
+
+typedef struct Range
+{
+    uint32_t start;
+    uint32_t end;
+} Range;
+
+// where a register is used for itself, like rax around a mul
+typedef struct RangeList
+{
+    size_t len;
+    size_t cap;
+    Range *ranges;
+
+    uint32_t last_write;
+} RangeList;
+
+typedef struct RegAlloc
+{
+    AsmContext *context;
+
+    size_t intervals_len;
+    Interval *intervals;
+
+    // the live intervals by where they start
+    size_t order_len;
+    uint32_t *order;
+
+    size_t loops_len;
+    size_t loops_cap;
+    Loop *loops;
+
+    // the innermost loop around every instruction
+    uint32_t *loop_at;
+
+    RangeList fixed[REGISTER_TYPES];
+
+    size_t slots_len;
+} RegAlloc;
+
+static void range_list_add(RangeList *list, uint32_t start, uint32_t end)
+{
+    if (list->len > 0 && start <= list->ranges[list->len - 1].end + 1) {
+        Range *last = &list->ranges[list->len - 1];
+
+        if (end > last->end) {
+            last->end = end;
+        }
+        return;
+    }
+
+    if (list->len >= list->cap) {
+        list->cap = list->cap == 0 ? 16 : list->cap * 2;
+        list->ranges = realloc(list->ranges, sizeof(*list->ranges) * list->cap);
+
+        if (list->ranges == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    list->ranges[list->len++] = (Range) {
+        .start = start,
+        .end = end
+    };
+}
+
+static bool range_list_overlaps(const RangeList *list, uint32_t start, uint32_t end)
+{
+    // the first range that doesn't end before `start`
+    size_t low = 0;
+    size_t high = list->len;
+
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+
+        if (list->ranges[middle].end < start) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low < list->len && list->ranges[low].start <= end;
+}
+
+static bool regalloc_is_virtual(const AsmOperand *operand)
+{
+    return (operand->type == OPERAND_REGISTER || operand->type == OPERAND_MEMORY)
+        && operand->base == REGISTER_VIRTUAL;
+}
+
+// rsp and rbp are never handed out, so they don't need tracking
+static bool regalloc_is_fixed(AsmRegister asm_register)
+{
+    return asm_register < REGISTER_TYPES && asm_register != REGISTER_RSP && asm_register != REGISTER_RBP;
+}
+
+static int regalloc_compare_loops(const void *lhs, const void *rhs)
+{
+    const Loop *a = lhs;
+    const Loop *b = rhs;
+
+    // outer loops first when they start at the same place
+    if (a->start != b->start) {
+        return a->start < b->start ? -1 : 1;
+    }
+
+    return a->end > b->end ? -1 : a->end < b->end;
+}
+
+static void regalloc_find_loops(RegAlloc *regalloc)
+{
+    const AsmContext *context = regalloc->context;
+
+    size_t *label_positions = malloc(sizeof(*label_positions) * (context->label_count + 1));
+
+    if (label_positions == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (size_t i = context->function_start; i < context->instructions_len; ++i) {
+        const AsmInstruction *instruction = &context->instructions[i];
+
+        if (instruction->opcode == ASM_LABEL && instruction->operands[0].type == OPERAND_LABEL) {
+            label_positions[instruction->operands[0].value] = i;
+        }
+    }
+
+    // every jump backwards closes a loop
+    for (size_t i = context->function_start; i < context->instructions_len; ++i) {
+        const AsmInstruction *instruction = &context->instructions[i];
+
+        if (!asm_opcode_is_jump(instruction->opcode)) {
+            continue;
+        }
+
+        if (instruction->operands[0].type != OPERAND_LABEL) {
+            continue;
+        }
+
+        const size_t target = label_positions[instruction->operands[0].value];
+
+        if (target > i) {
+            continue;
+        }
+
+        if (regalloc->loops_len >= regalloc->loops_cap) {
+            regalloc->loops_cap *= 2;
+            regalloc->loops = realloc(regalloc->loops, sizeof(*regalloc->loops) * regalloc->loops_cap);
+
+            if (regalloc->loops == NULL) {
+                ALLOCATION_ERROR();
+            }
+        }
+
+        regalloc->loops[regalloc->loops_len++] = (Loop) {
+            .start = position_read(target),
+            .end = position_write(i)
+        };
+    }
+
+    free(label_positions);
+
+    qsort(regalloc->loops, regalloc->loops_len, sizeof(*regalloc->loops), regalloc_compare_loops);
+
+    // the loops nest, so one sweep with a stack of them finds the innermost ones
+    uint32_t top = LOOP_NONE;
+    size_t next = 0;
+
+    for (size_t i = context->function_start; i < context->instructions_len; ++i) {
+        while (top != LOOP_NONE && regalloc->loops[top].end < position_read(i)) {
+            top = regalloc->loops[top].parent;
+        }
+
+        while (next < regalloc->loops_len && regalloc->loops[next].start == position_read(i)) {
+            Loop *entered = &regalloc->loops[next];
+
+            entered->parent = top;
+            entered->depth = top == LOOP_NONE ? 1 : regalloc->loops[top].depth + 1;
+
+            top = next++;
+        }
+
+        regalloc->loop_at[i] = top;
+    }
+}
+
+static void regalloc_touch(RegAlloc *regalloc, size_t virtual_register, uint32_t position, float weight)
+{
+    Interval *interval = &regalloc->intervals[virtual_register];
+
+    if (interval->start == POSITION_NONE || position < interval->start) {
+        interval->start = position;
+    }
+
+    if (position > interval->end) {
+        interval->end = position;
+    }
+
+    interval->weight += weight;
+}
+
+static void regalloc_fixed_read(RegAlloc *regalloc, AsmRegister asm_register, uint32_t position)
+{
+    if (!regalloc_is_fixed(asm_register)) {
+        return;
+    }
+
+    RangeList *list = &regalloc->fixed[asm_register];
+
+    range_list_add(list, list->last_write == POSITION_NONE ? position : list->last_write, position);
+}
+
+static void regalloc_fixed_write(RegAlloc *regalloc, AsmRegister asm_register, uint32_t position)
+{
+    if (!regalloc_is_fixed(asm_register)) {
+        return;
+    }
+
+    RangeList *list = &regalloc->fixed[asm_register];
+
+    range_list_add(list, position, position);
+    list->last_write = position;
+}
+
+static void regalloc_scan_operand(RegAlloc *regalloc, const AsmOperand *operand, uint8_t access, size_t i, float weight)
+{
+    switch (operand->type) {
+        case OPERAND_REGISTER: {
+            if (operand->base == REGISTER_VIRTUAL) {
+                if (operand->size >= SIZE_XMM) {
+                    regalloc->intervals[operand->value].vector = true;
+                }
+                if (access & ACCESS_READ) {
+                    regalloc_touch(regalloc, operand->value, position_read(i), weight);
+                }
+                if (access & ACCESS_WRITE) {
+                    regalloc_touch(regalloc, operand->value, position_write(i), weight);
+                }
+            } else {
+                if (access & ACCESS_READ) {
+                    regalloc_fixed_read(regalloc, operand->base, position_read(i));
+                }
+                if (access & ACCESS_WRITE) {
+                    regalloc_fixed_write(regalloc, operand->base, position_write(i));
+                }
+            }
+            break;
+        }
+
+        case OPERAND_MEMORY: {
+            // whatever happens to the memory, the address is only read
+            if (operand->base == REGISTER_VIRTUAL) {
+                regalloc_touch(regalloc, operand->value, position_read(i), weight);
+            } else if (operand->base != REGISTER_NONE) {
+                regalloc_fixed_read(regalloc, operand->base, position_read(i));
+            }
+
+            if (operand->index != REGISTER_NONE && operand->index != REGISTER_VIRTUAL) {
+                regalloc_fixed_read(regalloc, operand->index, position_read(i));
+            }
+            break;
+        }
+
+        default: {
+            break;
+        }
+    }
+}
+
+// Works out the live intervals, and where the real registers
+// can't be used. Those are only ever live within a block,
+// so they don't need anything more than one pass.
+static void regalloc_scan(RegAlloc *regalloc)
+{
+    const AsmContext *context = regalloc->context;
+
+    float depth_weights[REGALLOC_MAX_LOOP_DEPTH + 1];
+    depth_weights[0] = 1.0f;
+
+    for (size_t i = 1; i <= REGALLOC_MAX_LOOP_DEPTH; ++i) {
+        depth_weights[i] = depth_weights[i - 1] * REGALLOC_LOOP_WEIGHT;
+    }
+
+    for (size_t i = context->function_start; i < context->instructions_len; ++i) {
+        const AsmInstruction *instruction = &context->instructions[i];
+
+        if (instruction->opcode == ASM_LABEL) {
+            for (size_t j = 0; j < REGISTER_TYPES; ++j) {
+                regalloc->fixed[j].last_write = POSITION_NONE;
+            }
+            continue;
+        }
+
+        const uint32_t innermost = regalloc->loop_at[i];
+        uint32_t depth = innermost == LOOP_NONE ? 0 : regalloc->loops[innermost].depth;
+
+        if (depth > REGALLOC_MAX_LOOP_DEPTH) {
+            depth = REGALLOC_MAX_LOOP_DEPTH;
+        }
+
+        for (size_t j = 0; j < instruction->operands_len; ++j) {
+            regalloc_scan_operand(
+                regalloc,
+                &instruction->operands[j],
+                ASM_OPCODE_ACCESS[instruction->opcode][j],
+                i,
+                depth_weights[depth]
+            );
+        }
+
+        for (size_t j = 0; j < REGISTER_TYPES; ++j) {
+            if (asm_instruction_implicit_reads(instruction) & REGISTER_MASK(j)) {
+                regalloc_fixed_read(regalloc, j, position_read(i));
+            }
+        }
+
+        for (size_t j = 0; j < REGISTER_TYPES; ++j) {
+            if (ASM_OPCODE_IMPLICIT_WRITES[instruction->opcode] & REGISTER_MASK(j)) {
+                regalloc_fixed_write(regalloc, j, position_write(i));
+            }
+        }
+    }
+}
+
+// A value that's live at the top of a loop is live all the way
+// around it, and so is one that's made inside a loop and used
+// after it, since the loop can be left from the condition.
+static void regalloc_extend(RegAlloc *regalloc, Interval *interval)
+{
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (uint32_t i = regalloc->loop_at[interval->start / 2]; i != LOOP_NONE; i = regalloc->loops[i].parent) {
+            const Loop *l = &regalloc->loops[i];
+
+            if (interval->end > l->end && interval->start > l->start) {
+                interval->start = l->start;
+                changed = true;
+            }
+        }
+
+        for (uint32_t i = regalloc->loop_at[interval->end / 2]; i != LOOP_NONE; i = regalloc->loops[i].parent) {
+            const Loop *l = &regalloc->loops[i];
+
+            if (interval->start < l->start && interval->end < l->end) {
+                interval->end = l->end;
+                changed = true;
+            }
+        }
+    }
+}
+
+static int regalloc_compare_starts(const void *lhs, const void *rhs, void *arg)
+{
+    const Interval *intervals = arg;
+
+    const Interval *a = &intervals[*(const uint32_t *) lhs];
+    const Interval *b = &intervals[*(const uint32_t *) rhs];
+
+    if (a->start != b->start) {
+        return a->start < b->start ? -1 : 1;
+    }
+
+    return (*(const uint32_t *) lhs > *(const uint32_t *) rhs) - (*(const uint32_t *) lhs < *(const uint32_t *) rhs);
+}
+
+static int regalloc_compare_ends(const void *lhs, const void *rhs, void *arg)
+{
+    const Interval *intervals = arg;
+
+    const Interval *a = &intervals[*(const uint32_t *) lhs];
+    const Interval *b = &intervals[*(const uint32_t *) rhs];
+
+    return (a->end > b->end) - (a->end < b->end);
+}
+
+static bool regalloc_register_fits(const RegAlloc *regalloc, AsmRegister asm_register, const Interval *interval)
+{
+    return !range_list_overlaps(&regalloc->fixed[asm_register], interval->start, interval->end);
+}
+
+static void regalloc_linear_scan(RegAlloc *regalloc)
+{
+    Interval *intervals = regalloc->intervals;
+
+    // indices into the intervals, at most one per register
+    uint32_t active[ARRAY_LEN(ALLOCATABLE_REGISTERS) + ARRAY_LEN(VECTOR_REGISTERS)];
+    size_t active_len = 0;
+
+    for (size_t i = 0; i < regalloc->order_len; ++i) {
+        Interval *current = &intervals[regalloc->order[i]];
+
+        for (size_t j = 0; j < active_len;) {
+            if (intervals[active[j]].end < current->start) {
+                active[j] = active[--active_len];
+            } else {
+                ++j;
+            }
+        }
+
+        uint32_t taken = 0;
+        for (size_t j = 0; j < active_len; ++j) {
+            taken |= REGISTER_MASK(intervals[active[j]].asm_register);
+        }
+
+        const AsmRegister *registers = current->vector ? VECTOR_REGISTERS : ALLOCATABLE_REGISTERS;
+        const size_t registers_len = current->vector ? ARRAY_LEN(VECTOR_REGISTERS) : ARRAY_LEN(ALLOCATABLE_REGISTERS);
+
+        for (size_t j = 0; j < registers_len; ++j) {
+            const AsmRegister asm_register = registers[j];
+
+            if (!(taken & REGISTER_MASK(asm_register)) && regalloc_register_fits(regalloc, asm_register, current)) {
+                current->asm_register = asm_register;
+                break;
+            }
+        }
+
+        if (current->asm_register != REGISTER_NONE) {
+            active[active_len++] = regalloc->order[i];
+            continue;
+        }
+
+        // the vectorizer never has more vectors live at once than there are registers
+        if (current->vector) {
+            UNREACHABLE();
+        }
+
+        // the cheapest value in a register this one could have
+        size_t victim = active_len;
+
+        for (size_t j = 0; j < active_len; ++j) {
+            const Interval *candidate = &intervals[active[j]];
+
+            if (candidate->vector || !regalloc_register_fits(regalloc, candidate->asm_register, current)) {
+                continue;
+            }
+
+            if (victim == active_len || candidate->weight < intervals[active[victim]].weight) {
+                victim = j;
+            }
+        }
+
+        if (victim < active_len && intervals[active[victim]].weight < current->weight) {
+            current->asm_register = intervals[active[victim]].asm_register;
+            intervals[active[victim]].asm_register = REGISTER_NONE;
+
+            active[victim] = regalloc->order[i];
+        }
+    }
+}
+
+// spilled intervals share slots when they don't overlap
+static void regalloc_assign_slots(RegAlloc *regalloc)
+{
+    Interval *intervals = regalloc->intervals;
+
+    size_t spilled_len = 0;
+    uint32_t *spilled = malloc(sizeof(*spilled) * (regalloc->order_len + 1));
+    uint32_t *by_end = malloc(sizeof(*by_end) * (regalloc->order_len + 1));
+    uint32_t *free_slots = malloc(sizeof(*free_slots) * (regalloc->order_len + 1));
+
+    if (spilled == NULL || by_end == NULL || free_slots == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (size_t i = 0; i < regalloc->order_len; ++i) {
+        if (intervals[regalloc->order[i]].asm_register == REGISTER_NONE) {
+            spilled[spilled_len++] = regalloc->order[i];
+        }
+    }
+
+    memcpy(by_end, spilled, sizeof(*spilled) * spilled_len);
+    qsort_r(by_end, spilled_len, sizeof(*by_end), regalloc_compare_ends, intervals);
+
+    size_t free_slots_len = 0;
+    size_t ended = 0;
+
+    for (size_t i = 0; i < spilled_len; ++i) {
+        Interval *interval = &intervals[spilled[i]];
+
+        while (ended < spilled_len && intervals[by_end[ended]].end < interval->start) {
+            free_slots[free_slots_len++] = intervals[by_end[ended++]].slot;
+        }
+
+        interval->slot = free_slots_len > 0 ? free_slots[--free_slots_len] : regalloc->slots_len++;
+    }
+
+    free(spilled);
+    free(by_end);
+    free(free_slots);
+}
+
+// below the locals' slots
+static AsmOperand regalloc_slot(const RegAlloc *regalloc, uint32_t slot, AsmSize size)
+{
+    const int32_t offset = (int32_t) regalloc->context->locals_size + 8 * ((int32_t) slot + 1);
+    return asm_operand_memory(REGISTER_RBP, REGISTER_NONE, -offset, size);
+}
+
+typedef struct Rewriter
+{
+    size_t instructions_len;
+    size_t instructions_cap;
+    AsmInstruction *instructions;
+
+    // the allocated intervals around the instruction being rewritten
+    size_t next;
+    size_t active_len;
+    uint32_t active[2 * (ARRAY_LEN(ALLOCATABLE_REGISTERS) + ARRAY_LEN(VECTOR_REGISTERS))];
+} Rewriter;
+
+static void rewriter_push(Rewriter *rewriter, AsmInstruction instruction)
+{
+    if (rewriter->instructions_len >= rewriter->instructions_cap) {
+        while (rewriter->instructions_len >= rewriter->instructions_cap) {
+            rewriter->instructions_cap *= 2;
+        }
+
+        rewriter->instructions = realloc(
+            rewriter->instructions,
+            sizeof(*rewriter->instructions) * rewriter->instructions_cap
+        );
+
+        if (rewriter->instructions == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    rewriter->instructions[rewriter->instructions_len++] = instruction;
+}
+
+static void rewriter_push2(Rewriter *rewriter, AsmOpcode opcode, AsmOperand dst, AsmOperand src)
+{
+    rewriter_push(rewriter, (AsmInstruction) {
+        .opcode = opcode,
+        .operands_len = 2,
+        .operands = { dst, src }
+    });
+}
+
+static void rewriter_push1(Rewriter *rewriter, AsmOpcode opcode, AsmOperand operand)
+{
+    rewriter_push(rewriter, (AsmInstruction) {
+        .opcode = opcode,
+        .operands_len = 1,
+        .operands = { operand }
+    });
+}
+
+// registers that can't be touched around instruction `i`
+static uint32_t rewriter_taken(const RegAlloc *regalloc, Rewriter *rewriter, const AsmInstruction *instruction, size_t i)
+{
+    const Interval *intervals = regalloc->intervals;
+
+    while (rewriter->next < regalloc->order_len && intervals[regalloc->order[rewriter->next]].start <= position_write(i)) {
+        const uint32_t index = regalloc->order[rewriter->next++];
+
+        if (intervals[index].asm_register != REGISTER_NONE && intervals[index].end >= position_read(i)) {
+            rewriter->active[rewriter->active_len++] = index;
+        }
+    }
+
+    uint32_t taken = REGISTER_MASK(REGISTER_RSP) | REGISTER_MASK(REGISTER_RBP)
+        | asm_instruction_implicit_reads(instruction) | ASM_OPCODE_IMPLICIT_WRITES[instruction->opcode];
+
+    for (size_t j = 0; j < rewriter->active_len;) {
+        const Interval *interval = &intervals[rewriter->active[j]];
+
+        if (interval->end < position_read(i)) {
+            rewriter->active[j] = rewriter->active[--rewriter->active_len];
+            continue;
+        }
+
+        taken |= REGISTER_MASK(interval->asm_register);
+        ++j;
+    }
+
+    for (size_t j = 0; j < REGISTER_TYPES; ++j) {
+        if (range_list_overlaps(&regalloc->fixed[j], position_read(i), position_write(i))) {
+            taken |= REGISTER_MASK(j);
+        }
+    }
+
+    for (size_t j = 0; j < instruction->operands_len; ++j) {
+        const AsmOperand *operand = &instruction->operands[j];
+
+        if (operand->type == OPERAND_REGISTER || operand->type == OPERAND_MEMORY) {
+            if (operand->base < REGISTER_TYPES) {
+                taken |= REGISTER_MASK(operand->base);
+            }
+            if (operand->index < REGISTER_TYPES) {
+                taken |= REGISTER_MASK(operand->index);
+            }
+        }
+    }
+
+    return taken;
+}
+
+// spilled values that an instruction can't take from memory go
+// through a register nothing else needs there, or one that gets
+// saved on the stack around it if they're all in use
+static void regalloc_rewrite_instruction(RegAlloc *regalloc, Rewriter *rewriter, size_t i)
+{
+    const Interval *intervals = regalloc->intervals;
+
+    AsmInstruction instruction = regalloc->context->instructions[i];
+
+    bool virtual = false;
+    for (size_t j = 0; j < instruction.operands_len; ++j) {
+        virtual = virtual || regalloc_is_virtual(&instruction.operands[j]);
+    }
+
+    if (!virtual) {
+        rewriter_push(rewriter, instruction);
+        return;
+    }
+
+    // spilled values used as they are, and spilled pointers
+    bool spilled[2] = { false, false };
+    bool spilled_address[2] = { false, false };
+    uint32_t slots[2];
+
+    for (size_t j = 0; j < instruction.operands_len; ++j) {
+        AsmOperand *operand = &instruction.operands[j];
+
+        if (!regalloc_is_virtual(operand)) {
+            continue;
+        }
+
+        const Interval *interval = &intervals[operand->value];
+
+        if (interval->asm_register != REGISTER_NONE) {
+            if (operand->index == REGISTER_VIRTUAL) {
+                operand->index = interval->asm_register;
+            }
+
+            operand->base = interval->asm_register;
+            operand->value = 0;
+            continue;
+        }
+
+        slots[j] = interval->slot;
+
+        if (operand->type == OPERAND_MEMORY) {
+            spilled_address[j] = true;
+        } else {
+            spilled[j] = true;
+            *operand = regalloc_slot(regalloc, interval->slot, operand->size);
+        }
+    }
+
+    // spilled values that have to be in a register after all
+    bool reload[2] = { false, false };
+
+    if (instruction.operands_len == 2) {
+        const AsmOperand *dst = &instruction.operands[0];
+        const AsmOperand *src = &instruction.operands[1];
+
+        if (dst->type == OPERAND_MEMORY && src->type == OPERAND_MEMORY) {
+            if (spilled[1]) {
+                reload[1] = true;
+            } else {
+                reload[0] = true;
+            }
+        }
+
+        if (spilled[0] && (instruction.opcode == ASM_LEA || instruction.opcode == ASM_IMUL || instruction.opcode == ASM_MOVSX)) {
+            reload[0] = true;
+        }
+
+        // only a register can take a 64 bit immediate
+        if (spilled[0] && src->type == OPERAND_IMMEDIATE && dst->size == SIZE_QWORD
+            && src->value > INT32_MAX && src->value < (uint64_t) INT32_MIN) {
+            reload[0] = true;
+        }
+    }
+
+    bool needs_register[2];
+    for (size_t j = 0; j < 2; ++j) {
+        needs_register[j] = reload[j] || spilled_address[j];
+    }
+
+    if (!needs_register[0] && !needs_register[1]) {
+        rewriter_push(rewriter, instruction);
+        return;
+    }
+
+    uint32_t taken = rewriter_taken(regalloc, rewriter, &instruction, i);
+
+    AsmRegister temporaries[2] = { REGISTER_NONE, REGISTER_NONE };
+    bool borrowed[2] = { false, false };
+
+    for (size_t j = 0; j < 2; ++j) {
+        if (!needs_register[j]) {
+            continue;
+        }
+
+        for (size_t k = 0; k < ARRAY_LEN(ALLOCATABLE_REGISTERS); ++k) {
+            if (!(taken & REGISTER_MASK(ALLOCATABLE_REGISTERS[k]))) {
+                temporaries[j] = ALLOCATABLE_REGISTERS[k];
+                break;
+            }
+        }
+
+        // everything's in use, so save one that the instruction doesn't use itself
+        if (temporaries[j] == REGISTER_NONE) {
+            uint32_t used = REGISTER_MASK(REGISTER_RSP) | REGISTER_MASK(REGISTER_RBP)
+                | asm_instruction_implicit_reads(&instruction) | ASM_OPCODE_IMPLICIT_WRITES[instruction.opcode];
+
+            for (size_t k = 0; k < instruction.operands_len; ++k) {
+                const AsmOperand *operand = &instruction.operands[k];
+
+                if ((operand->type == OPERAND_REGISTER || operand->type == OPERAND_MEMORY) && operand->base < REGISTER_TYPES) {
+                    used |= REGISTER_MASK(operand->base);
+                }
+            }
+
+            for (size_t k = 0; k < ARRAY_LEN(ALLOCATABLE_REGISTERS); ++k) {
+                if (!(used & REGISTER_MASK(ALLOCATABLE_REGISTERS[k])) && ALLOCATABLE_REGISTERS[k] != temporaries[0]) {
+                    temporaries[j] = ALLOCATABLE_REGISTERS[k];
+                    break;
+                }
+            }
+
+            borrowed[j] = true;
+            rewriter_push1(rewriter, ASM_PUSH, asm_operand_register(temporaries[j], SIZE_QWORD));
+        }
+
+        taken |= REGISTER_MASK(temporaries[j]);
+    }
+
+    const uint8_t *access = ASM_OPCODE_ACCESS[instruction.opcode];
+
+    for (size_t j = 0; j < 2; ++j) {
+        if (!needs_register[j]) {
+            continue;
+        }
+
+        AsmOperand *operand = &instruction.operands[j];
+        const AsmOperand temporary = asm_operand_register(temporaries[j], SIZE_QWORD);
+
+        if (spilled_address[j]) {
+            rewriter_push2(rewriter, ASM_MOV, temporary, regalloc_slot(regalloc, slots[j], SIZE_QWORD));
+
+            if (operand->index == REGISTER_VIRTUAL) {
+                operand->index = temporaries[j];
+            }
+
+            operand->base = temporaries[j];
+            operand->value = 0;
+            continue;
+        }
+
+        if (access[j] & ACCESS_READ) {
+            rewriter_push2(rewriter, ASM_MOV, temporary, regalloc_slot(regalloc, slots[j], SIZE_QWORD));
+        }
+
+        *operand = asm_operand_register(temporaries[j], operand->size);
+    }
+
+    rewriter_push(rewriter, instruction);
+
+    for (size_t j = 2; j-- > 0;) {
+        if (reload[j] && (access[j] & ACCESS_WRITE)) {
+            rewriter_push2(
+                rewriter,
+                ASM_MOV,
+                regalloc_slot(regalloc, slots[j], SIZE_QWORD),
+                asm_operand_register(temporaries[j], SIZE_QWORD)
+            );
+        }
+
+        if (borrowed[j]) {
+            rewriter_push1(rewriter, ASM_POP, asm_operand_register(temporaries[j], SIZE_QWORD));
+        }
+    }
+}
+
+static void regalloc_rewrite(RegAlloc *regalloc)
+{
+    AsmContext *context = regalloc->context;
+
+    Rewriter rewriter = {
+        .instructions_len = 0,
+        .instructions_cap = context->instructions_cap,
+
+        .next = 0,
+        .active_len = 0
+    };
+
+    rewriter.instructions = malloc(sizeof(*rewriter.instructions) * rewriter.instructions_cap);
+
+    if (rewriter.instructions == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    // the functions before this one are done already
+    memcpy(rewriter.instructions, context->instructions, sizeof(*context->instructions) * context->function_start);
+    rewriter.instructions_len = context->function_start;
+
+    for (size_t i = context->function_start; i < context->instructions_len; ++i) {
+        regalloc_rewrite_instruction(regalloc, &rewriter, i);
+    }
+
+    free(context->instructions);
+
+    context->instructions_len = rewriter.instructions_len;
+    context->instructions_cap = rewriter.instructions_cap;
+    context->instructions = rewriter.instructions;
+}
+
+void asm_regalloc(AsmContext *context)
+{
+    RegAlloc regalloc = {
+        .context = context,
+
+        .intervals_len = context->virtual_registers_len,
+
+        .order_len = 0,
+
+        .loops_len = 0,
+        .loops_cap = 16,
+
+        .slots_len = 0
+    };
+
+    regalloc.intervals = malloc(sizeof(*regalloc.intervals) * (regalloc.intervals_len + 1));
+    regalloc.order = malloc(sizeof(*regalloc.order) * (regalloc.intervals_len + 1));
+    regalloc.loops = malloc(sizeof(*regalloc.loops) * regalloc.loops_cap);
+    regalloc.loop_at = malloc(sizeof(*regalloc.loop_at) * (context->instructions_len + 1));
+
+    if (regalloc.intervals == NULL || regalloc.order == NULL || regalloc.loops == NULL || regalloc.loop_at == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (size_t i = 0; i < regalloc.intervals_len; ++i) {
+        regalloc.intervals[i] = (Interval) {
+            .start = POSITION_NONE,
+            .end = 0,
+            .weight = 0.0f,
+            .asm_register = REGISTER_NONE,
+            .slot = 0,
+            .vector = false
+        };
+    }
+
+    for (size_t i = 0; i < REGISTER_TYPES; ++i) {
+        regalloc.fixed[i] = (RangeList) {
+            .len = 0,
+            .cap = 0,
+            .ranges = NULL,
+            .last_write = POSITION_NONE
+        };
+    }
+
+    regalloc_find_loops(&regalloc);
+    regalloc_scan(&regalloc);
+
+    for (size_t i = 0; i < regalloc.intervals_len; ++i) {
+        Interval *interval = &regalloc.intervals[i];
+
+        if (interval->start == POSITION_NONE) {
+            continue;
+        }
+
+        regalloc_extend(&regalloc, interval);
+
+        interval->weight /= (float) (interval->end - interval->start + 1);
+        regalloc.order[regalloc.order_len++] = i;
+    }
+
+    qsort_r(regalloc.order, regalloc.order_len, sizeof(*regalloc.order), regalloc_compare_starts, regalloc.intervals);
+
+    regalloc_linear_scan(&regalloc);
+    regalloc_assign_slots(&regalloc);
+
+    context->spill_slots = regalloc.slots_len;
+
+    regalloc_rewrite(&regalloc);
+
+    for (size_t i = 0; i < REGISTER_TYPES; ++i) {
+        free(regalloc.fixed[i].ranges);
+    }
+
+    free(regalloc.intervals);
+    free(regalloc.order);
+    free(regalloc.loops);
+    free(regalloc.loop_at);
+}
@@ -0,0 +1,62 @@
+#ifndef ASM_REGALLOC_H_
+#define ASM_REGALLOC_H_
+
+#include "asm_context.h"
+
+// in the order they're handed out, so values
+// that don't live across a call leave the rest alone
+static const AsmRegister ALLOCATABLE_REGISTERS[] = {
+    REGISTER_RCX,
+    REGISTER_RSI,
+    REGISTER_RDI,
+    REGISTER_R8,
+    REGISTER_R9,
+    REGISTER_R10,
+    REGISTER_R11,
+    REGISTER_RDX,
+    REGISTER_RAX,
+
+    REGISTER_RBX,
+    REGISTER_R12,
+    REGISTER_R13,
+    REGISTER_R14,
+    REGISTER_R15
+};
+
+// for the vectors, all of which a call can change
+static const AsmRegister VECTOR_REGISTERS[] = {
+    REGISTER_XMM0,
+    REGISTER_XMM1,
+    REGISTER_XMM2,
+    REGISTER_XMM3,
+    REGISTER_XMM4,
+    REGISTER_XMM5,
+    REGISTER_XMM6,
+    REGISTER_XMM7,
+    REGISTER_XMM8,
+    REGISTER_XMM9,
+    REGISTER_XMM10,
+    REGISTER_XMM11,
+    REGISTER_XMM12,
+    REGISTER_XMM13,
+    REGISTER_XMM14,
+    REGISTER_XMM15
+};
+
+// how many times more a use counts for every loop it's in
+#define REGALLOC_LOOP_WEIGHT 10.0f
+
+// deeper loops than this all count the same
+#define REGALLOC_MAX_LOOP_DEPTH 8
+
+// Linear scan register allocation over the instructions of the
+// function that's being added to the context.
+// Every virtual register gets one live interval, stretched over any
+// loop it's live around. The intervals are handed registers in order
+// of where they start, and when there aren't enough the one with the
+// fewest uses per instruction (weighted by loop depth) goes to a stack
+// slot below rbp. Slots are reused once their interval has ended.
+// Vectors get the xmm registers instead, and never go to a slot.
+void asm_regalloc(AsmContext *context);
+
+#endif // ASM_REGALLOC_H_
@@ -0,0 +1,228 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include "asm_select.h"
+#include "utils.h"
+
+typedef struct AsmMagic
+{
+    uint64_t multiplier;
+    uint8_t shift;
+} AsmMagic;
+
+static uint8_t asm_select_bits(AsmData data)
+{
+    return ASM_SIZE_TO_BYTES[DATA_TYPE_TO_ASM_SIZE[data.data_type->type]] * 8;
+}
+
+// the constant as the signed value of its size
+static int64_t asm_select_constant(AsmData data)
+{
+    const uint8_t bits = asm_select_bits(data);
+
+    if (bits == 64) {
+        return (int64_t) data.constant;
+    }
+
+    const uint64_t sign = UINT64_C(1) << (bits - 1);
+    const uint64_t value = data.constant & ((UINT64_C(1) << bits) - 1);
+
+    return (int64_t) (value ^ sign) - (int64_t) sign;
+}
+
+static bool asm_select_is_power_of_two(uint64_t value)
+{
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+static uint8_t asm_select_log2(uint64_t value)
+{
+    uint8_t log = 0;
+
+    while (value > 1) {
+        value >>= 1;
+        ++log;
+    }
+
+    return log;
+}
+
+// Hacker's Delight, figure 10-1, at any number of bits,
+// for a divisor that isn't 0, 1, -1 or a power of two
+static AsmMagic asm_select_magic(int64_t divisor, uint8_t bits)
+{
+    const uint64_t mask = bits == 64 ? UINT64_MAX : (UINT64_C(1) << bits) - 1;
+    const uint64_t two = UINT64_C(1) << (bits - 1);
+
+    const uint64_t absolute = divisor < 0 ? -(uint64_t) divisor : (uint64_t) divisor;
+    const uint64_t t = two + (divisor < 0);
+    const uint64_t absolute_nc = t - 1 - t % absolute;
+
+    uint8_t p = bits - 1;
+
+    uint64_t q1 = two / absolute_nc;
+    uint64_t r1 = two - q1 * absolute_nc;
+    uint64_t q2 = two / absolute;
+    uint64_t r2 = two - q2 * absolute;
+    uint64_t delta;
+
+    // the remainders wrap around at `bits` on purpose
+    do {
+        ++p;
+
+        q1 = (q1 * 2) & mask;
+        r1 = (r1 * 2) & mask;
+
+        if (r1 >= absolute_nc) {
+            q1 = (q1 + 1) & mask;
+            r1 = (r1 - absolute_nc) & mask;
+        }
+
+        q2 = (q2 * 2) & mask;
+        r2 = (r2 * 2) & mask;
+
+        if (r2 >= absolute) {
+            q2 = (q2 + 1) & mask;
+            r2 = (r2 - absolute) & mask;
+        }
+
+        delta = (absolute - r2) & mask;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    AsmMagic magic = {
+        .multiplier = (q2 + 1) & mask,
+        .shift = p - bits
+    };
+
+    if (divisor < 0) {
+        magic.multiplier = -magic.multiplier & mask;
+    }
+
+    return magic;
+}
+
+void asm_select_mul(AsmContext *context, AsmData dst, AsmData src)
+{
+    if (src.storage != STORAGE_CONSTANT) {
+        asm_context_mul(context, dst, src);
+        return;
+    }
+
+    const int64_t constant = asm_select_constant(src);
+    const uint64_t absolute = constant < 0 ? -(uint64_t) constant : (uint64_t) constant;
+
+    if (constant == 0) {
+        asm_context_mov_constant(context, dst, 0);
+        return;
+    }
+
+    if (asm_select_is_power_of_two(absolute)) {
+        if (absolute > 1) {
+            asm_context_shift(context, ASM_SHL, dst, asm_select_log2(absolute));
+        }
+
+        if (constant < 0) {
+            asm_context_negate(context, dst);
+        }
+        return;
+    }
+
+    // lea dst, [dst + dst * (constant - 1)], which is never a byte
+    if ((constant == 3 || constant == 5 || constant == 9) && dst.storage == STORAGE_VIRTUAL && !dst.auto_deref) {
+        AsmOperand result = asm_context_operand(context, dst);
+
+        if (result.size == SIZE_BYTE) {
+            result.size = SIZE_DWORD;
+        }
+
+        AsmOperand address = asm_operand_memory(REGISTER_VIRTUAL, REGISTER_VIRTUAL, 0, SIZE_QWORD);
+        address.value = result.value;
+        address.scale = asm_select_log2(constant - 1);
+
+        asm_context_instruction(context, ASM_LEA, 2, (AsmOperand[]) { result, address });
+        return;
+    }
+
+    asm_context_mul(context, dst, src);
+}
+
+// adds 2^shift - 1 to a negative dividend first,
+// so the shift rounds towards zero like idiv does
+static void asm_select_div_power_of_two(AsmContext *context, AsmData dst, uint8_t shift)
+{
+    const uint8_t bits = asm_select_bits(dst);
+
+    AsmData bias = asm_context_data_alloc(context, dst.data_type);
+
+    asm_context_mov(context, bias, dst);
+    asm_context_shift(context, ASM_SAR, bias, bits - 1);
+    asm_context_shift(context, ASM_SHR, bias, bits - shift);
+    asm_context_add(context, dst, bias);
+    asm_context_shift(context, ASM_SAR, dst, shift);
+}
+
+// the top half of dividend * multiplier, corrected and shifted, then
+// plus one if that's negative
+static void asm_select_div_magic(AsmContext *context, AsmData dst, int64_t divisor)
+{
+    const uint8_t bits = asm_select_bits(dst);
+    const AsmMagic magic = asm_select_magic(divisor, bits);
+    const bool negative = (magic.multiplier >> (bits - 1)) & 1;
+
+    const AsmData rax = asm_data_register(REGISTER_RAX, dst.data_type);
+    const AsmData rdx = asm_data_register(REGISTER_RDX, dst.data_type);
+
+    asm_context_mov_constant(context, rax, magic.multiplier);
+    asm_context_instruction(context, ASM_IMUL_WIDE, 1, (AsmOperand[]) { asm_context_operand(context, dst) });
+
+    if (divisor > 0 && negative) {
+        asm_context_add(context, rdx, dst);
+    } else if (divisor < 0 && !negative) {
+        asm_context_sub(context, rdx, dst);
+    }
+
+    if (magic.shift > 0) {
+        asm_context_shift(context, ASM_SAR, rdx, magic.shift);
+    }
+
+    asm_context_mov(context, dst, rdx);
+    asm_context_shift(context, ASM_SHR, rdx, bits - 1);
+    asm_context_add(context, dst, rdx);
+}
+
+void asm_select_div(AsmContext *context, AsmData dst, AsmData src)
+{
+    if (src.storage != STORAGE_CONSTANT) {
+        asm_context_div(context, dst, src);
+        return;
+    }
+
+    const int64_t constant = asm_select_constant(src);
+    const uint64_t absolute = constant < 0 ? -(uint64_t) constant : (uint64_t) constant;
+    const uint8_t bits = asm_select_bits(dst);
+
+    // dividing by zero faults the same as it would have, and so does
+    // dividing the smallest value by -1, which neg would wrap instead
+    if (constant == 0 || constant == -1) {
+        asm_context_div(context, dst, src);
+        return;
+    }
+
+    if (asm_select_is_power_of_two(absolute)) {
+        if (absolute > 1) {
+            asm_select_div_power_of_two(context, dst, asm_select_log2(absolute));
+        }
+
+        if (constant < 0) {
+            asm_context_negate(context, dst);
+        }
+        return;
+    }
+
+    // there's no good way to get at the top half of a byte or word product
+    if (bits < 32) {
+        asm_context_div(context, dst, src);
+        return;
+    }
+
+    asm_select_div_magic(context, dst, constant);
+}
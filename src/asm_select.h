@@ -0,0 +1,17 @@
+#ifndef ASM_SELECT_H_
+#define ASM_SELECT_H_
+
+#include "asm_context.h"
+
+// dst *= src, with a constant src turned into something cheaper than
+// imul where there is something: nothing, a neg, a shift, or an lea
+// for 3, 5 and 9
+void asm_select_mul(AsmContext *context, AsmData dst, AsmData src);
+
+// dst /= src, rounding towards zero. A power of two is a shift with
+// the rounding fixed up for negative numbers, and any other constant
+// in 32 or 64 bits is a multiplication by its "magic number" from
+// Hacker's Delight, chapter 10, instead of an idiv.
+void asm_select_div(AsmContext *context, AsmData dst, AsmData src);
+
+#endif // ASM_SELECT_H_
@@ -0,0 +1,177 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include "asm_writer.h"
+#include "utils.h"
+
+// runs of one byte at least this long are written with `times`
+#define ASM_WRITER_MIN_RUN 16
+
+// data bytes per `db` line, so huge strings don't make huge lines
+#define ASM_WRITER_LINE_BYTES 1024
+
+static const char DIGIT_PAIRS[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char HEX_DIGITS[16] = "0123456789abcdef";
+
+AsmWriter asm_writer_new(FILE *file)
+{
+    AsmWriter writer = {
+        .file = file,
+        .len  = 0
+    };
+
+    writer.buffer = malloc(ASM_WRITER_BUFFER_SIZE);
+
+    if (writer.buffer == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    return writer;
+}
+
+void asm_writer_write_file(AsmWriter *writer, const char *data, size_t data_len)
+{
+    if (data_len > 0 && fwrite(data, 1, data_len, writer->file) != data_len) {
+        ERROR("Could not write the output file.");
+    }
+}
+
+void asm_writer_flush(AsmWriter *writer)
+{
+    asm_writer_write_file(writer, writer->buffer, writer->len);
+
+    writer->len = 0;
+}
+
+void asm_writer_unsigned(AsmWriter *writer, uint64_t value)
+{
+    // written backwards, two digits at a time
+    char digits[20];
+    size_t start = sizeof(digits);
+
+    while (value >= 100) {
+        const size_t pair = (value % 100) * 2;
+        value /= 100;
+
+        digits[--start] = DIGIT_PAIRS[pair + 1];
+        digits[--start] = DIGIT_PAIRS[pair];
+    }
+
+    if (value >= 10) {
+        digits[--start] = DIGIT_PAIRS[value * 2 + 1];
+        digits[--start] = DIGIT_PAIRS[value * 2];
+    } else {
+        digits[--start] = '0' + value;
+    }
+
+    asm_writer_write(writer, digits + start, sizeof(digits) - start);
+}
+
+void asm_writer_signed(AsmWriter *writer, int64_t value)
+{
+    if (value < 0) {
+        asm_writer_char(writer, '-');
+        asm_writer_unsigned(writer, -(uint64_t) value);
+    } else {
+        asm_writer_unsigned(writer, value);
+    }
+}
+
+void asm_writer_hex_byte(AsmWriter *writer, uint8_t byte)
+{
+    const char hex[4] = { '0', 'x', HEX_DIGITS[byte >> 4], HEX_DIGITS[byte & 0xf] };
+
+    asm_writer_write(writer, hex, sizeof(hex));
+}
+
+// anything that can go between single quotes, which nasm doesn't escape
+static inline bool asm_writer_is_quotable(uint8_t byte)
+{
+    return byte >= ' ' && byte <= '~' && byte != '\'';
+}
+
+void asm_writer_bytes(AsmWriter *writer, const char *data, size_t data_len)
+{
+    // bytes on the `db` line being written, 0 if there isn't one
+    size_t line_bytes = 0;
+
+    size_t i = 0;
+
+    while (i < data_len) {
+        const uint8_t byte = data[i];
+
+        size_t run = 1;
+        while (i + run < data_len && (uint8_t) data[i + run] == byte) {
+            ++run;
+        }
+
+        if (run >= ASM_WRITER_MIN_RUN) {
+            if (line_bytes > 0) {
+                asm_writer_char(writer, '\n');
+                line_bytes = 0;
+            }
+
+            ASM_WRITER_LITERAL(writer, "    times ");
+            asm_writer_unsigned(writer, run);
+            ASM_WRITER_LITERAL(writer, " db ");
+            asm_writer_hex_byte(writer, byte);
+            asm_writer_char(writer, '\n');
+
+            i += run;
+            continue;
+        }
+
+        if (line_bytes == 0) {
+            ASM_WRITER_LITERAL(writer, "    db ");
+        } else {
+            ASM_WRITER_LITERAL(writer, ", ");
+        }
+
+        if (asm_writer_is_quotable(byte)) {
+            size_t len = 1;
+            while (i + len < data_len
+                && line_bytes + len < ASM_WRITER_LINE_BYTES
+                && asm_writer_is_quotable(data[i + len])) {
+                ++len;
+            }
+
+            asm_writer_char(writer, '\'');
+            asm_writer_write(writer, data + i, len);
+            asm_writer_char(writer, '\'');
+
+            i += len;
+            line_bytes += len;
+        } else {
+            asm_writer_hex_byte(writer, byte);
+
+            ++i;
+            ++line_bytes;
+        }
+
+        if (line_bytes >= ASM_WRITER_LINE_BYTES) {
+            asm_writer_char(writer, '\n');
+            line_bytes = 0;
+        }
+    }
+
+    if (line_bytes > 0) {
+        asm_writer_char(writer, '\n');
+    }
+}
+
+void asm_writer_free(AsmWriter *writer)
+{
+    asm_writer_flush(writer);
+
+    free(writer->buffer);
+}
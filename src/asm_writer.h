@@ -0,0 +1,80 @@
+#ifndef ASM_WRITER_H_
+#define ASM_WRITER_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// flushed to the file whenever it fills up
+#define ASM_WRITER_BUFFER_SIZE (256 * 1024)
+
+// A string with its length worked out at compile time,
+// for the mnemonics, registers and operand sizes.
+typedef struct AsmString
+{
+    const char *text;
+    size_t len;
+} AsmString;
+
+#define ASM_STRING(_text) ((AsmString) { .text = (_text), .len = sizeof(_text) - 1 })
+
+// Buffers the assembly in memory and writes it out in big blocks,
+// formatting numbers by hand instead of going through printf.
+typedef struct AsmWriter
+{
+    FILE *file;
+
+    size_t len;
+    char *buffer;
+} AsmWriter;
+
+AsmWriter asm_writer_new(FILE *file);
+
+void asm_writer_flush(AsmWriter *writer);
+
+// straight to the file, for what doesn't fit in the buffer
+void asm_writer_write_file(AsmWriter *writer, const char *data, size_t data_len);
+
+void asm_writer_unsigned(AsmWriter *writer, uint64_t value);
+void asm_writer_signed(AsmWriter *writer, int64_t value);
+void asm_writer_hex_byte(AsmWriter *writer, uint8_t byte);
+
+// writes `data` as the operands of `db` lines, with the printable
+// parts quoted and long runs of one byte as `times`
+void asm_writer_bytes(AsmWriter *writer, const char *data, size_t data_len);
+
+void asm_writer_free(AsmWriter *writer);
+
+static inline void asm_writer_write(AsmWriter *writer, const char *text, size_t len)
+{
+    if (writer->len + len > ASM_WRITER_BUFFER_SIZE) {
+        asm_writer_flush(writer);
+
+        if (len > ASM_WRITER_BUFFER_SIZE) {
+            asm_writer_write_file(writer, text, len);
+            return;
+        }
+    }
+
+    memcpy(writer->buffer + writer->len, text, len);
+    writer->len += len;
+}
+
+static inline void asm_writer_string(AsmWriter *writer, AsmString string)
+{
+    asm_writer_write(writer, string.text, string.len);
+}
+
+static inline void asm_writer_char(AsmWriter *writer, char c)
+{
+    if (writer->len >= ASM_WRITER_BUFFER_SIZE) {
+        asm_writer_flush(writer);
+    }
+
+    writer->buffer[writer->len++] = c;
+}
+
+#define ASM_WRITER_LITERAL(_writer, _text) asm_writer_write((_writer), (_text), sizeof(_text) - 1)
+
+#endif // ASM_WRITER_H_
@@ -3,49 +3,144 @@
 #include "ast.h"
 #include "utils.h"
 
-AST *ast_alloc(void)
+AST ast_new(const TokenBuffer *token_buffer)
 {
-    AST *ast = malloc(sizeof(AST));
-
-    if (ast == NULL) {
+    AST ast = {
+        .token_buffer = token_buffer,
+        .root = AST_NULL,
+
+        .len = 0,
+        .cap = 256,
+
+        .extra_len = 0,
+        .extra_cap = 256
+    };
+
+    ast.types      = malloc(sizeof(*ast.types) * ast.cap);
+    ast.tokens     = malloc(sizeof(*ast.tokens) * ast.cap);
+    ast.lhs        = malloc(sizeof(*ast.lhs) * ast.cap);
+    ast.rhs        = malloc(sizeof(*ast.rhs) * ast.cap);
+    ast.data_types = malloc(sizeof(*ast.data_types) * ast.cap);
+    ast.extra      = malloc(sizeof(*ast.extra) * ast.extra_cap);
+
+    if (ast.types == NULL || ast.tokens == NULL || ast.lhs == NULL
+     || ast.rhs == NULL || ast.data_types == NULL || ast.extra == NULL) {
         ALLOCATION_ERROR();
     }
 
-    ast->data_type = data_type_type(TYPE_NULL);
-
     return ast;
 }
 
-void ast_print(FILE *file, const AST *ast)
+ASTIndex ast_push(AST *ast, ASTType type, size_t token, uint32_t lhs, uint32_t rhs)
+{
+    if (ast->len >= AST_NULL) {
+        ERROR("Too many AST nodes.");
+    }
+
+    if (ast->len >= ast->cap) {
+        while (ast->len >= ast->cap) {
+            ast->cap *= 2;
+        }
+
+        ast->types      = realloc(ast->types, sizeof(*ast->types) * ast->cap);
+        ast->tokens     = realloc(ast->tokens, sizeof(*ast->tokens) * ast->cap);
+        ast->lhs        = realloc(ast->lhs, sizeof(*ast->lhs) * ast->cap);
+        ast->rhs        = realloc(ast->rhs, sizeof(*ast->rhs) * ast->cap);
+        ast->data_types = realloc(ast->data_types, sizeof(*ast->data_types) * ast->cap);
+
+        if (ast->types == NULL || ast->tokens == NULL || ast->lhs == NULL
+         || ast->rhs == NULL || ast->data_types == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    const ASTIndex node = ast->len++;
+
+    ast->types[node]      = type;
+    ast->tokens[node]     = token;
+    ast->lhs[node]        = lhs;
+    ast->rhs[node]        = rhs;
+    ast->data_types[node] = data_type_type(TYPE_NULL);
+
+    return node;
+}
+
+// returns where the copy of `extra` starts
+uint32_t ast_push_extra(AST *ast, const uint32_t *extra, size_t extra_len)
+{
+    if (ast->extra_len + extra_len >= UINT32_MAX) {
+        ERROR("Too many AST nodes.");
+    }
+
+    if (ast->extra_len + extra_len > ast->extra_cap) {
+        while (ast->extra_len + extra_len > ast->extra_cap) {
+            ast->extra_cap *= 2;
+        }
+
+        ast->extra = realloc(ast->extra, sizeof(*ast->extra) * ast->extra_cap);
+
+        if (ast->extra == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    const uint32_t start = ast->extra_len;
+
+    for (size_t i = 0; i < extra_len; ++i) {
+        ast->extra[ast->extra_len++] = extra[i];
+    }
+
+    return start;
+}
+
+void ast_print(FILE *file, const AST *ast, ASTIndex node)
 {
-    switch (ast->type) {
+    switch (ast_type(ast, node)) {
         case AST_NODE: {
-            fprintf(file, "%.*s", (int) ast->node.len, ast->node.text);
+            const Token token = ast_token(ast, node);
+            fprintf(file, "%.*s", (int) token.len, token.text);
             break;
         }
 
         case AST_INFIX: {
+            const Token oper = ast_token(ast, node);
+            if (oper.type == TOKEN_LEFT_SQUARE) {
+                ast_print(file, ast, ast_infix_lhs(ast, node));
+                fprintf(file, "[");
+                ast_print(file, ast, ast_infix_rhs(ast, node));
+                fprintf(file, "]");
+                break;
+            }
             fprintf(file, "(");
-            ast_print(file, ast->infix.lhs);
-            fprintf(file, " %.*s ", (int) ast->infix.oper.len, ast->infix.oper.text);
-            ast_print(file, ast->infix.rhs);
+            ast_print(file, ast, ast_infix_lhs(ast, node));
+            fprintf(file, " %.*s ", (int) oper.len, oper.text);
+            ast_print(file, ast, ast_infix_rhs(ast, node));
             fprintf(file, ")");
             break;
         }
 
         case AST_PREFIX: {
+            const Token oper = ast_token(ast, node);
+            if (oper.type == TOKEN_LEFT_SQUARE) {
+                fprintf(file, "[");
+                ast_print(file, ast, ast_array_type_len(ast, node));
+                fprintf(file, "]");
+                ast_print(file, ast, ast_prefix_node(ast, node));
+                break;
+            }
             fprintf(file, "(");
-            fprintf(file, "%.*s ", (int) ast->prefix.oper.len, ast->prefix.oper.text);
-            ast_print(file, ast->prefix.node);
+            fprintf(file, "%.*s ", (int) oper.len, oper.text);
+            ast_print(file, ast, ast_prefix_node(ast, node));
             fprintf(file, ")");
             break;
         }
 
         case AST_BLOCK: {
+            const size_t len = ast_block_len(ast, node);
             fprintf(file, "{ ");
-            for (size_t i = 0; i < ast->block.len; ++i) {
-                ast_print(file, ast->block.statements[i]);
-                if (i + 1 < ast->block.len) {
+            for (size_t i = 0; i < len; ++i) {
+                ast_print(file, ast, ast_block_statement(ast, node, i));
+                if (i + 1 < len) {
                     fprintf(file, "; ");
                 }
             }
@@ -54,11 +149,12 @@ void ast_print(FILE *file, const AST *ast)
         }
 
         case AST_FUNCTION_CALL: {
-            ast_print(file, ast->function_call.lhs);
+            const size_t len = ast_function_call_len(ast, node);
+            ast_print(file, ast, ast_function_call_lhs(ast, node));
             fprintf(file, "(");
-            for (size_t i = 0; i < ast->function_call.len; ++i) {
-                ast_print(file, ast->function_call.arguments[i]);
-                if (i + 1 < ast->function_call.len) {
+            for (size_t i = 0; i < len; ++i) {
+                ast_print(file, ast, ast_function_call_argument(ast, node, i));
+                if (i + 1 < len) {
                     fprintf(file, ", ");
                 }
             }
@@ -68,96 +164,77 @@ void ast_print(FILE *file, const AST *ast)
 
         case AST_IF_STATEMENT: {
             fprintf(file, "if ");
-            ast_print(file, ast->if_statement.condition);
+            ast_print(file, ast, ast_if_condition(ast, node));
             fprintf(file, " ");
-            ast_print(file, ast->if_statement.if_branch);
-            if (ast->if_statement.else_branch != NULL) {
+            ast_print(file, ast, ast_if_branch(ast, node));
+            if (ast_else_branch(ast, node) != AST_NULL) {
                 fprintf(file, " else ");
-                ast_print(file, ast->if_statement.else_branch);
+                ast_print(file, ast, ast_else_branch(ast, node));
             }
             break;
         }
 
         case AST_WHILE_LOOP: {
             fprintf(file, "while ");
-            ast_print(file, ast->while_loop.condition);
+            ast_print(file, ast, ast_while_condition(ast, node));
             fprintf(file, " ");
-            ast_print(file, ast->while_loop.body);
-            break;
-        }
-
-        case AST_DECLARATION: {
-            fprintf(file, "(");
-            fprintf(file, "%.*s: ", (int) ast->declaration.name.len, ast->declaration.name.text);
-            ast_print(file, ast->declaration.type);
-            fprintf(file, " = ");
-            ast_print(file, ast->declaration.value);
-            fprintf(file, ")");
+            ast_print(file, ast, ast_while_body(ast, node));
             break;
         }
-    }
-}
 
-void ast_free(AST *ast)
-{
-    switch (ast->type) {
-        case AST_NODE: {
-            break;
-        }
-
-        case AST_INFIX: {
-            ast_free(ast->infix.lhs);
-            ast_free(ast->infix.rhs);
-            break;
-        }
-
-        case AST_PREFIX: {
-            ast_free(ast->prefix.node);
-            break;
-        }
-
-        case AST_BLOCK: {
-            for (size_t i = 0; i < ast->block.len; ++i) {
-                ast_free(ast->block.statements[i]);
-            }
-            free(ast->block.statements);
-            break;
-        }
-
-        case AST_FUNCTION_CALL: {
-            ast_free(ast->function_call.lhs);
-            for (size_t i = 0; i < ast->function_call.len; ++i) {
-                ast_free(ast->function_call.arguments[i]);
+        case AST_FUNCTION: {
+            const Token name = ast_token(ast, node);
+            const size_t len = ast_function_len(ast, node);
+            fprintf(file, "fn %.*s(", (int) name.len, name.text);
+            for (size_t i = 0; i < len; ++i) {
+                ast_print(file, ast, ast_function_parameter(ast, node, i));
+                if (i + 1 < len) {
+                    fprintf(file, ", ");
+                }
             }
-            free(ast->function_call.arguments);
-            break;
-        }
-
-        case AST_IF_STATEMENT: {
-            ast_free(ast->if_statement.condition);
-            ast_free(ast->if_statement.if_branch);
-            if (ast->if_statement.else_branch != NULL) {
-                ast_free(ast->if_statement.else_branch);
+            fprintf(file, ")");
+            if (ast_function_return_type(ast, node) != AST_NULL) {
+                fprintf(file, ": ");
+                ast_print(file, ast, ast_function_return_type(ast, node));
             }
-            break;
-        }
-
-        case AST_WHILE_LOOP: {
-            ast_free(ast->while_loop.condition);
-            ast_free(ast->while_loop.body);
+            fprintf(file, " = ");
+            ast_print(file, ast, ast_function_body(ast, node));
             break;
         }
 
         case AST_DECLARATION: {
-            ast_free(ast->declaration.type);
-            if (ast->declaration.value != NULL) {
-                ast_free(ast->declaration.value);
+            const Token name = ast_token(ast, node);
+            fprintf(file, "(");
+            fprintf(file, "%.*s: ", (int) name.len, name.text);
+            ast_print(file, ast, ast_declaration_type(ast, node));
+            if (ast_declaration_value(ast, node) != AST_NULL) {
+                fprintf(file, " = ");
+                ast_print(file, ast, ast_declaration_value(ast, node));
             }
+            fprintf(file, ")");
             break;
         }
     }
+}
 
-    data_type_free(ast->data_type);
+static void *ast_move(Arena *arena, void *array, size_t size)
+{
+    void *copy = arena_copy(arena, array, size);
 
-    free(ast);
+    free(array);
+
+    return copy;
+}
+
+void ast_move_to_arena(AST *ast, Arena *arena)
+{
+    ast->types      = ast_move(arena, ast->types, sizeof(*ast->types) * ast->len);
+    ast->tokens     = ast_move(arena, ast->tokens, sizeof(*ast->tokens) * ast->len);
+    ast->lhs        = ast_move(arena, ast->lhs, sizeof(*ast->lhs) * ast->len);
+    ast->rhs        = ast_move(arena, ast->rhs, sizeof(*ast->rhs) * ast->len);
+    ast->data_types = ast_move(arena, ast->data_types, sizeof(*ast->data_types) * ast->len);
+    ast->extra      = ast_move(arena, ast->extra, sizeof(*ast->extra) * ast->extra_len);
+
+    ast->cap       = ast->len;
+    ast->extra_cap = ast->extra_len;
 }
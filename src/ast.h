@@ -2,6 +2,8 @@
 #define AST_H_
 
 #include <stdio.h>
+#include <stdint.h>
+#include "arena.h"
 #include "lexer.h"
 #include "types.h"
 
@@ -14,77 +16,201 @@ typedef enum ASTType
     AST_IF_STATEMENT,
     AST_WHILE_LOOP,
     AST_FUNCTION_CALL,
-    AST_DECLARATION
+    AST_DECLARATION,
+    AST_FUNCTION
 } ASTType;
 
-typedef struct AST AST;
+// Nodes are referred to by their index into the AST's arrays.
+typedef uint32_t ASTIndex;
 
-typedef struct ASTInfix
-{
-    Token oper;
-    AST *lhs;
-    AST *rhs;
-} ASTInfix;
+#define AST_NULL ((ASTIndex) UINT32_MAX)
 
-typedef struct ASTPrefix
+// The whole tree, stored as parallel arrays with one entry per node.
+// Children are always added before their parents.
+//
+// What `lhs` and `rhs` hold depends on the node's type, anything with
+// more than two operands keeps the rest in `extra`:
+//
+//     AST_NODE           lhs: binding (identifiers)
+//     AST_INFIX          lhs: lhs, rhs: rhs (the array and the index for `[`)
+//     AST_PREFIX         lhs: operand (the element type for `[`, rhs: length)
+//     AST_BLOCK          lhs: first statement in extra, rhs: statement count
+//     AST_IF_STATEMENT   lhs: condition, rhs: extra -> if branch, else branch
+//     AST_WHILE_LOOP     lhs: condition, rhs: body
+//     AST_FUNCTION_CALL  lhs: function, rhs: extra -> argument count, arguments...
+//     AST_DECLARATION    lhs: type, rhs: extra -> value, binding
+//     AST_FUNCTION       lhs: return type, rhs: extra -> body, binding,
+//                        parameter count, parameters (declarations)...
+//
+// `tokens` holds the node's token (the operator for infix and prefix
+// nodes, the name of a declaration) as an index into `token_buffer`.
+typedef struct AST
 {
-    Token oper;
-    AST *node;
-} ASTPrefix;
+    const TokenBuffer *token_buffer;
+
+    ASTIndex root;
 
-typedef struct ASTBlock
-{
     size_t len;
     size_t cap;
-    AST **statements;
-} ASTBlock;
+    uint8_t *types;
+    uint32_t *tokens;
+    uint32_t *lhs;
+    uint32_t *rhs;
+    const DataType **data_types;
+
+    size_t extra_len;
+    size_t extra_cap;
+    uint32_t *extra;
+} AST;
+
+AST ast_new(const TokenBuffer *token_buffer);
 
-typedef struct ASTIfStatement
+ASTIndex ast_push(AST *ast, ASTType type, size_t token, uint32_t lhs, uint32_t rhs);
+uint32_t ast_push_extra(AST *ast, const uint32_t *extra, size_t extra_len);
+
+void ast_print(FILE *file, const AST *ast, ASTIndex node);
+
+// Once it's parsed, the arrays are copied into the arena, cut down to
+// size, and the arena owns the AST from then on. Nothing can be pushed
+// after that, and the AST is freed along with the arena.
+void ast_move_to_arena(AST *ast, Arena *arena);
+
+static inline ASTType ast_type(const AST *ast, ASTIndex node)
 {
-    AST *condition;
-    AST *if_branch;
-    AST *else_branch;
-} ASTIfStatement;
+    return ast->types[node];
+}
 
-typedef struct ASTWhileLoop
+static inline Token ast_token(const AST *ast, ASTIndex node)
 {
-    AST *condition;
-    AST *body;
-} ASTWhileLoop;
+    return token_buffer_get(ast->token_buffer, ast->tokens[node]);
+}
 
-typedef struct ASTFunctionCall
+// the token type of a node, or of its operator
+static inline TokenType ast_token_type(const AST *ast, ASTIndex node)
 {
-    AST *lhs;
-    size_t len;
-    size_t cap;
-    AST **arguments;
-} ASTFunctionCall;
+    return ast->token_buffer->types[ast->tokens[node]];
+}
 
-typedef struct ASTDeclaration
+static inline ASTIndex ast_infix_lhs(const AST *ast, ASTIndex node)
 {
-    Token name;
-    AST *type;
-    AST *value;
-} ASTDeclaration;
+    return ast->lhs[node];
+}
 
-typedef struct AST
+static inline ASTIndex ast_infix_rhs(const AST *ast, ASTIndex node)
 {
-    ASTType type;
-    DataType *data_type;
-    union {
-        Token node;
-        ASTInfix infix;
-        ASTPrefix prefix;
-        ASTBlock block;
-        ASTIfStatement if_statement;
-        ASTWhileLoop while_loop;
-        ASTFunctionCall function_call;
-        ASTDeclaration declaration;
-    };
-} AST;
+    return ast->rhs[node];
+}
 
-AST *ast_alloc(void);
-void ast_print(FILE *file, const AST *ast);
-void ast_free(AST *ast);
+static inline ASTIndex ast_prefix_node(const AST *ast, ASTIndex node)
+{
+    return ast->lhs[node];
+}
+
+static inline ASTIndex ast_array_type_len(const AST *ast, ASTIndex node)
+{
+    return ast->rhs[node];
+}
+
+static inline size_t ast_block_len(const AST *ast, ASTIndex node)
+{
+    return ast->rhs[node];
+}
+
+static inline ASTIndex ast_block_statement(const AST *ast, ASTIndex node, size_t i)
+{
+    return ast->extra[ast->lhs[node] + i];
+}
+
+static inline ASTIndex ast_if_condition(const AST *ast, ASTIndex node)
+{
+    return ast->lhs[node];
+}
+
+static inline ASTIndex ast_if_branch(const AST *ast, ASTIndex node)
+{
+    return ast->extra[ast->rhs[node]];
+}
+
+// AST_NULL if there is no else
+static inline ASTIndex ast_else_branch(const AST *ast, ASTIndex node)
+{
+    return ast->extra[ast->rhs[node] + 1];
+}
+
+static inline ASTIndex ast_while_condition(const AST *ast, ASTIndex node)
+{
+    return ast->lhs[node];
+}
+
+static inline ASTIndex ast_while_body(const AST *ast, ASTIndex node)
+{
+    return ast->rhs[node];
+}
+
+static inline ASTIndex ast_function_call_lhs(const AST *ast, ASTIndex node)
+{
+    return ast->lhs[node];
+}
+
+static inline size_t ast_function_call_len(const AST *ast, ASTIndex node)
+{
+    return ast->extra[ast->rhs[node]];
+}
+
+static inline ASTIndex ast_function_call_argument(const AST *ast, ASTIndex node, size_t i)
+{
+    return ast->extra[ast->rhs[node] + 1 + i];
+}
+
+static inline ASTIndex ast_declaration_type(const AST *ast, ASTIndex node)
+{
+    return ast->lhs[node];
+}
+
+// AST_NULL if the variable isn't initialized
+static inline ASTIndex ast_declaration_value(const AST *ast, ASTIndex node)
+{
+    return ast->extra[ast->rhs[node]];
+}
+
+// AST_NULL if it doesn't return anything
+static inline ASTIndex ast_function_return_type(const AST *ast, ASTIndex node)
+{
+    return ast->lhs[node];
+}
+
+static inline ASTIndex ast_function_body(const AST *ast, ASTIndex node)
+{
+    return ast->extra[ast->rhs[node]];
+}
+
+static inline size_t ast_function_len(const AST *ast, ASTIndex node)
+{
+    return ast->extra[ast->rhs[node] + 2];
+}
+
+static inline ASTIndex ast_function_parameter(const AST *ast, ASTIndex node, size_t i)
+{
+    return ast->extra[ast->rhs[node] + 3 + i];
+}
+
+// for identifiers, declarations and functions: which declaration
+// the name refers to, filled in by symbol_table_scan
+static inline size_t ast_binding(const AST *ast, ASTIndex node)
+{
+    if (ast->types[node] == AST_DECLARATION || ast->types[node] == AST_FUNCTION) {
+        return ast->extra[ast->rhs[node] + 1];
+    }
+    return ast->lhs[node];
+}
+
+static inline void ast_set_binding(AST *ast, ASTIndex node, size_t binding)
+{
+    if (ast->types[node] == AST_DECLARATION || ast->types[node] == AST_FUNCTION) {
+        ast->extra[ast->rhs[node] + 1] = binding;
+    } else {
+        ast->lhs[node] = binding;
+    }
+}
 
 #endif // AST_H_
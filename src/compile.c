@@ -5,6 +5,13 @@
 #include "compile.h"
 #include "parser.h"
 #include "asm_context.h"
+#include "asm_peephole.h"
+#include "ir.h"
+#include "ir_fold.h"
+#include "ir_mem2reg.h"
+#include "ir_loop.h"
+#include "ir_lower.h"
+#include "ir_tail.h"
 #include "type_checker.h"
 #include "types.h"
 #include "utils.h"
@@ -58,38 +65,111 @@ static char *string_literal_to_string(char *text, size_t text_len)
     return out_text;
 }
 
-AsmData compile_ast(Compiler *compiler, AST *ast);
+IRValue compile_ast(Compiler *compiler, ASTIndex node);
+static IRValue compile_function_call(Compiler *compiler, ASTIndex node, bool become);
 
-static AsmData compile_node(Compiler *compiler, AST *ast)
+static void set_variable(Compiler *compiler, size_t binding, IRValue value)
 {
-    switch (ast->node.type) {
+    if (compiler->assignments_len >= compiler->assignments_cap) {
+        while (compiler->assignments_len >= compiler->assignments_cap) {
+            compiler->assignments_cap *= 2;
+        }
+
+        compiler->assignments = realloc(
+            compiler->assignments,
+            sizeof(*compiler->assignments) * compiler->assignments_cap
+        );
+
+        if (compiler->assignments == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    compiler->assignments[compiler->assignments_len++] = (CompilerAssignment) {
+        .binding = binding,
+        .value = compiler->variables[binding]
+    };
+
+    compiler->variables[binding] = value;
+}
+
+// puts the variables back to how they were when there were `len` assignments,
+// returns the variables that changed since then with the values they had
+static CompilerAssignment *undo_assignments(Compiler *compiler, size_t len, size_t *changed_len)
+{
+    *changed_len = compiler->assignments_len - len;
+
+    CompilerAssignment *changed = malloc(sizeof(*changed) * (*changed_len + 1));
+
+    if (changed == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (size_t i = 0; i < *changed_len; ++i) {
+        const size_t binding = compiler->assignments[len + i].binding;
+
+        changed[i] = (CompilerAssignment) {
+            .binding = binding,
+            .value = compiler->variables[binding]
+        };
+    }
+
+    while (compiler->assignments_len > len) {
+        const CompilerAssignment *assignment = &compiler->assignments[--compiler->assignments_len];
+        compiler->variables[assignment->binding] = assignment->value;
+    }
+
+    return changed;
+}
+
+static IRValue compile_node(Compiler *compiler, ASTIndex node)
+{
+    const AST *ast = compiler->ast;
+    const DataType *data_type = ast->data_types[node];
+    const Token token = ast_token(ast, node);
+
+    switch (token.type) {
         case TOKEN_IDENT: {
-            Variable variable      = symbol_table_variable(&compiler->table, ast->node.len, ast->node.text);
-            VariableID variable_id = symbol_table_variable_id(&compiler->table, ast->node.len, ast->node.text);
+            if (data_type->type == TYPE_FUNCTION) {
+                ERROR("You can only call a function.");
+            }
+
+            const size_t binding = ast_binding(ast, node);
 
-            if (ast->data_type->type == TYPE_FUNCTION) {
-                return asm_data_function(ast->node.len, ast->node.text, ast->data_type);
+            // an array is always in memory, and is used through its address
+            if (compiler->address_taken[binding] && data_type->type != TYPE_ARRAY) {
+                return ir_unary(&compiler->ir, compiler->block, IR_LOAD, data_type, compiler->variables[binding]);
             }
 
-            return asm_data_stack_variable(asm_context_variable_stack_position(&compiler->asm_context, variable_id), variable.data_type);
+            return compiler->variables[binding];
         }
 
         case TOKEN_NUMBER: {
-            AsmData asm_register = asm_context_data_alloc(&compiler->asm_context, ast->data_type);
+            // only ever digits, and sscanf would look at the whole
+            // rest of the source to find where the string ends
+            uint64_t num = 0;
 
-            size_t num;
-            if (sscanf(ast->node.text, "%zu", &num) == -1) {
-                ERROR("Could not parse integer.");
-            }
+            for (size_t i = 0; i < token.len; ++i) {
+                const uint64_t digit = token.text[i] - '0';
 
-            asm_context_mov_constant(&compiler->asm_context, asm_register, num);
+                if (num > (UINT64_MAX - digit) / 10) {
+                    ERROR("Integer literal is too big.");
+                }
 
-            return asm_register;
+                num = num * 10 + digit;
+            }
+
+            return ir_const(&compiler->ir, compiler->block, data_type, num);
         }
 
         case TOKEN_STRING: {
-            char *literal = string_literal_to_string(ast->node.text, ast->node.len);
-            return asm_context_add_to_data_section(&compiler->asm_context, literal, strlen(literal) + 1, ast->data_type);
+            char *literal = string_literal_to_string(token.text, token.len);
+
+            IRInstruction *instruction = ir_push(&compiler->ir, compiler->block, IR_STRING, data_type, 0);
+            instruction->string.len = strlen(literal) + 1;
+            instruction->string.data = literal;
+
+            return instruction->result;
         }
 
         default: {
@@ -98,77 +178,145 @@ static AsmData compile_node(Compiler *compiler, AST *ast)
     }
 }
 
-static AsmData compile_infix(Compiler *compiler, AST *ast)
+// the value of something that's used, which is 0 if it doesn't have one
+static IRValue compile_value(Compiler *compiler, ASTIndex node, const DataType *data_type)
+{
+    const IRValue value = compile_ast(compiler, node);
+
+    if (value == IR_NULL) {
+        return ir_const(&compiler->ir, compiler->block, data_type, 0);
+    }
+
+    return value;
+}
+
+// the address of `array[index]`
+static IRValue compile_index(Compiler *compiler, ASTIndex node)
+{
+    const AST *ast = compiler->ast;
+
+    const IRValue array = compile_ast(compiler, ast_infix_lhs(ast, node));
+    const IRValue index = compile_ast(compiler, ast_infix_rhs(ast, node));
+
+    return ir_binary(
+        &compiler->ir,
+        compiler->block,
+        IR_INDEX,
+        data_type_reference(compiler->types, ast->data_types[node]),
+        array,
+        index
+    );
+}
+
+static IRValue compile_assignment(Compiler *compiler, ASTIndex node)
+{
+    const AST *ast = compiler->ast;
+    const ASTIndex lhs = ast_infix_lhs(ast, node);
+
+    // `array[index] = value`
+    if (ast_type(ast, lhs) == AST_INFIX) {
+        const IRValue address = compile_index(compiler, lhs);
+        const IRValue value = compile_value(compiler, ast_infix_rhs(ast, node), ast->data_types[lhs]);
+
+        ir_store(&compiler->ir, compiler->block, address, value);
+
+        return value;
+    }
+
+    // `@pointer = value`
+    if (ast_type(ast, lhs) == AST_PREFIX) {
+        const IRValue address = compile_ast(compiler, ast_prefix_node(ast, lhs));
+        const IRValue value = compile_value(compiler, ast_infix_rhs(ast, node), ast->data_types[lhs]);
+
+        ir_store(&compiler->ir, compiler->block, address, value);
+
+        return value;
+    }
+
+    const size_t binding = ast_binding(ast, lhs);
+    const IRValue value = compile_value(compiler, ast_infix_rhs(ast, node), ast->data_types[lhs]);
+
+    if (compiler->address_taken[binding]) {
+        ir_store(&compiler->ir, compiler->block, compiler->variables[binding], value);
+    } else {
+        set_variable(compiler, binding, value);
+    }
+
+    return value;
+}
+
+static IRValue compile_infix(Compiler *compiler, ASTIndex node)
 {
-    AsmData lhs = compile_ast(compiler, ast->infix.lhs);
-    AsmData rhs = compile_ast(compiler, ast->infix.rhs);
+    const AST *ast = compiler->ast;
+
+    if (ast_token_type(ast, node) == TOKEN_ASSIGN) {
+        return compile_assignment(compiler, node);
+    }
+
+    if (ast_token_type(ast, node) == TOKEN_LEFT_SQUARE) {
+        const IRValue address = compile_index(compiler, node);
+
+        // an array of arrays is indexed again through the address
+        if (ast->data_types[node]->type == TYPE_ARRAY) {
+            return address;
+        }
+
+        return ir_unary(&compiler->ir, compiler->block, IR_LOAD, ast->data_types[node], address);
+    }
+
+    const IRValue lhs = compile_ast(compiler, ast_infix_lhs(ast, node));
+    const IRValue rhs = compile_ast(compiler, ast_infix_rhs(ast, node));
 
-    AsmData result = asm_context_data_alloc(&compiler->asm_context, lhs.data_type);
+    IROpcode opcode;
 
-    switch (ast->infix.oper.type) {
+    switch (ast_token_type(ast, node)) {
         case TOKEN_OPER_ADD: {
-            asm_context_mov(&compiler->asm_context, result, lhs);
-            asm_context_add(&compiler->asm_context, result, rhs);
+            opcode = IR_ADD;
             break;
         }
 
         case TOKEN_OPER_SUB: {
-            asm_context_mov(&compiler->asm_context, result, lhs);
-            asm_context_sub(&compiler->asm_context, result, rhs);
+            opcode = IR_SUB;
             break;
         }
 
         case TOKEN_OPER_MUL: {
-            asm_context_mov(&compiler->asm_context, result, lhs);
-            asm_context_mul(&compiler->asm_context, result, rhs);
+            opcode = IR_MUL;
             break;
         }
 
         case TOKEN_OPER_DIV: {
-            asm_context_mov(&compiler->asm_context, result, lhs);
-            asm_context_div(&compiler->asm_context, result, rhs);
+            opcode = IR_DIV;
             break;
         }
 
         case TOKEN_OPER_EQUALS: {
-            asm_context_cmp(&compiler->asm_context, lhs, rhs);
-            asm_context_setz(&compiler->asm_context, result);
+            opcode = IR_EQ;
             break;
         }
 
         case TOKEN_OPER_NOT_EQUALS: {
-            asm_context_cmp(&compiler->asm_context, lhs, rhs);
-            asm_context_setnz(&compiler->asm_context, result);
+            opcode = IR_NE;
             break;
         }
 
         case TOKEN_OPER_GT: {
-            asm_context_cmp(&compiler->asm_context, lhs, rhs);
-            asm_context_setg(&compiler->asm_context, result);
+            opcode = IR_GT;
             break;
         }
 
         case TOKEN_OPER_LT: {
-            asm_context_cmp(&compiler->asm_context, lhs, rhs);
-            asm_context_setl(&compiler->asm_context, result);
+            opcode = IR_LT;
             break;
         }
 
         case TOKEN_OPER_GT_OR_EQUALS: {
-            asm_context_cmp(&compiler->asm_context, lhs, rhs);
-            asm_context_setge(&compiler->asm_context, result);
+            opcode = IR_GE;
             break;
         }
 
         case TOKEN_OPER_LT_OR_EQUALS: {
-            asm_context_cmp(&compiler->asm_context, lhs, rhs);
-            asm_context_setle(&compiler->asm_context, result);
-            break;
-        }
-
-        case TOKEN_ASSIGN: {
-            asm_context_mov(&compiler->asm_context, lhs, rhs);
-            asm_context_mov(&compiler->asm_context, result, lhs);
+            opcode = IR_LE;
             break;
         }
 
@@ -177,46 +325,48 @@ static AsmData compile_infix(Compiler *compiler, AST *ast)
         }
     }
 
-    asm_context_data_free(&compiler->asm_context, lhs);
-    asm_context_data_free(&compiler->asm_context, rhs);
-
-    return result;
+    return ir_binary(&compiler->ir, compiler->block, opcode, ast->data_types[node], lhs, rhs);
 }
 
-static AsmData compile_prefix(Compiler *compiler, AST *ast)
+static IRValue compile_prefix(Compiler *compiler, ASTIndex node)
 {
-    AsmData node = compile_ast(compiler, ast->prefix.node);
+    const AST *ast = compiler->ast;
+    const ASTIndex operand = ast_prefix_node(ast, node);
+    const DataType *data_type = ast->data_types[node];
 
-    switch (ast->prefix.oper.type) {
+    switch (ast_token_type(ast, node)) {
         case TOKEN_OPER_SUB: {
-            asm_context_negate(&compiler->asm_context, node);
-
-            return node;
+            return ir_unary(&compiler->ir, compiler->block, IR_NEG, data_type, compile_ast(compiler, operand));
         }
 
         case TOKEN_NOT: {
-            asm_context_test(&compiler->asm_context, node, node);
-            asm_context_setz(&compiler->asm_context, node);
-
-            return node;
+            return ir_unary(&compiler->ir, compiler->block, IR_NOT, data_type, compile_ast(compiler, operand));
         }
 
         case TOKEN_REFERENCE: {
-            AsmData reference = asm_context_data_alloc(&compiler->asm_context, ast->data_type);
-
-            asm_context_reference(&compiler->asm_context, reference, node);
+            // `#@pointer` is just the pointer
+            if (ast_type(ast, operand) == AST_PREFIX) {
+                return compile_ast(compiler, ast_prefix_node(ast, operand));
+            }
 
-            asm_context_data_free(&compiler->asm_context, node);
+            if (ast_type(ast, operand) == AST_INFIX) {
+                return compile_index(compiler, operand);
+            }
 
-            return reference;
+            return compiler->variables[ast_binding(ast, operand)];
         }
 
         case TOKEN_DEREFERENCE: {
-            AsmData deref = asm_context_dereference(&compiler->asm_context, node);
+            // what an array is used through is its address anyway
+            if (data_type->type == TYPE_ARRAY) {
+                return compile_ast(compiler, operand);
+            }
 
-            asm_context_data_free(&compiler->asm_context, node);
+            return ir_unary(&compiler->ir, compiler->block, IR_LOAD, data_type, compile_ast(compiler, operand));
+        }
 
-            return deref;
+        case TOKEN_BECOME: {
+            return compile_function_call(compiler, operand, true);
         }
 
         default: {
@@ -225,205 +375,1058 @@ static AsmData compile_prefix(Compiler *compiler, AST *ast)
     }
 }
 
-static AsmData compile_block(Compiler *compiler, AST *ast)
+static IRValue compile_block(Compiler *compiler, ASTIndex node)
 {
-    AsmData statement = asm_context_data_alloc(&compiler->asm_context, ast->data_type);
+    const AST *ast = compiler->ast;
 
-    symbol_table_begin_scope(&compiler->table);
+    IRValue statement = IR_NULL;
 
-    for (size_t i = 0; i < ast->block.len; ++i) {
-        asm_context_data_free(&compiler->asm_context, statement);
-        statement = compile_ast(compiler, ast->block.statements[i]);
+    for (size_t i = 0; i < ast_block_len(ast, node); ++i) {
+        statement = compile_ast(compiler, ast_block_statement(ast, node, i));
     }
 
-    symbol_table_end_scope(&compiler->table);
-
     return statement;
 }
 
-static AsmData compile_if_statement(Compiler *compiler, AST *ast)
+// a phi in `block` for every variable that is different coming from
+// its first predecessor than from its second one
+static void merge_branches(
+    Compiler *compiler,
+    IRBlockIndex block,
+    const CompilerAssignment *if_changed,
+    size_t if_changed_len,
+    const CompilerAssignment *else_changed,
+    size_t else_changed_len
+) {
+    const uint32_t pending = ++compiler->mark;
+    const uint32_t merged  = ++compiler->mark;
+
+    for (size_t i = 0; i < if_changed_len; ++i) {
+        compiler->marks[if_changed[i].binding] = pending;
+        compiler->merge_values[if_changed[i].binding] = if_changed[i].value;
+    }
+
+    for (size_t pass = 0; pass < 2; ++pass) {
+        const CompilerAssignment *changed = pass == 0 ? else_changed : if_changed;
+        const size_t changed_len = pass == 0 ? else_changed_len : if_changed_len;
+
+        for (size_t i = 0; i < changed_len; ++i) {
+            const size_t binding = changed[i].binding;
+            const IRValue before = compiler->variables[binding];
+
+            // declared in the branch, so it's gone now
+            if (before == IR_NULL || compiler->marks[binding] == merged) {
+                continue;
+            }
+
+            const IRValue if_value = compiler->marks[binding] == pending
+                ? compiler->merge_values[binding]
+                : before;
+
+            const IRValue else_value = pass == 0 ? changed[i].value : before;
+
+            compiler->marks[binding] = merged;
+
+            if (if_value == else_value) {
+                if (if_value != before) {
+                    set_variable(compiler, binding, if_value);
+                }
+                continue;
+            }
+
+            IRInstruction *phi = ir_push(&compiler->ir, block, IR_PHI, compiler->ir.value_types[if_value], 2);
+            ir_operands(&compiler->ir, phi)[0] = if_value;
+            ir_operands(&compiler->ir, phi)[1] = else_value;
+
+            set_variable(compiler, binding, phi->result);
+        }
+    }
+}
+
+static IRValue compile_if_statement(Compiler *compiler, ASTIndex node)
 {
-    const size_t if_label  = asm_context_label_new(&compiler->asm_context);
-    const size_t end_label = asm_context_label_new(&compiler->asm_context);
+    const AST *ast = compiler->ast;
+    const DataType *data_type = ast->data_types[node];
+
+    const bool has_value = data_type->type != TYPE_NULL && data_type->type != TYPE_VOID;
+
+    const IRValue condition = compile_ast(compiler, ast_if_condition(ast, node));
+    const IRBlockIndex condition_block = compiler->block;
+    const size_t assignments_len = compiler->assignments_len;
+
+    const IRBlockIndex if_block = ir_block_new(&compiler->ir);
+    compiler->block = if_block;
+
+    IRValue if_value = compile_ast(compiler, ast_if_branch(ast, node));
+
+    if (has_value && if_value == IR_NULL) {
+        if_value = ir_const(&compiler->ir, compiler->block, data_type, 0);
+    }
+
+    const IRBlockIndex if_end = compiler->block;
+
+    size_t if_changed_len;
+    CompilerAssignment *if_changed = undo_assignments(compiler, assignments_len, &if_changed_len);
+
+    // there's always an else block, even if it's empty,
+    // so that a phi has somewhere to put its copies
+    const IRBlockIndex else_block = ir_block_new(&compiler->ir);
+    compiler->block = else_block;
+
+    ir_branch(&compiler->ir, condition_block, condition, if_block, else_block);
+
+    IRValue else_value = IR_NULL;
+
+    if (ast_else_branch(ast, node) != AST_NULL) {
+        else_value = compile_ast(compiler, ast_else_branch(ast, node));
+    }
+
+    if (has_value && else_value == IR_NULL) {
+        else_value = ir_const(&compiler->ir, compiler->block, data_type, 0);
+    }
+
+    const IRBlockIndex else_end = compiler->block;
+
+    size_t else_changed_len;
+    CompilerAssignment *else_changed = undo_assignments(compiler, assignments_len, &else_changed_len);
+
+    const IRBlockIndex end_block = ir_block_new(&compiler->ir);
+
+    ir_jump(&compiler->ir, if_end, end_block);
+    ir_jump(&compiler->ir, else_end, end_block);
+
+    compiler->block = end_block;
+
+    merge_branches(compiler, end_block, if_changed, if_changed_len, else_changed, else_changed_len);
+
+    free(if_changed);
+    free(else_changed);
+
+    if (!has_value) {
+        return IR_NULL;
+    }
+
+    IRInstruction *phi = ir_push(&compiler->ir, end_block, IR_PHI, data_type, 2);
+    ir_operands(&compiler->ir, phi)[0] = if_value;
+    ir_operands(&compiler->ir, phi)[1] = else_value;
+
+    return phi->result;
+}
+
+// a phi in the loop's header for every variable from outside
+// the loop that the loop assigns to, before compiling any of it
+static void make_loop_phis(Compiler *compiler, ASTIndex node, uint32_t mark)
+{
+    const AST *ast = compiler->ast;
+
+    if (node == AST_NULL) {
+        return;
+    }
+
+    switch (ast_type(ast, node)) {
+        case AST_NODE: {
+            break;
+        }
+
+        case AST_INFIX: {
+            const ASTIndex lhs = ast_infix_lhs(ast, node);
+
+            if (ast_token_type(ast, node) == TOKEN_ASSIGN && ast_type(ast, lhs) == AST_NODE) {
+                const size_t binding = ast_binding(ast, lhs);
+
+                if (
+                    !compiler->address_taken[binding]
+                    && compiler->variables[binding] != IR_NULL
+                    && compiler->marks[binding] != mark
+                ) {
+                    compiler->marks[binding] = mark;
+
+                    IRInstruction *phi = ir_push(&compiler->ir, compiler->block, IR_PHI, ast->data_types[lhs], 2);
+                    ir_operands(&compiler->ir, phi)[0] = compiler->variables[binding];
+
+                    set_variable(compiler, binding, phi->result);
+                }
+            }
+
+            make_loop_phis(compiler, lhs, mark);
+            make_loop_phis(compiler, ast_infix_rhs(ast, node), mark);
+            break;
+        }
+
+        case AST_PREFIX: {
+            make_loop_phis(compiler, ast_prefix_node(ast, node), mark);
+            break;
+        }
+
+        case AST_BLOCK: {
+            for (size_t i = 0; i < ast_block_len(ast, node); ++i) {
+                make_loop_phis(compiler, ast_block_statement(ast, node, i), mark);
+            }
+            break;
+        }
+
+        case AST_IF_STATEMENT: {
+            make_loop_phis(compiler, ast_if_condition(ast, node), mark);
+            make_loop_phis(compiler, ast_if_branch(ast, node), mark);
+            make_loop_phis(compiler, ast_else_branch(ast, node), mark);
+            break;
+        }
+
+        case AST_WHILE_LOOP: {
+            make_loop_phis(compiler, ast_while_condition(ast, node), mark);
+            make_loop_phis(compiler, ast_while_body(ast, node), mark);
+            break;
+        }
+
+        case AST_FUNCTION_CALL: {
+            for (size_t i = 0; i < ast_function_call_len(ast, node); ++i) {
+                make_loop_phis(compiler, ast_function_call_argument(ast, node, i), mark);
+            }
+            break;
+        }
+
+        case AST_DECLARATION: {
+            make_loop_phis(compiler, ast_declaration_value(ast, node), mark);
+            break;
+        }
+
+        case AST_FUNCTION: {
+            break;
+        }
+    }
+}
+
+static IRValue compile_while_loop(Compiler *compiler, ASTIndex node)
+{
+    const AST *ast = compiler->ast;
+
+    const IRBlockIndex header = ir_block_new(&compiler->ir);
+
+    ir_jump(&compiler->ir, compiler->block, header);
+    compiler->block = header;
+
+    const size_t phis_start = compiler->assignments_len;
+
+    make_loop_phis(compiler, node, ++compiler->mark);
+
+    const size_t phis_len = compiler->assignments_len - phis_start;
+
+    const IRValue condition = compile_ast(compiler, ast_while_condition(ast, node));
+    const IRBlockIndex condition_block = compiler->block;
+    const size_t assignments_len = compiler->assignments_len;
+
+    const IRBlockIndex body = ir_block_new(&compiler->ir);
+    compiler->block = body;
+
+    compile_ast(compiler, ast_while_body(ast, node));
+
+    ir_jump(&compiler->ir, compiler->block, header);
+
+    // the phis are the first thing in the header, in the order they were made
+    for (size_t i = 0; i < phis_len; ++i) {
+        const IRInstruction *phi = &compiler->ir.blocks[header].instructions[i];
+        const size_t binding = compiler->assignments[phis_start + i].binding;
+
+        ir_operands(&compiler->ir, phi)[1] = compiler->variables[binding];
+    }
+
+    size_t changed_len;
+    free(undo_assignments(compiler, assignments_len, &changed_len));
+
+    const IRBlockIndex end_block = ir_block_new(&compiler->ir);
+
+    ir_branch(&compiler->ir, condition_block, condition, body, end_block);
+
+    compiler->block = end_block;
+
+    return IR_NULL;
+}
+
+// only variables that something points to need to be in memory
+static void declare_variable(Compiler *compiler, size_t binding, const DataType *data_type, IRValue value)
+{
+    if (compiler->address_taken[binding]) {
+        const IRValue address = ir_push(
+            &compiler->ir,
+            compiler->block,
+            IR_LOCAL,
+            data_type_reference(compiler->types, data_type),
+            0
+        )->result;
+
+        ir_store(&compiler->ir, compiler->block, address, value);
+
+        set_variable(compiler, binding, address);
+    } else {
+        set_variable(compiler, binding, value);
+    }
+}
+
+// the function that a call calls, AST_NULL for print
+static ASTIndex called_function(const Compiler *compiler, ASTIndex call)
+{
+    const AST *ast = compiler->ast;
+    const ASTIndex function = ast_function_call_lhs(ast, call);
+
+    if (ast_type(ast, function) != AST_NODE) {
+        return AST_NULL;
+    }
+
+    return compiler->functions[ast_binding(ast, function)];
+}
+
+// whether something that `node` calls can end up calling `function`,
+// the functions that have been looked into already have `mark`
+static bool calls_function(Compiler *compiler, ASTIndex node, ASTIndex function, uint32_t mark)
+{
+    const AST *ast = compiler->ast;
+
+    if (node == AST_NULL) {
+        return false;
+    }
+
+    switch (ast_type(ast, node)) {
+        case AST_NODE:
+        case AST_FUNCTION: {
+            return false;
+        }
+
+        case AST_INFIX: {
+            return calls_function(compiler, ast_infix_lhs(ast, node), function, mark)
+                || calls_function(compiler, ast_infix_rhs(ast, node), function, mark);
+        }
+
+        case AST_PREFIX: {
+            return calls_function(compiler, ast_prefix_node(ast, node), function, mark);
+        }
+
+        case AST_BLOCK: {
+            for (size_t i = 0; i < ast_block_len(ast, node); ++i) {
+                if (calls_function(compiler, ast_block_statement(ast, node, i), function, mark)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        case AST_IF_STATEMENT: {
+            return calls_function(compiler, ast_if_condition(ast, node), function, mark)
+                || calls_function(compiler, ast_if_branch(ast, node), function, mark)
+                || calls_function(compiler, ast_else_branch(ast, node), function, mark);
+        }
+
+        case AST_WHILE_LOOP: {
+            return calls_function(compiler, ast_while_condition(ast, node), function, mark)
+                || calls_function(compiler, ast_while_body(ast, node), function, mark);
+        }
+
+        case AST_FUNCTION_CALL: {
+            const ASTIndex callee = called_function(compiler, node);
 
-    AsmData condition = compile_ast(compiler, ast->if_statement.condition);
+            if (callee == function) {
+                return true;
+            }
+
+            if (callee != AST_NULL && compiler->marks[ast_binding(ast, callee)] != mark) {
+                compiler->marks[ast_binding(ast, callee)] = mark;
 
-    AsmData result = asm_context_data_alloc(&compiler->asm_context, condition.data_type);
+                if (calls_function(compiler, ast_function_body(ast, callee), function, mark)) {
+                    return true;
+                }
+            }
 
-    asm_context_test(&compiler->asm_context, condition, condition);
-    asm_context_jz(&compiler->asm_context, if_label);
+            for (size_t i = 0; i < ast_function_call_len(ast, node); ++i) {
+                if (calls_function(compiler, ast_function_call_argument(ast, node, i), function, mark)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        case AST_DECLARATION: {
+            return calls_function(compiler, ast_declaration_value(ast, node), function, mark);
+        }
+    }
 
-    asm_context_data_free(&compiler->asm_context, condition);
+    UNREACHABLE();
+}
 
-    AsmData if_block = compile_ast(compiler, ast->if_statement.if_branch);
+static bool is_inlined(Compiler *compiler, ASTIndex function);
 
-    asm_context_mov(&compiler->asm_context, result, if_block);
+// how many nodes `node` comes to once the calls in it are inlined
+static size_t inlined_size(Compiler *compiler, ASTIndex node)
+{
+    const AST *ast = compiler->ast;
 
-    if (ast->if_statement.else_branch != NULL) {
-        asm_context_jmp(&compiler->asm_context, end_label);
+    if (node == AST_NULL) {
+        return 0;
     }
 
-    asm_context_label(&compiler->asm_context, if_label);
+    switch (ast_type(ast, node)) {
+        case AST_NODE: {
+            return 1;
+        }
+
+        case AST_INFIX: {
+            return 1 + inlined_size(compiler, ast_infix_lhs(ast, node)) + inlined_size(compiler, ast_infix_rhs(ast, node));
+        }
+
+        case AST_PREFIX: {
+            const ASTIndex operand = ast_prefix_node(ast, node);
+
+            // what `become` calls is never inlined
+            if (ast_token_type(ast, node) == TOKEN_BECOME) {
+                size_t size = 2;
+                for (size_t i = 0; i < ast_function_call_len(ast, operand); ++i) {
+                    size += inlined_size(compiler, ast_function_call_argument(ast, operand, i));
+                }
+                return size;
+            }
+
+            return 1 + inlined_size(compiler, operand);
+        }
+
+        case AST_BLOCK: {
+            size_t size = 1;
+            for (size_t i = 0; i < ast_block_len(ast, node); ++i) {
+                size += inlined_size(compiler, ast_block_statement(ast, node, i));
+            }
+            return size;
+        }
+
+        case AST_IF_STATEMENT: {
+            return 1
+                + inlined_size(compiler, ast_if_condition(ast, node))
+                + inlined_size(compiler, ast_if_branch(ast, node))
+                + inlined_size(compiler, ast_else_branch(ast, node));
+        }
+
+        case AST_WHILE_LOOP: {
+            return 1 + inlined_size(compiler, ast_while_condition(ast, node)) + inlined_size(compiler, ast_while_body(ast, node));
+        }
+
+        case AST_FUNCTION_CALL: {
+            const ASTIndex callee = called_function(compiler, node);
+
+            size_t size = 1;
+
+            if (callee != AST_NULL && is_inlined(compiler, callee)) {
+                size += compiler->inlines[ast_binding(ast, callee)].size;
+            }
 
-    if (ast->if_statement.else_branch != NULL) {
-        AsmData else_block = compile_ast(compiler, ast->if_statement.else_branch);
+            for (size_t i = 0; i < ast_function_call_len(ast, node); ++i) {
+                size += inlined_size(compiler, ast_function_call_argument(ast, node, i));
+            }
+            return size;
+        }
 
-        asm_context_mov(&compiler->asm_context, result, else_block);
+        case AST_DECLARATION: {
+            return 1 + inlined_size(compiler, ast_declaration_value(ast, node));
+        }
 
-        asm_context_data_free(&compiler->asm_context, else_block);
+        case AST_FUNCTION: {
+            return 0;
+        }
     }
 
-    asm_context_label(&compiler->asm_context, end_label);
+    UNREACHABLE();
+}
+
+// Every call to a function is inlined, or none are, besides the ones
+// `become` is used on, which never are. It's inlined if it can't end up
+// calling itself, and its body comes to no more than the budget with the
+// functions it calls inlined into it, which is what inlining it adds to
+// the function it's called from. That way nothing is inlined into itself,
+// and functions can't get any bigger than the budget from being inlined
+// into each other.
+static bool is_inlined(Compiler *compiler, ASTIndex function)
+{
+    const AST *ast = compiler->ast;
+    CompilerInline *decision = &compiler->inlines[ast_binding(ast, function)];
 
-    asm_context_data_free(&compiler->asm_context, if_block);
+    if (!decision->decided) {
+        decision->decided = true;
+        decision->recursive = calls_function(compiler, ast_function_body(ast, function), function, ++compiler->mark);
 
-    return result;
+        if (!decision->recursive) {
+            decision->size = ast_function_len(ast, function) + inlined_size(compiler, ast_function_body(ast, function));
+        }
+    }
+
+    return !decision->recursive && decision->size <= compiler->options->inline_budget;
 }
 
-static AsmData compile_while_loop(Compiler *compiler, AST *ast)
+// the name of the function that's being compiled
+static Token function_name(const Compiler *compiler)
 {
-    const size_t start_label = asm_context_label_new(&compiler->asm_context);
-    const size_t end_label   = asm_context_label_new(&compiler->asm_context);
+    if (compiler->function == AST_NULL) {
+        return (Token) {
+            .text = "_start",
+            .len = 6
+        };
+    }
+
+    return ast_token(compiler->ast, compiler->function);
+}
 
-    asm_context_label(&compiler->asm_context, start_label);
+static void report_inline(Compiler *compiler, ASTIndex function, bool become)
+{
+    const Token callee = ast_token(compiler->ast, function);
+    const Token caller = function_name(compiler);
+    const CompilerInline *decision = &compiler->inlines[ast_binding(compiler->ast, function)];
+
+    if (become) {
+        fprintf(
+            stderr,
+            "inline: %.*s called from %.*s, it's what `become` jumps to\n",
+            (int) callee.len, callee.text,
+            (int) caller.len, caller.text
+        );
+    } else if (is_inlined(compiler, function)) {
+        fprintf(
+            stderr,
+            "inline: %.*s into %.*s, %zu nodes\n",
+            (int) callee.len, callee.text,
+            (int) caller.len, caller.text,
+            decision->size
+        );
+    } else if (decision->recursive) {
+        fprintf(
+            stderr,
+            "inline: %.*s called from %.*s, it's recursive\n",
+            (int) callee.len, callee.text,
+            (int) caller.len, caller.text
+        );
+    } else {
+        fprintf(
+            stderr,
+            "inline: %.*s called from %.*s, %zu nodes is over the budget of %zu\n",
+            (int) callee.len, callee.text,
+            (int) caller.len, caller.text,
+            decision->size,
+            compiler->options->inline_budget
+        );
+    }
+}
 
-    AsmData condition = compile_ast(compiler, ast->while_loop.condition);
+// The parameters are declared with the arguments' values, then the body
+// is compiled, and its value is what the function returns. Bodies only
+// ever use their own variables, which symbol_table_scan already told
+// apart from everyone else's, so this is the same for a body that's
+// inlined as for the function's own.
+static IRValue compile_body(Compiler *compiler, ASTIndex function, const IRValue *arguments)
+{
+    const AST *ast = compiler->ast;
 
-    asm_context_test(&compiler->asm_context, condition, condition);
-    asm_context_jz(&compiler->asm_context, end_label);
+    for (size_t i = 0; i < ast_function_len(ast, function); ++i) {
+        const ASTIndex parameter = ast_function_parameter(ast, function, i);
+        const DataType *data_type = ast->data_types[ast_declaration_type(ast, parameter)];
 
-    asm_context_data_free(&compiler->asm_context, condition);
+        declare_variable(compiler, ast_binding(ast, parameter), data_type, arguments[i]);
+    }
 
-    AsmData body = compile_ast(compiler, ast->while_loop.body);
+    const ASTIndex body = ast_function_body(ast, function);
+    const ASTIndex return_type = ast_function_return_type(ast, function);
 
-    asm_context_jmp(&compiler->asm_context, start_label);
-    asm_context_label(&compiler->asm_context, end_label);
+    if (return_type == AST_NULL || ast->data_types[return_type]->type == TYPE_VOID) {
+        compile_ast(compiler, body);
+        return IR_NULL;
+    }
 
-    return body;
+    return compile_value(compiler, body, ast->data_types[return_type]);
 }
 
-static AsmData compile_function_call(Compiler *compiler, AST *ast)
+static IRValue compile_function_call(Compiler *compiler, ASTIndex node, bool become)
 {
-    AsmData function = compile_ast(compiler, ast->function_call.lhs);
-    AsmData return_value = asm_context_data_alloc(&compiler->asm_context, ast->data_type);
+    const AST *ast = compiler->ast;
+    const size_t len = ast_function_call_len(ast, node);
+    const ASTIndex function = ast_function_call_lhs(ast, node);
+    const Token name = ast_token(ast, function);
 
-    AsmData *function_args = malloc(sizeof(*function_args) * ast->function_call.len);
+    const DataType *return_type = ast->data_types[node];
 
-    if (function_args == NULL) {
+    IRValue *arguments = malloc(sizeof(*arguments) * (len + 1));
+
+    if (arguments == NULL) {
         ALLOCATION_ERROR();
     }
 
-    for (size_t i = 0; i < ast->function_call.len; ++i) {
-        AsmData argument = compile_ast(compiler, ast->function_call.arguments[i]);
-        asm_context_push(&compiler->asm_context, argument);
-        asm_context_data_free(&compiler->asm_context, argument);
-        function_args[i] = asm_data_stack(compiler->asm_context.stack_frame_size, ast->function_call.arguments[i]->data_type);
+    for (size_t i = 0; i < len; ++i) {
+        arguments[i] = compile_ast(compiler, ast_function_call_argument(ast, node, i));
     }
 
-    asm_context_call_function(&compiler->asm_context, function, return_value);
+    const ASTIndex callee = called_function(compiler, node);
 
-    for (size_t i = 0; i < ast->function_call.len; ++i) {
-        asm_context_data_free(&compiler->asm_context, function_args[i]);
+    if (callee != AST_NULL && compiler->options->inline_report) {
+        report_inline(compiler, callee, become);
     }
 
-    free(function_args);
+    // what `become` calls has to be a call for it to be a tail call,
+    // whatever the budget is, so that whether it can be doesn't change
+    if (callee != AST_NULL && !become && is_inlined(compiler, callee)) {
+        ++compiler->inlining;
+        const IRValue value = compile_body(compiler, callee, arguments);
+        --compiler->inlining;
+
+        free(arguments);
+
+        return value;
+    }
+
+    IRInstruction *call = ir_push(
+        &compiler->ir,
+        compiler->block,
+        IR_CALL,
+        return_type->type == TYPE_VOID ? NULL : return_type,
+        len
+    );
+
+    call->function.name_len = name.len;
+    call->function.name = name.text;
+    call->function.data_type = ast->data_types[function];
+    // a body that's inlined doesn't have to, since it can't be recursive
+    call->function.become = become && compiler->inlining == 0;
+
+    for (size_t i = 0; i < len; ++i) {
+        ir_operands(&compiler->ir, call)[i] = arguments[i];
+    }
 
-    asm_context_data_free(&compiler->asm_context, function);
+    free(arguments);
 
-    return return_value;
+    return call->result;
 }
 
-static AsmData compile_declaration(Compiler *compiler, AST *ast)
+// An array is a stack slot of its own, which starts out zeroed by a
+// loop over all of its elements, arrays of arrays as one long one.
+static IRValue compile_array_declaration(Compiler *compiler, size_t binding, const DataType *data_type)
 {
-    Variable variable      = symbol_table_variable(&compiler->table, ast->declaration.name.len, ast->declaration.name.text);
-    VariableID variable_id = symbol_table_variable_id(&compiler->table, ast->declaration.name.len, ast->declaration.name.text);
+    IR *ir = &compiler->ir;
+
+    const DataType *element = data_type;
+
+    while (element->type == TYPE_ARRAY) {
+        element = element->array.element;
+    }
+
+    const DataType *index_type = data_type_type(TYPE_INT64);
+    const DataType *address_type = data_type_reference(compiler->types, element);
+
+    const IRValue array = ir_push(ir, compiler->block, IR_LOCAL, data_type_reference(compiler->types, data_type), 0)->result;
+    const IRValue start = ir_const(ir, compiler->block, index_type, 0);
+    const IRValue len = ir_const(ir, compiler->block, index_type, data_type_size(data_type) / data_type_size(element));
+
+    const IRBlockIndex header = ir_block_new(ir);
+
+    ir_jump(ir, compiler->block, header);
+
+    IRInstruction *phi = ir_push(ir, header, IR_PHI, index_type, 2);
+    const IRValue index = phi->result;
+    ir_operands(ir, phi)[0] = start;
+
+    const IRValue condition = ir_binary(ir, header, IR_LT, index_type, index, len);
+
+    const IRBlockIndex body = ir_block_new(ir);
+
+    const IRValue address = ir_binary(ir, body, IR_INDEX, address_type, array, index);
+    ir_store(ir, body, address, ir_const(ir, body, element, 0));
+
+    const IRValue next = ir_binary(ir, body, IR_ADD, index_type, index, ir_const(ir, body, index_type, 1));
+    ir_jump(ir, body, header);
+
+    // ir_push may have moved the header's instructions
+    ir_operands(ir, &ir->blocks[header].instructions[0])[1] = next;
+
+    const IRBlockIndex end_block = ir_block_new(ir);
+
+    ir_branch(ir, header, condition, body, end_block);
+
+    compiler->block = end_block;
+
+    set_variable(compiler, binding, array);
+
+    return IR_NULL;
+}
 
-    asm_context_change_stack(&compiler->asm_context, 8);
-    asm_context_add_variable_stack_position(&compiler->asm_context, variable_id, compiler->asm_context.stack_frame_size);
+static IRValue compile_declaration(Compiler *compiler, ASTIndex node)
+{
+    const AST *ast = compiler->ast;
 
-    AsmData asm_variable = asm_data_stack_variable(compiler->asm_context.stack_frame_size, variable.data_type);
+    const size_t binding = ast_binding(ast, node);
+    const ASTIndex type = ast_declaration_type(ast, node);
+    const DataType *data_type = ast->data_types[type];
 
-    if (ast->declaration.value != NULL) {
-        AsmData value = compile_ast(compiler, ast->declaration.value);
+    if (data_type->type == TYPE_ARRAY) {
+        return compile_array_declaration(compiler, binding, data_type);
+    }
 
-        asm_context_mov(&compiler->asm_context, asm_variable, value);
+    IRValue value;
 
-        asm_context_data_free(&compiler->asm_context, value);
+    if (ast_declaration_value(ast, node) != AST_NULL) {
+        value = compile_value(compiler, ast_declaration_value(ast, node), data_type);
+    } else {
+        value = ir_const(&compiler->ir, compiler->block, data_type, 0);
     }
 
-    return asm_variable;
+    declare_variable(compiler, binding, data_type, value);
+
+    return value;
 }
 
-AsmData compile_ast(Compiler *compiler, AST *ast)
+IRValue compile_ast(Compiler *compiler, ASTIndex node)
 {
-    switch (ast->type) {
+    switch (ast_type(compiler->ast, node)) {
         case AST_NODE: {
-            return compile_node(compiler, ast);
+            return compile_node(compiler, node);
         }
 
         case AST_INFIX: {
-            return compile_infix(compiler, ast);
+            return compile_infix(compiler, node);
         }
 
         case AST_PREFIX: {
-            return compile_prefix(compiler, ast);
+            return compile_prefix(compiler, node);
         }
 
         case AST_BLOCK: {
-            return compile_block(compiler, ast);
+            return compile_block(compiler, node);
         }
 
         case AST_IF_STATEMENT: {
-            return compile_if_statement(compiler, ast);
+            return compile_if_statement(compiler, node);
         }
 
         case AST_WHILE_LOOP: {
-            return compile_while_loop(compiler, ast);
+            return compile_while_loop(compiler, node);
         }
 
         case AST_FUNCTION_CALL: {
-            return compile_function_call(compiler, ast);
+            return compile_function_call(compiler, node, false);
         }
 
         case AST_DECLARATION: {
-            return compile_declaration(compiler, ast);
+            return compile_declaration(compiler, node);
+        }
+
+        // compiled on their own by compile_function
+        case AST_FUNCTION: {
+            return IR_NULL;
         }
     }
+
+    UNREACHABLE();
 }
 
-void compile(AST *ast, FILE *file)
+// marks every variable that `#` is used on, skipping type expressions
+// since `#int` in a declaration doesn't reference anything, and every
+// function that `become` is used on a call to
+static void find_uses(Compiler *compiler, ASTIndex node)
 {
+    const AST *ast = compiler->ast;
+
+    if (node == AST_NULL) {
+        return;
+    }
+
+    switch (ast_type(ast, node)) {
+        case AST_NODE: {
+            break;
+        }
+
+        case AST_INFIX: {
+            find_uses(compiler, ast_infix_lhs(ast, node));
+            find_uses(compiler, ast_infix_rhs(ast, node));
+            break;
+        }
+
+        case AST_PREFIX: {
+            const ASTIndex operand = ast_prefix_node(ast, node);
+
+            if (
+                ast_token_type(ast, node) == TOKEN_REFERENCE &&
+                ast_type(ast, operand) == AST_NODE &&
+                ast_token_type(ast, operand) == TOKEN_IDENT
+            ) {
+                compiler->address_taken[ast_binding(ast, operand)] = true;
+            }
+
+            if (ast_token_type(ast, node) == TOKEN_BECOME) {
+                const ASTIndex callee = called_function(compiler, operand);
+
+                if (callee != AST_NULL) {
+                    compiler->inlines[ast_binding(ast, callee)].become = true;
+                }
+            }
+
+            find_uses(compiler, operand);
+            break;
+        }
+
+        case AST_BLOCK: {
+            for (size_t i = 0; i < ast_block_len(ast, node); ++i) {
+                find_uses(compiler, ast_block_statement(ast, node, i));
+            }
+            break;
+        }
+
+        case AST_IF_STATEMENT: {
+            find_uses(compiler, ast_if_condition(ast, node));
+            find_uses(compiler, ast_if_branch(ast, node));
+            find_uses(compiler, ast_else_branch(ast, node));
+            break;
+        }
+
+        case AST_WHILE_LOOP: {
+            find_uses(compiler, ast_while_condition(ast, node));
+            find_uses(compiler, ast_while_body(ast, node));
+            break;
+        }
+
+        case AST_FUNCTION_CALL: {
+            find_uses(compiler, ast_function_call_lhs(ast, node));
+
+            for (size_t i = 0; i < ast_function_call_len(ast, node); ++i) {
+                find_uses(compiler, ast_function_call_argument(ast, node, i));
+            }
+            break;
+        }
+
+        case AST_DECLARATION: {
+            find_uses(compiler, ast_declaration_value(ast, node));
+            break;
+        }
+
+        case AST_FUNCTION: {
+            find_uses(compiler, ast_function_body(ast, node));
+            break;
+        }
+    }
+}
+
+// every call that `become` is used on has to have ended up a tail call
+static void check_become(const Compiler *compiler)
+{
+    const IR *ir = &compiler->ir;
+
+    bool frame = false;
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        for (size_t i = 0; i < ir->blocks[block].instructions_len; ++i) {
+            frame = frame || ir->blocks[block].instructions[i].opcode == IR_LOCAL;
+        }
+    }
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        for (size_t i = 0; i < ir->blocks[block].instructions_len; ++i) {
+            const IRInstruction *call = &ir->blocks[block].instructions[i];
+
+            if (call->opcode != IR_CALL || !call->function.become || call->function.tail) {
+                continue;
+            }
+
+            const int len = (int) call->function.name_len;
+            const char *name = call->function.name;
+
+            if (call->operands_len > ARRAY_LEN(ARGUMENT_REGISTERS)) {
+                ERROR("Can't become `%.*s`, it has more arguments than there are registers for.", len, name);
+            }
+
+            if (frame) {
+                ERROR("Can't become `%.*s`, something could still point into the frame.", len, name);
+            }
+
+            ERROR("Can't become `%.*s`, it isn't what the function returns.", len, name);
+        }
+    }
+}
+
+// The function's own IR, optimized and added to the context, which is
+// the program itself as _start when `function` is AST_NULL. Bindings
+// are never shared between functions, so they're all in `variables`.
+static void compile_function(Compiler *compiler, AsmContext *context, ASTIndex function)
+{
+    const AST *ast = compiler->ast;
+    const CompileOptions *options = compiler->options;
+
+    compiler->function = function;
+    compiler->ir = ir_new();
+    compiler->block = ir_block_new(&compiler->ir);
+    compiler->assignments_len = 0;
+
+    // a body that's inlined into more than one function would
+    // otherwise still have values from the last one's IR
+    for (size_t i = 0; i < compiler->table.bindings_len + 1; ++i) {
+        compiler->variables[i] = IR_NULL;
+    }
+
+    const Token name = function_name(compiler);
+
+    IRValue value;
+
+    if (function == AST_NULL) {
+        value = compile_ast(compiler, ast->root);
+    } else {
+        const size_t len = ast_function_len(ast, function);
+        IRValue *parameters = malloc(sizeof(*parameters) * (len + 1));
+
+        if (parameters == NULL) {
+            ALLOCATION_ERROR();
+        }
+
+        for (size_t i = 0; i < len; ++i) {
+            const ASTIndex parameter = ast_function_parameter(ast, function, i);
+            const DataType *data_type = ast->data_types[ast_declaration_type(ast, parameter)];
+
+            IRInstruction *instruction = ir_push(&compiler->ir, compiler->block, IR_PARAMETER, data_type, 0);
+            instruction->parameter = i;
+
+            parameters[i] = instruction->result;
+        }
+
+        value = compile_body(compiler, function, parameters);
+
+        free(parameters);
+    }
+
+    ir_return(&compiler->ir, compiler->block, value);
+
+    ir_mem2reg(&compiler->ir);
+    ir_optimize_loops(&compiler->ir, compiler->types, &options->loops);
+    ir_fold_constants(&compiler->ir);
+    ir_remove_dead_code(&compiler->ir);
+
+    // _start exits instead of returning, so it has nowhere to jump to
+    if (function != AST_NULL) {
+        ir_find_tail_calls(&compiler->ir, ARRAY_LEN(ARGUMENT_REGISTERS));
+    }
+
+    check_become(compiler);
+
+    if (options->dump_ir) {
+        if (function != AST_NULL) {
+            printf("fn %.*s:\n", (int) name.len, name.text);
+        }
+
+        ir_print(stdout, &compiler->ir);
+    }
+
+    asm_context_begin_function(context, name.len, name.text, function == AST_NULL);
+    ir_lower(&compiler->ir, context);
+    asm_context_end_function(context);
+
+    ir_free(&compiler->ir);
+}
+
+void compile(AST *ast, Arena *arena, const InternTable *interns, FILE *file, const CompileOptions *options)
+{
+    TypeTable types = type_table_new(arena);
+
     Compiler compiler = {
-        .table = symbol_table_new(),
-        .asm_context = asm_context_new(file)
+        .options = options,
+        .ast = ast,
+
+        .assignments_len = 0,
+        .assignments_cap = 256,
+
+        .mark = 0,
+
+        .types = &types,
+        .table = symbol_table_new(&types, interns)
     };
 
-    size_t arguments_cap = 16;
-    DataType **arguments = malloc(sizeof(*arguments) * arguments_cap);
+    const DataType *arguments[] = {
+        data_type_reference(&types, data_type_type(TYPE_INT8))
+    };
 
-    if (arguments == NULL) {
+    symbol_table_add_variable(
+        &compiler.table,
+        SYMBOL_PRINT,
+        data_type_function(&types, ARRAY_LEN(arguments), arguments, data_type_type(TYPE_VOID))
+    );
+
+    symbol_table_declare_functions(&compiler.table, ast, ast->root);
+    symbol_table_scan(&compiler.table, ast, ast->root);
+
+    const size_t bindings_len = compiler.table.bindings_len + 1;
+
+    compiler.address_taken = calloc(bindings_len, sizeof(*compiler.address_taken));
+    compiler.functions     = malloc(sizeof(*compiler.functions) * bindings_len);
+    compiler.inlines       = calloc(bindings_len, sizeof(*compiler.inlines));
+    compiler.variables     = malloc(sizeof(*compiler.variables) * bindings_len);
+    compiler.marks         = calloc(bindings_len, sizeof(*compiler.marks));
+    compiler.merge_values  = malloc(sizeof(*compiler.merge_values) * bindings_len);
+    compiler.assignments   = malloc(sizeof(*compiler.assignments) * compiler.assignments_cap);
+
+    if (compiler.address_taken == NULL || compiler.functions == NULL || compiler.inlines == NULL
+     || compiler.variables == NULL || compiler.marks == NULL || compiler.merge_values == NULL
+     || compiler.assignments == NULL) {
         ALLOCATION_ERROR();
     }
 
-    arguments[0] = data_type_reference(data_type_type(TYPE_INT8));
+    for (size_t i = 0; i < bindings_len; ++i) {
+        compiler.functions[i] = AST_NULL;
+    }
 
-    symbol_table_add_variable(
-        &compiler.table,
-        strlen("print"),
-        "print",
-        (Variable) {
-            .data_type = data_type_function(1, arguments_cap, arguments, data_type_type(TYPE_VOID))
+    for (size_t i = 0; i < ast_block_len(ast, ast->root); ++i) {
+        const ASTIndex statement = ast_block_statement(ast, ast->root, i);
+
+        if (ast_type(ast, statement) == AST_FUNCTION) {
+            compiler.functions[ast_binding(ast, statement)] = statement;
         }
-    );
+    }
+
+    find_uses(&compiler, ast->root);
+
+    if (options->arena_stats) {
+        arena_print_stats(stderr, arena, "type check");
+    }
 
-    symbol_table_scan(&compiler.table, ast);
-    compiler.table.scope_id = 0;
+    AsmContext asm_context = asm_context_new(file, options->output);
+    asm_context.peephole_window = options->peephole_window;
+    asm_context.avx2 = options->loops.vector_width == 32;
+    asm_context.frame_pointer = !options->omit_frame_pointer;
 
-    AsmData data = compile_ast(&compiler, ast);
+    compile_function(&compiler, &asm_context, AST_NULL);
 
-    asm_context_mov(&compiler.asm_context, asm_data_register(REGISTER_RAX, data.data_type), data);
+    for (size_t i = 0; i < ast_block_len(ast, ast->root); ++i) {
+        const ASTIndex statement = ast_block_statement(ast, ast->root, i);
+
+        if (ast_type(ast, statement) != AST_FUNCTION) {
+            continue;
+        }
 
-    asm_context_data_free(&compiler.asm_context, data);
-    asm_context_free(&compiler.asm_context);
+        // only ever called, so there's nothing left to call
+        if (is_inlined(&compiler, statement) && !compiler.inlines[ast_binding(ast, statement)].become) {
+            if (options->inline_report) {
+                const Token name = ast_token(ast, statement);
+                fprintf(stderr, "inline: %.*s has no routine, every call to it is inlined\n", (int) name.len, name.text);
+            }
+            continue;
+        }
+
+        compile_function(&compiler, &asm_context, statement);
+    }
+
+    if (options->stats) {
+        asm_peephole_print_stats(stderr, &asm_context);
+    }
+
+    if (options->frame_report) {
+        asm_context_print_frame(stderr, &asm_context);
+    }
+
+    asm_context_free(&asm_context);
+
+    free(compiler.address_taken);
+    free(compiler.functions);
+    free(compiler.inlines);
+    free(compiler.variables);
+    free(compiler.marks);
+    free(compiler.merge_values);
+    free(compiler.assignments);
     symbol_table_free(&compiler.table);
+    type_table_free(&types);
+
+    if (options->arena_stats) {
+        arena_print_stats(stderr, arena, "codegen");
+    }
 }
@@ -2,16 +2,116 @@
 #define COMPILE_H_
 
 #include <stdio.h>
+#include <stdbool.h>
+#include "arena.h"
+#include "intern.h"
 #include "type_checker.h"
 #include "asm_context.h"
 #include "parser.h"
+#include "ir.h"
+#include "ir_loop.h"
+
+#define INLINE_DEFAULT_BUDGET 40
+
+typedef struct CompileOptions
+{
+    // print arena usage after every phase
+    bool arena_stats;
+
+    // nasm assembly, or an executable
+    AsmOutput output;
+
+    // print the IR before it's lowered
+    bool dump_ir;
+
+    // print how often each optimization applied
+    bool stats;
+
+    // print what's in the stack frame and how big it got
+    bool frame_report;
+
+    // address the stack frame from rsp, see AsmContext
+    bool omit_frame_pointer;
+
+    // the most nodes a function can come to and still be inlined, 0 inlines nothing
+    size_t inline_budget;
+
+    // print whether each call was inlined and why
+    bool inline_report;
+
+    // see asm_peephole
+    size_t peephole_window;
+
+    // see ir_optimize_loops
+    IRLoopOptions loops;
+} CompileOptions;
+
+// what a variable was before it was assigned to, so that the assignments
+// in one branch of an if can be undone before compiling the other one
+typedef struct CompilerAssignment
+{
+    size_t binding;
+    IRValue value;
+} CompilerAssignment;
+
+// what's known about a function, for deciding whether to inline it
+typedef struct CompilerInline
+{
+    bool decided;
+
+    // it can end up calling itself
+    bool recursive;
+
+    // of its body, with what's inlined into it
+    size_t size;
+
+    // `become` is used on a call to it, which needs its routine
+    bool become;
+} CompilerInline;
 
 typedef struct Compiler
 {
+    const CompileOptions *options;
+
+    const AST *ast;
+
+    // indexed by binding, for the variables that `#` is used on
+    bool *address_taken;
+
+    // indexed by binding: the AST_FUNCTION it was declared by,
+    // AST_NULL for anything else, print included
+    ASTIndex *functions;
+    CompilerInline *inlines;
+
+    // indexed by binding: the current value of each variable,
+    // or the address of its stack slot if `#` is used on it
+    IRValue *variables;
+
+    // every change to `variables`, in order
+    size_t assignments_len;
+    size_t assignments_cap;
+    CompilerAssignment *assignments;
+
+    // indexed by binding, scratch space for merging the
+    // branches of an if and for making the phis of a loop
+    uint32_t *marks;
+    IRValue *merge_values;
+    uint32_t mark;
+
+    TypeTable *types;
     SymbolTable table;
-    AsmContext asm_context;
+
+    // the function that's being compiled, AST_NULL for the program
+    ASTIndex function;
+
+    // how many bodies deep into inlining it is
+    size_t inlining;
+    IR ir;
+
+    // where the code that's being compiled goes
+    IRBlockIndex block;
 } Compiler;
 
-void compile(AST *ast, FILE *file);
+void compile(AST *ast, Arena *arena, const InternTable *interns, FILE *file, const CompileOptions *options);
 
 #endif // COMPILE_H_
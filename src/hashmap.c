@@ -18,143 +18,33 @@ uint32_t hash_string(const char *string, const size_t string_len)
     return hashed;
 }
 
-HashMap hashmap_new(HashFn hash_fn, EqualsFn equals_fn, const size_t key_size, const size_t value_size)
+uint32_t hash_integer(uint64_t integer)
 {
-    HashMap hashmap = {
-        .hash_fn = hash_fn,
-        .equals_fn = equals_fn,
-        .key_size = key_size,
-        .value_size = value_size,
-    };
-
-    // clear the memory (init to NULL)
-    hashmap.buckets = malloc(sizeof(*hashmap.buckets) * HASHMAP_SIZE);
-
-    if (hashmap.buckets == NULL) {
-        ALLOCATION_ERROR();
-    }
-
-    memset(hashmap.buckets, 0, sizeof(*hashmap.buckets) * HASHMAP_SIZE);
-
-    return hashmap;
+    // murmur3 finalizer
+    integer ^= integer >> 33;
+    integer *= 0xff51afd7ed558ccd;
+    integer ^= integer >> 33;
+    integer *= 0xc4ceb9fe1a85ec53;
+    integer ^= integer >> 33;
+
+    return (uint32_t) integer;
 }
 
-void hashmap_insert(HashMap *hashmap, const void *key, const void *value)
+uint8_t *hashmap_ctrl_new(size_t cap)
 {
-    // hash the key
-    const uint32_t index = (*hashmap->hash_fn)(key) % HASHMAP_SIZE;
-
-    // allocate an entry
-    HashMapEntry *entry = malloc(sizeof(HashMapEntry));
-
-    if (entry == NULL) {
-        ALLOCATION_ERROR();
-    }
-
-    entry->key = malloc(hashmap->key_size);
-
-    if (entry->key == NULL) {
-        ALLOCATION_ERROR();
-    }
-
-    // copy the key
-    memcpy(entry->key, key, hashmap->key_size);
+    // groups are loaded with aligned SIMD loads
+    uint8_t *ctrl = aligned_alloc(HASHMAP_GROUP_WIDTH, cap);
 
-    entry->value = malloc(hashmap->value_size);
-
-    if (entry->value == NULL) {
+    if (ctrl == NULL) {
         ALLOCATION_ERROR();
     }
 
-    // copy the value
-    memcpy(entry->value, value, hashmap->value_size);
-
-    entry->next = NULL;
-
-    HashMapEntry *iter = hashmap->buckets[index];
-
-    if (iter == NULL) {
-        hashmap->buckets[index] = entry;
-        return;
-    }
-
-    // find the item in the hashmap (in case of collisions)
-    while (iter->next != NULL && !(*hashmap->equals_fn)(iter->next->key, entry->key)) {
-        iter = iter->next;
-    }
-
-    if (iter->next != NULL) {
-        entry->next = iter->next->next;
-        free(iter->next->key);
-        free(iter->next->value);
-        free(iter->next);
-    }
-    iter->next = entry;
-}
-
-void *hashmap_get(const HashMap *hashmap, const void *key)
-{
-    // hash the key
-    const uint32_t index = (*hashmap->hash_fn)(key) % HASHMAP_SIZE;
-
-    HashMapEntry *iter = hashmap->buckets[index];
-
-    // find the item in the hashmap (in case of collisions)
-    while (iter != NULL && !(*hashmap->equals_fn)(iter->key, key)) {
-        iter = iter->next;
-    }
-
-    if (iter == NULL) {
-        return NULL;
-    }
-
-    return iter->value;
-}
-
-void hashmap_remove(HashMap *hashmap, const void *key)
-{
-    const uint32_t index = (*hashmap->hash_fn)(key) % HASHMAP_SIZE;
-
-    HashMapEntry *prev = NULL;
-    HashMapEntry *iter = hashmap->buckets[index];
-
-    // find the item in the hashmap
-    while (iter != NULL && !(*hashmap->equals_fn)(iter->key, key)) {
-        prev = iter;
-        iter = iter->next;
-    }
-
-    if (iter == NULL) {
-        return; // Key not found
-    }
-
-    if (prev != NULL) {
-        prev->next = iter->next;
-    } else {
-        hashmap->buckets[index] = iter->next;
-    }
+    memset(ctrl, HASHMAP_EMPTY, cap);
 
-    free(iter->key);
-    free(iter->value);
-    free(iter);
+    return ctrl;
 }
 
-void hashmap_free(HashMap *hashmap)
+void hashmap_ctrl_free(uint8_t *ctrl)
 {
-    for (size_t i = 0; i < HASHMAP_SIZE; ++i) {
-        HashMapEntry *iter = hashmap->buckets[i];
-
-        // free every item
-        while (iter != NULL) {
-            HashMapEntry *next = iter->next;
-
-            free(iter->key);
-            free(iter->value);
-            free(iter);
-
-            iter = next;
-        }
-    }
-
-    free(hashmap->buckets);
+    free(ctrl);
 }
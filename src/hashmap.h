@@ -1,43 +1,91 @@
 #ifndef HASHMAP_H_
 #define HASHMAP_H_
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
-// prime number not close to 1024 or 2048
-#define HASHMAP_SIZE 1669
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-// don't judge
-typedef uint32_t (*HashFn)(const void *);
-typedef bool (*EqualsFn)(const void *, const void *);
+// Open addressing hash maps with one control byte per slot, in the
+// style of swiss tables.
+//
+// The slots are split into groups of HASHMAP_GROUP_WIDTH, and the control
+// bytes of a whole group are compared against the 7 bits of the hash
+// that aren't used to pick the group (one SSE2 compare), so the keys are
+// only compared for the slots that are likely to match.
+//
+// A map is generated for a key and value type by defining the parameters
+// below and including "hashmap_template.h":
+//
+//     #define HASHMAP_NAME   VariableMap
+//     #define HASHMAP_PREFIX variable_map
+//     #define HASHMAP_KEY    VariableID
+//     #define HASHMAP_VALUE  Variable
+//     #define HASHMAP_HASH   variable_id_hash   // uint32_t (const KEY *)
+//     #define HASHMAP_EQUALS variable_id_equals // bool (const KEY *, const KEY *)
+//     #include "hashmap_template.h"
+//
+// which defines `VariableMap` and `variable_map_new`, `variable_map_insert`,
+// `variable_map_get`, `variable_map_remove` and `variable_map_free`.
+// Keys and values are stored inline, next to each other.
 
-// An entry to the hashmap
-typedef struct HashMapEntry
-{
-    void *key;
-    void *value;
-    struct HashMapEntry *next;
-} HashMapEntry;
-
-typedef struct HashMap
-{
-    HashFn hash_fn;
-    EqualsFn equals_fn;
+#define HASHMAP_GROUP_WIDTH 16
 
-    size_t key_size;
-    size_t value_size;
+// smallest map, in slots
+#define HASHMAP_MIN_CAP HASHMAP_GROUP_WIDTH
 
-    HashMapEntry **buckets;
-} HashMap;
+// control bytes, full slots hold the low 7 bits of the hash instead
+#define HASHMAP_EMPTY   ((uint8_t) 0x80)
+#define HASHMAP_DELETED ((uint8_t) 0xfe)
 
 uint32_t hash_string(const char *string, const size_t string_len);
+uint32_t hash_integer(uint64_t integer);
 
-HashMap hashmap_new(HashFn hash_fn, EqualsFn equals_fn, const size_t key_size, const size_t value_size);
+// all control bytes start off empty
+uint8_t *hashmap_ctrl_new(size_t cap);
+void hashmap_ctrl_free(uint8_t *ctrl);
 
-void hashmap_insert(HashMap *hashmap, const void *key, const void *value);
-void *hashmap_get(const HashMap *hashmap, const void *key);
-void hashmap_remove(HashMap *hashmap, const void *key);
+// a bit for every slot in the group whose control byte is `byte`
+static inline uint32_t hashmap_group_match(const uint8_t *group, uint8_t byte)
+{
+#ifdef __SSE2__
+    const __m128i ctrl = _mm_load_si128((const __m128i *) group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(byte)));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < HASHMAP_GROUP_WIDTH; ++i) {
+        mask |= (uint32_t) (group[i] == byte) << i;
+    }
+    return mask;
+#endif
+}
 
-void hashmap_free(HashMap *hashmap);
+// a bit for every empty or deleted slot in the group,
+// which are the only control bytes with the top bit set
+static inline uint32_t hashmap_group_match_free(const uint8_t *group)
+{
+#ifdef __SSE2__
+    return _mm_movemask_epi8(_mm_load_si128((const __m128i *) group));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < HASHMAP_GROUP_WIDTH; ++i) {
+        mask |= (uint32_t) (group[i] >> 7) << i;
+    }
+    return mask;
+#endif
+}
+
+static inline uint8_t hashmap_hash_ctrl(uint32_t hash)
+{
+    return hash & 0x7f;
+}
+
+static inline size_t hashmap_hash_group(uint32_t hash, size_t groups_len)
+{
+    return (hash >> 7) & (groups_len - 1);
+}
 
 #endif // HASHMAP_H_
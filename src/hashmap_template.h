@@ -0,0 +1,225 @@
+// Generates a hash map for one key and value type, see "hashmap.h".
+// This header has no include guard on purpose, it is included once per map.
+
+#include <stdlib.h>
+#include "hashmap.h"
+#include "utils.h"
+
+#if !defined(HASHMAP_NAME) || !defined(HASHMAP_PREFIX) || !defined(HASHMAP_KEY) \
+ || !defined(HASHMAP_VALUE) || !defined(HASHMAP_HASH) || !defined(HASHMAP_EQUALS)
+#error "hashmap_template.h included without all of its parameters defined"
+#endif
+
+#define HASHMAP_CONCAT_(_lhs, _rhs) _lhs##_rhs
+#define HASHMAP_CONCAT(_lhs, _rhs) HASHMAP_CONCAT_(_lhs, _rhs)
+
+#define HASHMAP_FN(_name) HASHMAP_CONCAT(HASHMAP_PREFIX, _##_name)
+#define HASHMAP_ENTRY HASHMAP_CONCAT(HASHMAP_NAME, Entry)
+
+#define HASHMAP_NOT_FOUND ((size_t) -1)
+
+typedef struct HASHMAP_ENTRY
+{
+    HASHMAP_KEY key;
+    HASHMAP_VALUE value;
+} HASHMAP_ENTRY;
+
+typedef struct HASHMAP_NAME
+{
+    size_t len;
+
+    // empty slots that can still be filled before growing, so
+    // the map never gets more than 7/8 full (counting deleted slots)
+    size_t growth_left;
+
+    // always a power of two, and at least one group
+    size_t cap;
+    uint8_t *ctrl;
+    HASHMAP_ENTRY *entries;
+} HASHMAP_NAME;
+
+static inline HASHMAP_NAME HASHMAP_FN(with_cap)(size_t cap)
+{
+    HASHMAP_NAME map = {
+        .len = 0,
+        .growth_left = cap / 8 * 7,
+        .cap = cap,
+        .ctrl = hashmap_ctrl_new(cap)
+    };
+
+    map.entries = malloc(sizeof(*map.entries) * cap);
+
+    if (map.entries == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    return map;
+}
+
+static inline HASHMAP_NAME HASHMAP_FN(new)(void)
+{
+    return HASHMAP_FN(with_cap)(HASHMAP_MIN_CAP);
+}
+
+static inline size_t HASHMAP_FN(find)(const HASHMAP_NAME *map, const HASHMAP_KEY *key, uint32_t hash)
+{
+    const uint8_t ctrl = hashmap_hash_ctrl(hash);
+    const size_t groups_len = map->cap / HASHMAP_GROUP_WIDTH;
+
+    size_t group = hashmap_hash_group(hash, groups_len);
+
+    // triangular probing, which visits every group
+    for (size_t probe = 1;; ++probe) {
+        const uint8_t *group_ctrl = map->ctrl + group * HASHMAP_GROUP_WIDTH;
+
+        uint32_t match = hashmap_group_match(group_ctrl, ctrl);
+
+        while (match != 0) {
+            const size_t slot = group * HASHMAP_GROUP_WIDTH + __builtin_ctz(match);
+
+            if (HASHMAP_EQUALS(&map->entries[slot].key, key)) {
+                return slot;
+            }
+
+            match &= match - 1;
+        }
+
+        // the key would have been put in this empty slot
+        if (hashmap_group_match(group_ctrl, HASHMAP_EMPTY) != 0) {
+            return HASHMAP_NOT_FOUND;
+        }
+
+        group = (group + probe) & (groups_len - 1);
+    }
+}
+
+// first empty or deleted slot on the probe sequence of `hash`
+static inline size_t HASHMAP_FN(find_free)(const HASHMAP_NAME *map, uint32_t hash)
+{
+    const size_t groups_len = map->cap / HASHMAP_GROUP_WIDTH;
+
+    size_t group = hashmap_hash_group(hash, groups_len);
+
+    for (size_t probe = 1;; ++probe) {
+        const uint32_t match = hashmap_group_match_free(map->ctrl + group * HASHMAP_GROUP_WIDTH);
+
+        if (match != 0) {
+            return group * HASHMAP_GROUP_WIDTH + __builtin_ctz(match);
+        }
+
+        group = (group + probe) & (groups_len - 1);
+    }
+}
+
+static inline void HASHMAP_FN(rehash)(HASHMAP_NAME *map, size_t cap)
+{
+    HASHMAP_NAME rehashed = HASHMAP_FN(with_cap)(cap);
+
+    for (size_t slot = 0; slot < map->cap; ++slot) {
+        if (map->ctrl[slot] & HASHMAP_EMPTY) {
+            continue;
+        }
+
+        const uint32_t hash = HASHMAP_HASH(&map->entries[slot].key);
+        const size_t new_slot = HASHMAP_FN(find_free)(&rehashed, hash);
+
+        rehashed.ctrl[new_slot] = hashmap_hash_ctrl(hash);
+        rehashed.entries[new_slot] = map->entries[slot];
+    }
+
+    rehashed.len = map->len;
+    rehashed.growth_left -= map->len;
+
+    hashmap_ctrl_free(map->ctrl);
+    free(map->entries);
+
+    *map = rehashed;
+}
+
+static inline HASHMAP_VALUE *HASHMAP_FN(get)(const HASHMAP_NAME *map, const HASHMAP_KEY *key)
+{
+    const size_t slot = HASHMAP_FN(find)(map, key, HASHMAP_HASH(key));
+
+    if (slot == HASHMAP_NOT_FOUND) {
+        return NULL;
+    }
+
+    return &map->entries[slot].value;
+}
+
+static inline void HASHMAP_FN(insert)(HASHMAP_NAME *map, const HASHMAP_KEY *key, const HASHMAP_VALUE *value)
+{
+    const uint32_t hash = HASHMAP_HASH(key);
+
+    size_t slot = HASHMAP_FN(find)(map, key, hash);
+
+    if (slot != HASHMAP_NOT_FOUND) {
+        map->entries[slot].value = *value;
+        return;
+    }
+
+    if (map->growth_left == 0) {
+        // if most of the used slots are just deleted,
+        // cleaning them up is enough
+        if ((map->len + 1) * 16 > map->cap * 7) {
+            HASHMAP_FN(rehash)(map, map->cap * 2);
+        } else {
+            HASHMAP_FN(rehash)(map, map->cap);
+        }
+    }
+
+    slot = HASHMAP_FN(find_free)(map, hash);
+
+    if (map->ctrl[slot] == HASHMAP_EMPTY) {
+        --map->growth_left;
+    }
+
+    map->ctrl[slot] = hashmap_hash_ctrl(hash);
+    map->entries[slot] = (HASHMAP_ENTRY) {
+        .key = *key,
+        .value = *value
+    };
+
+    ++map->len;
+}
+
+static inline void HASHMAP_FN(remove)(HASHMAP_NAME *map, const HASHMAP_KEY *key)
+{
+    const size_t slot = HASHMAP_FN(find)(map, key, HASHMAP_HASH(key));
+
+    if (slot == HASHMAP_NOT_FOUND) {
+        return;
+    }
+
+    --map->len;
+
+    // a probe only ever continues past a group with no empty slots,
+    // so if this group still has one, nothing can be relying on this slot
+    const uint8_t *group_ctrl = map->ctrl + (slot & ~(size_t) (HASHMAP_GROUP_WIDTH - 1));
+
+    if (hashmap_group_match(group_ctrl, HASHMAP_EMPTY) != 0) {
+        map->ctrl[slot] = HASHMAP_EMPTY;
+        ++map->growth_left;
+    } else {
+        map->ctrl[slot] = HASHMAP_DELETED;
+    }
+}
+
+static inline void HASHMAP_FN(free)(HASHMAP_NAME *map)
+{
+    hashmap_ctrl_free(map->ctrl);
+    free(map->entries);
+}
+
+#undef HASHMAP_NOT_FOUND
+#undef HASHMAP_ENTRY
+#undef HASHMAP_FN
+#undef HASHMAP_CONCAT
+#undef HASHMAP_CONCAT_
+
+#undef HASHMAP_NAME
+#undef HASHMAP_PREFIX
+#undef HASHMAP_KEY
+#undef HASHMAP_VALUE
+#undef HASHMAP_HASH
+#undef HASHMAP_EQUALS
@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <string.h>
+#include "intern.h"
+#include "hashmap.h"
+#include "utils.h"
+
+static const char *BUILTIN_SYMBOL_TO_STRING[BUILTIN_SYMBOLS] = {
+    [SYMBOL_S8]     = "s8",
+    [SYMBOL_S16]    = "s16",
+    [SYMBOL_S32]    = "s32",
+    [SYMBOL_S64]    = "s64",
+    [SYMBOL_INT]    = "int",
+    [SYMBOL_VOID]   = "void",
+    [SYMBOL_STRING] = "string",
+    [SYMBOL_PRINT]  = "print"
+};
+
+static void intern_table_grow(InternTable *table)
+{
+    const size_t slots_cap = table->slots_cap * 2;
+
+    uint32_t *slots = calloc(slots_cap, sizeof(*slots));
+
+    if (slots == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    // rehash using the stored hashes, the names never move
+    for (size_t i = 0; i < table->names_len; ++i) {
+        size_t index = table->names[i].hash & (slots_cap - 1);
+
+        while (slots[index] != 0) {
+            index = (index + 1) & (slots_cap - 1);
+        }
+
+        slots[index] = i + 1;
+    }
+
+    free(table->slots);
+
+    table->slots_cap = slots_cap;
+    table->slots = slots;
+}
+
+InternTable intern_table_new(void)
+{
+    InternTable table = {
+        .names_len = 0,
+        .names_cap = 256,
+
+        .slots_cap = 512
+    };
+
+    table.names = malloc(sizeof(*table.names) * table.names_cap);
+    table.slots = calloc(table.slots_cap, sizeof(*table.slots));
+
+    if (table.names == NULL || table.slots == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (size_t i = 0; i < BUILTIN_SYMBOLS; ++i) {
+        const char *name = BUILTIN_SYMBOL_TO_STRING[i];
+        intern(&table, name, strlen(name));
+    }
+
+    return table;
+}
+
+Symbol intern(InternTable *table, const char *text, size_t len)
+{
+    const uint32_t hash = hash_string(text, len);
+
+    size_t index = hash & (table->slots_cap - 1);
+
+    // linear probing
+    while (table->slots[index] != 0) {
+        const Symbol symbol = table->slots[index] - 1;
+        const InternName *name = &table->names[symbol];
+
+        if (name->hash == hash && name->len == len && memcmp(name->text, text, len) == 0) {
+            return symbol;
+        }
+
+        index = (index + 1) & (table->slots_cap - 1);
+    }
+
+    if (table->names_len >= UINT32_MAX - 1) {
+        ERROR("Too many identifiers.");
+    }
+
+    if (table->names_len >= table->names_cap) {
+        while (table->names_len >= table->names_cap) {
+            table->names_cap *= 2;
+        }
+
+        table->names = realloc(table->names, sizeof(*table->names) * table->names_cap);
+
+        if (table->names == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    const Symbol symbol = table->names_len++;
+
+    table->names[symbol] = (InternName) {
+        .hash = hash,
+        .len  = len,
+        .text = text
+    };
+    table->slots[index] = symbol + 1;
+
+    // keep the load factor under a half
+    if (table->names_len * 2 > table->slots_cap) {
+        intern_table_grow(table);
+    }
+
+    return symbol;
+}
+
+InternName intern_name(const InternTable *table, Symbol symbol)
+{
+    return table->names[symbol];
+}
+
+void intern_table_free(InternTable *table)
+{
+    free(table->names);
+    free(table->slots);
+}
@@ -0,0 +1,51 @@
+#ifndef INTERN_H_
+#define INTERN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A dense id for every distinct identifier in a program.
+typedef uint32_t Symbol;
+
+// interned before anything else, so these ids never change
+typedef enum BuiltinSymbol
+{
+    SYMBOL_S8,
+    SYMBOL_S16,
+    SYMBOL_S32,
+    SYMBOL_S64,
+    SYMBOL_INT,
+    SYMBOL_VOID,
+    SYMBOL_STRING,
+    SYMBOL_PRINT,
+
+    BUILTIN_SYMBOLS
+} BuiltinSymbol;
+
+typedef struct InternName
+{
+    uint32_t hash;
+    size_t len;
+    const char *text;
+} InternName;
+
+typedef struct InternTable
+{
+    // indexed by symbol, the names point into the source
+    size_t names_len;
+    size_t names_cap;
+    InternName *names;
+
+    // open addressing, holds symbol + 1 so that 0 is empty
+    size_t slots_cap;
+    uint32_t *slots;
+} InternTable;
+
+InternTable intern_table_new(void);
+
+Symbol intern(InternTable *table, const char *text, size_t len);
+InternName intern_name(const InternTable *table, Symbol symbol);
+
+void intern_table_free(InternTable *table);
+
+#endif // INTERN_H_
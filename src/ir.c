@@ -0,0 +1,579 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "ir.h"
+#include "utils.h"
+
+IR ir_new(void)
+{
+    IR ir = {
+        .blocks_len = 0,
+        .blocks_cap = 16,
+
+        .operands_len = 0,
+        .operands_cap = 256,
+
+        .values_len = 0,
+        .values_cap = 256
+    };
+
+    ir.blocks = malloc(sizeof(*ir.blocks) * ir.blocks_cap);
+    ir.operands = malloc(sizeof(*ir.operands) * ir.operands_cap);
+    ir.value_types = malloc(sizeof(*ir.value_types) * ir.values_cap);
+
+    if (ir.blocks == NULL || ir.operands == NULL || ir.value_types == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    return ir;
+}
+
+IRBlockIndex ir_block_new(IR *ir)
+{
+    if (ir->blocks_len >= ir->blocks_cap) {
+        while (ir->blocks_len >= ir->blocks_cap) {
+            ir->blocks_cap *= 2;
+        }
+
+        ir->blocks = realloc(ir->blocks, sizeof(*ir->blocks) * ir->blocks_cap);
+
+        if (ir->blocks == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    IRBlock *block = &ir->blocks[ir->blocks_len];
+
+    *block = (IRBlock) {
+        .instructions_len = 0,
+        .instructions_cap = 16,
+
+        .predecessors_len = 0,
+        .predecessors_cap = 2
+    };
+
+    block->instructions = malloc(sizeof(*block->instructions) * block->instructions_cap);
+    block->predecessors = malloc(sizeof(*block->predecessors) * block->predecessors_cap);
+
+    if (block->instructions == NULL || block->predecessors == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    return ir->blocks_len++;
+}
+
+void ir_layout(IR *ir, const IRBlockIndex *order)
+{
+    IRBlockIndex *indices = malloc(sizeof(*indices) * ir->blocks_len);
+    IRBlock *blocks = malloc(sizeof(*blocks) * ir->blocks_cap);
+
+    if (indices == NULL || blocks == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        indices[order[block]] = block;
+        blocks[block] = ir->blocks[order[block]];
+    }
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        IRBlock *ir_block = &blocks[block];
+
+        for (size_t i = 0; i < ir_block->predecessors_len; ++i) {
+            ir_block->predecessors[i] = indices[ir_block->predecessors[i]];
+        }
+
+        if (ir_block->instructions_len == 0) {
+            continue;
+        }
+
+        IRInstruction *terminator = &ir_block->instructions[ir_block->instructions_len - 1];
+
+        if (terminator->opcode == IR_JUMP || terminator->opcode == IR_BRANCH) {
+            terminator->targets[0] = indices[terminator->targets[0]];
+        }
+
+        if (terminator->opcode == IR_BRANCH) {
+            terminator->targets[1] = indices[terminator->targets[1]];
+        }
+    }
+
+    free(ir->blocks);
+    ir->blocks = blocks;
+
+    free(indices);
+}
+
+static void ir_add_predecessor(IR *ir, IRBlockIndex block, IRBlockIndex predecessor)
+{
+    IRBlock *ir_block = &ir->blocks[block];
+
+    if (ir_block->predecessors_len >= ir_block->predecessors_cap) {
+        while (ir_block->predecessors_len >= ir_block->predecessors_cap) {
+            ir_block->predecessors_cap *= 2;
+        }
+
+        ir_block->predecessors = realloc(
+            ir_block->predecessors,
+            sizeof(*ir_block->predecessors) * ir_block->predecessors_cap
+        );
+
+        if (ir_block->predecessors == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    ir_block->predecessors[ir_block->predecessors_len++] = predecessor;
+}
+
+IRInstruction *ir_push(IR *ir, IRBlockIndex block, IROpcode opcode, const DataType *data_type, size_t operands_len)
+{
+    IRBlock *ir_block = &ir->blocks[block];
+
+    if (ir_block->instructions_len >= ir_block->instructions_cap) {
+        while (ir_block->instructions_len >= ir_block->instructions_cap) {
+            ir_block->instructions_cap *= 2;
+        }
+
+        ir_block->instructions = realloc(
+            ir_block->instructions,
+            sizeof(*ir_block->instructions) * ir_block->instructions_cap
+        );
+
+        if (ir_block->instructions == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    if (ir->operands_len + operands_len >= UINT32_MAX) {
+        ERROR("Too many IR operands.");
+    }
+
+    if (ir->operands_len + operands_len > ir->operands_cap) {
+        while (ir->operands_len + operands_len > ir->operands_cap) {
+            ir->operands_cap *= 2;
+        }
+
+        ir->operands = realloc(ir->operands, sizeof(*ir->operands) * ir->operands_cap);
+
+        if (ir->operands == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    if (data_type != NULL) {
+        if (ir->values_len >= IR_NULL) {
+            ERROR("Too many IR values.");
+        }
+
+        if (ir->values_len >= ir->values_cap) {
+            while (ir->values_len >= ir->values_cap) {
+                ir->values_cap *= 2;
+            }
+
+            ir->value_types = realloc(ir->value_types, sizeof(*ir->value_types) * ir->values_cap);
+
+            if (ir->value_types == NULL) {
+                ALLOCATION_ERROR();
+            }
+        }
+
+        ir->value_types[ir->values_len] = data_type;
+    }
+
+    IRInstruction *instruction = &ir_block->instructions[ir_block->instructions_len++];
+
+    *instruction = (IRInstruction) {
+        .opcode = opcode,
+        .data_type = data_type,
+        .result = data_type != NULL ? ir->values_len++ : IR_NULL,
+        .operands = ir->operands_len,
+        .operands_len = operands_len
+    };
+
+    for (size_t i = 0; i < operands_len; ++i) {
+        ir->operands[ir->operands_len++] = IR_NULL;
+    }
+
+    return instruction;
+}
+
+IRInstruction *ir_insert(IR *ir, IRBlockIndex block, size_t position, IROpcode opcode, const DataType *data_type, size_t operands_len)
+{
+    const IRInstruction instruction = *ir_push(ir, block, opcode, data_type, operands_len);
+
+    IRBlock *ir_block = &ir->blocks[block];
+
+    for (size_t i = ir_block->instructions_len - 1; i > position; --i) {
+        ir_block->instructions[i] = ir_block->instructions[i - 1];
+    }
+
+    ir_block->instructions[position] = instruction;
+
+    return &ir_block->instructions[position];
+}
+
+void ir_place(IR *ir, IRBlockIndex block, size_t position, size_t instructions_len, const IRInstruction *instructions)
+{
+    IRBlock *ir_block = &ir->blocks[block];
+
+    if (ir_block->instructions_len + instructions_len > ir_block->instructions_cap) {
+        while (ir_block->instructions_len + instructions_len > ir_block->instructions_cap) {
+            ir_block->instructions_cap *= 2;
+        }
+
+        ir_block->instructions = realloc(
+            ir_block->instructions,
+            sizeof(*ir_block->instructions) * ir_block->instructions_cap
+        );
+
+        if (ir_block->instructions == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    memmove(
+        &ir_block->instructions[position + instructions_len],
+        &ir_block->instructions[position],
+        sizeof(*ir_block->instructions) * (ir_block->instructions_len - position)
+    );
+
+    memcpy(&ir_block->instructions[position], instructions, sizeof(*instructions) * instructions_len);
+
+    ir_block->instructions_len += instructions_len;
+}
+
+IRValue ir_const(IR *ir, IRBlockIndex block, const DataType *data_type, uint64_t constant)
+{
+    IRInstruction *instruction = ir_push(ir, block, IR_CONST, data_type, 0);
+    instruction->constant = constant;
+
+    return instruction->result;
+}
+
+IRValue ir_unary(IR *ir, IRBlockIndex block, IROpcode opcode, const DataType *data_type, IRValue operand)
+{
+    IRInstruction *instruction = ir_push(ir, block, opcode, data_type, 1);
+    ir_operands(ir, instruction)[0] = operand;
+
+    return instruction->result;
+}
+
+IRValue ir_binary(IR *ir, IRBlockIndex block, IROpcode opcode, const DataType *data_type, IRValue lhs, IRValue rhs)
+{
+    IRInstruction *instruction = ir_push(ir, block, opcode, data_type, 2);
+    ir_operands(ir, instruction)[0] = lhs;
+    ir_operands(ir, instruction)[1] = rhs;
+
+    return instruction->result;
+}
+
+void ir_store(IR *ir, IRBlockIndex block, IRValue address, IRValue value)
+{
+    ir_binary(ir, block, IR_STORE, NULL, address, value);
+}
+
+void ir_jump(IR *ir, IRBlockIndex block, IRBlockIndex target)
+{
+    IRInstruction *instruction = ir_push(ir, block, IR_JUMP, NULL, 0);
+    instruction->targets[0] = target;
+
+    ir_add_predecessor(ir, target, block);
+}
+
+void ir_branch(IR *ir, IRBlockIndex block, IRValue condition, IRBlockIndex taken, IRBlockIndex not_taken)
+{
+    IRInstruction *instruction = ir_push(ir, block, IR_BRANCH, NULL, 1);
+    ir_operands(ir, instruction)[0] = condition;
+    instruction->targets[0] = taken;
+    instruction->targets[1] = not_taken;
+
+    ir_add_predecessor(ir, taken, block);
+    ir_add_predecessor(ir, not_taken, block);
+}
+
+void ir_return(IR *ir, IRBlockIndex block, IRValue value)
+{
+    if (value == IR_NULL) {
+        ir_push(ir, block, IR_RETURN, NULL, 0);
+    } else {
+        ir_unary(ir, block, IR_RETURN, NULL, value);
+    }
+}
+
+// whether it has to stay even if nothing uses its result
+static bool ir_has_effect(IROpcode opcode)
+{
+    switch (opcode) {
+        case IR_STORE:
+        case IR_CALL:
+        case IR_JUMP:
+        case IR_BRANCH:
+        case IR_RETURN: {
+            return true;
+        }
+
+        default: {
+            return false;
+        }
+    }
+}
+
+void ir_remove_dead_code(IR *ir)
+{
+    const IRInstruction **definitions = malloc(sizeof(*definitions) * (ir->values_len + 1));
+    bool *live = calloc(ir->values_len + 1, sizeof(*live));
+
+    size_t worklist_len = 0;
+    IRValue *worklist = malloc(sizeof(*worklist) * (ir->values_len + 1));
+
+    if (definitions == NULL || live == NULL || worklist == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (size_t block = 0; block < ir->blocks_len; ++block) {
+        const IRBlock *ir_block = &ir->blocks[block];
+
+        for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+            const IRInstruction *instruction = &ir_block->instructions[i];
+
+            if (instruction->result != IR_NULL) {
+                definitions[instruction->result] = instruction;
+            }
+
+            if (!ir_has_effect(instruction->opcode)) {
+                continue;
+            }
+
+            for (size_t j = 0; j < instruction->operands_len; ++j) {
+                const IRValue operand = ir_operands(ir, instruction)[j];
+
+                if (!live[operand]) {
+                    live[operand] = true;
+                    worklist[worklist_len++] = operand;
+                }
+            }
+        }
+    }
+
+    while (worklist_len > 0) {
+        const IRInstruction *instruction = definitions[worklist[--worklist_len]];
+
+        for (size_t j = 0; j < instruction->operands_len; ++j) {
+            const IRValue operand = ir_operands(ir, instruction)[j];
+
+            if (!live[operand]) {
+                live[operand] = true;
+                worklist[worklist_len++] = operand;
+            }
+        }
+    }
+
+    for (size_t block = 0; block < ir->blocks_len; ++block) {
+        IRBlock *ir_block = &ir->blocks[block];
+
+        size_t len = 0;
+
+        for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+            const IRInstruction *instruction = &ir_block->instructions[i];
+
+            if (ir_has_effect(instruction->opcode) || live[instruction->result]) {
+                ir_block->instructions[len++] = *instruction;
+            } else if (instruction->opcode == IR_STRING) {
+                free(instruction->string.data);
+            }
+        }
+
+        ir_block->instructions_len = len;
+    }
+
+    free(definitions);
+    free(live);
+    free(worklist);
+}
+
+static void ir_print_data_type(FILE *file, const DataType *data_type)
+{
+    switch (data_type->type) {
+        case TYPE_NULL:
+        case TYPE_VOID: {
+            fprintf(file, "void");
+            break;
+        }
+
+        case TYPE_FUNCTION: {
+            fprintf(file, "fn");
+            break;
+        }
+
+        case TYPE_REFERENCE: {
+            fprintf(file, "#");
+            ir_print_data_type(file, data_type->dereference);
+            break;
+        }
+
+        case TYPE_ARRAY: {
+            fprintf(file, "[%zu]", data_type->array.len);
+            ir_print_data_type(file, data_type->array.element);
+            break;
+        }
+
+        case TYPE_INT8: {
+            fprintf(file, "s8");
+            break;
+        }
+
+        case TYPE_INT16: {
+            fprintf(file, "s16");
+            break;
+        }
+
+        case TYPE_INT32: {
+            fprintf(file, "s32");
+            break;
+        }
+
+        case TYPE_INT64: {
+            fprintf(file, "s64");
+            break;
+        }
+
+        case DATA_TYPES: {
+            UNREACHABLE();
+        }
+    }
+}
+
+static void ir_print_instruction(FILE *file, const IR *ir, const IRBlock *block, const IRInstruction *instruction)
+{
+    fprintf(file, "    ");
+
+    if (instruction->result != IR_NULL) {
+        fprintf(file, "%%%u = ", instruction->result);
+    }
+
+    fprintf(file, "%s", IR_OPCODE_TO_STRING[instruction->opcode]);
+
+    if (instruction->data_type != NULL) {
+        fprintf(file, " ");
+        ir_print_data_type(file, instruction->data_type);
+    }
+
+    switch (instruction->opcode) {
+        case IR_CONST: {
+            fprintf(file, " %lld", (long long) instruction->constant);
+            break;
+        }
+
+        case IR_PARAMETER: {
+            fprintf(file, " %zu", instruction->parameter);
+            break;
+        }
+
+        case IR_STRING: {
+            fprintf(file, " \"");
+            for (size_t i = 0; i < instruction->string.len - 1; ++i) {
+                const char c = instruction->string.data[i];
+
+                if (c == '\n') {
+                    fprintf(file, "\\n");
+                } else if (c == '\t') {
+                    fprintf(file, "\\t");
+                } else if (c == '"' || c == '\\') {
+                    fprintf(file, "\\%c", c);
+                } else if (c < ' ' || c > '~') {
+                    fprintf(file, "\\x%02x", (unsigned char) c);
+                } else {
+                    fprintf(file, "%c", c);
+                }
+            }
+            fprintf(file, "\"");
+            break;
+        }
+
+        case IR_PHI: {
+            for (size_t i = 0; i < instruction->operands_len; ++i) {
+                fprintf(
+                    file,
+                    "%s [%%%u, block%u]",
+                    i == 0 ? "" : ",",
+                    ir_operands(ir, instruction)[i],
+                    block->predecessors[i]
+                );
+            }
+            break;
+        }
+
+        case IR_CALL: {
+            fprintf(file, " %.*s(", (int) instruction->function.name_len, instruction->function.name);
+            for (size_t i = 0; i < instruction->operands_len; ++i) {
+                fprintf(file, "%s%%%u", i == 0 ? "" : ", ", ir_operands(ir, instruction)[i]);
+            }
+            fprintf(file, ")%s", instruction->function.tail ? " tail" : "");
+            break;
+        }
+
+        case IR_JUMP: {
+            fprintf(file, " block%u", instruction->targets[0]);
+            break;
+        }
+
+        case IR_BRANCH: {
+            fprintf(
+                file,
+                " %%%u, block%u, block%u",
+                ir_operands(ir, instruction)[0],
+                instruction->targets[0],
+                instruction->targets[1]
+            );
+            break;
+        }
+
+        default: {
+            for (size_t i = 0; i < instruction->operands_len; ++i) {
+                fprintf(file, "%s %%%u", i == 0 ? "" : ",", ir_operands(ir, instruction)[i]);
+            }
+            break;
+        }
+    }
+
+    fprintf(file, "\n");
+}
+
+void ir_print(FILE *file, const IR *ir)
+{
+    for (size_t i = 0; i < ir->blocks_len; ++i) {
+        const IRBlock *block = &ir->blocks[i];
+
+        if (block->instructions_len == 0) {
+            continue;
+        }
+
+        fprintf(file, "block%zu:", i);
+
+        if (block->predecessors_len > 0) {
+            fprintf(file, " ; preds");
+            for (size_t j = 0; j < block->predecessors_len; ++j) {
+                fprintf(file, "%s block%u", j == 0 ? "" : ",", block->predecessors[j]);
+            }
+        }
+
+        fprintf(file, "\n");
+
+        for (size_t j = 0; j < block->instructions_len; ++j) {
+            ir_print_instruction(file, ir, block, &block->instructions[j]);
+        }
+    }
+}
+
+void ir_free(IR *ir)
+{
+    for (size_t i = 0; i < ir->blocks_len; ++i) {
+        free(ir->blocks[i].instructions);
+        free(ir->blocks[i].predecessors);
+    }
+
+    free(ir->blocks);
+    free(ir->operands);
+    free(ir->value_types);
+}
@@ -0,0 +1,267 @@
+#ifndef IR_H_
+#define IR_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "types.h"
+
+// Every value is defined by exactly one instruction.
+typedef uint32_t IRValue;
+
+#define IR_NULL ((IRValue) UINT32_MAX)
+
+typedef uint32_t IRBlockIndex;
+
+typedef enum IROpcode
+{
+    IR_CONST,
+    IR_STRING,
+
+    // the address of a stack slot, for the variables that `#` is used on
+    IR_LOCAL,
+
+    // one of the function's arguments, only ever in the entry block
+    IR_PARAMETER,
+
+    // one operand per predecessor, in the order of the block's predecessors
+    IR_PHI,
+
+    IR_ADD,
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+
+    IR_EQ,
+    IR_NE,
+    IR_LT,
+    IR_GT,
+    IR_LE,
+    IR_GE,
+
+    IR_NEG,
+    IR_NOT,
+
+    // load address, store address value
+    IR_LOAD,
+    IR_STORE,
+
+    // index array position, the address of the element at `position`,
+    // whose size is the size of what the result points to
+    IR_INDEX,
+
+    // broadcast value, an array of values that fits in a vector register
+    IR_BROADCAST,
+
+    // the arguments are its operands
+    IR_CALL,
+
+    // every block ends in exactly one of these
+    IR_JUMP,
+    IR_BRANCH,
+    IR_RETURN,
+
+    IR_OPCODES
+} IROpcode;
+
+static const char *const IR_OPCODE_TO_STRING[IR_OPCODES] = {
+    [IR_CONST]     = "const",
+    [IR_STRING]    = "string",
+    [IR_LOCAL]     = "local",
+    [IR_PARAMETER] = "parameter",
+    [IR_PHI]       = "phi",
+    [IR_ADD]       = "add",
+    [IR_SUB]       = "sub",
+    [IR_MUL]       = "mul",
+    [IR_DIV]       = "div",
+    [IR_EQ]        = "eq",
+    [IR_NE]        = "ne",
+    [IR_LT]        = "lt",
+    [IR_GT]        = "gt",
+    [IR_LE]        = "le",
+    [IR_GE]        = "ge",
+    [IR_NEG]       = "neg",
+    [IR_NOT]       = "not",
+    [IR_LOAD]      = "load",
+    [IR_STORE]     = "store",
+    [IR_INDEX]     = "index",
+    [IR_BROADCAST] = "broadcast",
+    [IR_CALL]      = "call",
+    [IR_JUMP]      = "jump",
+    [IR_BRANCH]    = "branch",
+    [IR_RETURN]    = "return"
+};
+
+// the comparison that's the same with its operands swapped
+static const IROpcode IR_MIRRORED_COMPARISON[IR_OPCODES] = {
+    [IR_EQ] = IR_EQ,
+    [IR_NE] = IR_NE,
+    [IR_LT] = IR_GT,
+    [IR_GT] = IR_LT,
+    [IR_LE] = IR_GE,
+    [IR_GE] = IR_LE
+};
+
+// the comparison that's true exactly when this one isn't
+static const IROpcode IR_INVERTED_COMPARISON[IR_OPCODES] = {
+    [IR_EQ] = IR_NE,
+    [IR_NE] = IR_EQ,
+    [IR_LT] = IR_GE,
+    [IR_GT] = IR_LE,
+    [IR_LE] = IR_GT,
+    [IR_GE] = IR_LT
+};
+
+static inline bool ir_opcode_is_comparison(IROpcode opcode)
+{
+    return opcode >= IR_EQ && opcode <= IR_GE;
+}
+
+typedef struct IRInstruction
+{
+    IROpcode opcode;
+
+    // of the result
+    const DataType *data_type;
+
+    // IR_NULL if it doesn't define a value
+    IRValue result;
+
+    // where its operands start in the IR's `operands`
+    uint32_t operands;
+    uint32_t operands_len;
+
+    union {
+        // IR_CONST
+        uint64_t constant;
+
+        // IR_PARAMETER, which of the arguments it is
+        size_t parameter;
+
+        // IR_STRING, owned by the IR until lowering hands it to the data section
+        struct {
+            size_t len;
+            char *data;
+        } string;
+
+        // IR_CALL
+        struct {
+            size_t name_len;
+            const char *name;
+            const DataType *data_type;
+
+            // see ir_find_tail_calls
+            bool tail;
+
+            // from `become`, so it has to end up a tail call
+            bool become;
+        } function;
+
+        // IR_JUMP and IR_BRANCH, the taken one first
+        IRBlockIndex targets[2];
+    };
+} IRInstruction;
+
+typedef struct IRBlock
+{
+    size_t instructions_len;
+    size_t instructions_cap;
+    IRInstruction *instructions;
+
+    size_t predecessors_len;
+    size_t predecessors_cap;
+    IRBlockIndex *predecessors;
+} IRBlock;
+
+// The program as basic blocks of SSA instructions. Blocks are laid out
+// in the order they were made in, the first one is the entry.
+//
+// A block with more than one successor never jumps straight to a block
+// with more than one predecessor, so there's always somewhere to put
+// the copies for a phi. Blocks that can't be reached are left
+// without any instructions.
+typedef struct IR
+{
+    size_t blocks_len;
+    size_t blocks_cap;
+    IRBlock *blocks;
+
+    size_t operands_len;
+    size_t operands_cap;
+    IRValue *operands;
+
+    // indexed by value
+    size_t values_len;
+    size_t values_cap;
+    const DataType **value_types;
+} IR;
+
+IR ir_new(void);
+IRBlockIndex ir_block_new(IR *ir);
+
+// lays the blocks out again, `order` is the blocks in their new order,
+// the entry still has to come first
+void ir_layout(IR *ir, const IRBlockIndex *order);
+
+// adds an instruction with room for `operands_len` operands to the end
+// of `block`, its result is a new value unless `data_type` is NULL
+IRInstruction *ir_push(IR *ir, IRBlockIndex block, IROpcode opcode, const DataType *data_type, size_t operands_len);
+
+// like ir_push, but puts it before the instruction at `position`
+IRInstruction *ir_insert(IR *ir, IRBlockIndex block, size_t position, IROpcode opcode, const DataType *data_type, size_t operands_len);
+
+// puts `instructions` before the one at `position` in `block` as they
+// are, keeping their results and operands, for moving them elsewhere
+void ir_place(IR *ir, IRBlockIndex block, size_t position, size_t instructions_len, const IRInstruction *instructions);
+
+IRValue ir_const(IR *ir, IRBlockIndex block, const DataType *data_type, uint64_t constant);
+IRValue ir_unary(IR *ir, IRBlockIndex block, IROpcode opcode, const DataType *data_type, IRValue operand);
+IRValue ir_binary(IR *ir, IRBlockIndex block, IROpcode opcode, const DataType *data_type, IRValue lhs, IRValue rhs);
+void ir_store(IR *ir, IRBlockIndex block, IRValue address, IRValue value);
+
+void ir_jump(IR *ir, IRBlockIndex block, IRBlockIndex target);
+void ir_branch(IR *ir, IRBlockIndex block, IRValue condition, IRBlockIndex taken, IRBlockIndex not_taken);
+void ir_return(IR *ir, IRBlockIndex block, IRValue value);
+
+static inline IRValue *ir_operands(const IR *ir, const IRInstruction *instruction)
+{
+    return &ir->operands[instruction->operands];
+}
+
+static inline IRInstruction *ir_terminator(const IR *ir, IRBlockIndex block)
+{
+    const IRBlock *ir_block = &ir->blocks[block];
+    return &ir_block->instructions[ir_block->instructions_len - 1];
+}
+
+// fills `successors` with the up to 2 blocks `block` can go to next
+static inline size_t ir_successors(const IR *ir, IRBlockIndex block, IRBlockIndex *successors)
+{
+    const IRInstruction *terminator = ir_terminator(ir, block);
+
+    switch (terminator->opcode) {
+        case IR_JUMP: {
+            successors[0] = terminator->targets[0];
+            return 1;
+        }
+
+        case IR_BRANCH: {
+            successors[0] = terminator->targets[0];
+            successors[1] = terminator->targets[1];
+            return 2;
+        }
+
+        default: {
+            return 0;
+        }
+    }
+}
+
+// removes every instruction whose result is never used
+// and that doesn't do anything besides defining it
+void ir_remove_dead_code(IR *ir);
+
+void ir_print(FILE *file, const IR *ir);
+
+void ir_free(IR *ir);
+
+#endif // IR_H_
@@ -0,0 +1,489 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include "ir_fold.h"
+#include "utils.h"
+
+typedef struct IRFold
+{
+    IR *ir;
+
+    // indexed by value
+    bool *is_constant;
+    uint64_t *constants;
+
+    // indexed by value, what to use instead of it
+    IRValue *replacements;
+
+    // pairs of blocks, the edges ir_fold_remove_edges still has to remove
+    size_t edges_len;
+    size_t edges_cap;
+    IRBlockIndex *edges;
+
+    bool changed;
+} IRFold;
+
+uint64_t ir_fold_wrap(const DataType *data_type, uint64_t value)
+{
+    switch (data_type->type) {
+        case TYPE_INT8: {
+            return (uint64_t) (int64_t) (int8_t) value;
+        }
+
+        case TYPE_INT16: {
+            return (uint64_t) (int64_t) (int16_t) value;
+        }
+
+        case TYPE_INT32: {
+            return (uint64_t) (int64_t) (int32_t) value;
+        }
+
+        default: {
+            return value;
+        }
+    }
+}
+
+static IRValue ir_fold_resolve(const IRFold *fold, IRValue value)
+{
+    while (fold->replacements[value] != IR_NULL) {
+        value = fold->replacements[value];
+    }
+
+    return value;
+}
+
+// false if it has to be left for when the program runs
+static bool ir_fold_evaluate(IROpcode opcode, const DataType *data_type, const uint64_t *operands, uint64_t *result)
+{
+    const int64_t lhs = (int64_t) operands[0];
+    const int64_t rhs = (int64_t) operands[1];
+
+    switch (opcode) {
+        case IR_ADD: {
+            *result = operands[0] + operands[1];
+            break;
+        }
+
+        case IR_SUB: {
+            *result = operands[0] - operands[1];
+            break;
+        }
+
+        case IR_MUL: {
+            *result = operands[0] * operands[1];
+            break;
+        }
+
+        case IR_DIV: {
+            // left to fault when the program runs, the quotient of the
+            // smallest value of its type by -1 doesn't fit in the type
+            const int64_t min = (int64_t) ir_fold_wrap(data_type, (uint64_t) 1 << (data_type_size(data_type) * 8 - 1));
+
+            if (rhs == 0 || (lhs == min && rhs == -1)) {
+                return false;
+            }
+
+            *result = lhs / rhs;
+            break;
+        }
+
+        case IR_EQ: {
+            *result = lhs == rhs;
+            break;
+        }
+
+        case IR_NE: {
+            *result = lhs != rhs;
+            break;
+        }
+
+        case IR_LT: {
+            *result = lhs < rhs;
+            break;
+        }
+
+        case IR_GT: {
+            *result = lhs > rhs;
+            break;
+        }
+
+        case IR_LE: {
+            *result = lhs <= rhs;
+            break;
+        }
+
+        case IR_GE: {
+            *result = lhs >= rhs;
+            break;
+        }
+
+        case IR_NEG: {
+            *result = -operands[0];
+            break;
+        }
+
+        case IR_NOT: {
+            *result = operands[0] == 0;
+            break;
+        }
+
+        default: {
+            return false;
+        }
+    }
+
+    *result = ir_fold_wrap(data_type, *result);
+
+    return true;
+}
+
+static void ir_fold_make_constant(IRFold *fold, IRInstruction *instruction, uint64_t constant)
+{
+    instruction->opcode = IR_CONST;
+    instruction->operands_len = 0;
+    instruction->constant = constant;
+
+    fold->is_constant[instruction->result] = true;
+    fold->constants[instruction->result] = constant;
+
+    fold->changed = true;
+}
+
+static void ir_fold_remove_edge(IRFold *fold, IRBlockIndex from, IRBlockIndex to)
+{
+    IR *ir = fold->ir;
+    IRBlock *block = &ir->blocks[to];
+
+    size_t predecessor = 0;
+    while (block->predecessors[predecessor] != from) {
+        ++predecessor;
+    }
+
+    for (size_t i = predecessor + 1; i < block->predecessors_len; ++i) {
+        block->predecessors[i - 1] = block->predecessors[i];
+    }
+    --block->predecessors_len;
+
+    for (size_t i = 0; i < block->instructions_len && block->instructions[i].opcode == IR_PHI; ++i) {
+        IRInstruction *phi = &block->instructions[i];
+        IRValue *operands = ir_operands(ir, phi);
+
+        for (size_t j = predecessor + 1; j < phi->operands_len; ++j) {
+            operands[j - 1] = operands[j];
+        }
+        --phi->operands_len;
+    }
+}
+
+static void ir_fold_clear_block(IRFold *fold, IRBlockIndex block)
+{
+    IRBlock *ir_block = &fold->ir->blocks[block];
+
+    for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+        if (ir_block->instructions[i].opcode == IR_STRING) {
+            free(ir_block->instructions[i].string.data);
+        }
+    }
+
+    ir_block->instructions_len = 0;
+    ir_block->predecessors_len = 0;
+}
+
+static void ir_fold_push_edge(IRFold *fold, IRBlockIndex from, IRBlockIndex to)
+{
+    if (fold->edges_len + 2 > fold->edges_cap) {
+        while (fold->edges_len + 2 > fold->edges_cap) {
+            fold->edges_cap *= 2;
+        }
+
+        fold->edges = realloc(fold->edges, sizeof(*fold->edges) * fold->edges_cap);
+
+        if (fold->edges == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    fold->edges[fold->edges_len++] = from;
+    fold->edges[fold->edges_len++] = to;
+}
+
+// Removes the edge, and with it every block that's left without a
+// predecessor. That's enough for the ifs, so the block after one can
+// be folded in the same pass. A loop that can't be reached anymore
+// still has its back edge, which ir_fold_remove_unreachable is for.
+static void ir_fold_remove_edges(IRFold *fold, IRBlockIndex from, IRBlockIndex to)
+{
+    IR *ir = fold->ir;
+
+    ir_fold_push_edge(fold, from, to);
+
+    while (fold->edges_len > 0) {
+        const IRBlockIndex target = fold->edges[--fold->edges_len];
+        const IRBlockIndex source = fold->edges[--fold->edges_len];
+
+        // already removed, along with its edges
+        if (ir->blocks[target].instructions_len == 0) {
+            continue;
+        }
+
+        ir_fold_remove_edge(fold, source, target);
+
+        if (target == 0 || ir->blocks[target].predecessors_len > 0) {
+            continue;
+        }
+
+        IRBlockIndex successors[2];
+        const size_t successors_len = ir_successors(ir, target, successors);
+
+        for (size_t i = 0; i < successors_len; ++i) {
+            ir_fold_push_edge(fold, target, successors[i]);
+        }
+
+        ir_fold_clear_block(fold, target);
+    }
+}
+
+// empties every block that the entry can't get to anymore
+static void ir_fold_remove_unreachable(IRFold *fold)
+{
+    IR *ir = fold->ir;
+
+    bool *reachable = calloc(ir->blocks_len, sizeof(*reachable));
+
+    size_t stack_len = 0;
+    IRBlockIndex *stack = malloc(sizeof(*stack) * (ir->blocks_len + 1));
+
+    if (reachable == NULL || stack == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    reachable[0] = true;
+    stack[stack_len++] = 0;
+
+    while (stack_len > 0) {
+        IRBlockIndex successors[2];
+        const size_t successors_len = ir_successors(ir, stack[--stack_len], successors);
+
+        for (size_t i = 0; i < successors_len; ++i) {
+            if (!reachable[successors[i]]) {
+                reachable[successors[i]] = true;
+                stack[stack_len++] = successors[i];
+            }
+        }
+    }
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        IRBlock *ir_block = &ir->blocks[block];
+
+        if (reachable[block] || ir_block->instructions_len == 0) {
+            continue;
+        }
+
+        IRBlockIndex successors[2];
+        const size_t successors_len = ir_successors(ir, block, successors);
+
+        for (size_t i = 0; i < successors_len; ++i) {
+            if (reachable[successors[i]]) {
+                ir_fold_remove_edge(fold, block, successors[i]);
+            }
+        }
+
+        ir_fold_clear_block(fold, block);
+    }
+
+    free(reachable);
+    free(stack);
+}
+
+// returns whether the phi became a constant
+static bool ir_fold_phi(IRFold *fold, IRInstruction *phi)
+{
+    const IRValue *operands = ir_operands(fold->ir, phi);
+
+    IRValue value = IR_NULL;
+    bool same_value = true;
+    bool same_constant = true;
+
+    for (size_t i = 0; i < phi->operands_len; ++i) {
+        // a loop that doesn't change it
+        if (operands[i] == phi->result) {
+            continue;
+        }
+
+        if (value == IR_NULL) {
+            value = operands[i];
+            continue;
+        }
+
+        same_value = same_value && operands[i] == value;
+        same_constant = same_constant
+            && fold->is_constant[operands[i]]
+            && fold->is_constant[value]
+            && fold->constants[operands[i]] == fold->constants[value];
+    }
+
+    if (value == IR_NULL) {
+        return false;
+    }
+
+    if (same_value) {
+        fold->replacements[phi->result] = value;
+        fold->changed = true;
+        return false;
+    }
+
+    // the same constant from different places, none of which come before
+    // the phi on every path, so it has to be its own constant
+    if (same_constant) {
+        ir_fold_make_constant(fold, phi, fold->constants[value]);
+        return true;
+    }
+
+    return false;
+}
+
+// keeps the phis at the start of the block
+static void ir_fold_sort_phis(IRBlock *block)
+{
+    size_t len = 0;
+
+    for (size_t i = 0; i < block->instructions_len; ++i) {
+        if (block->instructions[i].opcode != IR_PHI) {
+            continue;
+        }
+
+        const IRInstruction phi = block->instructions[i];
+
+        for (size_t j = i; j > len; --j) {
+            block->instructions[j] = block->instructions[j - 1];
+        }
+
+        block->instructions[len++] = phi;
+    }
+}
+
+static void ir_fold_block(IRFold *fold, IRBlockIndex block)
+{
+    IR *ir = fold->ir;
+    IRBlock *ir_block = &ir->blocks[block];
+
+    bool sort_phis = false;
+
+    for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+        IRInstruction *instruction = &ir_block->instructions[i];
+        IRValue *operands = ir_operands(ir, instruction);
+
+        if (instruction->result != IR_NULL && fold->replacements[instruction->result] != IR_NULL) {
+            continue;
+        }
+
+        uint64_t constants[2] = { 0 };
+        bool all_constant = true;
+
+        for (size_t j = 0; j < instruction->operands_len; ++j) {
+            operands[j] = ir_fold_resolve(fold, operands[j]);
+
+            all_constant = all_constant && fold->is_constant[operands[j]];
+
+            if (j < ARRAY_LEN(constants)) {
+                constants[j] = fold->constants[operands[j]];
+            }
+        }
+
+        switch (instruction->opcode) {
+            case IR_CONST: {
+                fold->is_constant[instruction->result] = true;
+                fold->constants[instruction->result] = ir_fold_wrap(instruction->data_type, instruction->constant);
+                break;
+            }
+
+            case IR_PHI: {
+                sort_phis = ir_fold_phi(fold, instruction) || sort_phis;
+                break;
+            }
+
+            case IR_ADD:
+            case IR_SUB:
+            case IR_MUL:
+            case IR_DIV:
+            case IR_EQ:
+            case IR_NE:
+            case IR_LT:
+            case IR_GT:
+            case IR_LE:
+            case IR_GE:
+            case IR_NEG:
+            case IR_NOT: {
+                uint64_t result;
+
+                if (all_constant && ir_fold_evaluate(instruction->opcode, instruction->data_type, constants, &result)) {
+                    ir_fold_make_constant(fold, instruction, result);
+                }
+                break;
+            }
+
+            case IR_BRANCH: {
+                if (!all_constant) {
+                    break;
+                }
+
+                const IRBlockIndex taken     = instruction->targets[constants[0] != 0 ? 0 : 1];
+                const IRBlockIndex not_taken = instruction->targets[constants[0] != 0 ? 1 : 0];
+
+                instruction->opcode = IR_JUMP;
+                instruction->operands_len = 0;
+                instruction->targets[0] = taken;
+
+                ir_fold_remove_edges(fold, block, not_taken);
+
+                fold->changed = true;
+                break;
+            }
+
+            default: {
+                break;
+            }
+        }
+    }
+
+    if (sort_phis) {
+        ir_fold_sort_phis(ir_block);
+    }
+}
+
+void ir_fold_constants(IR *ir)
+{
+    IRFold fold = {
+        .ir = ir,
+
+        .edges_cap = 16
+    };
+
+    fold.is_constant  = calloc(ir->values_len + 1, sizeof(*fold.is_constant));
+    fold.constants    = calloc(ir->values_len + 1, sizeof(*fold.constants));
+    fold.replacements = malloc(sizeof(*fold.replacements) * (ir->values_len + 1));
+    fold.edges        = malloc(sizeof(*fold.edges) * fold.edges_cap);
+
+    if (fold.is_constant == NULL || fold.constants == NULL || fold.replacements == NULL || fold.edges == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (size_t i = 0; i < ir->values_len; ++i) {
+        fold.replacements[i] = IR_NULL;
+    }
+
+    do {
+        fold.changed = false;
+
+        for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+            ir_fold_block(&fold, block);
+        }
+
+        ir_fold_remove_unreachable(&fold);
+    } while (fold.changed);
+
+    free(fold.is_constant);
+    free(fold.constants);
+    free(fold.replacements);
+    free(fold.edges);
+}
@@ -0,0 +1,16 @@
+#ifndef IR_FOLD_H_
+#define IR_FOLD_H_
+
+#include "ir.h"
+
+// the value as its type sees it, sign extended to 64 bits
+uint64_t ir_fold_wrap(const DataType *data_type, uint64_t value);
+
+// Constant folding and propagation. Instructions whose operands are all
+// constants become constants, wrapping around like the type they're
+// done in would. A branch on a constant becomes a jump and whatever
+// can't be reached anymore is removed, and phis that only ever get one
+// value are replaced by it. Repeats until nothing changes.
+void ir_fold_constants(IR *ir);
+
+#endif // IR_FOLD_H_
@@ -0,0 +1,357 @@
+#define _GNU_SOURCE // needed for qsort_r
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "ir_frame.h"
+#include "utils.h"
+
+#define LOCAL_NONE UINT32_MAX
+
+typedef struct FrameInterval
+{
+    // positions in the blocks' layout, every instruction has one
+    size_t start;
+    size_t end;
+
+    uint32_t slot;
+} FrameInterval;
+
+typedef struct Frame
+{
+    const IR *ir;
+
+    // indexed by block, where its instructions start and end
+    size_t *block_starts;
+    size_t *block_ends;
+    size_t positions_len;
+
+    // indexed by value, the local whose address it is
+    uint32_t *owners;
+
+    // indexed by local
+    size_t intervals_len;
+    FrameInterval *intervals;
+} Frame;
+
+static void frame_extend(Frame *frame, uint32_t local, size_t position)
+{
+    FrameInterval *interval = &frame->intervals[local];
+
+    if (position < interval->start) {
+        interval->start = position;
+    }
+
+    if (position > interval->end) {
+        interval->end = position;
+    }
+}
+
+static void frame_pin(Frame *frame, uint32_t local)
+{
+    frame->intervals[local].start = 0;
+    frame->intervals[local].end = frame->positions_len;
+}
+
+// an address can go through phis, another one merging
+// into the same phi means both have to stay
+static void frame_find_owners(Frame *frame)
+{
+    const IR *ir = frame->ir;
+
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+            const IRBlock *ir_block = &ir->blocks[block];
+
+            for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+                const IRInstruction *phi = &ir_block->instructions[i];
+
+                if (phi->opcode != IR_PHI) {
+                    break;
+                }
+
+                const IRValue *operands = ir_operands(ir, phi);
+
+                for (size_t j = 0; j < phi->operands_len; ++j) {
+                    const uint32_t owner = frame->owners[operands[j]];
+
+                    if (owner == LOCAL_NONE || owner == frame->owners[phi->result]) {
+                        continue;
+                    }
+
+                    if (frame->owners[phi->result] != LOCAL_NONE) {
+                        frame_pin(frame, frame->owners[phi->result]);
+                        frame_pin(frame, owner);
+                        continue;
+                    }
+
+                    frame->owners[phi->result] = owner;
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+static void frame_find_intervals(Frame *frame)
+{
+    const IR *ir = frame->ir;
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        const IRBlock *ir_block = &ir->blocks[block];
+
+        for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+            const IRInstruction *instruction = &ir_block->instructions[i];
+            const IRValue *operands = ir_operands(ir, instruction);
+            const size_t position = frame->block_starts[block] + i;
+
+            if (instruction->result != IR_NULL && frame->owners[instruction->result] != LOCAL_NONE) {
+                frame_extend(frame, frame->owners[instruction->result], position);
+            }
+
+            for (size_t j = 0; j < instruction->operands_len; ++j) {
+                const uint32_t owner = frame->owners[operands[j]];
+
+                if (owner == LOCAL_NONE) {
+                    continue;
+                }
+
+                switch (instruction->opcode) {
+                    case IR_PHI: {
+                        // used on the way out of the predecessor
+                        frame_extend(frame, owner, frame->block_ends[ir_block->predecessors[j]]);
+                        break;
+                    }
+
+                    case IR_LOAD:
+                    case IR_STORE: {
+                        if (j == 0) {
+                            frame_extend(frame, owner, position);
+                        } else {
+                            frame_pin(frame, owner);
+                        }
+                        break;
+                    }
+
+                    default: {
+                        if (ir_opcode_is_comparison(instruction->opcode)) {
+                            frame_extend(frame, owner, position);
+                        } else {
+                            frame_pin(frame, owner);
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // a loop is a jump back to a block that's laid out earlier, whatever
+    // is live going into it and used in it is live all the way around
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+            if (ir->blocks[block].instructions_len == 0) {
+                continue;
+            }
+
+            IRBlockIndex successors[2];
+            const size_t successors_len = ir_successors(ir, block, successors);
+
+            for (size_t i = 0; i < successors_len; ++i) {
+                if (successors[i] > block) {
+                    continue;
+                }
+
+                const size_t loop_start = frame->block_starts[successors[i]];
+                const size_t loop_end = frame->block_ends[block];
+
+                for (size_t j = 0; j < frame->intervals_len; ++j) {
+                    FrameInterval *interval = &frame->intervals[j];
+
+                    if (interval->start < loop_start && interval->end >= loop_start && interval->end < loop_end) {
+                        interval->end = loop_end;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static int frame_compare_starts(const void *lhs, const void *rhs, void *arg)
+{
+    const FrameInterval *intervals = arg;
+
+    const FrameInterval *a = &intervals[*(const uint32_t *) lhs];
+    const FrameInterval *b = &intervals[*(const uint32_t *) rhs];
+
+    return (a->start > b->start) - (a->start < b->start);
+}
+
+static int frame_compare_ends(const void *lhs, const void *rhs, void *arg)
+{
+    const FrameInterval *intervals = arg;
+
+    const FrameInterval *a = &intervals[*(const uint32_t *) lhs];
+    const FrameInterval *b = &intervals[*(const uint32_t *) rhs];
+
+    return (a->end > b->end) - (a->end < b->end);
+}
+
+// the same as the register allocator does for spill slots
+static size_t frame_assign_slots(Frame *frame)
+{
+    FrameInterval *intervals = frame->intervals;
+    const size_t intervals_len = frame->intervals_len;
+
+    uint32_t *by_start = malloc(sizeof(*by_start) * (intervals_len + 1));
+    uint32_t *by_end = malloc(sizeof(*by_end) * (intervals_len + 1));
+    uint32_t *free_slots = malloc(sizeof(*free_slots) * (intervals_len + 1));
+
+    if (by_start == NULL || by_end == NULL || free_slots == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (size_t i = 0; i < intervals_len; ++i) {
+        by_start[i] = i;
+    }
+
+    qsort_r(by_start, intervals_len, sizeof(*by_start), frame_compare_starts, intervals);
+    memcpy(by_end, by_start, sizeof(*by_start) * intervals_len);
+    qsort_r(by_end, intervals_len, sizeof(*by_end), frame_compare_ends, intervals);
+
+    size_t slots_len = 0;
+    size_t free_slots_len = 0;
+    size_t ended = 0;
+
+    for (size_t i = 0; i < intervals_len; ++i) {
+        FrameInterval *interval = &intervals[by_start[i]];
+
+        while (ended < intervals_len && intervals[by_end[ended]].end < interval->start) {
+            free_slots[free_slots_len++] = intervals[by_end[ended++]].slot;
+        }
+
+        interval->slot = free_slots_len > 0 ? free_slots[--free_slots_len] : slots_len++;
+    }
+
+    free(by_start);
+    free(by_end);
+    free(free_slots);
+
+    return slots_len;
+}
+
+IRFrame ir_frame_layout(const IR *ir, int32_t *offsets)
+{
+    Frame frame = {
+        .ir = ir,
+
+        .positions_len = 0,
+        .intervals_len = 0
+    };
+
+    frame.block_starts = malloc(sizeof(*frame.block_starts) * ir->blocks_len);
+    frame.block_ends   = malloc(sizeof(*frame.block_ends) * ir->blocks_len);
+    frame.owners       = malloc(sizeof(*frame.owners) * (ir->values_len + 1));
+
+    if (frame.block_starts == NULL || frame.block_ends == NULL || frame.owners == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (size_t i = 0; i < ir->values_len; ++i) {
+        frame.owners[i] = LOCAL_NONE;
+    }
+
+    // arrays go right below rbp, each in a slot of its own
+    size_t arrays_size = 0;
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        const IRBlock *ir_block = &ir->blocks[block];
+
+        frame.block_starts[block] = frame.positions_len;
+        frame.positions_len += ir_block->instructions_len;
+        frame.block_ends[block] = frame.positions_len > 0 ? frame.positions_len - 1 : 0;
+
+        for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+            const IRInstruction *instruction = &ir_block->instructions[i];
+
+            if (instruction->opcode != IR_LOCAL) {
+                continue;
+            }
+
+            const DataType *data_type = instruction->data_type->dereference;
+
+            if (data_type->type == TYPE_ARRAY) {
+                arrays_size += (data_type_size(data_type) + 7) & ~(size_t) 7;
+
+                if (arrays_size > DATA_TYPE_MAX_SIZE) {
+                    ERROR("Stack frame is too big, its arrays can take up at most %zu bytes.", DATA_TYPE_MAX_SIZE);
+                }
+
+                offsets[instruction->result] = -(int32_t) arrays_size;
+                continue;
+            }
+
+            frame.owners[instruction->result] = frame.intervals_len++;
+        }
+    }
+
+    if (frame.intervals_len == 0) {
+        free(frame.block_starts);
+        free(frame.block_ends);
+        free(frame.owners);
+
+        return (IRFrame) { .locals_len = 0, .slots_len = 0, .arrays_size = arrays_size };
+    }
+
+    frame.intervals = malloc(sizeof(*frame.intervals) * frame.intervals_len);
+
+    if (frame.intervals == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (size_t i = 0; i < frame.intervals_len; ++i) {
+        frame.intervals[i] = (FrameInterval) {
+            .start = SIZE_MAX,
+            .end = 0
+        };
+    }
+
+    frame_find_owners(&frame);
+    frame_find_intervals(&frame);
+
+    const size_t slots_len = frame_assign_slots(&frame);
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        const IRBlock *ir_block = &ir->blocks[block];
+
+        for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+            const IRInstruction *instruction = &ir_block->instructions[i];
+
+            if (instruction->opcode == IR_LOCAL && frame.owners[instruction->result] != LOCAL_NONE) {
+                const uint32_t slot = frame.intervals[frame.owners[instruction->result]].slot;
+                offsets[instruction->result] = -(int32_t) arrays_size - 8 * ((int32_t) slot + 1);
+            }
+        }
+    }
+
+    const IRFrame result = {
+        .locals_len = frame.intervals_len,
+        .slots_len = slots_len,
+        .arrays_size = arrays_size
+    };
+
+    free(frame.block_starts);
+    free(frame.block_ends);
+    free(frame.owners);
+    free(frame.intervals);
+
+    return result;
+}
@@ -0,0 +1,27 @@
+#ifndef IR_FRAME_H_
+#define IR_FRAME_H_
+
+#include "ir.h"
+
+typedef struct IRFrame
+{
+    // how many IR_LOCALs there are besides the arrays,
+    // and how many slots they ended up in
+    size_t locals_len;
+    size_t slots_len;
+
+    // bytes taken up by the arrays, which are above the slots
+    size_t arrays_size;
+} IRFrame;
+
+// Lays out the stack slots of the IR_LOCALs before anything is lowered,
+// so the frame is made once in the prologue. A slot is live from its
+// IR_LOCAL to the last use of its address, counting the phis it flows
+// into and stretched over any loop it's live around. Locals that are
+// never live at the same time share an 8 byte slot, and ones whose
+// address is stored somewhere or passed to a call keep theirs for the
+// whole program. Arrays always keep theirs, right below rbp and above
+// all of the slots. `offsets` gets each IR_LOCAL's offset from rbp.
+IRFrame ir_frame_layout(const IR *ir, int32_t *offsets);
+
+#endif // IR_FRAME_H_
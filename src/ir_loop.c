@@ -0,0 +1,2063 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "ir_loop.h"
+#include "ir_fold.h"
+#include "utils.h"
+
+#define IR_NO_BLOCK UINT32_MAX
+
+// as many as there are xmm registers, since vectors never spill
+#define IR_LOOP_MAX_VECTORS 16
+
+typedef struct IRLoop
+{
+    IRBlockIndex header;
+
+    // the only block outside the loop that goes to the header, as long
+    // as it doesn't go anywhere else, IR_NO_BLOCK otherwise
+    IRBlockIndex preheader;
+
+    // the only block that jumps back to the header, IR_NO_BLOCK if there's more
+    IRBlockIndex latch;
+
+    // in layout order, the header first
+    size_t blocks_len;
+    IRBlockIndex *blocks;
+
+    // it has a vectorized copy in front of it, so it only ever
+    // goes round the few times left over, not worth unrolling
+    bool vectorized;
+} IRLoop;
+
+typedef struct IRLoops
+{
+    // innermost first
+    size_t len;
+    size_t cap;
+    IRLoop *loops;
+} IRLoops;
+
+// a phi in a loop's header that goes `opcode` `step` on the way round
+typedef struct IRInduction
+{
+    IRValue phi;
+    IRValue start;
+    IRValue step;
+    IRValue next;
+    IROpcode opcode;
+} IRInduction;
+
+// a mul of an induction variable that becomes one of its own
+typedef struct IRReduction
+{
+    size_t loop_index;
+    IRInduction induction;
+
+    IRValue product;
+    IRValue factor;
+} IRReduction;
+
+typedef struct IRLoopPass
+{
+    IR *ir;
+    const IRLoopOptions *options;
+    IRLoops loops;
+
+    // for the vectors a vectorized loop works on
+    TypeTable *types;
+
+    // how many values there were to begin with, the
+    // ones `blocks` and `constants` know about
+    size_t values_len;
+
+    // indexed by value, the block it's defined in
+    IRBlockIndex *blocks;
+
+    // indexed by value, whether it's a constant and which
+    bool *is_constant;
+    uint64_t *constants;
+
+    size_t hoisted_cap;
+    IRInstruction *hoisted;
+
+    size_t inductions_len;
+    size_t inductions_cap;
+    IRInduction *inductions;
+
+    size_t reductions_len;
+    size_t reductions_cap;
+    IRReduction *reductions;
+
+    // indexed by value, what to use instead of a mul that was reduced
+    IRValue *replacements;
+
+    // indexed by value, what a copy of an instruction reads
+    // instead of it, IR_NULL to read the value itself
+    size_t map_len;
+    IRValue *map;
+
+    // the block that each block that was added goes in
+    // front of, in the order they were added in
+    size_t placements_len;
+    size_t placements_cap;
+    IRBlockIndex *placements;
+} IRLoopPass;
+
+static int ir_loop_compare_blocks(const void *lhs, const void *rhs)
+{
+    const IRBlockIndex a = *(const IRBlockIndex *) lhs;
+    const IRBlockIndex b = *(const IRBlockIndex *) rhs;
+
+    return (a > b) - (a < b);
+}
+
+static int ir_loop_compare_sizes(const void *lhs, const void *rhs)
+{
+    const IRLoop *a = lhs;
+    const IRLoop *b = rhs;
+
+    return (a->blocks_len > b->blocks_len) - (a->blocks_len < b->blocks_len);
+}
+
+static bool ir_loop_contains(const IRLoop *ir_loop, IRBlockIndex block)
+{
+    return bsearch(&block, ir_loop->blocks, ir_loop->blocks_len, sizeof(*ir_loop->blocks), ir_loop_compare_blocks) != NULL;
+}
+
+static size_t ir_loop_predecessor(const IR *ir, IRBlockIndex block, IRBlockIndex predecessor)
+{
+    const IRBlock *ir_block = &ir->blocks[block];
+
+    size_t i = 0;
+    while (ir_block->predecessors[i] != predecessor) {
+        ++i;
+    }
+
+    return i;
+}
+
+static void ir_loops_push(IRLoops *loops, IRLoop ir_loop)
+{
+    if (loops->len >= loops->cap) {
+        while (loops->len >= loops->cap) {
+            loops->cap *= 2;
+        }
+
+        loops->loops = realloc(loops->loops, sizeof(*loops->loops) * loops->cap);
+
+        if (loops->loops == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    loops->loops[loops->len++] = ir_loop;
+}
+
+// the blocks that get to a jump back to `header` without going through
+// it, if they can't be got to without going through it either
+static IRLoops ir_loops_find(const IR *ir)
+{
+    IRLoops loops = {
+        .len = 0,
+        .cap = 16
+    };
+
+    loops.loops = malloc(sizeof(*loops.loops) * loops.cap);
+
+    bool *marked = calloc(ir->blocks_len, sizeof(*marked));
+    IRBlockIndex *stack = malloc(sizeof(*stack) * (ir->blocks_len + 1));
+    IRBlockIndex *blocks = malloc(sizeof(*blocks) * (ir->blocks_len + 1));
+
+    if (loops.loops == NULL || marked == NULL || stack == NULL || blocks == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (IRBlockIndex header = 0; header < ir->blocks_len; ++header) {
+        const IRBlock *header_block = &ir->blocks[header];
+
+        if (header_block->instructions_len == 0) {
+            continue;
+        }
+
+        size_t stack_len = 0;
+        size_t blocks_len = 0;
+        size_t latches_len = 0;
+        IRBlockIndex latch = IR_NO_BLOCK;
+
+        marked[header] = true;
+        blocks[blocks_len++] = header;
+
+        for (size_t i = 0; i < header_block->predecessors_len; ++i) {
+            const IRBlockIndex predecessor = header_block->predecessors[i];
+
+            if (predecessor < header) {
+                continue;
+            }
+
+            latch = predecessor;
+            ++latches_len;
+
+            if (!marked[predecessor]) {
+                marked[predecessor] = true;
+                blocks[blocks_len++] = predecessor;
+                stack[stack_len++] = predecessor;
+            }
+        }
+
+        // a way in that isn't through the header, which never
+        // happens with the blocks laid out the way they're made
+        bool entered = false;
+
+        while (stack_len > 0) {
+            const IRBlock *ir_block = &ir->blocks[stack[--stack_len]];
+
+            for (size_t i = 0; i < ir_block->predecessors_len; ++i) {
+                const IRBlockIndex predecessor = ir_block->predecessors[i];
+
+                if (marked[predecessor]) {
+                    continue;
+                }
+
+                entered = entered || predecessor < header;
+
+                marked[predecessor] = true;
+                blocks[blocks_len++] = predecessor;
+                stack[stack_len++] = predecessor;
+            }
+        }
+
+        for (size_t i = 0; i < blocks_len; ++i) {
+            marked[blocks[i]] = false;
+        }
+
+        if (latches_len == 0 || entered) {
+            continue;
+        }
+
+        IRLoop ir_loop = {
+            .header = header,
+            .preheader = IR_NO_BLOCK,
+            .latch = latches_len == 1 ? latch : IR_NO_BLOCK,
+
+            .blocks_len = blocks_len
+        };
+
+        size_t entries_len = 0;
+
+        for (size_t i = 0; i < header_block->predecessors_len; ++i) {
+            if (header_block->predecessors[i] < header) {
+                ir_loop.preheader = header_block->predecessors[i];
+                ++entries_len;
+            }
+        }
+
+        if (entries_len != 1 || ir_terminator(ir, ir_loop.preheader)->opcode != IR_JUMP) {
+            ir_loop.preheader = IR_NO_BLOCK;
+        }
+
+        ir_loop.blocks = malloc(sizeof(*ir_loop.blocks) * blocks_len);
+
+        if (ir_loop.blocks == NULL) {
+            ALLOCATION_ERROR();
+        }
+
+        memcpy(ir_loop.blocks, blocks, sizeof(*blocks) * blocks_len);
+        qsort(ir_loop.blocks, blocks_len, sizeof(*ir_loop.blocks), ir_loop_compare_blocks);
+
+        ir_loops_push(&loops, ir_loop);
+    }
+
+    // nested loops are always smaller than the ones around them
+    qsort(loops.loops, loops.len, sizeof(*loops.loops), ir_loop_compare_sizes);
+
+    free(marked);
+    free(stack);
+    free(blocks);
+
+    return loops;
+}
+
+static void ir_loops_free(IRLoops *loops)
+{
+    for (size_t i = 0; i < loops->len; ++i) {
+        free(loops->loops[i].blocks);
+    }
+
+    free(loops->loops);
+}
+
+// the index of the innermost loop `block` is in, loops->len if none
+static size_t ir_loops_innermost(const IRLoops *loops, IRBlockIndex block)
+{
+    size_t i = 0;
+
+    while (i < loops->len && !ir_loop_contains(&loops->loops[i], block)) {
+        ++i;
+    }
+
+    return i;
+}
+
+static void ir_loop_find_blocks(IRLoopPass *pass)
+{
+    const IR *ir = pass->ir;
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        const IRBlock *ir_block = &ir->blocks[block];
+
+        for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+            const IRInstruction *instruction = &ir_block->instructions[i];
+
+            if (instruction->result != IR_NULL) {
+                pass->blocks[instruction->result] = block;
+            }
+
+            if (instruction->opcode == IR_CONST) {
+                pass->is_constant[instruction->result] = true;
+                pass->constants[instruction->result] = ir_fold_wrap(instruction->data_type, instruction->constant);
+            }
+        }
+    }
+}
+
+static bool ir_loop_is_invariant(const IRLoopPass *pass, const IRLoop *ir_loop, IRValue value)
+{
+    return !ir_loop_contains(ir_loop, pass->blocks[value]);
+}
+
+// the same every time round, and safe to do even if the loop never runs
+static bool ir_loop_can_hoist(const IRLoopPass *pass, const IRLoop *ir_loop, const IRInstruction *instruction)
+{
+    const IRValue *operands = ir_operands(pass->ir, instruction);
+
+    switch (instruction->opcode) {
+        case IR_CONST:
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_EQ:
+        case IR_NE:
+        case IR_LT:
+        case IR_GT:
+        case IR_LE:
+        case IR_GE:
+        case IR_NEG:
+        case IR_NOT:
+        case IR_INDEX:
+        case IR_BROADCAST: {
+            break;
+        }
+
+        // dividing by a constant can't fault, unless it's 0 or -1
+        case IR_DIV: {
+            if (!pass->is_constant[operands[1]]
+             || pass->constants[operands[1]] == 0
+             || pass->constants[operands[1]] == UINT64_MAX) {
+                return false;
+            }
+            break;
+        }
+
+        default: {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < instruction->operands_len; ++i) {
+        if (!ir_loop_is_invariant(pass, ir_loop, operands[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void ir_loop_hoist(IRLoopPass *pass, const IRLoop *ir_loop)
+{
+    IR *ir = pass->ir;
+
+    if (ir_loop->preheader == IR_NO_BLOCK) {
+        return;
+    }
+
+    size_t hoisted_len = 0;
+
+    // laid out in the order they're worked out, so one pass is
+    // enough for whatever depends on something hoisted before it
+    for (size_t i = 0; i < ir_loop->blocks_len; ++i) {
+        IRBlock *ir_block = &ir->blocks[ir_loop->blocks[i]];
+
+        size_t len = 0;
+
+        for (size_t j = 0; j < ir_block->instructions_len; ++j) {
+            const IRInstruction instruction = ir_block->instructions[j];
+
+            if (!ir_loop_can_hoist(pass, ir_loop, &instruction)) {
+                ir_block->instructions[len++] = instruction;
+                continue;
+            }
+
+            if (hoisted_len >= pass->hoisted_cap) {
+                while (hoisted_len >= pass->hoisted_cap) {
+                    pass->hoisted_cap *= 2;
+                }
+
+                pass->hoisted = realloc(pass->hoisted, sizeof(*pass->hoisted) * pass->hoisted_cap);
+
+                if (pass->hoisted == NULL) {
+                    ALLOCATION_ERROR();
+                }
+            }
+
+            pass->hoisted[hoisted_len++] = instruction;
+            pass->blocks[instruction.result] = ir_loop->preheader;
+        }
+
+        ir_block->instructions_len = len;
+    }
+
+    if (hoisted_len > 0) {
+        const size_t position = ir->blocks[ir_loop->preheader].instructions_len - 1;
+
+        ir_place(ir, ir_loop->preheader, position, hoisted_len, pass->hoisted);
+    }
+}
+
+static void ir_loop_push_induction(IRLoopPass *pass, IRInduction induction)
+{
+    if (pass->inductions_len >= pass->inductions_cap) {
+        while (pass->inductions_len >= pass->inductions_cap) {
+            pass->inductions_cap *= 2;
+        }
+
+        pass->inductions = realloc(pass->inductions, sizeof(*pass->inductions) * pass->inductions_cap);
+
+        if (pass->inductions == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    pass->inductions[pass->inductions_len++] = induction;
+}
+
+static void ir_loop_push_reduction(IRLoopPass *pass, IRReduction reduction)
+{
+    if (pass->reductions_len >= pass->reductions_cap) {
+        while (pass->reductions_len >= pass->reductions_cap) {
+            pass->reductions_cap *= 2;
+        }
+
+        pass->reductions = realloc(pass->reductions, sizeof(*pass->reductions) * pass->reductions_cap);
+
+        if (pass->reductions == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    pass->reductions[pass->reductions_len++] = reduction;
+}
+
+// the header's phis that go up or down by something invariant on the way round
+static void ir_loop_find_inductions(IRLoopPass *pass, const IRLoop *ir_loop, const IRInstruction **definitions)
+{
+    const IR *ir = pass->ir;
+    const IRBlock *header_block = &ir->blocks[ir_loop->header];
+
+    const size_t entry = ir_loop_predecessor(ir, ir_loop->header, ir_loop->preheader);
+    const size_t back = ir_loop_predecessor(ir, ir_loop->header, ir_loop->latch);
+
+    pass->inductions_len = 0;
+
+    for (size_t i = 0; i < header_block->instructions_len; ++i) {
+        const IRInstruction *phi = &header_block->instructions[i];
+
+        if (phi->opcode != IR_PHI) {
+            break;
+        }
+
+        const IRValue next = ir_operands(ir, phi)[back];
+        const IRInstruction *update = definitions[next];
+
+        if (!ir_loop_contains(ir_loop, pass->blocks[next])) {
+            continue;
+        }
+
+        const IRValue *operands = ir_operands(ir, update);
+
+        IRInduction induction = {
+            .phi = phi->result,
+            .start = ir_operands(ir, phi)[entry],
+            .next = next,
+            .opcode = update->opcode
+        };
+
+        if (update->opcode == IR_ADD && operands[1] == phi->result) {
+            induction.step = operands[0];
+        } else if ((update->opcode == IR_ADD || update->opcode == IR_SUB) && operands[0] == phi->result) {
+            induction.step = operands[1];
+        } else {
+            continue;
+        }
+
+        if (ir_loop_is_invariant(pass, ir_loop, induction.step)) {
+            ir_loop_push_induction(pass, induction);
+        }
+    }
+}
+
+// the same value, or the same constant twice
+static bool ir_loop_is_same(const IRInstruction **definitions, IRValue a, IRValue b)
+{
+    if (a == b) {
+        return true;
+    }
+
+    return definitions[a]->opcode == IR_CONST
+        && definitions[b]->opcode == IR_CONST
+        && ir_fold_wrap(definitions[a]->data_type, definitions[a]->constant)
+            == ir_fold_wrap(definitions[b]->data_type, definitions[b]->constant);
+}
+
+static void ir_loop_find_reductions(IRLoopPass *pass, size_t loop_index, const IRInstruction **definitions)
+{
+    const IR *ir = pass->ir;
+    const IRLoop *ir_loop = &pass->loops.loops[loop_index];
+
+    if (ir_loop->preheader == IR_NO_BLOCK || ir_loop->latch == IR_NO_BLOCK) {
+        return;
+    }
+
+    ir_loop_find_inductions(pass, ir_loop, definitions);
+
+    if (pass->inductions_len == 0) {
+        return;
+    }
+
+    const size_t reductions_start = pass->reductions_len;
+
+    for (size_t i = 0; i < ir_loop->blocks_len; ++i) {
+        const IRBlock *ir_block = &ir->blocks[ir_loop->blocks[i]];
+
+        for (size_t j = 0; j < ir_block->instructions_len; ++j) {
+            const IRInstruction *instruction = &ir_block->instructions[j];
+
+            if (instruction->opcode != IR_MUL) {
+                continue;
+            }
+
+            const IRValue *operands = ir_operands(ir, instruction);
+
+            for (size_t k = 0; k < pass->inductions_len; ++k) {
+                const IRInduction *induction = &pass->inductions[k];
+
+                IRValue factor;
+
+                if (operands[0] == induction->phi) {
+                    factor = operands[1];
+                } else if (operands[1] == induction->phi) {
+                    factor = operands[0];
+                } else {
+                    continue;
+                }
+
+                if (!ir_loop_is_invariant(pass, ir_loop, factor)) {
+                    continue;
+                }
+
+                // the same product more than once only needs the one phi
+                bool repeated = false;
+
+                for (size_t l = reductions_start; l < pass->reductions_len && !repeated; ++l) {
+                    const IRReduction *reduction = &pass->reductions[l];
+
+                    if (reduction->induction.phi == induction->phi && ir_loop_is_same(definitions, reduction->factor, factor)) {
+                        pass->replacements[instruction->result] = reduction->product;
+                        repeated = true;
+                    }
+                }
+
+                if (!repeated) {
+                    ir_loop_push_reduction(pass, (IRReduction) {
+                        .loop_index = loop_index,
+                        .induction = *induction,
+                        .product = instruction->result,
+                        .factor = factor
+                    });
+                }
+                break;
+            }
+        }
+    }
+}
+
+// start * factor before the loop, then the step * factor
+// after every update of the induction variable
+static void ir_loop_reduce(IRLoopPass *pass, const IRReduction *reduction)
+{
+    IR *ir = pass->ir;
+    const IRLoop *ir_loop = &pass->loops.loops[reduction->loop_index];
+    const IRInduction *induction = &reduction->induction;
+    const DataType *data_type = ir->value_types[reduction->product];
+
+    const size_t position = ir->blocks[ir_loop->preheader].instructions_len - 1;
+
+    IRInstruction *instruction = ir_insert(ir, ir_loop->preheader, position, IR_MUL, data_type, 2);
+    ir_operands(ir, instruction)[0] = induction->start;
+    ir_operands(ir, instruction)[1] = reduction->factor;
+
+    const IRValue start = instruction->result;
+
+    instruction = ir_insert(ir, ir_loop->preheader, position + 1, IR_MUL, data_type, 2);
+    ir_operands(ir, instruction)[0] = induction->step;
+    ir_operands(ir, instruction)[1] = reduction->factor;
+
+    const IRValue step = instruction->result;
+
+    const IRBlock *header_block = &ir->blocks[ir_loop->header];
+
+    size_t phis_len = 0;
+    while (header_block->instructions[phis_len].opcode == IR_PHI) {
+        ++phis_len;
+    }
+
+    const IRValue phi = ir_insert(ir, ir_loop->header, phis_len, IR_PHI, data_type, header_block->predecessors_len)->result;
+
+    const IRBlockIndex update_block = pass->blocks[induction->next];
+    const IRBlock *ir_block = &ir->blocks[update_block];
+
+    size_t update_position = 0;
+    while (ir_block->instructions[update_position].result != induction->next) {
+        ++update_position;
+    }
+
+    instruction = ir_insert(ir, update_block, update_position + 1, induction->opcode, data_type, 2);
+    ir_operands(ir, instruction)[0] = phi;
+    ir_operands(ir, instruction)[1] = step;
+
+    const IRValue next = instruction->result;
+
+    // nothing went in front of the phi, whatever was added after it
+    instruction = &ir->blocks[ir_loop->header].instructions[phis_len];
+    ir_operands(ir, instruction)[ir_loop_predecessor(ir, ir_loop->header, ir_loop->preheader)] = start;
+    ir_operands(ir, instruction)[ir_loop_predecessor(ir, ir_loop->header, ir_loop->latch)] = next;
+
+    pass->replacements[reduction->product] = phi;
+}
+
+static void ir_loop_map_reserve(IRLoopPass *pass)
+{
+    const size_t values_len = pass->ir->values_len;
+
+    if (pass->map_len >= values_len) {
+        return;
+    }
+
+    pass->map = realloc(pass->map, sizeof(*pass->map) * values_len);
+
+    if (pass->map == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (size_t i = pass->map_len; i < values_len; ++i) {
+        pass->map[i] = IR_NULL;
+    }
+
+    pass->map_len = values_len;
+}
+
+static bool ir_loop_is_mapped(const IRLoopPass *pass, IRValue value)
+{
+    return value < pass->map_len && pass->map[value] != IR_NULL;
+}
+
+static IRValue ir_loop_mapped(const IRLoopPass *pass, IRValue value)
+{
+    return ir_loop_is_mapped(pass, value) ? pass->map[value] : value;
+}
+
+// laid out in front of `before`, and in every loop that `like` is in
+static IRBlockIndex ir_loop_new_block(IRLoopPass *pass, IRBlockIndex before, IRBlockIndex like)
+{
+    const IRBlockIndex block = ir_block_new(pass->ir);
+
+    if (pass->placements_len >= pass->placements_cap) {
+        while (pass->placements_len >= pass->placements_cap) {
+            pass->placements_cap *= 2;
+        }
+
+        pass->placements = realloc(pass->placements, sizeof(*pass->placements) * pass->placements_cap);
+
+        if (pass->placements == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    pass->placements[pass->placements_len++] = before;
+
+    for (size_t i = 0; i < pass->loops.len; ++i) {
+        IRLoop *ir_loop = &pass->loops.loops[i];
+
+        if (!ir_loop_contains(ir_loop, like)) {
+            continue;
+        }
+
+        ir_loop->blocks = realloc(ir_loop->blocks, sizeof(*ir_loop->blocks) * (ir_loop->blocks_len + 1));
+
+        if (ir_loop->blocks == NULL) {
+            ALLOCATION_ERROR();
+        }
+
+        // the newest block comes last, so they stay sorted
+        ir_loop->blocks[ir_loop->blocks_len++] = block;
+    }
+
+    return block;
+}
+
+// copies the instructions of `source` but its phis and its terminator
+// to the end of `block`, their operands read through the map, and maps
+// what each one defines to what its copy does
+static void ir_loop_copy(IRLoopPass *pass, IRBlockIndex source, IRBlockIndex block)
+{
+    IR *ir = pass->ir;
+
+    for (size_t i = 0; i + 1 < ir->blocks[source].instructions_len; ++i) {
+        const IRInstruction original = ir->blocks[source].instructions[i];
+
+        if (original.opcode == IR_PHI) {
+            continue;
+        }
+
+        IRInstruction *copy = ir_push(ir, block, original.opcode, original.data_type, original.operands_len);
+
+        const IRValue result = copy->result;
+        const uint32_t operands = copy->operands;
+
+        *copy = original;
+        copy->result = result;
+        copy->operands = operands;
+
+        if (original.opcode == IR_STRING) {
+            copy->string.data = malloc(original.string.len);
+
+            if (copy->string.data == NULL) {
+                ALLOCATION_ERROR();
+            }
+
+            memcpy(copy->string.data, original.string.data, original.string.len);
+        }
+
+        for (size_t j = 0; j < original.operands_len; ++j) {
+            ir->operands[operands + j] = ir_loop_mapped(pass, ir->operands[original.operands + j]);
+        }
+
+        if (original.result != IR_NULL) {
+            pass->map[original.result] = result;
+        }
+    }
+}
+
+static void ir_loop_unmap(IRLoopPass *pass, IRBlockIndex block)
+{
+    const IRBlock *ir_block = &pass->ir->blocks[block];
+
+    for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+        if (ir_block->instructions[i].result != IR_NULL) {
+            pass->map[ir_block->instructions[i].result] = IR_NULL;
+        }
+    }
+}
+
+// a loop that's just the header, with nothing but its phis and the test,
+// and a body that doesn't branch, going round while `opcode phi, bound`,
+// where the phi goes up or down by a constant every time round
+typedef struct IRCountedLoop
+{
+    IRBlockIndex body;
+
+    size_t phis_len;
+    size_t induction;
+
+    IRValue bound;
+    IROpcode opcode;
+    const DataType *test_type;
+
+    int64_t step;
+} IRCountedLoop;
+
+static bool ir_loop_is_counted(const IRLoopPass *pass, const IRLoop *ir_loop, IRCountedLoop *counted)
+{
+    const IR *ir = pass->ir;
+
+    if (ir_loop->blocks_len != 2 || ir_loop->preheader == IR_NO_BLOCK || ir_loop->latch != ir_loop->blocks[1]) {
+        return false;
+    }
+
+    const IRBlock *header_block = &ir->blocks[ir_loop->header];
+    const IRBlock *body_block = &ir->blocks[ir_loop->latch];
+    const IRInstruction *branch = ir_terminator(ir, ir_loop->header);
+
+    if (branch->opcode != IR_BRANCH || body_block->predecessors_len != 1) {
+        return false;
+    }
+
+    size_t phis_len = 0;
+    while (header_block->instructions[phis_len].opcode == IR_PHI) {
+        ++phis_len;
+    }
+
+    const IRInstruction *test = &header_block->instructions[phis_len];
+
+    if (header_block->instructions_len != phis_len + 2
+     || !ir_opcode_is_comparison(test->opcode)
+     || ir_operands(ir, branch)[0] != test->result) {
+        return false;
+    }
+
+    *counted = (IRCountedLoop) {
+        .body = ir_loop->latch,
+        .phis_len = phis_len,
+        .induction = phis_len,
+        .bound = ir_operands(ir, test)[1],
+        .opcode = test->opcode,
+        .test_type = test->data_type
+    };
+
+    IRValue phi = ir_operands(ir, test)[0];
+
+    for (size_t i = 0; i < phis_len; ++i) {
+        if (header_block->instructions[i].result == phi) {
+            counted->induction = i;
+        }
+    }
+
+    if (counted->induction == phis_len) {
+        counted->bound = phi;
+        counted->opcode = IR_MIRRORED_COMPARISON[counted->opcode];
+        phi = ir_operands(ir, test)[1];
+
+        for (size_t i = 0; i < phis_len; ++i) {
+            if (header_block->instructions[i].result == phi) {
+                counted->induction = i;
+            }
+        }
+    }
+
+    if (counted->induction == phis_len) {
+        return false;
+    }
+
+    if (branch->targets[0] != counted->body) {
+        counted->opcode = IR_INVERTED_COMPARISON[counted->opcode];
+    }
+
+    if (counted->bound >= pass->values_len || !ir_loop_is_invariant(pass, ir_loop, counted->bound)) {
+        return false;
+    }
+
+    const DataType *data_type = ir->value_types[phi];
+
+    if (data_type->type < TYPE_INT8 || data_type->type > TYPE_INT64) {
+        return false;
+    }
+
+    const IRInstruction *induction = &header_block->instructions[counted->induction];
+    const IRValue next = ir_operands(ir, induction)[ir_loop_predecessor(ir, ir_loop->header, counted->body)];
+
+    const IRInstruction *update = NULL;
+
+    for (size_t i = 0; i + 1 < body_block->instructions_len; ++i) {
+        const IRInstruction *instruction = &body_block->instructions[i];
+        const IRValue *operands = ir_operands(ir, instruction);
+
+        // a local copied would be a different slot every time
+        if (instruction->opcode == IR_LOCAL) {
+            return false;
+        }
+
+        for (size_t j = 0; j < instruction->operands_len; ++j) {
+            if (operands[j] == test->result) {
+                return false;
+            }
+        }
+
+        if (instruction->result == next) {
+            update = instruction;
+        }
+    }
+
+    if (update == NULL) {
+        return false;
+    }
+
+    const IRValue *operands = ir_operands(ir, update);
+    IRValue step;
+
+    if (update->opcode == IR_ADD && operands[1] == phi) {
+        step = operands[0];
+    } else if ((update->opcode == IR_ADD || update->opcode == IR_SUB) && operands[0] == phi) {
+        step = operands[1];
+    } else {
+        return false;
+    }
+
+    if (step >= pass->values_len || !pass->is_constant[step]) {
+        return false;
+    }
+
+    counted->step = (int64_t) pass->constants[step];
+
+    if (update->opcode == IR_SUB) {
+        if (counted->step == INT64_MIN) {
+            return false;
+        }
+
+        counted->step = -counted->step;
+    }
+
+    // counting towards the bound
+    switch (counted->opcode) {
+        case IR_LT:
+        case IR_LE: {
+            return counted->step > 0;
+        }
+
+        case IR_GT:
+        case IR_GE: {
+            return counted->step < 0;
+        }
+
+        default: {
+            return false;
+        }
+    }
+}
+
+// the vector that does what `value` does to each of its elements, a
+// broadcast in `entry` of a value that's the same every time round
+static IRValue ir_loop_vector_operand(IRLoopPass *pass, IRBlockIndex entry, const DataType *vector, IRValue value)
+{
+    if (!ir_loop_is_mapped(pass, value)) {
+        pass->map[value] = ir_unary(pass->ir, entry, IR_BROADCAST, vector, value);
+    }
+
+    return pass->map[value];
+}
+
+// Like ir_loop_copy, but what the body loads, works out and stores are
+// vectors, starting at the element the phi indexes. The update of the
+// phi is copied as it is, for the caller to make it go up by a vector.
+static void ir_loop_copy_vector(
+    IRLoopPass *pass,
+    IRBlockIndex source,
+    IRBlockIndex block,
+    IRBlockIndex entry,
+    const DataType *vector,
+    IRValue update
+)
+{
+    IR *ir = pass->ir;
+
+    for (size_t i = 0; i + 1 < ir->blocks[source].instructions_len; ++i) {
+        const IRInstruction original = ir->blocks[source].instructions[i];
+
+        // adding instructions can move the operands, so they're copied
+        IRValue operands[2] = { IR_NULL, IR_NULL };
+        memcpy(operands, ir_operands(ir, &original), sizeof(*operands) * original.operands_len);
+
+        IRValue result = IR_NULL;
+
+        switch (original.opcode) {
+            case IR_INDEX: {
+                result = ir_binary(ir, block, IR_INDEX, original.data_type, operands[0], ir_loop_mapped(pass, operands[1]));
+                break;
+            }
+
+            case IR_LOAD: {
+                result = ir_unary(ir, block, IR_LOAD, vector, ir_loop_mapped(pass, operands[0]));
+                break;
+            }
+
+            case IR_STORE: {
+                const IRValue value = ir_loop_vector_operand(pass, entry, vector, operands[1]);
+
+                ir_store(ir, block, ir_loop_mapped(pass, operands[0]), value);
+                break;
+            }
+
+            default: {
+                if (original.result == update) {
+                    result = ir_binary(
+                        ir,
+                        block,
+                        original.opcode,
+                        original.data_type,
+                        ir_loop_mapped(pass, operands[0]),
+                        ir_loop_mapped(pass, operands[1])
+                    );
+                    break;
+                }
+
+                const IRValue lhs = ir_loop_vector_operand(pass, entry, vector, operands[0]);
+                const IRValue rhs = ir_loop_vector_operand(pass, entry, vector, operands[1]);
+
+                result = ir_binary(ir, block, original.opcode, vector, lhs, rhs);
+                break;
+            }
+        }
+
+        if (original.result != IR_NULL) {
+            pass->map[original.result] = result;
+        }
+    }
+}
+
+// In front of the loop goes one that tests whether there are `unroll`
+// times round left, does them all, and goes round again. Going round
+// while `phi < bound` there are if `phi + (unroll - 1) * step < bound`,
+// which is `phi < bound - (unroll - 1) * step` unless that wraps. Then
+// the loop itself goes round whatever times are left. With a `vector`
+// type, the loop in front does the body once, on that many elements.
+static bool ir_loop_widen(IRLoopPass *pass, IRLoop *ir_loop, const IRCountedLoop *counted, size_t unroll, const DataType *vector)
+{
+    IR *ir = pass->ir;
+
+    const IRBlockIndex preheader = ir_loop->preheader;
+    const IRBlockIndex header = ir_loop->header;
+    const IRBlockIndex body = counted->body;
+
+    const IRValue phi = ir->blocks[header].instructions[counted->induction].result;
+    const DataType *data_type = ir->value_types[phi];
+
+    // how far the unrolled loop goes every time round, which has to fit
+    if ((uint64_t) (counted->step < 0 ? -counted->step : counted->step) > INT64_MAX / unroll) {
+        return false;
+    }
+
+    const int64_t stride = counted->step * (int64_t) unroll;
+
+    if ((int64_t) ir_fold_wrap(data_type, (uint64_t) stride) != stride) {
+        return false;
+    }
+
+    const size_t phis_len = counted->phis_len;
+    const size_t entry = ir_loop_predecessor(ir, header, preheader);
+    const size_t back = ir_loop_predecessor(ir, header, body);
+
+    IRValue *values = malloc(sizeof(*values) * (phis_len * 5 + unroll));
+
+    if (values == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    // the header's phis, what they start as and go round with, and what
+    // they are so far in the unrolled loop and after the next copy
+    IRValue *phis = values;
+    IRValue *starts = values + phis_len;
+    IRValue *nexts = values + phis_len * 2;
+    IRValue *currents = values + phis_len * 3;
+    IRValue *going = values + phis_len * 4;
+
+    // indexed by copy, how far its update is from the phi
+    IRValue *distances = values + phis_len * 5;
+
+    for (size_t i = 0; i < phis_len; ++i) {
+        const IRInstruction *instruction = &ir->blocks[header].instructions[i];
+
+        phis[i] = instruction->result;
+        starts[i] = ir_operands(ir, instruction)[entry];
+        nexts[i] = ir_operands(ir, instruction)[back];
+    }
+
+    const IRBlockIndex enough = ir_loop_new_block(pass, header, preheader);
+    const IRBlockIndex unrolled_entry = ir_loop_new_block(pass, header, preheader);
+    const IRBlockIndex unrolled = ir_loop_new_block(pass, header, preheader);
+    const IRBlockIndex unrolled_latch = ir_loop_new_block(pass, header, preheader);
+    const IRBlockIndex unrolled_exit = ir_loop_new_block(pass, header, preheader);
+    const IRBlockIndex wrapped = ir_loop_new_block(pass, header, preheader);
+    const IRBlockIndex not_enough = ir_loop_new_block(pass, header, preheader);
+    const IRBlockIndex remainder = ir_loop_new_block(pass, header, preheader);
+
+    const IROpcode strict = counted->step > 0 ? IR_LT : IR_GT;
+
+    // the jump to the header
+    --ir->blocks[preheader].instructions_len;
+
+    for (size_t i = 0; i < unroll; ++i) {
+        distances[i] = ir_const(ir, preheader, data_type, (uint64_t) (counted->step * (int64_t) (i + 1)));
+    }
+
+    const IRValue limit = ir_binary(ir, preheader, IR_SUB, data_type, counted->bound, distances[unroll - 2]);
+    const IRValue fits = ir_binary(ir, preheader, strict, counted->test_type, limit, counted->bound);
+
+    ir_branch(ir, preheader, fits, enough, wrapped);
+
+    const IRValue first = ir_binary(ir, enough, counted->opcode, counted->test_type, starts[counted->induction], limit);
+
+    ir_branch(ir, enough, first, unrolled_entry, not_enough);
+
+    for (size_t i = 0; i < phis_len; ++i) {
+        IRInstruction *instruction = ir_push(ir, unrolled, IR_PHI, ir->value_types[phis[i]], 2);
+        ir_operands(ir, instruction)[0] = starts[i];
+
+        currents[i] = instruction->result;
+    }
+
+    ir_loop_map_reserve(pass);
+
+    const size_t copies = vector != NULL ? 1 : unroll;
+
+    for (size_t i = 0; i < copies; ++i) {
+        for (size_t j = 0; j < phis_len; ++j) {
+            pass->map[phis[j]] = currents[j];
+        }
+
+        if (vector != NULL) {
+            ir_loop_copy_vector(pass, body, unrolled, unrolled_entry, vector, nexts[counted->induction]);
+        } else {
+            ir_loop_copy(pass, body, unrolled);
+        }
+
+        // counting from the phi rather than the copy before, so the
+        // copies of the body don't have to wait for each other
+        const IRBlock *unrolled_block = &ir->blocks[unrolled];
+        const IRValue update = pass->map[nexts[counted->induction]];
+
+        size_t position = unrolled_block->instructions_len - 1;
+        while (unrolled_block->instructions[position].result != update) {
+            --position;
+        }
+
+        IRInstruction *instruction = &unrolled_block->instructions[position];
+        instruction->opcode = IR_ADD;
+        ir_operands(ir, instruction)[0] = unrolled_block->instructions[counted->induction].result;
+        ir_operands(ir, instruction)[1] = distances[vector != NULL ? unroll - 1 : i];
+
+        // one phi can go round with another, so they're
+        // all looked up before any of them changes
+        for (size_t j = 0; j < phis_len; ++j) {
+            going[j] = ir_loop_mapped(pass, nexts[j]);
+        }
+
+        memcpy(currents, going, sizeof(*currents) * phis_len);
+    }
+
+    ir_loop_unmap(pass, body);
+
+    // the broadcasts, mapped from what they broadcast
+    for (size_t i = 0; i < ir->blocks[unrolled_entry].instructions_len; ++i) {
+        pass->map[ir_operands(ir, &ir->blocks[unrolled_entry].instructions[i])[0]] = IR_NULL;
+    }
+
+    ir_jump(ir, unrolled_entry, unrolled);
+
+    for (size_t i = 0; i < phis_len; ++i) {
+        pass->map[phis[i]] = IR_NULL;
+        ir_operands(ir, &ir->blocks[unrolled].instructions[i])[1] = currents[i];
+    }
+
+    const IRValue again = ir_binary(ir, unrolled, counted->opcode, counted->test_type, currents[counted->induction], limit);
+
+    ir_branch(ir, unrolled, again, unrolled_latch, unrolled_exit);
+    ir_jump(ir, unrolled_latch, unrolled);
+
+    ir_jump(ir, unrolled_exit, remainder);
+    ir_jump(ir, wrapped, remainder);
+    ir_jump(ir, not_enough, remainder);
+
+    for (size_t i = 0; i < phis_len; ++i) {
+        IRInstruction *instruction = ir_push(ir, remainder, IR_PHI, ir->value_types[phis[i]], 3);
+        ir_operands(ir, instruction)[0] = currents[i];
+        ir_operands(ir, instruction)[1] = starts[i];
+        ir_operands(ir, instruction)[2] = starts[i];
+
+        ir_operands(ir, &ir->blocks[header].instructions[i])[entry] = instruction->result;
+    }
+
+    // the remainder takes the preheader's place, rather than being added
+    ir_jump(ir, remainder, header);
+
+    IRBlock *header_block = &ir->blocks[header];
+
+    --header_block->predecessors_len;
+    header_block->predecessors[entry] = remainder;
+
+    ir_loop->preheader = remainder;
+
+    free(values);
+
+    return true;
+}
+
+// Whether the body only works on arrays, one element at a time: every
+// address is `array[phi]`, and everything else is loaded from one, stored
+// to one, or an add, sub or mul of those and what's the same every time
+// round. The elements are all `element`, which is set, and the phi isn't
+// used for anything else. Indexing out of bounds isn't allowed, so arrays
+// of the same element are either the same one or don't overlap at all,
+// and doing a few elements at a time can't read what hasn't been stored.
+static bool ir_loop_is_vectorizable(
+    const IRLoopPass *pass,
+    const IRLoop *ir_loop,
+    const IRCountedLoop *counted,
+    const DataType **element
+)
+{
+    const IR *ir = pass->ir;
+    const IRBlock *body_block = &ir->blocks[counted->body];
+
+    const IRValue phi = ir->blocks[ir_loop->header].instructions[counted->induction].result;
+    const IRValue update = ir_operands(ir, &ir->blocks[ir_loop->header].instructions[counted->induction])[
+        ir_loop_predecessor(ir, ir_loop->header, counted->body)
+    ];
+
+    const size_t body_len = body_block->instructions_len - 1;
+
+    if (counted->phis_len != 1 || counted->step != 1 || body_len > pass->options->budget) {
+        return false;
+    }
+
+    *element = NULL;
+
+    // loads, arithmetic and broadcasts, which all need a register
+    size_t vectors = 0;
+
+    for (size_t i = 0; i < body_len; ++i) {
+        const IRInstruction *instruction = &body_block->instructions[i];
+        const IRValue *operands = ir_operands(ir, instruction);
+
+        if (instruction->result == update) {
+            continue;
+        }
+
+        // what each operand has to be: 0 for an address in the body,
+        // 1 for the phi, 2 for an element, in the body or invariant
+        uint8_t kinds[2];
+
+        switch (instruction->opcode) {
+            case IR_INDEX: {
+                const DataType *data_type = instruction->data_type->dereference;
+
+                if (!data_type_is_integer(data_type)
+                 || operands[0] >= pass->values_len
+                 || !ir_loop_is_invariant(pass, ir_loop, operands[0])
+                 || operands[1] != phi) {
+                    return false;
+                }
+
+                if (*element == NULL) {
+                    *element = data_type;
+                } else if (data_type_size(*element) != data_type_size(data_type)) {
+                    return false;
+                }
+
+                continue;
+            }
+
+            case IR_LOAD: {
+                kinds[0] = 0;
+                break;
+            }
+
+            case IR_STORE: {
+                kinds[0] = 0;
+                kinds[1] = 2;
+                break;
+            }
+
+            case IR_MUL: {
+                const size_t size = data_type_size(instruction->data_type);
+
+                if (size != 2 && (size != 4 || pass->options->vector_width != 32)) {
+                    return false;
+                }
+
+                kinds[0] = 2;
+                kinds[1] = 2;
+                break;
+            }
+
+            case IR_ADD:
+            case IR_SUB: {
+                kinds[0] = 2;
+                kinds[1] = 2;
+                break;
+            }
+
+            default: {
+                return false;
+            }
+        }
+
+        if (instruction->result != IR_NULL) {
+            ++vectors;
+        }
+
+        for (size_t j = 0; j < instruction->operands_len; ++j) {
+            const IRValue operand = operands[j];
+
+            if (operand == phi || operand == update || operand >= pass->values_len) {
+                return false;
+            }
+
+            const bool in_body = pass->blocks[operand] == counted->body;
+
+            // found by position, an address is defined before it's used
+            const IRInstruction *definition = NULL;
+
+            for (size_t k = i; in_body && k-- > 0;) {
+                if (body_block->instructions[k].result == operand) {
+                    definition = &body_block->instructions[k];
+                }
+            }
+
+            const bool is_address = definition != NULL && definition->opcode == IR_INDEX;
+
+            if (kinds[j] == 0 ? !is_address : is_address) {
+                return false;
+            }
+
+            if (kinds[j] == 2 && !in_body) {
+                if (!ir_loop_is_invariant(pass, ir_loop, operand)) {
+                    return false;
+                }
+
+                ++vectors;
+            }
+        }
+    }
+
+    if (*element == NULL || vectors > IR_LOOP_MAX_VECTORS) {
+        return false;
+    }
+
+    // every element is the same type, and so is everything worked out
+    for (size_t i = 0; i < body_len; ++i) {
+        const IRInstruction *instruction = &body_block->instructions[i];
+
+        if (instruction->result == update || instruction->opcode == IR_INDEX) {
+            continue;
+        }
+
+        const IRValue value = instruction->opcode == IR_STORE ? ir_operands(ir, instruction)[1] : instruction->result;
+
+        if (ir->value_types[value]->type != (*element)->type) {
+            return false;
+        }
+
+        for (size_t j = 0; instruction->opcode != IR_LOAD && j < instruction->operands_len; ++j) {
+            const IRValue operand = ir_operands(ir, instruction)[j];
+
+            if (instruction->opcode == IR_STORE && j == 0) {
+                continue;
+            }
+
+            if (ir->value_types[operand]->type != (*element)->type) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// a counted loop that goes up by 1 and only works on arrays, a vector of
+// elements at a time in front of it, and whatever's left over after
+static void ir_loop_vectorize(IRLoopPass *pass, IRLoop *ir_loop)
+{
+    IRCountedLoop counted;
+    const DataType *element;
+
+    if (!ir_loop_is_counted(pass, ir_loop, &counted) || !ir_loop_is_vectorizable(pass, ir_loop, &counted, &element)) {
+        return;
+    }
+
+    const size_t lanes = pass->options->vector_width / data_type_size(element);
+
+    if (lanes < 2) {
+        return;
+    }
+
+    const DataType *vector = data_type_array(pass->types, lanes, element);
+
+    ir_loop->vectorized = ir_loop_widen(pass, ir_loop, &counted, lanes, vector);
+}
+
+static void ir_loop_unroll(IRLoopPass *pass, IRLoop *ir_loop)
+{
+    IRCountedLoop counted;
+
+    if (ir_loop->vectorized || !ir_loop_is_counted(pass, ir_loop, &counted)) {
+        return;
+    }
+
+    const size_t body_len = pass->ir->blocks[counted.body].instructions_len - 1;
+
+    size_t unroll = pass->options->unroll;
+
+    if (body_len * unroll > pass->options->budget) {
+        unroll = pass->options->budget / body_len;
+    }
+
+    if (unroll < 2) {
+        return;
+    }
+
+    ir_loop_widen(pass, ir_loop, &counted, unroll, NULL);
+}
+
+// The header's test goes in front of the loop, where it either goes into
+// the body or skips the loop, and at the end of the body, where it either
+// goes back round or leaves. The body gets phis of its own instead of the
+// header's, and whatever reads those after the loop reads phis in the exit.
+static void ir_loop_rotate(IRLoopPass *pass, IRLoop *ir_loop)
+{
+    IR *ir = pass->ir;
+
+    const IRBlockIndex preheader = ir_loop->preheader;
+    const IRBlockIndex header = ir_loop->header;
+    const IRBlockIndex latch = ir_loop->latch;
+
+    if (preheader == IR_NO_BLOCK || latch == IR_NO_BLOCK || latch == header) {
+        return;
+    }
+
+    const IRInstruction *branch = ir_terminator(ir, header);
+
+    if (branch->opcode != IR_BRANCH || ir_terminator(ir, latch)->opcode != IR_JUMP) {
+        return;
+    }
+
+    const bool taken_stays = ir_loop_contains(ir_loop, branch->targets[0]);
+    const IRBlockIndex body = branch->targets[taken_stays ? 0 : 1];
+    const IRBlockIndex end_block = branch->targets[taken_stays ? 1 : 0];
+
+    if (!ir_loop_contains(ir_loop, body) || ir_loop_contains(ir_loop, end_block) || body == header
+     || ir->blocks[body].predecessors_len != 1 || ir->blocks[body].instructions[0].opcode == IR_PHI
+     || ir->blocks[end_block].predecessors_len != 1 || ir->blocks[end_block].instructions[0].opcode == IR_PHI) {
+        return;
+    }
+
+    // the header has to be the only way out
+    for (size_t i = 0; i < ir_loop->blocks_len; ++i) {
+        const IRBlockIndex block = ir_loop->blocks[i];
+
+        IRBlockIndex successors[2];
+        const size_t successors_len = block != header ? ir_successors(ir, block, successors) : 0;
+
+        for (size_t j = 0; j < successors_len; ++j) {
+            if (!ir_loop_contains(ir_loop, successors[j])) {
+                return;
+            }
+        }
+    }
+
+    const IRBlock *header_block = &ir->blocks[header];
+
+    size_t phis_len = 0;
+    while (header_block->instructions[phis_len].opcode == IR_PHI) {
+        ++phis_len;
+    }
+
+    if (header_block->instructions_len - 1 - phis_len > pass->options->budget) {
+        return;
+    }
+
+    const size_t entry = ir_loop_predecessor(ir, header, preheader);
+    const size_t back = ir_loop_predecessor(ir, header, latch);
+    const IRValue condition = ir_operands(ir, branch)[0];
+
+    IRValue *values = malloc(sizeof(*values) * (phis_len * 4 + 1));
+
+    if (values == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    // the header's phis, what they start as and go round with,
+    // and the end_block's phis for the ones read after the loop
+    IRValue *phis = values;
+    IRValue *starts = values + phis_len;
+    IRValue *nexts = values + phis_len * 2;
+    IRValue *exits = values + phis_len * 3;
+
+    for (size_t i = 0; i < phis_len; ++i) {
+        const IRInstruction *instruction = &header_block->instructions[i];
+
+        phis[i] = instruction->result;
+        starts[i] = ir_operands(ir, instruction)[entry];
+        nexts[i] = ir_operands(ir, instruction)[back];
+        exits[i] = IR_NULL;
+    }
+
+    ir_loop_map_reserve(pass);
+
+    // marks what the header defines, which nothing but the header itself
+    // can read, besides its phis, which need phis in the end_block if they're
+    // read after the loop
+    for (size_t i = 0; i + 1 < header_block->instructions_len; ++i) {
+        if (header_block->instructions[i].result != IR_NULL) {
+            pass->map[header_block->instructions[i].result] = header_block->instructions[i].result;
+        }
+    }
+
+    bool escapes = false;
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len && !escapes; ++block) {
+        const IRBlock *ir_block = &ir->blocks[block];
+        const bool inside = ir_loop_contains(ir_loop, block);
+
+        for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+            const IRInstruction *instruction = &ir_block->instructions[i];
+            const IRValue *operands = ir_operands(ir, instruction);
+
+            // the header's own phis can go round with the others
+            if (block == header && instruction->opcode != IR_PHI) {
+                break;
+            }
+
+            for (size_t j = 0; j < instruction->operands_len; ++j) {
+                if (!ir_loop_is_mapped(pass, operands[j])) {
+                    continue;
+                }
+
+                size_t k = 0;
+                while (k < phis_len && phis[k] != operands[j]) {
+                    ++k;
+                }
+
+                if (k == phis_len) {
+                    escapes = true;
+                } else if (!inside) {
+                    exits[k] = phis[k];
+                }
+            }
+        }
+    }
+
+    ir_loop_unmap(pass, header);
+
+    if (escapes) {
+        free(values);
+        return;
+    }
+
+    for (size_t i = 0; i < phis_len; ++i) {
+        pass->map[phis[i]] = ir_insert(ir, body, i, IR_PHI, ir->value_types[phis[i]], 2)->result;
+    }
+
+    size_t exits_len = 0;
+
+    for (size_t i = 0; i < phis_len; ++i) {
+        nexts[i] = ir_loop_mapped(pass, nexts[i]);
+
+        IRValue *operands = ir_operands(ir, &ir->blocks[body].instructions[i]);
+        operands[0] = starts[i];
+        operands[1] = nexts[i];
+
+        if (exits[i] != IR_NULL) {
+            IRInstruction *instruction = ir_insert(ir, end_block, exits_len++, IR_PHI, ir->value_types[phis[i]], 2);
+            ir_operands(ir, instruction)[0] = starts[i];
+            ir_operands(ir, instruction)[1] = nexts[i];
+
+            exits[i] = instruction->result;
+        }
+    }
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        const IRBlock *ir_block = &ir->blocks[block];
+        const bool inside = ir_loop_contains(ir_loop, block);
+
+        if (block == header) {
+            continue;
+        }
+
+        for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+            const IRInstruction *instruction = &ir_block->instructions[i];
+            IRValue *operands = ir_operands(ir, instruction);
+
+            for (size_t j = 0; j < instruction->operands_len; ++j) {
+                if (!ir_loop_is_mapped(pass, operands[j])) {
+                    continue;
+                }
+
+                if (inside) {
+                    operands[j] = pass->map[operands[j]];
+                    continue;
+                }
+
+                size_t k = 0;
+                while (phis[k] != operands[j]) {
+                    ++k;
+                }
+
+                operands[j] = exits[k];
+            }
+        }
+    }
+
+    ir->blocks[header].predecessors_len = 0;
+    ir->blocks[body].predecessors_len = 0;
+    ir->blocks[end_block].predecessors_len = 0;
+
+    const IRBlockIndex back_edge = ir_loop_new_block(pass, end_block, latch);
+    const IRBlockIndex leave = ir_loop_new_block(pass, end_block, end_block);
+    const IRBlockIndex skip = ir_loop_new_block(pass, end_block, end_block);
+
+    // the test in front of the loop, with what the phis start as
+    for (size_t i = 0; i < phis_len; ++i) {
+        pass->map[phis[i]] = starts[i];
+    }
+
+    --ir->blocks[preheader].instructions_len;
+    ir_loop_copy(pass, header, preheader);
+
+    const IRValue enter = ir_loop_mapped(pass, condition);
+
+    if (taken_stays) {
+        ir_branch(ir, preheader, enter, header, skip);
+    } else {
+        ir_branch(ir, preheader, enter, skip, header);
+    }
+
+    // and at the end of the body, with what they go round with
+    for (size_t i = 0; i < phis_len; ++i) {
+        pass->map[phis[i]] = nexts[i];
+    }
+
+    --ir->blocks[latch].instructions_len;
+    ir_loop_copy(pass, header, latch);
+
+    const IRValue again = ir_loop_mapped(pass, condition);
+
+    if (taken_stays) {
+        ir_branch(ir, latch, again, back_edge, leave);
+    } else {
+        ir_branch(ir, latch, again, leave, back_edge);
+    }
+
+    ir_loop_unmap(pass, header);
+
+    IRBlock *old_header = &ir->blocks[header];
+
+    for (size_t i = 0; i < old_header->instructions_len; ++i) {
+        if (old_header->instructions[i].opcode == IR_STRING) {
+            free(old_header->instructions[i].string.data);
+        }
+    }
+
+    old_header->instructions_len = 0;
+
+    ir_jump(ir, header, body);
+    ir_jump(ir, back_edge, body);
+    ir_jump(ir, skip, end_block);
+    ir_jump(ir, leave, end_block);
+
+    // the old header is only the way into the loop now
+    size_t position = 0;
+    while (ir_loop->blocks[position] != header) {
+        ++position;
+    }
+
+    memmove(
+        &ir_loop->blocks[position],
+        &ir_loop->blocks[position + 1],
+        sizeof(*ir_loop->blocks) * (ir_loop->blocks_len - position - 1)
+    );
+
+    --ir_loop->blocks_len;
+
+    ir_loop->header = body;
+    ir_loop->preheader = header;
+    ir_loop->latch = back_edge;
+
+    free(values);
+}
+
+// puts the blocks that were added in front of the ones they were made
+// for, in the order they were made in
+static void ir_loop_lay_out(IRLoopPass *pass)
+{
+    IR *ir = pass->ir;
+    const size_t blocks_len = ir->blocks_len;
+    const size_t added_from = blocks_len - pass->placements_len;
+
+    if (pass->placements_len == 0) {
+        return;
+    }
+
+    size_t *starts = calloc(added_from + 1, sizeof(*starts));
+    IRBlockIndex *added = malloc(sizeof(*added) * pass->placements_len);
+    IRBlockIndex *order = malloc(sizeof(*order) * blocks_len);
+
+    if (starts == NULL || added == NULL || order == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (size_t i = 0; i < pass->placements_len; ++i) {
+        ++starts[pass->placements[i] + 1];
+    }
+
+    for (size_t i = 0; i < added_from; ++i) {
+        starts[i + 1] += starts[i];
+    }
+
+    for (size_t i = 0; i < pass->placements_len; ++i) {
+        added[starts[pass->placements[i]]++] = added_from + i;
+    }
+
+    size_t order_len = 0;
+    size_t next = 0;
+
+    for (IRBlockIndex block = 0; block < added_from; ++block) {
+        // filling `added` moved each start along to where its blocks end
+        while (next < starts[block]) {
+            order[order_len++] = added[next++];
+        }
+
+        order[order_len++] = block;
+    }
+
+    ir_layout(ir, order);
+
+    free(starts);
+    free(added);
+    free(order);
+}
+
+void ir_optimize_loops(IR *ir, TypeTable *types, const IRLoopOptions *options)
+{
+    if (options->level == 0) {
+        return;
+    }
+
+    IRLoopPass pass = {
+        .ir = ir,
+        .options = options,
+        .loops = ir_loops_find(ir),
+        .types = types,
+        .values_len = ir->values_len,
+
+        .hoisted_cap = 16,
+
+        .inductions_len = 0,
+        .inductions_cap = 16,
+
+        .reductions_len = 0,
+        .reductions_cap = 16,
+
+        .map_len = 0,
+
+        .placements_len = 0,
+        .placements_cap = 16
+    };
+
+    if (pass.loops.len == 0) {
+        ir_loops_free(&pass.loops);
+        return;
+    }
+
+    const size_t values_len = ir->values_len;
+
+    pass.blocks       = malloc(sizeof(*pass.blocks) * (values_len + 1));
+    pass.is_constant  = calloc(values_len + 1, sizeof(*pass.is_constant));
+    pass.constants    = malloc(sizeof(*pass.constants) * (values_len + 1));
+    pass.replacements = malloc(sizeof(*pass.replacements) * (values_len + 1));
+    pass.hoisted      = malloc(sizeof(*pass.hoisted) * pass.hoisted_cap);
+    pass.inductions   = malloc(sizeof(*pass.inductions) * pass.inductions_cap);
+    pass.reductions   = malloc(sizeof(*pass.reductions) * pass.reductions_cap);
+    pass.placements   = malloc(sizeof(*pass.placements) * pass.placements_cap);
+
+    const IRInstruction **definitions = malloc(sizeof(*definitions) * (values_len + 1));
+
+    if (pass.blocks == NULL || pass.is_constant == NULL || pass.constants == NULL || pass.replacements == NULL
+     || pass.hoisted == NULL || pass.inductions == NULL || pass.reductions == NULL || pass.placements == NULL
+     || definitions == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (size_t i = 0; i < values_len; ++i) {
+        pass.replacements[i] = IR_NULL;
+    }
+
+    ir_loop_find_blocks(&pass);
+
+    for (size_t i = 0; i < pass.loops.len; ++i) {
+        ir_loop_hoist(&pass, &pass.loops.loops[i]);
+    }
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        const IRBlock *ir_block = &ir->blocks[block];
+
+        for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+            if (ir_block->instructions[i].result != IR_NULL) {
+                definitions[ir_block->instructions[i].result] = &ir_block->instructions[i];
+            }
+        }
+    }
+
+    // all found before any are added, which moves the instructions around
+    for (size_t i = 0; i < pass.loops.len; ++i) {
+        ir_loop_find_reductions(&pass, i, definitions);
+    }
+
+    for (size_t i = 0; i < pass.reductions_len; ++i) {
+        ir_loop_reduce(&pass, &pass.reductions[i]);
+    }
+
+    if (pass.reductions_len > 0) {
+        for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+            const IRBlock *ir_block = &ir->blocks[block];
+
+            for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+                const IRInstruction *instruction = &ir_block->instructions[i];
+                IRValue *operands = ir_operands(ir, instruction);
+
+                for (size_t j = 0; j < instruction->operands_len; ++j) {
+                    while (operands[j] < values_len && pass.replacements[operands[j]] != IR_NULL) {
+                        operands[j] = pass.replacements[operands[j]];
+                    }
+                }
+            }
+        }
+    }
+
+    if (options->level >= 2) {
+        for (size_t i = 0; options->vector_width > 0 && i < pass.loops.len; ++i) {
+            ir_loop_vectorize(&pass, &pass.loops.loops[i]);
+        }
+
+        for (size_t i = 0; i < pass.loops.len; ++i) {
+            ir_loop_unroll(&pass, &pass.loops.loops[i]);
+        }
+    }
+
+    for (size_t i = 0; i < pass.loops.len; ++i) {
+        ir_loop_rotate(&pass, &pass.loops.loops[i]);
+    }
+
+    ir_loop_lay_out(&pass);
+
+    ir_loops_free(&pass.loops);
+    free(pass.blocks);
+    free(pass.is_constant);
+    free(pass.constants);
+    free(pass.replacements);
+    free(pass.hoisted);
+    free(pass.inductions);
+    free(pass.reductions);
+    free(pass.map);
+    free(pass.placements);
+    free(definitions);
+}
+
+void ir_loop_find_updates(const IR *ir, IRValue *updates)
+{
+    for (size_t i = 0; i < ir->values_len; ++i) {
+        updates[i] = IR_NULL;
+    }
+
+    IRLoops loops = ir_loops_find(ir);
+
+    if (loops.len == 0) {
+        ir_loops_free(&loops);
+        return;
+    }
+
+    // positions in the blocks' layout, every instruction has one,
+    // which inside a loop is the order they happen in on the way round
+    size_t *block_starts = malloc(sizeof(*block_starts) * ir->blocks_len);
+    size_t *positions = malloc(sizeof(*positions) * (ir->values_len + 1));
+
+    // indexed by value, the update done after it in the same register,
+    // and the phi whose register that is
+    IRValue *successors = malloc(sizeof(*successors) * (ir->values_len + 1));
+    IRValue *roots = malloc(sizeof(*roots) * (ir->values_len + 1));
+
+    // indexed by phi, the last update so far, which loop it's in and
+    // whether its updates can all be done in its register
+    IRValue *lasts = malloc(sizeof(*lasts) * (ir->values_len + 1));
+    size_t *candidate_loops = malloc(sizeof(*candidate_loops) * (ir->values_len + 1));
+    bool *candidates = calloc(ir->values_len + 1, sizeof(*candidates));
+
+    // indexed by loop, the last position the loop can be left from
+    size_t *last_exits = calloc(loops.len, sizeof(*last_exits));
+
+    if (block_starts == NULL || positions == NULL || successors == NULL || roots == NULL
+     || lasts == NULL || candidate_loops == NULL || candidates == NULL || last_exits == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    size_t positions_len = 0;
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        const IRBlock *ir_block = &ir->blocks[block];
+
+        block_starts[block] = positions_len;
+
+        for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+            const IRInstruction *instruction = &ir_block->instructions[i];
+
+            if (instruction->result != IR_NULL) {
+                positions[instruction->result] = positions_len + i;
+                successors[instruction->result] = IR_NULL;
+                roots[instruction->result] = IR_NULL;
+            }
+        }
+
+        positions_len += ir_block->instructions_len;
+    }
+
+    for (size_t i = 0; i < loops.len; ++i) {
+        const IRLoop *ir_loop = &loops.loops[i];
+
+        if (ir_loop->latch == IR_NO_BLOCK) {
+            continue;
+        }
+
+        const IRBlock *header_block = &ir->blocks[ir_loop->header];
+
+        for (size_t j = 0; j < header_block->instructions_len && header_block->instructions[j].opcode == IR_PHI; ++j) {
+            const IRValue phi = header_block->instructions[j].result;
+
+            roots[phi] = phi;
+            lasts[phi] = phi;
+            candidate_loops[phi] = i;
+        }
+
+        // one update after another, `phi op= operand` every time, each
+        // done once every time round rather than in a loop inside this one
+        for (size_t j = 0; j < ir_loop->blocks_len; ++j) {
+            const IRBlockIndex block = ir_loop->blocks[j];
+            const IRBlock *ir_block = &ir->blocks[block];
+
+            IRBlockIndex block_successors[2];
+            const size_t successors_len = ir_successors(ir, block, block_successors);
+
+            for (size_t k = 0; k < successors_len; ++k) {
+                if (!ir_loop_contains(ir_loop, block_successors[k])) {
+                    last_exits[i] = block_starts[block] + ir_block->instructions_len - 1;
+                }
+            }
+
+            if (ir_loops_innermost(&loops, block) != i) {
+                continue;
+            }
+
+            for (size_t k = 0; k < ir_block->instructions_len; ++k) {
+                const IRInstruction *update = &ir_block->instructions[k];
+                const IRValue *operands = ir_operands(ir, update);
+
+                size_t updated_len;
+
+                switch (update->opcode) {
+                    case IR_ADD:
+                    case IR_MUL: {
+                        updated_len = 2;
+                        break;
+                    }
+
+                    case IR_SUB:
+                    case IR_DIV: {
+                        updated_len = 1;
+                        break;
+                    }
+
+                    default: {
+                        updated_len = 0;
+                        break;
+                    }
+                }
+
+                for (size_t l = 0; l < updated_len; ++l) {
+                    const IRValue root = roots[operands[l]];
+
+                    if (root != IR_NULL && candidate_loops[root] == i && lasts[root] == operands[l]) {
+                        successors[operands[l]] = update->result;
+                        roots[update->result] = root;
+                        lasts[root] = update->result;
+                        break;
+                    }
+                }
+            }
+        }
+
+        // the last update is what goes round
+        const size_t back = ir_loop_predecessor(ir, ir_loop->header, ir_loop->latch);
+
+        for (size_t j = 0; j < header_block->instructions_len && header_block->instructions[j].opcode == IR_PHI; ++j) {
+            const IRInstruction *phi = &header_block->instructions[j];
+
+            candidates[phi->result] = lasts[phi->result] != phi->result
+                && lasts[phi->result] == ir_operands(ir, phi)[back];
+        }
+    }
+
+    // anything reading a phi or an update after the next update would
+    // get the new value, inside the loop that's after it in the layout,
+    // and outside it's anywhere if the loop can be left after the update
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        const IRBlock *ir_block = &ir->blocks[block];
+
+        for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+            const IRInstruction *instruction = &ir_block->instructions[i];
+            const IRValue *operands = ir_operands(ir, instruction);
+
+            for (size_t j = 0; j < instruction->operands_len; ++j) {
+                const IRValue value = operands[j];
+                const IRValue root = roots[value];
+
+                if (root == IR_NULL || !candidates[root]
+                 || successors[value] == IR_NULL || successors[value] == instruction->result) {
+                    continue;
+                }
+
+                const IRLoop *ir_loop = &loops.loops[candidate_loops[root]];
+                const size_t overwritten = positions[successors[value]];
+
+                // a phi reads it on the way out of the predecessor
+                IRBlockIndex use_block = block;
+                size_t position = block_starts[block] + i;
+
+                if (instruction->opcode == IR_PHI) {
+                    use_block = ir_block->predecessors[j];
+                    position = block_starts[use_block] + ir->blocks[use_block].instructions_len - 1;
+                }
+
+                const bool after = ir_loop_contains(ir_loop, use_block)
+                    ? position > overwritten
+                    : last_exits[candidate_loops[root]] > overwritten;
+
+                if (after) {
+                    candidates[root] = false;
+                }
+            }
+        }
+    }
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        const IRBlock *ir_block = &ir->blocks[block];
+
+        for (size_t i = 0; i < ir_block->instructions_len && ir_block->instructions[i].opcode == IR_PHI; ++i) {
+            const IRValue phi = ir_block->instructions[i].result;
+
+            if (!candidates[phi]) {
+                continue;
+            }
+
+            for (IRValue value = successors[phi]; value != IR_NULL; value = successors[value]) {
+                updates[value] = phi;
+            }
+        }
+    }
+
+    ir_loops_free(&loops);
+    free(block_starts);
+    free(positions);
+    free(successors);
+    free(roots);
+    free(lasts);
+    free(candidate_loops);
+    free(candidates);
+    free(last_exits);
+}
@@ -0,0 +1,63 @@
+#ifndef IR_LOOP_H_
+#define IR_LOOP_H_
+
+#include "ir.h"
+
+#define IR_LOOP_DEFAULT_LEVEL 2
+#define IR_LOOP_DEFAULT_UNROLL 4
+#define IR_LOOP_DEFAULT_BUDGET 64
+
+typedef struct IRLoopOptions
+{
+    // 0 leaves loops alone, 1 does everything but unrolling, 2 unrolls too
+    size_t level;
+
+    // how many copies of its body an unrolled loop goes round with
+    size_t unroll;
+
+    // the most instructions the copies of a loop's body can add up to
+    size_t budget;
+
+    // how many bytes a vector has, 16 for sse2 and 32 for avx2,
+    // 0 to leave loops that work on arrays to the unroller
+    size_t vector_width;
+} IRLoopOptions;
+
+// Loop-invariant code motion, induction variables, rotation and
+// unrolling. A loop is a jump back to a block that's laid out earlier,
+// its header, along with every block that can get to that jump without
+// going through the header.
+//
+// Whatever a loop works out the same way every time around, and can't
+// fault, is moved to the end of the block that jumps into the header,
+// innermost loops first, so it can keep moving out. Then a phi in the
+// header that goes up or down by something invariant every time round
+// is an induction variable, and multiplying it by something invariant
+// becomes a phi of its own that goes up by the step times that, so
+// there's an add instead of a mul every time round.
+//
+// A loop that counts up by 1 to something invariant, whose body doesn't
+// branch and only adds, subtracts or multiplies elements of arrays at the
+// counter, is vectorized: in front of it goes a loop that does the body
+// once on a vector of elements every time round, and the loop itself
+// does whatever's left over, like it does when it's unrolled.
+//
+// Any other loop that counts up or down by a constant to something
+// invariant, with a body that doesn't branch, is unrolled: in front of it goes a
+// loop that does `unroll` copies of the body every time round, for as
+// long as there are that many times round left, and the loop itself
+// does whatever's left over.
+//
+// Then loops are rotated, the test in the header is done once in front
+// of the loop and again at the end of the body, which branches back,
+// so there's no jump back to the top every time round.
+void ir_optimize_loops(IR *ir, TypeTable *types, const IRLoopOptions *options);
+
+// The updates of a loop header's phis, like `i = i + 1`, or one after
+// another like an unrolled loop's, after which nothing reads the old
+// value anymore. They can be done in the phi's own register instead of
+// a new one that's copied back on the way round. `updates` is indexed
+// by value, the phi that it updates, IR_NULL for every other value.
+void ir_loop_find_updates(const IR *ir, IRValue *updates);
+
+#endif // IR_LOOP_H_
@@ -0,0 +1,1108 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include "ir_lower.h"
+#include "ir_frame.h"
+#include "ir_loop.h"
+#include "ir_fold.h"
+#include "asm_select.h"
+#include "utils.h"
+
+// where the blocks without instructions forward to
+#define IR_UNREACHABLE_BLOCK ((IRBlockIndex) UINT32_MAX)
+
+typedef struct IRCopy
+{
+    AsmData dst;
+    AsmData src;
+} IRCopy;
+
+typedef struct IRLowering
+{
+    IR *ir;
+    AsmContext *context;
+
+    // indexed by value, where it is
+    AsmData *values;
+
+    // indexed by value
+    const IRInstruction **definitions;
+    uint32_t *uses;
+
+    // indexed by value, see ir_lower_fuse_condition
+    bool *fused;
+
+    // indexed by value, the phi whose register it's worked out in
+    IRValue *updates;
+
+    // indexed by block
+    size_t *labels;
+
+    // indexed by block, where jumping to it really ends up
+    IRBlockIndex *forward;
+
+    // indexed by block, the latches whose copies are done before
+    // the branch into them instead, see ir_lower_find_bottom_copies
+    bool *bottom_copies;
+
+    size_t copies_cap;
+    IRCopy *copies;
+} IRLowering;
+
+static bool ir_lower_is_register(AsmData data)
+{
+    return data.storage == STORAGE_VIRTUAL && !data.auto_deref;
+}
+
+static bool ir_block_has_phis(const IR *ir, IRBlockIndex block)
+{
+    const IRBlock *ir_block = &ir->blocks[block];
+    return ir_block->instructions_len > 0 && ir_block->instructions[0].opcode == IR_PHI;
+}
+
+// whether any of `target`'s phis needs a copy on the way from `block`
+static bool ir_lower_has_copies(const IRLowering *lowering, IRBlockIndex block, IRBlockIndex target)
+{
+    const IR *ir = lowering->ir;
+    const IRBlock *target_block = &ir->blocks[target];
+
+    size_t predecessor = 0;
+    while (target_block->predecessors[predecessor] != block) {
+        ++predecessor;
+    }
+
+    for (size_t i = 0; i < target_block->instructions_len && target_block->instructions[i].opcode == IR_PHI; ++i) {
+        const IRInstruction *phi = &target_block->instructions[i];
+        const IRValue src = ir_operands(ir, phi)[predecessor];
+
+        if (src != phi->result && lowering->updates[src] != phi->result) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// only a jump, and none of the phis where it goes need a
+// copy on the way, so nothing has to happen in it
+static bool ir_block_is_empty(const IRLowering *lowering, IRBlockIndex block)
+{
+    const IRBlock *ir_block = &lowering->ir->blocks[block];
+
+    return ir_block->instructions_len == 1
+        && ir_block->instructions[0].opcode == IR_JUMP
+        && (lowering->bottom_copies[block] || !ir_lower_has_copies(lowering, block, ir_block->instructions[0].targets[0]));
+}
+
+// whether `value` lives in the register of `phi`, being it or an update of it
+static bool ir_lower_in_phi_register(const IRLowering *lowering, IRValue value, IRValue phi)
+{
+    return value == phi || lowering->updates[value] == phi;
+}
+
+// A latch that's only there for the copies into its header's phis,
+// like the one between a rotated loop's test at the bottom and its
+// header, would be a jump back every time round. When nothing outside
+// the loop reads the phis' registers, the copies can be done before
+// the branch into the latch instead, whichever way it goes, and the
+// branch goes straight back to the header.
+static void ir_lower_find_bottom_copies(IRLowering *lowering)
+{
+    const IR *ir = lowering->ir;
+
+    bool *in_loop = malloc(sizeof(*in_loop) * ir->blocks_len);
+    IRBlockIndex *stack = malloc(sizeof(*stack) * (ir->blocks_len + 1));
+
+    if (in_loop == NULL || stack == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (IRBlockIndex latch = 0; latch < ir->blocks_len; ++latch) {
+        const IRBlock *latch_block = &ir->blocks[latch];
+
+        if (latch_block->instructions_len != 1
+         || latch_block->instructions[0].opcode != IR_JUMP
+         || latch_block->predecessors_len != 1) {
+            continue;
+        }
+
+        const IRBlockIndex header = latch_block->instructions[0].targets[0];
+        const IRBlockIndex bottom = latch_block->predecessors[0];
+        const IRInstruction *branch = ir_terminator(ir, bottom);
+
+        if (!ir_lower_has_copies(lowering, latch, header) || branch->opcode != IR_BRANCH
+         || branch->targets[0] == branch->targets[1]
+         || lowering->bottom_copies[branch->targets[0]] || lowering->bottom_copies[branch->targets[1]]) {
+            continue;
+        }
+
+        // the loop is every block that gets to the bottom without going
+        // through the header, which has to be all the way in, so
+        // nothing after the loop gets back into it any other way
+        for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+            in_loop[block] = false;
+        }
+
+        in_loop[header] = true;
+        in_loop[latch] = true;
+        in_loop[bottom] = true;
+
+        size_t stack_len = 0;
+
+        if (bottom != header) {
+            stack[stack_len++] = bottom;
+        }
+
+        bool natural = header != 0;
+
+        while (stack_len > 0 && natural) {
+            const IRBlock *ir_block = &ir->blocks[stack[--stack_len]];
+
+            for (size_t i = 0; i < ir_block->predecessors_len; ++i) {
+                const IRBlockIndex predecessor = ir_block->predecessors[i];
+
+                if (predecessor == 0) {
+                    natural = false;
+                } else if (!in_loop[predecessor]) {
+                    in_loop[predecessor] = true;
+                    stack[stack_len++] = predecessor;
+                }
+            }
+        }
+
+        if (!natural) {
+            continue;
+        }
+
+        bool read_outside = false;
+
+        for (IRBlockIndex block = 0; block < ir->blocks_len && !read_outside; ++block) {
+            if (in_loop[block]) {
+                continue;
+            }
+
+            const IRBlock *ir_block = &ir->blocks[block];
+
+            for (size_t i = 0; i < ir_block->instructions_len && !read_outside; ++i) {
+                const IRInstruction *instruction = &ir_block->instructions[i];
+
+                for (size_t j = 0; j < instruction->operands_len && !read_outside; ++j) {
+                    const IRValue operand = ir_operands(ir, instruction)[j];
+
+                    for (size_t k = 0; k < ir->blocks[header].instructions_len && !read_outside; ++k) {
+                        const IRInstruction *phi = &ir->blocks[header].instructions[k];
+
+                        if (phi->opcode != IR_PHI) {
+                            break;
+                        }
+
+                        read_outside = ir_lower_in_phi_register(lowering, operand, phi->result);
+                    }
+                }
+            }
+        }
+
+        lowering->bottom_copies[latch] = !read_outside;
+    }
+
+    free(in_loop);
+    free(stack);
+}
+
+static void ir_lower_find_forwards(IRLowering *lowering)
+{
+    const IR *ir = lowering->ir;
+
+    // set once a block's forward is known, every block on the way
+    // to where a jump ends up gets it too, so no chain is walked twice
+    bool *done = calloc(ir->blocks_len, sizeof(*done));
+    bool *on_path = calloc(ir->blocks_len, sizeof(*on_path));
+    IRBlockIndex *path = malloc(sizeof(*path) * (ir->blocks_len + 1));
+
+    if (done == NULL || on_path == NULL || path == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        if (done[block]) {
+            continue;
+        }
+
+        // what folding found to be unreachable, which is never emitted
+        if (ir->blocks[block].instructions_len == 0) {
+            lowering->forward[block] = IR_UNREACHABLE_BLOCK;
+            done[block] = true;
+            continue;
+        }
+
+        size_t path_len = 0;
+        IRBlockIndex target = block;
+
+        // the entry is fallen into, so it can't be skipped, and a loop
+        // of empty blocks has to keep one of them to jump around in
+        while (target != 0 && !done[target] && !on_path[target] && ir_block_is_empty(lowering, target)) {
+            on_path[target] = true;
+            path[path_len++] = target;
+
+            target = ir_terminator(ir, target)->targets[0];
+        }
+
+        if (done[target]) {
+            target = lowering->forward[target];
+        }
+
+        for (size_t i = 0; i < path_len; ++i) {
+            lowering->forward[path[i]] = target;
+            done[path[i]] = true;
+            on_path[path[i]] = false;
+        }
+
+        if (!done[target]) {
+            lowering->forward[target] = target;
+            done[target] = true;
+        }
+    }
+
+    free(done);
+    free(on_path);
+    free(path);
+}
+
+static AsmData ir_lower_result(IRLowering *lowering, IRValue value)
+{
+    AsmData *data = &lowering->values[value];
+
+    if (data->storage == STORAGE_NULL) {
+        *data = asm_context_data_alloc(lowering->context, lowering->ir->value_types[value]);
+    }
+
+    return *data;
+}
+
+// a stack slot's address is only worked out when it's used as a value
+static AsmData ir_lower_value(IRLowering *lowering, IRValue value)
+{
+    const AsmData data = lowering->values[value];
+
+    if (data.storage == STORAGE_STACK_VARIABLE) {
+        AsmData address = asm_context_data_alloc(lowering->context, data.data_type);
+
+        AsmData slot = data;
+        slot.data_type = data.data_type->dereference;
+
+        asm_context_reference(lowering->context, address, slot);
+
+        return address;
+    }
+
+    return data;
+}
+
+// what a load or store of `address` reads or writes
+static AsmData ir_lower_memory(IRLowering *lowering, IRValue address)
+{
+    AsmData data = lowering->values[address];
+
+    if (data.storage == STORAGE_STACK_VARIABLE) {
+        data.data_type = data.data_type->dereference;
+        return data;
+    }
+
+    if (!ir_lower_is_register(data)) {
+        AsmData pointer = asm_context_data_alloc(lowering->context, data.data_type);
+
+        asm_context_mov(lowering->context, pointer, data);
+
+        data = pointer;
+    }
+
+    return asm_data_auto_deref(data);
+}
+
+// for the instructions that can't take an immediate where it's used
+static AsmData ir_lower_register(IRLowering *lowering, AsmData data)
+{
+    if (data.storage != STORAGE_CONSTANT) {
+        return data;
+    }
+
+    const AsmData scratch = asm_context_data_alloc(lowering->context, data.data_type);
+
+    asm_context_mov(lowering->context, scratch, data);
+
+    return scratch;
+}
+
+// the packed instruction that does `opcode` to every element of a vector
+static AsmOpcode ir_lower_vector_opcode(IROpcode opcode, const DataType *vector)
+{
+    static const AsmOpcode add[] = { [1] = ASM_PADDB, [2] = ASM_PADDW, [4] = ASM_PADDD, [8] = ASM_PADDQ };
+    static const AsmOpcode sub[] = { [1] = ASM_PSUBB, [2] = ASM_PSUBW, [4] = ASM_PSUBD, [8] = ASM_PSUBQ };
+    static const AsmOpcode mul[] = { [2] = ASM_PMULLW, [4] = ASM_PMULLD };
+
+    const size_t element_size = data_type_size(vector->array.element);
+
+    switch (opcode) {
+        case IR_ADD: {
+            return add[element_size];
+        }
+
+        case IR_SUB: {
+            return sub[element_size];
+        }
+
+        case IR_MUL: {
+            if (element_size != 2 && element_size != 4) {
+                UNREACHABLE();
+            }
+
+            return mul[element_size];
+        }
+
+        default: {
+            UNREACHABLE();
+        }
+    }
+}
+
+// The address of an element. One at a constant index in an array on the
+// stack is a slot of its own, the rest are the array's address plus the
+// index times the element's size.
+static void ir_lower_index(IRLowering *lowering, const IRInstruction *instruction)
+{
+    AsmContext *context = lowering->context;
+    const IRValue *operands = ir_operands(lowering->ir, instruction);
+
+    const AsmData array = lowering->values[operands[0]];
+    const AsmData index = lowering->values[operands[1]];
+
+    const DataType *s64 = data_type_type(TYPE_INT64);
+    const int64_t size = (int64_t) data_type_size(instruction->data_type->dereference);
+
+    AsmData offset;
+
+    if (index.storage == STORAGE_CONSTANT) {
+        int64_t displacement = (int64_t) ir_fold_wrap(index.data_type, index.constant);
+
+        // further out than the biggest array can only be in code
+        // that never runs, where any address will do
+        if (displacement < -(int64_t) DATA_TYPE_MAX_SIZE || displacement > (int64_t) DATA_TYPE_MAX_SIZE) {
+            displacement = 0;
+        }
+
+        displacement *= size;
+
+        if (array.storage == STORAGE_STACK_VARIABLE
+            && array.stack_location + displacement >= INT32_MIN && array.stack_location + displacement <= INT32_MAX) {
+            lowering->values[instruction->result] = asm_data_stack_variable(
+                (int) (array.stack_location + displacement),
+                instruction->data_type
+            );
+            return;
+        }
+
+        if (displacement >= INT32_MIN && displacement <= INT32_MAX) {
+            offset = asm_data_constant((uint64_t) displacement, s64);
+        } else {
+            offset = asm_context_data_alloc(context, s64);
+            asm_context_mov_constant(context, offset, (uint64_t) displacement);
+        }
+    } else {
+        offset = asm_context_data_alloc(context, s64);
+
+        if (index.data_type->type == TYPE_INT64) {
+            asm_context_mov(context, offset, index);
+        } else {
+            asm_context_movsx(context, offset, index);
+        }
+
+        if (size > 1) {
+            asm_select_mul(context, offset, asm_data_constant((uint64_t) size, s64));
+        }
+    }
+
+    const AsmData result = ir_lower_result(lowering, instruction->result);
+
+    asm_context_mov(context, result, ir_lower_value(lowering, operands[0]));
+    asm_context_add(context, result, offset);
+}
+
+static void ir_lower_copies(IRLowering *lowering, size_t copies_len)
+{
+    IRCopy *copies = lowering->copies;
+
+    while (copies_len > 0) {
+        bool progress = false;
+
+        for (size_t i = 0; i < copies_len; ++i) {
+            bool blocked = false;
+
+            for (size_t j = 0; j < copies_len && !blocked; ++j) {
+                blocked = j != i
+                    && ir_lower_is_register(copies[j].src)
+                    && copies[j].src.virtual_register == copies[i].dst.virtual_register;
+            }
+
+            if (blocked) {
+                continue;
+            }
+
+            asm_context_mov(lowering->context, copies[i].dst, copies[i].src);
+
+            copies[i] = copies[--copies_len];
+            progress = true;
+            break;
+        }
+
+        if (progress) {
+            continue;
+        }
+
+        // every copy overwrites what another one still needs, so they
+        // form cycles, which one temporary is enough to break
+        const AsmData dst = copies[0].dst;
+        const AsmData temporary = asm_context_data_alloc(lowering->context, dst.data_type);
+
+        asm_context_mov(lowering->context, temporary, dst);
+
+        for (size_t i = 0; i < copies_len; ++i) {
+            if (ir_lower_is_register(copies[i].src) && copies[i].src.virtual_register == dst.virtual_register) {
+                copies[i].src = temporary;
+            }
+        }
+    }
+}
+
+// the phis of `target`, as copies at the end of `block`
+static void ir_lower_phis(IRLowering *lowering, IRBlockIndex block, IRBlockIndex target)
+{
+    const IR *ir = lowering->ir;
+    const IRBlock *target_block = &ir->blocks[target];
+
+    size_t predecessor = 0;
+    while (target_block->predecessors[predecessor] != block) {
+        ++predecessor;
+    }
+
+    size_t copies_len = 0;
+
+    for (size_t i = 0; i < target_block->instructions_len; ++i) {
+        const IRInstruction *phi = &target_block->instructions[i];
+
+        if (phi->opcode != IR_PHI) {
+            break;
+        }
+
+        const IRValue src = ir_operands(ir, phi)[predecessor];
+
+        if (src == phi->result || lowering->updates[src] == phi->result) {
+            continue;
+        }
+
+        if (copies_len >= lowering->copies_cap) {
+            while (copies_len >= lowering->copies_cap) {
+                lowering->copies_cap *= 2;
+            }
+
+            lowering->copies = realloc(lowering->copies, sizeof(*lowering->copies) * lowering->copies_cap);
+
+            if (lowering->copies == NULL) {
+                ALLOCATION_ERROR();
+            }
+        }
+
+        lowering->copies[copies_len++] = (IRCopy) {
+            .dst = ir_lower_result(lowering, phi->result),
+            .src = ir_lower_value(lowering, src)
+        };
+    }
+
+    ir_lower_copies(lowering, copies_len);
+}
+
+// emits the cmp of a comparison, and returns the comparison the
+// flags are for, which is the other way round if it swapped them
+static IROpcode ir_lower_cmp(IRLowering *lowering, const IRInstruction *instruction)
+{
+    const IRValue *operands = ir_operands(lowering->ir, instruction);
+
+    AsmData lhs = ir_lower_value(lowering, operands[0]);
+    AsmData rhs = ir_lower_value(lowering, operands[1]);
+    IROpcode opcode = instruction->opcode;
+
+    // cmp only takes an immediate on the right
+    if (lhs.storage == STORAGE_CONSTANT) {
+        if (rhs.storage == STORAGE_CONSTANT) {
+            lhs = ir_lower_register(lowering, lhs);
+        } else {
+            const AsmData constant = lhs;
+
+            lhs = rhs;
+            rhs = constant;
+            opcode = IR_MIRRORED_COMPARISON[opcode];
+        }
+    }
+
+    asm_context_cmp(lowering->context, lhs, rhs);
+
+    return opcode;
+}
+
+static void ir_lower_jump_if(IRLowering *lowering, IROpcode comparison, size_t label_id)
+{
+    AsmContext *context = lowering->context;
+
+    switch (comparison) {
+        case IR_EQ: {
+            asm_context_jz(context, label_id);
+            break;
+        }
+
+        case IR_NE: {
+            asm_context_jnz(context, label_id);
+            break;
+        }
+
+        case IR_LT: {
+            asm_context_jl(context, label_id);
+            break;
+        }
+
+        case IR_GT: {
+            asm_context_jg(context, label_id);
+            break;
+        }
+
+        case IR_LE: {
+            asm_context_jle(context, label_id);
+            break;
+        }
+
+        case IR_GE: {
+            asm_context_jge(context, label_id);
+            break;
+        }
+
+        default: {
+            UNREACHABLE();
+        }
+    }
+}
+
+// A comparison that only the branch at the end of its block uses, maybe
+// through some nots, is left for the branch to jump on its flags, so the
+// result never has to be set in a register and tested.
+static void ir_lower_fuse_condition(IRLowering *lowering, IRBlockIndex block)
+{
+    const IR *ir = lowering->ir;
+    const IRBlock *ir_block = &ir->blocks[block];
+    const IRInstruction *terminator = ir_terminator(ir, block);
+
+    if (terminator->opcode != IR_BRANCH) {
+        return;
+    }
+
+    IRValue value = ir_operands(ir, terminator)[0];
+
+    for (size_t i = ir_block->instructions_len - 1; i-- > 0;) {
+        const IRInstruction *instruction = &ir_block->instructions[i];
+
+        if (instruction->result != value) {
+            continue;
+        }
+
+        if (lowering->uses[value] != 1) {
+            break;
+        }
+
+        if (ir_opcode_is_comparison(instruction->opcode)) {
+            lowering->fused[value] = true;
+            break;
+        }
+
+        if (instruction->opcode != IR_NOT) {
+            break;
+        }
+
+        lowering->fused[value] = true;
+        value = ir_operands(ir, instruction)[0];
+    }
+}
+
+static void ir_lower_instruction(IRLowering *lowering, IRBlockIndex block, const IRInstruction *instruction, IRBlockIndex next)
+{
+    AsmContext *context = lowering->context;
+    const IRValue *operands = ir_operands(lowering->ir, instruction);
+
+    switch (instruction->opcode) {
+        case IR_CONST: {
+            const uint64_t constant = instruction->constant;
+
+            // anything bigger only fits in a mov to a register
+            if (DATA_TYPE_TO_ASM_SIZE[instruction->data_type->type] != SIZE_QWORD
+                || ((int64_t) constant >= INT32_MIN && (int64_t) constant <= INT32_MAX)) {
+                lowering->values[instruction->result] = asm_data_constant(constant, instruction->data_type);
+            } else {
+                asm_context_mov_constant(context, ir_lower_result(lowering, instruction->result), constant);
+            }
+            break;
+        }
+
+        case IR_STRING: {
+            lowering->values[instruction->result] = asm_context_add_to_data_section(
+                context,
+                instruction->string.data,
+                instruction->string.len,
+                instruction->data_type
+            );
+            break;
+        }
+
+        // laid out up front by ir_frame_layout, and copied
+        // out of where the caller put them up front
+        case IR_LOCAL:
+        case IR_PARAMETER:
+        case IR_PHI: {
+            break;
+        }
+
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV: {
+            if (instruction->data_type->type == TYPE_ARRAY) {
+                const AsmData result = ir_lower_result(lowering, instruction->result);
+
+                asm_context_mov(context, result, ir_lower_value(lowering, operands[0]));
+                asm_context_vector(
+                    context,
+                    ir_lower_vector_opcode(instruction->opcode, instruction->data_type),
+                    result,
+                    ir_lower_value(lowering, operands[1])
+                );
+                break;
+            }
+
+            IRValue lhs_value = operands[0];
+            IRValue rhs_value = operands[1];
+
+            // a constant is only of any use on the right
+            const bool commutes = instruction->opcode == IR_ADD || instruction->opcode == IR_MUL;
+
+            if (commutes && lowering->values[lhs_value].storage == STORAGE_CONSTANT) {
+                lhs_value = operands[1];
+                rhs_value = operands[0];
+            }
+
+            // an update done in the phi's register has to start from
+            // what's in it, the phi or the update before this one
+            const IRValue phi = lowering->updates[instruction->result];
+
+            if (commutes && phi != IR_NULL && (rhs_value == phi || lowering->updates[rhs_value] == phi)) {
+                const IRValue swapped = lhs_value;
+                lhs_value = rhs_value;
+                rhs_value = swapped;
+            }
+
+            const AsmData result = ir_lower_result(lowering, instruction->result);
+            const AsmData rhs = ir_lower_value(lowering, rhs_value);
+
+            asm_context_mov(context, result, ir_lower_value(lowering, lhs_value));
+
+            switch (instruction->opcode) {
+                case IR_ADD: {
+                    asm_context_add(context, result, rhs);
+                    break;
+                }
+
+                case IR_SUB: {
+                    asm_context_sub(context, result, rhs);
+                    break;
+                }
+
+                case IR_MUL: {
+                    asm_select_mul(context, result, rhs);
+                    break;
+                }
+
+                default: {
+                    asm_select_div(context, result, rhs);
+                    break;
+                }
+            }
+            break;
+        }
+
+        case IR_EQ:
+        case IR_NE:
+        case IR_LT:
+        case IR_GT:
+        case IR_LE:
+        case IR_GE: {
+            if (lowering->fused[instruction->result]) {
+                break;
+            }
+
+            const AsmData result = ir_lower_result(lowering, instruction->result);
+
+            switch (ir_lower_cmp(lowering, instruction)) {
+                case IR_EQ: {
+                    asm_context_setz(context, result);
+                    break;
+                }
+
+                case IR_NE: {
+                    asm_context_setnz(context, result);
+                    break;
+                }
+
+                case IR_LT: {
+                    asm_context_setl(context, result);
+                    break;
+                }
+
+                case IR_GT: {
+                    asm_context_setg(context, result);
+                    break;
+                }
+
+                case IR_LE: {
+                    asm_context_setle(context, result);
+                    break;
+                }
+
+                default: {
+                    asm_context_setge(context, result);
+                    break;
+                }
+            }
+            break;
+        }
+
+        case IR_NEG: {
+            const AsmData result = ir_lower_result(lowering, instruction->result);
+
+            asm_context_mov(context, result, ir_lower_value(lowering, operands[0]));
+            asm_context_negate(context, result);
+            break;
+        }
+
+        case IR_NOT: {
+            if (lowering->fused[instruction->result]) {
+                break;
+            }
+
+            const AsmData operand = ir_lower_register(lowering, ir_lower_value(lowering, operands[0]));
+
+            asm_context_test(context, operand, operand);
+            asm_context_setz(context, ir_lower_result(lowering, instruction->result));
+            break;
+        }
+
+        // a vector is loaded from and stored to the address of its first element
+        case IR_LOAD: {
+            const AsmData result = ir_lower_result(lowering, instruction->result);
+
+            AsmData memory = ir_lower_memory(lowering, operands[0]);
+
+            if (result.data_type->type == TYPE_ARRAY) {
+                memory.data_type = result.data_type;
+            }
+
+            asm_context_mov(context, result, memory);
+            break;
+        }
+
+        case IR_STORE: {
+            const AsmData value = ir_lower_value(lowering, operands[1]);
+
+            AsmData memory = ir_lower_memory(lowering, operands[0]);
+
+            if (value.data_type->type == TYPE_ARRAY) {
+                memory.data_type = value.data_type;
+            }
+
+            asm_context_mov(context, memory, value);
+            break;
+        }
+
+        case IR_INDEX: {
+            ir_lower_index(lowering, instruction);
+            break;
+        }
+
+        case IR_BROADCAST: {
+            asm_context_broadcast(context, ir_lower_result(lowering, instruction->result), ir_lower_value(lowering, operands[0]));
+            break;
+        }
+
+        case IR_CALL: {
+            AsmData *arguments = malloc(sizeof(*arguments) * (instruction->operands_len + 1));
+
+            if (arguments == NULL) {
+                ALLOCATION_ERROR();
+            }
+
+            for (size_t i = 0; i < instruction->operands_len; ++i) {
+                arguments[i] = ir_lower_value(lowering, operands[i]);
+            }
+
+            const AsmData function = asm_data_function(
+                instruction->function.name_len,
+                instruction->function.name,
+                instruction->function.data_type
+            );
+
+            if (instruction->function.tail) {
+                asm_context_tail_call(context, function, instruction->operands_len, arguments);
+                free(arguments);
+                break;
+            }
+
+            const AsmData return_value = instruction->result != IR_NULL
+                ? ir_lower_result(lowering, instruction->result)
+                : (AsmData) { .storage = STORAGE_NULL, .data_type = data_type_type(TYPE_VOID) };
+
+            asm_context_call_function(context, function, instruction->operands_len, arguments, return_value);
+            free(arguments);
+            break;
+        }
+
+        case IR_JUMP: {
+            const IRBlockIndex target = instruction->targets[0];
+
+            if (ir_block_has_phis(lowering->ir, target)) {
+                ir_lower_phis(lowering, block, target);
+            }
+
+            if (lowering->forward[target] != next) {
+                asm_context_jmp(context, lowering->labels[lowering->forward[target]]);
+            }
+            break;
+        }
+
+        case IR_BRANCH: {
+            const IRBlockIndex taken     = lowering->forward[instruction->targets[0]];
+            const IRBlockIndex not_taken = lowering->forward[instruction->targets[1]];
+
+            IRValue condition = operands[0];
+            bool inverted = false;
+
+            while (lowering->fused[condition] && lowering->definitions[condition]->opcode == IR_NOT) {
+                condition = ir_operands(lowering->ir, lowering->definitions[condition])[0];
+                inverted = !inverted;
+            }
+
+            // jumps to `taken` when this is true
+            IROpcode comparison;
+
+            if (lowering->fused[condition]) {
+                comparison = ir_lower_cmp(lowering, lowering->definitions[condition]);
+            } else {
+                const AsmData value = ir_lower_register(lowering, ir_lower_value(lowering, condition));
+
+                asm_context_test(context, value, value);
+                comparison = IR_NE;
+            }
+
+            if (inverted) {
+                comparison = IR_INVERTED_COMPARISON[comparison];
+            }
+
+            // mov leaves the flags alone
+            for (size_t i = 0; i < 2; ++i) {
+                const IRBlockIndex target = instruction->targets[i];
+
+                if (lowering->bottom_copies[target]) {
+                    ir_lower_phis(lowering, target, ir_terminator(lowering->ir, target)->targets[0]);
+                }
+            }
+
+            if (not_taken == next) {
+                ir_lower_jump_if(lowering, comparison, lowering->labels[taken]);
+            } else {
+                ir_lower_jump_if(lowering, IR_INVERTED_COMPARISON[comparison], lowering->labels[not_taken]);
+
+                if (taken != next) {
+                    asm_context_jmp(context, lowering->labels[taken]);
+                }
+            }
+            break;
+        }
+
+        case IR_RETURN: {
+            // the tail call right before it has already left
+            if (instruction != lowering->ir->blocks[block].instructions && instruction[-1].opcode == IR_CALL
+             && instruction[-1].function.tail) {
+                break;
+            }
+
+            const AsmData rax = asm_data_register(REGISTER_RAX, data_type_type(TYPE_INT64));
+
+            if (instruction->operands_len == 0) {
+                asm_context_mov_constant(context, rax, 0);
+            } else {
+                const AsmData value = ir_lower_value(lowering, operands[0]);
+
+                asm_context_mov(context, asm_data_register(REGISTER_RAX, value.data_type), value);
+            }
+
+            asm_context_ret(context);
+            break;
+        }
+
+        case IR_OPCODES: {
+            UNREACHABLE();
+        }
+    }
+}
+
+// The arguments are copied out of their registers, or from above the
+// return address, before anything else can overwrite those registers.
+static void ir_lower_parameters(IRLowering *lowering)
+{
+    const IRBlock *entry = &lowering->ir->blocks[0];
+
+    for (size_t i = 0; i < entry->instructions_len; ++i) {
+        const IRInstruction *instruction = &entry->instructions[i];
+
+        if (instruction->opcode != IR_PARAMETER) {
+            continue;
+        }
+
+        const size_t parameter = instruction->parameter;
+        const AsmData result = ir_lower_result(lowering, instruction->result);
+
+        if (parameter < ARRAY_LEN(ARGUMENT_REGISTERS)) {
+            asm_context_mov(lowering->context, result, asm_data_register(ARGUMENT_REGISTERS[parameter], instruction->data_type));
+        } else {
+            const int32_t offset = 16 + 8 * (int32_t) (parameter - ARRAY_LEN(ARGUMENT_REGISTERS));
+            asm_context_mov(lowering->context, result, asm_data_stack_variable(offset, instruction->data_type));
+        }
+    }
+}
+
+void ir_lower(IR *ir, AsmContext *context)
+{
+    IRLowering lowering = {
+        .ir = ir,
+        .context = context,
+
+        .copies_cap = 16
+    };
+
+    lowering.values  = calloc(ir->values_len + 1, sizeof(*lowering.values));
+    lowering.labels  = malloc(sizeof(*lowering.labels) * ir->blocks_len);
+    lowering.forward = malloc(sizeof(*lowering.forward) * ir->blocks_len);
+    lowering.copies  = malloc(sizeof(*lowering.copies) * lowering.copies_cap);
+
+    lowering.definitions = malloc(sizeof(*lowering.definitions) * (ir->values_len + 1));
+    lowering.uses        = calloc(ir->values_len + 1, sizeof(*lowering.uses));
+    lowering.fused       = calloc(ir->values_len + 1, sizeof(*lowering.fused));
+    lowering.updates     = malloc(sizeof(*lowering.updates) * (ir->values_len + 1));
+
+    lowering.bottom_copies = calloc(ir->blocks_len, sizeof(*lowering.bottom_copies));
+
+    if (lowering.values == NULL || lowering.labels == NULL || lowering.forward == NULL || lowering.copies == NULL
+     || lowering.definitions == NULL || lowering.uses == NULL || lowering.fused == NULL || lowering.updates == NULL
+     || lowering.bottom_copies == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        const IRBlock *ir_block = &ir->blocks[block];
+
+        for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+            const IRInstruction *instruction = &ir_block->instructions[i];
+
+            if (instruction->result != IR_NULL) {
+                lowering.definitions[instruction->result] = instruction;
+            }
+
+            for (size_t j = 0; j < instruction->operands_len; ++j) {
+                ++lowering.uses[ir_operands(ir, instruction)[j]];
+            }
+        }
+    }
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        lowering.labels[block] = asm_context_label_new(context);
+    }
+
+    int32_t *offsets = malloc(sizeof(*offsets) * (ir->values_len + 1));
+
+    if (offsets == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    const IRFrame frame = ir_frame_layout(ir, offsets);
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        const IRBlock *ir_block = &ir->blocks[block];
+
+        for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+            const IRInstruction *instruction = &ir_block->instructions[i];
+
+            if (instruction->opcode == IR_LOCAL) {
+                lowering.values[instruction->result] = asm_data_stack_variable(
+                    offsets[instruction->result],
+                    instruction->data_type
+                );
+            }
+        }
+    }
+
+    free(offsets);
+
+    ir_loop_find_updates(ir, lowering.updates);
+
+    for (size_t i = 0; i < ir->values_len; ++i) {
+        if (lowering.updates[i] != IR_NULL) {
+            lowering.values[i] = ir_lower_result(&lowering, lowering.updates[i]);
+        }
+    }
+
+    context->locals_size = frame.arrays_size + frame.slots_len * 8;
+    context->locals_len = frame.locals_len;
+    context->arrays_size = frame.arrays_size;
+
+    ir_lower_parameters(&lowering);
+
+    ir_lower_find_bottom_copies(&lowering);
+    ir_lower_find_forwards(&lowering);
+
+    IRBlockIndex next = 0;
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        if (lowering.forward[block] != block) {
+            continue;
+        }
+
+        if (next <= block) {
+            next = block + 1;
+        }
+
+        while (next < ir->blocks_len && lowering.forward[next] != next) {
+            ++next;
+        }
+
+        asm_context_label(context, lowering.labels[block]);
+
+        ir_lower_fuse_condition(&lowering, block);
+
+        const IRBlock *ir_block = &ir->blocks[block];
+
+        for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+            ir_lower_instruction(&lowering, block, &ir_block->instructions[i], next);
+        }
+    }
+
+    free(lowering.values);
+    free(lowering.labels);
+    free(lowering.forward);
+    free(lowering.copies);
+    free(lowering.definitions);
+    free(lowering.uses);
+    free(lowering.fused);
+    free(lowering.updates);
+    free(lowering.bottom_copies);
+}
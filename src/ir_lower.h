@@ -0,0 +1,14 @@
+#ifndef IR_LOWER_H_
+#define IR_LOWER_H_
+
+#include "ir.h"
+#include "asm_context.h"
+
+// Turns the IR into instructions in the context. Every value gets a
+// virtual register, and phis become copies at the end of each of the
+// block's predecessors. Blocks that only jump somewhere without phis
+// are skipped, the jumps to them go straight to where they lead.
+// Takes ownership of the IR's strings.
+void ir_lower(IR *ir, AsmContext *context);
+
+#endif // IR_LOWER_H_
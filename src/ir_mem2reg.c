@@ -0,0 +1,785 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include "ir_mem2reg.h"
+#include "utils.h"
+
+#define IR_NO_LOCAL   UINT32_MAX
+#define IR_NO_BLOCK   UINT32_MAX
+
+typedef struct IRMem2Reg
+{
+    IR *ir;
+
+    // indexed by the values from before any phis were added, which
+    // promoted local it's the address of, IR_NO_LOCAL if none
+    size_t addresses_len;
+    uint32_t *addresses;
+
+    // which promoted local each phi that was added is for, the
+    // phis' values are consecutive from `phis_start`
+    IRValue phis_start;
+    size_t phis_len;
+    size_t phis_cap;
+    uint32_t *phis;
+
+    // indexed by value, what to use instead of a load
+    IRValue *replacements;
+
+    // indexed by local, the value it has before anything is stored to
+    // it and the one it has at the point renaming got to
+    size_t locals_len;
+    IRValue *zeros;
+    IRValue *current;
+
+    // pairs of a local and the value it had before, to undo them when
+    // renaming leaves a block
+    size_t log_len;
+    size_t log_cap;
+    uint32_t *log;
+
+    // indexed by block, IR_NO_BLOCK if it can't be reached
+    uint32_t *order;
+    IRBlockIndex *idoms;
+
+    size_t postorder_len;
+    IRBlockIndex *postorder;
+
+    // indexed by block, where its dominance frontier starts in `frontiers`
+    size_t *frontiers_start;
+    IRBlockIndex *frontiers;
+} IRMem2Reg;
+
+static uint32_t ir_mem2reg_address(const IRMem2Reg *mem2reg, IRValue value)
+{
+    if (value == IR_NULL || value >= mem2reg->addresses_len) {
+        return IR_NO_LOCAL;
+    }
+
+    return mem2reg->addresses[value];
+}
+
+// the loads and stores that go through an address are its only uses
+// that don't let it escape
+static bool ir_mem2reg_find_locals(IRMem2Reg *mem2reg)
+{
+    IR *ir = mem2reg->ir;
+
+    mem2reg->addresses_len = ir->values_len;
+    mem2reg->addresses = malloc(sizeof(*mem2reg->addresses) * ir->values_len);
+
+    if (mem2reg->addresses == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (size_t i = 0; i < ir->values_len; ++i) {
+        mem2reg->addresses[i] = IR_NO_LOCAL;
+    }
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        const IRBlock *ir_block = &ir->blocks[block];
+
+        for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+            if (ir_block->instructions[i].opcode == IR_LOCAL) {
+                mem2reg->addresses[ir_block->instructions[i].result] = 0;
+            }
+        }
+    }
+
+    bool *escapes = calloc(ir->values_len, sizeof(*escapes));
+
+    if (escapes == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        const IRBlock *ir_block = &ir->blocks[block];
+
+        for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+            const IRInstruction *instruction = &ir_block->instructions[i];
+            const IRValue *operands = ir_operands(ir, instruction);
+
+            for (size_t j = 0; j < instruction->operands_len; ++j) {
+                if (ir_mem2reg_address(mem2reg, operands[j]) == IR_NO_LOCAL) {
+                    continue;
+                }
+
+                if (j != 0 || (instruction->opcode != IR_LOAD && instruction->opcode != IR_STORE)) {
+                    escapes[operands[j]] = true;
+                }
+            }
+        }
+    }
+
+    mem2reg->locals_len = 0;
+
+    for (size_t i = 0; i < ir->values_len; ++i) {
+        if (mem2reg->addresses[i] == IR_NO_LOCAL) {
+            continue;
+        }
+
+        mem2reg->addresses[i] = escapes[i] ? IR_NO_LOCAL : mem2reg->locals_len++;
+    }
+
+    free(escapes);
+
+    return mem2reg->locals_len > 0;
+}
+
+static IRBlockIndex ir_mem2reg_intersect(const IRMem2Reg *mem2reg, IRBlockIndex a, IRBlockIndex b)
+{
+    while (a != b) {
+        while (mem2reg->order[a] < mem2reg->order[b]) {
+            a = mem2reg->idoms[a];
+        }
+
+        while (mem2reg->order[b] < mem2reg->order[a]) {
+            b = mem2reg->idoms[b];
+        }
+    }
+
+    return a;
+}
+
+// Cooper, Harvey and Kennedy's "A Simple, Fast Dominance Algorithm",
+// with `order` being the position in postorder
+static void ir_mem2reg_find_dominators(IRMem2Reg *mem2reg)
+{
+    IR *ir = mem2reg->ir;
+
+    mem2reg->order     = malloc(sizeof(*mem2reg->order) * ir->blocks_len);
+    mem2reg->idoms     = malloc(sizeof(*mem2reg->idoms) * ir->blocks_len);
+    mem2reg->postorder = malloc(sizeof(*mem2reg->postorder) * ir->blocks_len);
+
+    size_t stack_len = 0;
+    IRBlockIndex *stack = malloc(sizeof(*stack) * ir->blocks_len);
+    uint8_t *next_successor = calloc(ir->blocks_len, sizeof(*next_successor));
+
+    if (mem2reg->order == NULL || mem2reg->idoms == NULL || mem2reg->postorder == NULL
+     || stack == NULL || next_successor == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        mem2reg->order[block] = IR_NO_BLOCK;
+        mem2reg->idoms[block] = IR_NO_BLOCK;
+    }
+
+    // IR_NO_BLOCK - 1 marks the blocks that are on the stack
+    mem2reg->postorder_len = 0;
+    mem2reg->order[0] = IR_NO_BLOCK - 1;
+    stack[stack_len++] = 0;
+
+    while (stack_len > 0) {
+        const IRBlockIndex block = stack[stack_len - 1];
+
+        IRBlockIndex successors[2];
+        const size_t successors_len = ir_successors(ir, block, successors);
+
+        if (next_successor[block] < successors_len) {
+            const IRBlockIndex successor = successors[next_successor[block]++];
+
+            if (mem2reg->order[successor] == IR_NO_BLOCK) {
+                mem2reg->order[successor] = IR_NO_BLOCK - 1;
+                stack[stack_len++] = successor;
+            }
+
+            continue;
+        }
+
+        --stack_len;
+        mem2reg->order[block] = mem2reg->postorder_len;
+        mem2reg->postorder[mem2reg->postorder_len++] = block;
+    }
+
+    free(stack);
+    free(next_successor);
+
+    mem2reg->idoms[0] = 0;
+
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        // in reverse postorder, without the entry, which is last
+        for (size_t i = mem2reg->postorder_len - 1; i-- > 0;) {
+            const IRBlockIndex block = mem2reg->postorder[i];
+            const IRBlock *ir_block = &ir->blocks[block];
+
+            IRBlockIndex idom = IR_NO_BLOCK;
+
+            for (size_t j = 0; j < ir_block->predecessors_len; ++j) {
+                const IRBlockIndex predecessor = ir_block->predecessors[j];
+
+                if (mem2reg->idoms[predecessor] == IR_NO_BLOCK) {
+                    continue;
+                }
+
+                idom = idom == IR_NO_BLOCK ? predecessor : ir_mem2reg_intersect(mem2reg, predecessor, idom);
+            }
+
+            if (mem2reg->idoms[block] != idom) {
+                mem2reg->idoms[block] = idom;
+                changed = true;
+            }
+        }
+    }
+}
+
+// walks up from each predecessor of a join to the join's idom, the
+// join is in the frontier of every block on the way
+static void ir_mem2reg_walk_frontiers(IRMem2Reg *mem2reg, size_t *lens, IRBlockIndex *last, bool fill)
+{
+    const IR *ir = mem2reg->ir;
+
+    for (size_t i = 0; i < mem2reg->postorder_len; ++i) {
+        const IRBlockIndex block = mem2reg->postorder[i];
+        const IRBlock *ir_block = &ir->blocks[block];
+
+        if (ir_block->predecessors_len < 2) {
+            continue;
+        }
+
+        for (size_t j = 0; j < ir_block->predecessors_len; ++j) {
+            IRBlockIndex runner = ir_block->predecessors[j];
+
+            if (mem2reg->order[runner] == IR_NO_BLOCK) {
+                continue;
+            }
+
+            while (runner != mem2reg->idoms[block]) {
+                if (last[runner] != block) {
+                    last[runner] = block;
+
+                    if (fill) {
+                        mem2reg->frontiers[mem2reg->frontiers_start[runner] + lens[runner]] = block;
+                    }
+
+                    ++lens[runner];
+                }
+
+                runner = mem2reg->idoms[runner];
+            }
+        }
+    }
+}
+
+static void ir_mem2reg_find_frontiers(IRMem2Reg *mem2reg)
+{
+    const IR *ir = mem2reg->ir;
+
+    size_t *lens = calloc(ir->blocks_len, sizeof(*lens));
+    IRBlockIndex *last = malloc(sizeof(*last) * ir->blocks_len);
+    mem2reg->frontiers_start = malloc(sizeof(*mem2reg->frontiers_start) * (ir->blocks_len + 1));
+
+    if (lens == NULL || last == NULL || mem2reg->frontiers_start == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        last[block] = IR_NO_BLOCK;
+    }
+
+    ir_mem2reg_walk_frontiers(mem2reg, lens, last, false);
+
+    mem2reg->frontiers_start[0] = 0;
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        mem2reg->frontiers_start[block + 1] = mem2reg->frontiers_start[block] + lens[block];
+        lens[block] = 0;
+        last[block] = IR_NO_BLOCK;
+    }
+
+    mem2reg->frontiers = malloc(sizeof(*mem2reg->frontiers) * (mem2reg->frontiers_start[ir->blocks_len] + 1));
+
+    if (mem2reg->frontiers == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    ir_mem2reg_walk_frontiers(mem2reg, lens, last, true);
+
+    free(lens);
+    free(last);
+}
+
+static void ir_mem2reg_add_zeros(IRMem2Reg *mem2reg)
+{
+    IR *ir = mem2reg->ir;
+
+    mem2reg->zeros   = malloc(sizeof(*mem2reg->zeros) * mem2reg->locals_len);
+    mem2reg->current = malloc(sizeof(*mem2reg->current) * mem2reg->locals_len);
+
+    if (mem2reg->zeros == NULL || mem2reg->current == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (size_t i = 0; i < mem2reg->addresses_len; ++i) {
+        const uint32_t local = mem2reg->addresses[i];
+
+        if (local == IR_NO_LOCAL) {
+            continue;
+        }
+
+        IRInstruction *zero = ir_insert(ir, 0, 0, IR_CONST, ir->value_types[i]->dereference, 0);
+        zero->constant = 0;
+
+        mem2reg->zeros[local]   = zero->result;
+        mem2reg->current[local] = zero->result;
+    }
+}
+
+static void ir_mem2reg_push_phi(IRMem2Reg *mem2reg, uint32_t local)
+{
+    if (mem2reg->phis_len >= mem2reg->phis_cap) {
+        while (mem2reg->phis_len >= mem2reg->phis_cap) {
+            mem2reg->phis_cap *= 2;
+        }
+
+        mem2reg->phis = realloc(mem2reg->phis, sizeof(*mem2reg->phis) * mem2reg->phis_cap);
+
+        if (mem2reg->phis == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    mem2reg->phis[mem2reg->phis_len++] = local;
+}
+
+static uint32_t ir_mem2reg_phi(const IRMem2Reg *mem2reg, IRValue value)
+{
+    if (value < mem2reg->phis_start || value - mem2reg->phis_start >= mem2reg->phis_len) {
+        return IR_NO_LOCAL;
+    }
+
+    return mem2reg->phis[value - mem2reg->phis_start];
+}
+
+// a phi goes into the iterated dominance frontier of every block that
+// stores to the local
+static void ir_mem2reg_add_phis(IRMem2Reg *mem2reg)
+{
+    IR *ir = mem2reg->ir;
+    const size_t locals_len = mem2reg->locals_len;
+
+    // the blocks that store to each local, grouped by local
+    size_t *stores_start = malloc(sizeof(*stores_start) * (locals_len + 1));
+    size_t *stores_len = calloc(locals_len, sizeof(*stores_len));
+    IRBlockIndex *stores = NULL;
+    IRBlockIndex *last = malloc(sizeof(*last) * locals_len);
+
+    if (stores_start == NULL || stores_len == NULL || last == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (size_t pass = 0; pass < 2; ++pass) {
+        for (size_t i = 0; i < locals_len; ++i) {
+            last[i] = IR_NO_BLOCK;
+        }
+
+        for (size_t i = 0; i < mem2reg->postorder_len; ++i) {
+            const IRBlockIndex block = mem2reg->postorder[i];
+            const IRBlock *ir_block = &ir->blocks[block];
+
+            for (size_t j = 0; j < ir_block->instructions_len; ++j) {
+                const IRInstruction *instruction = &ir_block->instructions[j];
+
+                if (instruction->opcode != IR_STORE) {
+                    continue;
+                }
+
+                const uint32_t local = ir_mem2reg_address(mem2reg, ir_operands(ir, instruction)[0]);
+
+                if (local == IR_NO_LOCAL || last[local] == block) {
+                    continue;
+                }
+
+                last[local] = block;
+
+                if (pass == 1) {
+                    stores[stores_start[local] + stores_len[local]] = block;
+                }
+
+                ++stores_len[local];
+            }
+        }
+
+        if (pass == 0) {
+            stores_start[0] = 0;
+
+            for (size_t i = 0; i < locals_len; ++i) {
+                stores_start[i + 1] = stores_start[i] + stores_len[i];
+                stores_len[i] = 0;
+            }
+
+            stores = malloc(sizeof(*stores) * (stores_start[locals_len] + 1));
+
+            if (stores == NULL) {
+                ALLOCATION_ERROR();
+            }
+        }
+    }
+
+    mem2reg->phis_start = ir->values_len;
+    mem2reg->phis_len = 0;
+    mem2reg->phis_cap = 16;
+    mem2reg->phis = malloc(sizeof(*mem2reg->phis) * mem2reg->phis_cap);
+
+    // a block goes on the worklist and gets a phi at most once per local
+    size_t worklist_len = 0;
+    IRBlockIndex *worklist = malloc(sizeof(*worklist) * ir->blocks_len);
+    uint32_t *queued  = malloc(sizeof(*queued) * ir->blocks_len);
+    uint32_t *has_phi = malloc(sizeof(*has_phi) * ir->blocks_len);
+
+    if (mem2reg->phis == NULL || worklist == NULL || queued == NULL || has_phi == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        queued[block]  = IR_NO_LOCAL;
+        has_phi[block] = IR_NO_LOCAL;
+    }
+
+    for (uint32_t local = 0; local < locals_len; ++local) {
+        for (size_t i = stores_start[local]; i < stores_start[local + 1]; ++i) {
+            queued[stores[i]] = local;
+            worklist[worklist_len++] = stores[i];
+        }
+
+        while (worklist_len > 0) {
+            const IRBlockIndex block = worklist[--worklist_len];
+
+            for (size_t i = mem2reg->frontiers_start[block]; i < mem2reg->frontiers_start[block + 1]; ++i) {
+                const IRBlockIndex frontier = mem2reg->frontiers[i];
+
+                if (has_phi[frontier] == local) {
+                    continue;
+                }
+
+                has_phi[frontier] = local;
+
+                const IRValue zero = mem2reg->zeros[local];
+                const size_t predecessors_len = ir->blocks[frontier].predecessors_len;
+
+                IRInstruction *phi = ir_insert(ir, frontier, 0, IR_PHI, ir->value_types[zero], predecessors_len);
+                IRValue *operands = ir_operands(ir, phi);
+
+                // the predecessors that can't be reached keep it
+                for (size_t j = 0; j < predecessors_len; ++j) {
+                    operands[j] = zero;
+                }
+
+                ir_mem2reg_push_phi(mem2reg, local);
+
+                if (queued[frontier] != local) {
+                    queued[frontier] = local;
+                    worklist[worklist_len++] = frontier;
+                }
+            }
+        }
+    }
+
+    free(stores_start);
+    free(stores_len);
+    free(stores);
+    free(last);
+    free(worklist);
+    free(queued);
+    free(has_phi);
+}
+
+static IRValue ir_mem2reg_resolve(const IRMem2Reg *mem2reg, IRValue value)
+{
+    while (value != IR_NULL && mem2reg->replacements[value] != IR_NULL) {
+        value = mem2reg->replacements[value];
+    }
+
+    return value;
+}
+
+static void ir_mem2reg_set(IRMem2Reg *mem2reg, uint32_t local, IRValue value)
+{
+    if (mem2reg->log_len + 2 > mem2reg->log_cap) {
+        while (mem2reg->log_len + 2 > mem2reg->log_cap) {
+            mem2reg->log_cap *= 2;
+        }
+
+        mem2reg->log = realloc(mem2reg->log, sizeof(*mem2reg->log) * mem2reg->log_cap);
+
+        if (mem2reg->log == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    mem2reg->log[mem2reg->log_len++] = local;
+    mem2reg->log[mem2reg->log_len++] = mem2reg->current[local];
+
+    mem2reg->current[local] = value;
+}
+
+static void ir_mem2reg_rename_block(IRMem2Reg *mem2reg, IRBlockIndex block)
+{
+    IR *ir = mem2reg->ir;
+    const IRBlock *ir_block = &ir->blocks[block];
+
+    for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+        const IRInstruction *instruction = &ir_block->instructions[i];
+        const IRValue *operands = ir_operands(ir, instruction);
+
+        switch (instruction->opcode) {
+            case IR_PHI: {
+                const uint32_t local = ir_mem2reg_phi(mem2reg, instruction->result);
+
+                if (local != IR_NO_LOCAL) {
+                    ir_mem2reg_set(mem2reg, local, instruction->result);
+                }
+
+                break;
+            }
+
+            case IR_LOAD: {
+                const uint32_t local = ir_mem2reg_address(mem2reg, operands[0]);
+
+                if (local != IR_NO_LOCAL) {
+                    mem2reg->replacements[instruction->result] = mem2reg->current[local];
+                }
+
+                break;
+            }
+
+            case IR_STORE: {
+                const uint32_t local = ir_mem2reg_address(mem2reg, operands[0]);
+
+                if (local != IR_NO_LOCAL) {
+                    ir_mem2reg_set(mem2reg, local, ir_mem2reg_resolve(mem2reg, operands[1]));
+                }
+
+                break;
+            }
+
+            default: {
+                break;
+            }
+        }
+    }
+
+    IRBlockIndex successors[2];
+    const size_t successors_len = ir_successors(ir, block, successors);
+
+    for (size_t i = 0; i < successors_len; ++i) {
+        const IRBlock *successor = &ir->blocks[successors[i]];
+
+        for (size_t j = 0; j < successor->predecessors_len; ++j) {
+            if (successor->predecessors[j] != block) {
+                continue;
+            }
+
+            for (size_t k = 0; k < successor->instructions_len; ++k) {
+                const IRInstruction *phi = &successor->instructions[k];
+
+                if (phi->opcode != IR_PHI) {
+                    break;
+                }
+
+                const uint32_t local = ir_mem2reg_phi(mem2reg, phi->result);
+
+                if (local != IR_NO_LOCAL) {
+                    ir_operands(ir, phi)[j] = mem2reg->current[local];
+                }
+            }
+        }
+    }
+}
+
+// walks the dominator tree, so the value a local has when a block is
+// entered is the one it had at the end of its idom
+static void ir_mem2reg_rename(IRMem2Reg *mem2reg)
+{
+    const IR *ir = mem2reg->ir;
+
+    size_t *children_start = calloc(ir->blocks_len + 1, sizeof(*children_start));
+    IRBlockIndex *children = malloc(sizeof(*children) * ir->blocks_len);
+
+    if (children_start == NULL || children == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (IRBlockIndex block = 1; block < ir->blocks_len; ++block) {
+        if (mem2reg->idoms[block] != IR_NO_BLOCK) {
+            ++children_start[mem2reg->idoms[block] + 1];
+        }
+    }
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        children_start[block + 1] += children_start[block];
+    }
+
+    for (IRBlockIndex block = 1; block < ir->blocks_len; ++block) {
+        if (mem2reg->idoms[block] != IR_NO_BLOCK) {
+            children[children_start[mem2reg->idoms[block]]++] = block;
+        }
+    }
+
+    // filling them in moved every start to the next one's
+    for (IRBlockIndex block = ir->blocks_len; block > 0; --block) {
+        children_start[block] = children_start[block - 1];
+    }
+
+    children_start[0] = 0;
+
+    // SIZE_MAX for entering the block, otherwise how long the log was
+    // when it was entered
+    typedef struct {
+        IRBlockIndex block;
+        size_t log_len;
+    } Visit;
+
+    size_t stack_len = 0;
+    Visit *stack = malloc(sizeof(*stack) * 2 * ir->blocks_len);
+
+    if (stack == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    stack[stack_len++] = (Visit) { .block = 0, .log_len = SIZE_MAX };
+
+    while (stack_len > 0) {
+        const Visit visit = stack[--stack_len];
+
+        if (visit.log_len != SIZE_MAX) {
+            while (mem2reg->log_len > visit.log_len) {
+                mem2reg->log_len -= 2;
+                mem2reg->current[mem2reg->log[mem2reg->log_len]] = mem2reg->log[mem2reg->log_len + 1];
+            }
+
+            continue;
+        }
+
+        stack[stack_len++] = (Visit) { .block = visit.block, .log_len = mem2reg->log_len };
+
+        ir_mem2reg_rename_block(mem2reg, visit.block);
+
+        for (size_t i = children_start[visit.block]; i < children_start[visit.block + 1]; ++i) {
+            stack[stack_len++] = (Visit) { .block = children[i], .log_len = SIZE_MAX };
+        }
+    }
+
+    free(children_start);
+    free(children);
+    free(stack);
+}
+
+static void ir_mem2reg_remove(IRMem2Reg *mem2reg)
+{
+    IR *ir = mem2reg->ir;
+
+    // the blocks renaming didn't get to can't be reached anyway
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        const IRBlock *ir_block = &ir->blocks[block];
+
+        if (mem2reg->order[block] != IR_NO_BLOCK) {
+            continue;
+        }
+
+        for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+            const IRInstruction *instruction = &ir_block->instructions[i];
+
+            if (instruction->opcode != IR_LOAD) {
+                continue;
+            }
+
+            const uint32_t local = ir_mem2reg_address(mem2reg, ir_operands(ir, instruction)[0]);
+
+            if (local != IR_NO_LOCAL) {
+                mem2reg->replacements[instruction->result] = mem2reg->zeros[local];
+            }
+        }
+    }
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        IRBlock *ir_block = &ir->blocks[block];
+
+        size_t len = 0;
+
+        for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+            const IRInstruction *instruction = &ir_block->instructions[i];
+            IRValue *operands = ir_operands(ir, instruction);
+
+            switch (instruction->opcode) {
+                case IR_LOCAL: {
+                    if (ir_mem2reg_address(mem2reg, instruction->result) != IR_NO_LOCAL) {
+                        continue;
+                    }
+
+                    break;
+                }
+
+                case IR_LOAD:
+                case IR_STORE: {
+                    if (ir_mem2reg_address(mem2reg, operands[0]) != IR_NO_LOCAL) {
+                        continue;
+                    }
+
+                    break;
+                }
+
+                default: {
+                    break;
+                }
+            }
+
+            for (size_t j = 0; j < instruction->operands_len; ++j) {
+                operands[j] = ir_mem2reg_resolve(mem2reg, operands[j]);
+            }
+
+            ir_block->instructions[len++] = *instruction;
+        }
+
+        ir_block->instructions_len = len;
+    }
+}
+
+void ir_mem2reg(IR *ir)
+{
+    IRMem2Reg mem2reg = {
+        .ir = ir,
+
+        .log_len = 0,
+        .log_cap = 64
+    };
+
+    if (!ir_mem2reg_find_locals(&mem2reg)) {
+        free(mem2reg.addresses);
+        return;
+    }
+
+    ir_mem2reg_find_dominators(&mem2reg);
+    ir_mem2reg_find_frontiers(&mem2reg);
+    ir_mem2reg_add_zeros(&mem2reg);
+    ir_mem2reg_add_phis(&mem2reg);
+
+    mem2reg.replacements = malloc(sizeof(*mem2reg.replacements) * ir->values_len);
+    mem2reg.log = malloc(sizeof(*mem2reg.log) * mem2reg.log_cap);
+
+    if (mem2reg.replacements == NULL || mem2reg.log == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    for (size_t i = 0; i < ir->values_len; ++i) {
+        mem2reg.replacements[i] = IR_NULL;
+    }
+
+    ir_mem2reg_rename(&mem2reg);
+    ir_mem2reg_remove(&mem2reg);
+
+    free(mem2reg.addresses);
+    free(mem2reg.phis);
+    free(mem2reg.replacements);
+    free(mem2reg.zeros);
+    free(mem2reg.current);
+    free(mem2reg.log);
+    free(mem2reg.order);
+    free(mem2reg.idoms);
+    free(mem2reg.postorder);
+    free(mem2reg.frontiers_start);
+    free(mem2reg.frontiers);
+}
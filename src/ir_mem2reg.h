@@ -0,0 +1,13 @@
+#ifndef IR_MEM2REG_H_
+#define IR_MEM2REG_H_
+
+#include "ir.h"
+
+// Takes the stack slots whose address is only ever loaded from and
+// stored to directly out of memory. As long as the address doesn't go
+// anywhere else (a call, a phi, memory), nothing but those loads and
+// stores can see the slot, so every load is replaced by whatever was
+// stored last, with phis where different stores meet.
+void ir_mem2reg(IR *ir);
+
+#endif // IR_MEM2REG_H_
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include "ir_tail.h"
+#include "utils.h"
+
+// nothing but phis and a return
+static bool ir_tail_is_return(const IR *ir, IRBlockIndex block)
+{
+    const IRBlock *ir_block = &ir->blocks[block];
+
+    if (ir_block->instructions_len == 0 || ir_terminator(ir, block)->opcode != IR_RETURN) {
+        return false;
+    }
+
+    for (size_t i = 0; i + 1 < ir_block->instructions_len; ++i) {
+        if (ir_block->instructions[i].opcode != IR_PHI) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// `block` returns what `target` would have returned coming from it,
+// instead of jumping there, and `target` forgets it was a predecessor
+static void ir_tail_copy_return(IR *ir, IRBlockIndex block, IRBlockIndex target)
+{
+    IRBlock *target_block = &ir->blocks[target];
+    const IRInstruction *ret = ir_terminator(ir, target);
+
+    size_t predecessor = 0;
+    while (target_block->predecessors[predecessor] != block) {
+        ++predecessor;
+    }
+
+    IRValue value = ret->operands_len > 0 ? ir_operands(ir, ret)[0] : IR_NULL;
+
+    // the block can't be in a loop, so none of the phis get each other
+    for (size_t i = 0; i + 1 < target_block->instructions_len; ++i) {
+        IRInstruction *phi = &target_block->instructions[i];
+        IRValue *operands = ir_operands(ir, phi);
+
+        if (phi->result == value) {
+            value = operands[predecessor];
+        }
+
+        for (size_t j = predecessor; j + 1 < phi->operands_len; ++j) {
+            operands[j] = operands[j + 1];
+        }
+        --phi->operands_len;
+    }
+
+    for (size_t i = predecessor; i + 1 < target_block->predecessors_len; ++i) {
+        target_block->predecessors[i] = target_block->predecessors[i + 1];
+    }
+    --target_block->predecessors_len;
+
+    // the jump
+    --ir->blocks[block].instructions_len;
+
+    ir_return(ir, block, value);
+}
+
+void ir_find_tail_calls(IR *ir, size_t registers_len)
+{
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+            if (!ir_tail_is_return(ir, block)) {
+                continue;
+            }
+
+            IRBlock *ir_block = &ir->blocks[block];
+            const size_t predecessors_len = ir_block->predecessors_len;
+
+            for (size_t i = ir_block->predecessors_len; i-- > 0;) {
+                const IRBlockIndex predecessor = ir_block->predecessors[i];
+
+                if (ir_terminator(ir, predecessor)->opcode == IR_JUMP) {
+                    ir_tail_copy_return(ir, predecessor, block);
+                    changed = true;
+                }
+            }
+
+            // every block that went there returns on its own now
+            if (predecessors_len > 0 && ir_block->predecessors_len == 0) {
+                ir_block->instructions_len = 0;
+            }
+        }
+    }
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        const IRBlock *ir_block = &ir->blocks[block];
+
+        for (size_t i = 0; i < ir_block->instructions_len; ++i) {
+            if (ir_block->instructions[i].opcode == IR_LOCAL) {
+                return;
+            }
+        }
+    }
+
+    for (IRBlockIndex block = 0; block < ir->blocks_len; ++block) {
+        const IRBlock *ir_block = &ir->blocks[block];
+
+        if (ir_block->instructions_len < 2 || ir_terminator(ir, block)->opcode != IR_RETURN) {
+            continue;
+        }
+
+        const IRInstruction *ret = ir_terminator(ir, block);
+        IRInstruction *call = &ir_block->instructions[ir_block->instructions_len - 2];
+
+        if (call->opcode != IR_CALL || call->operands_len > registers_len) {
+            continue;
+        }
+
+        if (ret->operands_len == 0 || ir_operands(ir, ret)[0] == call->result) {
+            call->function.tail = true;
+        }
+    }
+}
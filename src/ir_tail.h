@@ -0,0 +1,16 @@
+#ifndef IR_TAIL_H_
+#define IR_TAIL_H_
+
+#include "ir.h"
+
+// Tail calls. First a block that's only phis and a return is copied into
+// every block that jumps to it, so a call in either branch of an if ends
+// up right before a return of its own. Then a call right before the
+// return of what it returns, or of nothing at all, jumps to the function
+// instead of calling it, so the callee returns straight to whoever called
+// this one. The frame is gone by then, so that's only if nothing can
+// point into it, and if no more than `registers_len` arguments are passed,
+// since the ones on the stack would have to go where the return address is.
+void ir_find_tail_calls(IR *ir, size_t registers_len);
+
+#endif // IR_TAIL_H_
@@ -3,29 +3,65 @@
 #include <string.h>
 #include <stdbool.h>
 #include "lexer.h"
+#include "scan.h"
 #include "utils.h"
 
-static inline bool is_ident(char ch)
-{
-    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_';
-}
-
 static inline bool is_digit(char ch)
 {
     return ch >= '0' && ch <= '9';
 }
 
-static inline bool is_whitespace(char ch)
+// keywords are told apart by length first, so most identifiers
+// never get compared against anything
+static TokenType keyword_type(const char *text, size_t len)
 {
-    return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t';
+    switch (len) {
+        case 2: {
+            if (memcmp(text, "if", 2) == 0) {
+                return TOKEN_IF;
+            }
+            if (memcmp(text, "fn", 2) == 0) {
+                return TOKEN_FN;
+            }
+            break;
+        }
+
+        case 4: {
+            if (memcmp(text, "else", 4) == 0) {
+                return TOKEN_ELSE;
+            }
+            break;
+        }
+
+        case 5: {
+            if (memcmp(text, "while", 5) == 0) {
+                return TOKEN_WHILE;
+            }
+            break;
+        }
+
+        case 6: {
+            if (memcmp(text, "become", 6) == 0) {
+                return TOKEN_BECOME;
+            }
+            break;
+        }
+
+        default: {
+            break;
+        }
+    }
+
+    return TOKEN_IDENT;
 }
 
-Lexer lexer_new(char *text)
+Lexer lexer_new(char *text, InternTable *interns)
 {
     Lexer lexer = {
         .len = strlen(text),
         .text = text,
-        .pos = 0
+        .pos = 0,
+        .interns = interns
     };
 
     return lexer;
@@ -34,13 +70,12 @@ Lexer lexer_new(char *text)
 Token lexer_next(Lexer *lexer)
 {
     loop {
-        while (is_whitespace(lexer->text[lexer->pos])) {
-            ++lexer->pos;
-        }
+        lexer->pos = scan_whitespace(lexer->text, lexer->pos);
 
         const size_t start = lexer->pos;
 
         TokenType type;
+        Symbol symbol = 0;
         switch (lexer->text[lexer->pos]) {
             case '\0': {
                 type = TOKEN_EOF;
@@ -50,15 +85,20 @@ Token lexer_next(Lexer *lexer)
             case '"': {
                 type = TOKEN_STRING;
                 ++lexer->pos;
-                while (lexer->text[lexer->pos] != '"') {
+                loop {
+                    lexer->pos = scan_string(lexer->text, lexer->pos);
+
+                    if (lexer->text[lexer->pos] == '"') {
+                        break;
+                    }
                     if (lexer->text[lexer->pos] == '\0') {
                         ERROR("String literal not closed off.");
                     }
-                    if (lexer->text[lexer->pos] == '\\') {
-                        ++lexer->pos;
-                        if (lexer->text[lexer->pos] == '\0') {
-                            ERROR("Cannot escape an EOF.");
-                        }
+
+                    // skip the backslash and whatever it escapes
+                    ++lexer->pos;
+                    if (lexer->text[lexer->pos] == '\0') {
+                        ERROR("Cannot escape an EOF.");
                     }
                     ++lexer->pos;
                 }
@@ -69,17 +109,12 @@ Token lexer_next(Lexer *lexer)
             case 'a' ... 'z':
             case 'A' ... 'Z':
             case '_': {
-                type = TOKEN_IDENT;
+                lexer->pos = scan_ident(lexer->text, lexer->pos);
 
-                while (is_ident(lexer->text[lexer->pos])) {
-                    ++lexer->pos;
-                }
+                type = keyword_type(lexer->text + start, lexer->pos - start);
 
-                for (size_t i = 0; i < ARRAY_LEN(STRING_TO_TOKEN_TYPE); ++i) {
-                    const char *text = STRING_TO_TOKEN_TYPE[i].text;
-                    if (strncmp(text, lexer->text + start, strlen(text)) == 0) {
-                        type = STRING_TO_TOKEN_TYPE[i].type;
-                    }
+                if (type == TOKEN_IDENT) {
+                    symbol = intern(lexer->interns, lexer->text + start, lexer->pos - start);
                 }
 
                 break;
@@ -102,6 +137,9 @@ Token lexer_next(Lexer *lexer)
             case '{': { type = TOKEN_LEFT_CURLY; ++lexer->pos; break; }
             case '}': { type = TOKEN_RIGHT_CURLY; ++lexer->pos; break; }
 
+            case '[': { type = TOKEN_LEFT_SQUARE; ++lexer->pos; break; }
+            case ']': { type = TOKEN_RIGHT_SQUARE; ++lexer->pos; break; }
+
             case '#': { type = TOKEN_REFERENCE; ++lexer->pos; break; }
             case '@': { type = TOKEN_DEREFERENCE; ++lexer->pos; break; }
 
@@ -113,10 +151,10 @@ Token lexer_next(Lexer *lexer)
                 type = TOKEN_OPER_DIV;
                 ++lexer->pos;
                 if (lexer->text[lexer->pos] == '/') {
-                    while (lexer->text[lexer->pos] != '\n') {
+                    lexer->pos = scan_line(lexer->text, lexer->pos);
+                    if (lexer->text[lexer->pos] == '\n') {
                         ++lexer->pos;
                     }
-                    ++lexer->pos;
                     continue;
                 }
                 break;
@@ -180,7 +218,8 @@ Token lexer_next(Lexer *lexer)
             .type = type,
             .text = lexer->text + start,
             .pos = start,
-            .len = lexer->pos - start
+            .len = lexer->pos - start,
+            .symbol = symbol
         };
     }
 }
@@ -191,3 +230,88 @@ Token lexer_peek(Lexer *lexer)
     lexer->pos = token.pos;
     return token;
 }
+
+static void token_buffer_push(TokenBuffer *tokens, Token token)
+{
+    if (tokens->len >= tokens->cap) {
+        while (tokens->len >= tokens->cap) {
+            tokens->cap *= 2;
+        }
+
+        tokens->types     = realloc(tokens->types, sizeof(*tokens->types) * tokens->cap);
+        tokens->positions = realloc(tokens->positions, sizeof(*tokens->positions) * tokens->cap);
+        tokens->lens      = realloc(tokens->lens, sizeof(*tokens->lens) * tokens->cap);
+        tokens->symbols   = realloc(tokens->symbols, sizeof(*tokens->symbols) * tokens->cap);
+
+        if (tokens->types == NULL || tokens->positions == NULL || tokens->lens == NULL || tokens->symbols == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    tokens->types[tokens->len]     = token.type;
+    tokens->positions[tokens->len] = token.pos;
+    tokens->lens[tokens->len]      = token.len;
+    tokens->symbols[tokens->len]   = token.symbol;
+
+    ++tokens->len;
+}
+
+TokenBuffer lexer_tokenize(Lexer *lexer)
+{
+    if (lexer->len > UINT32_MAX) {
+        ERROR("Source file is too large.");
+    }
+
+    TokenBuffer tokens = {
+        .text = lexer->text,
+
+        .len = 0,
+        // roughly one token every four bytes
+        .cap = lexer->len / 4 + 16
+    };
+
+    tokens.types     = malloc(sizeof(*tokens.types) * tokens.cap);
+    tokens.positions = malloc(sizeof(*tokens.positions) * tokens.cap);
+    tokens.lens      = malloc(sizeof(*tokens.lens) * tokens.cap);
+    tokens.symbols   = malloc(sizeof(*tokens.symbols) * tokens.cap);
+
+    if (tokens.types == NULL || tokens.positions == NULL || tokens.lens == NULL || tokens.symbols == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    loop {
+        const Token token = lexer_next(lexer);
+
+        token_buffer_push(&tokens, token);
+
+        if (token.type == TOKEN_EOF) {
+            break;
+        }
+    }
+
+    return tokens;
+}
+
+Token token_buffer_get(const TokenBuffer *tokens, size_t index)
+{
+    // reading past the end keeps returning the EOF
+    if (index >= tokens->len) {
+        index = tokens->len - 1;
+    }
+
+    return (Token) {
+        .type   = tokens->types[index],
+        .text   = tokens->text + tokens->positions[index],
+        .pos    = tokens->positions[index],
+        .len    = tokens->lens[index],
+        .symbol = tokens->symbols[index]
+    };
+}
+
+void token_buffer_free(TokenBuffer *tokens)
+{
+    free(tokens->types);
+    free(tokens->positions);
+    free(tokens->lens);
+    free(tokens->symbols);
+}
@@ -2,6 +2,8 @@
 #define LEXER_H_
 
 #include <stddef.h>
+#include <stdint.h>
+#include "intern.h"
 
 typedef enum TokenType
 {
@@ -12,6 +14,8 @@ typedef enum TokenType
     TOKEN_IF,
     TOKEN_WHILE,
     TOKEN_ELSE,
+    TOKEN_FN,
+    TOKEN_BECOME,
 
     TOKEN_LEFT_PAREN,
     TOKEN_RIGHT_PAREN,
@@ -19,6 +23,9 @@ typedef enum TokenType
     TOKEN_LEFT_CURLY,
     TOKEN_RIGHT_CURLY,
 
+    TOKEN_LEFT_SQUARE,
+    TOKEN_RIGHT_SQUARE,
+
     TOKEN_OPER_ADD,
     TOKEN_OPER_SUB,
     TOKEN_OPER_MUL,
@@ -49,28 +56,20 @@ typedef enum TokenType
     TOKEN_TYPES
 } TokenType;
 
-typedef struct StringTokenTypeTuple
-{
-    char *text;
-    TokenType type;
-} StringTokenTypeTuple;
-
-static const StringTokenTypeTuple STRING_TO_TOKEN_TYPE[] = {
-    {"if",    TOKEN_IF},
-    {"else",  TOKEN_ELSE},
-    {"while", TOKEN_WHILE}
-};
-
 static const char *TOKEN_TYPE_TO_STRING[TOKEN_TYPES] = {
     [TOKEN_IDENT]             = "IDENT",
     [TOKEN_NUMBER]            = "NUMBER",
     [TOKEN_IF]                = "IF",
     [TOKEN_ELSE]              = "ELSE",
     [TOKEN_WHILE]             = "WHILE",
+    [TOKEN_FN]                = "FN",
+    [TOKEN_BECOME]            = "BECOME",
     [TOKEN_LEFT_PAREN]        = "LEFT_PAREN",
     [TOKEN_RIGHT_PAREN]       = "RIGHT_PAREN",
     [TOKEN_LEFT_CURLY]        = "LEFT_CURLY",
     [TOKEN_RIGHT_CURLY]       = "RIGHT_CURLY",
+    [TOKEN_LEFT_SQUARE]       = "LEFT_SQUARE",
+    [TOKEN_RIGHT_SQUARE]      = "RIGHT_SQUARE",
     [TOKEN_OPER_ADD]          = "OPER_ADD",
     [TOKEN_OPER_SUB]          = "OPER_SUB",
     [TOKEN_OPER_MUL]          = "OPER_MUL",
@@ -96,6 +95,9 @@ typedef struct Token
     char *text;
     size_t pos;
     size_t len;
+
+    // only set for TOKEN_IDENT
+    Symbol symbol;
 } Token;
 
 typedef struct Lexer
@@ -103,10 +105,32 @@ typedef struct Lexer
     size_t len;
     char *text;
     size_t pos;
+
+    // identifiers are interned as they are lexed
+    InternTable *interns;
 } Lexer;
 
-Lexer lexer_new(char *text);
+// The whole source lexed up front, stored as parallel arrays.
+// Always ends with a TOKEN_EOF.
+typedef struct TokenBuffer
+{
+    char *text;
+
+    size_t len;
+    size_t cap;
+    uint8_t *types;
+    uint32_t *positions;
+    uint32_t *lens;
+    Symbol *symbols;
+} TokenBuffer;
+
+Lexer lexer_new(char *text, InternTable *interns);
 Token lexer_next(Lexer *lexer);
 Token lexer_peek(Lexer *lexer);
 
+TokenBuffer lexer_tokenize(Lexer *lexer);
+
+Token token_buffer_get(const TokenBuffer *tokens, size_t index);
+void token_buffer_free(TokenBuffer *tokens);
+
 #endif // LEXER_H_ 
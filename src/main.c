@@ -1,12 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
+#include "arena.h"
 #include "ast.h"
 #include "lexer.h"
 #include "parser.h"
 #include "compile.h"
 #include "hashmap.h"
+#include "intern.h"
 #include "utils.h"
 
 const char *extension = ".asm";
@@ -36,32 +39,163 @@ char *read_file(const char *path)
     return text;
 }
 
+// the argument after the option at `*i`, which it skips
+size_t read_number(int argc, char **argv, int *i)
+{
+    if (*i + 1 >= argc) {
+        ERROR("Expected a number after `%s`.", argv[*i]);
+    }
+
+    char *end;
+    const size_t number = strtoul(argv[*i + 1], &end, 10);
+
+    if (*end != '\0' || end == argv[*i + 1]) {
+        ERROR("Expected a number after `%s`.", argv[*i]);
+    }
+
+    ++*i;
+
+    return number;
+}
+
+// how wide the vectors that `--simd` names are, which it skips
+size_t read_simd(int argc, char **argv, int *i)
+{
+    static const struct { const char *name; size_t width; } SIMD[] = {
+        { "none", 0  },
+        { "sse2", 16 },
+        { "avx2", 32 }
+    };
+
+    if (*i + 1 < argc) {
+        for (size_t j = 0; j < ARRAY_LEN(SIMD); ++j) {
+            if (strcmp(argv[*i + 1], SIMD[j].name) == 0) {
+                ++*i;
+                return SIMD[j].width;
+            }
+        }
+    }
+
+    ERROR("Expected none, sse2 or avx2 after `%s`.", argv[*i]);
+}
+
+// the widest vectors the machine that's compiling has, since
+// that's usually the one the program is going to run on too
+size_t default_vector_width(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) {
+        return 32;
+    }
+#endif
+
+    return 16;
+}
+
 int main(int argc, char **argv)
 {
-    if (argc < 3) {
+    CompileOptions options = {
+        .peephole_window = PEEPHOLE_DEFAULT_WINDOW,
+
+        .inline_budget = INLINE_DEFAULT_BUDGET,
+
+        .loops = {
+            .level = IR_LOOP_DEFAULT_LEVEL,
+            .unroll = IR_LOOP_DEFAULT_UNROLL,
+            .budget = IR_LOOP_DEFAULT_BUDGET,
+            .vector_width = default_vector_width()
+        }
+    };
+
+    size_t paths_len = 0;
+    const char *paths[2];
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--", 2) != 0) {
+            if (paths_len >= ARRAY_LEN(paths)) {
+                ERROR("Too many arguments.");
+            }
+            paths[paths_len++] = argv[i];
+        } else if (strcmp(argv[i], "--arena-stats") == 0) {
+            options.arena_stats = true;
+        } else if (strcmp(argv[i], "--elf") == 0) {
+            options.output = OUTPUT_ELF;
+        } else if (strcmp(argv[i], "--dump-ir") == 0) {
+            options.dump_ir = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            options.stats = true;
+        } else if (strcmp(argv[i], "--frame-report") == 0) {
+            options.frame_report = true;
+        } else if (strcmp(argv[i], "--omit-frame-pointer") == 0) {
+            options.omit_frame_pointer = true;
+        } else if (strcmp(argv[i], "--inline-report") == 0) {
+            options.inline_report = true;
+        } else if (strcmp(argv[i], "--inline-budget") == 0) {
+            options.inline_budget = read_number(argc, argv, &i);
+        } else if (strcmp(argv[i], "--peephole-window") == 0) {
+            options.peephole_window = read_number(argc, argv, &i);
+        } else if (strcmp(argv[i], "--opt-level") == 0) {
+            options.loops.level = read_number(argc, argv, &i);
+        } else if (strcmp(argv[i], "--unroll") == 0) {
+            options.loops.unroll = read_number(argc, argv, &i);
+        } else if (strcmp(argv[i], "--unroll-budget") == 0) {
+            options.loops.budget = read_number(argc, argv, &i);
+        } else if (strcmp(argv[i], "--simd") == 0) {
+            options.loops.vector_width = read_simd(argc, argv, &i);
+        } else {
+            ERROR("Unknown option `%s`.", argv[i]);
+        }
+    }
+
+    if (paths_len < 2) {
         ERROR("Not enough arguments.");
     }
 
-    const char *file_name = argv[1];
+    const char *file_name = paths[0];
     
-    const char *path = argv[2];
+    const char *path = paths[1];
 
     char *text = read_file(file_name);
 
-    Lexer lexer = lexer_new(text);
+    Arena arena = arena_new();
+
+    InternTable interns = intern_table_new();
 
-    AST *ast = parse(&lexer);
+    Lexer lexer = lexer_new(text, &interns);
+
+    TokenBuffer tokens = lexer_tokenize(&lexer);
+
+    AST ast = parse(&tokens, &arena);
+
+    if (options.arena_stats) {
+        arena_print_stats(stderr, &arena, "parse");
+    }
 
-    //ast_print(ast);
+    //ast_print(stdout, &ast, ast.root);
     //printf("\n");
 
-    FILE *file = fopen(path, "w");
+    FILE *file = fopen(path, options.output == OUTPUT_ELF ? "wb" : "w");
+
+    if (file == NULL) {
+        ERROR("Could not open file %s.", path);
+    }
+
+    compile(&ast, &arena, &interns, file, &options);
+
+    // whatever stdio was still holding on to only gets written here
+    if (fclose(file) != 0) {
+        ERROR("Could not write file %s.", path);
+    }
+
+    if (options.output == OUTPUT_ELF) {
+        chmod(path, 0755);
+    }
 
-    compile(ast, file);
+    arena_free(&arena);
 
-    fclose(file);
+    token_buffer_free(&tokens);
 
-    ast_free(ast);
+    intern_table_free(&interns);
 
     free(text);
 
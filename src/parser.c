@@ -5,202 +5,260 @@
 #include "errors.h"
 #include "utils.h"
 
-AST *parse_expr(Lexer *lexer);
-AST *parse_statements(Lexer *lexer);
+ASTIndex parse_expr(Parser *parser);
+ASTIndex parse_statements(Parser *parser);
 
-static AST *parse_node(Lexer *lexer)
+static inline Token parser_peek(const Parser *parser)
 {
-    Token token = lexer_next(lexer);
+    return token_buffer_get(parser->tokens, parser->pos);
+}
 
-    if (!IS_NODE[token.type]) {
-        UNEXPECTED_TOKEN(token);
+static inline Token parser_next(Parser *parser)
+{
+    return token_buffer_get(parser->tokens, parser->pos++);
+}
+
+// the index of the next token, for the node being built
+static inline size_t parser_token(const Parser *parser)
+{
+    // reading past the end keeps returning the EOF
+    if (parser->pos >= parser->tokens->len) {
+        return parser->tokens->len - 1;
     }
+    return parser->pos;
+}
 
-    AST *ast = ast_alloc();
+static void parser_scratch_push(Parser *parser, ASTIndex node)
+{
+    if (parser->scratch_len >= parser->scratch_cap) {
+        while (parser->scratch_len >= parser->scratch_cap) {
+            parser->scratch_cap *= 2;
+        }
 
-    ast->type = AST_NODE;
-    ast->node = token;
+        parser->scratch = realloc(parser->scratch, sizeof(*parser->scratch) * parser->scratch_cap);
 
-    return ast;
+        if (parser->scratch == NULL) {
+            ALLOCATION_ERROR();
+        }
+    }
+
+    parser->scratch[parser->scratch_len++] = node;
+}
+
+// moves everything pushed since `start` into the AST
+static uint32_t parser_scratch_pop(Parser *parser, size_t start)
+{
+    const uint32_t children = ast_push_extra(
+        parser->ast,
+        parser->scratch + start,
+        parser->scratch_len - start
+    );
+
+    parser->scratch_len = start;
+
+    return children;
+}
+
+static ASTIndex parse_node(Parser *parser)
+{
+    const size_t index = parser_token(parser);
+
+    Token token = parser_next(parser);
+
+    if (!IS_NODE[token.type]) {
+        UNEXPECTED_TOKEN(token);
+    }
+
+    return ast_push(parser->ast, AST_NODE, index, AST_NULL, AST_NULL);
 }
 
-static AST *parse_brackets_or_node(Lexer *lexer)
+static ASTIndex parse_brackets_or_node(Parser *parser)
 {
-    if (lexer_peek(lexer).type != TOKEN_LEFT_PAREN) {
-        return parse_node(lexer);
+    if (parser_peek(parser).type != TOKEN_LEFT_PAREN) {
+        return parse_node(parser);
     }
 
-    lexer_next(lexer);
+    parser_next(parser);
 
-    AST *ast = parse_expr(lexer);
+    ASTIndex node = parse_expr(parser);
 
-    const Token token = lexer_next(lexer);
+    const Token token = parser_next(parser);
     if (token.type != TOKEN_RIGHT_PAREN) {
         UNEXPECTED_TOKEN(token);
     }
 
-    return ast;
+    return node;
 }
 
-static AST *parse_block(Lexer *lexer)
+static ASTIndex parse_block(Parser *parser)
 {
     {
-        const Token token = lexer_next(lexer);
+        const Token token = parser_next(parser);
         if (token.type != TOKEN_LEFT_CURLY) {
             UNEXPECTED_TOKEN(token);
         }
     }
 
-    AST *ast = parse_statements(lexer);
+    ASTIndex node = parse_statements(parser);
 
     {
-        const Token token = lexer_next(lexer);
+        const Token token = parser_next(parser);
         if (token.type != TOKEN_RIGHT_CURLY) {
             UNEXPECTED_TOKEN(token);
         }
     }
 
-    return ast;
+    return node;
 }
 
-static AST *parse_block_or_brackets(Lexer *lexer)
+static ASTIndex parse_block_or_brackets(Parser *parser)
 {
-    if (lexer_peek(lexer).type != TOKEN_LEFT_CURLY) {
-        return parse_brackets_or_node(lexer);
+    if (parser_peek(parser).type != TOKEN_LEFT_CURLY) {
+        return parse_brackets_or_node(parser);
     } else {
-        return parse_block(lexer);
+        return parse_block(parser);
     }
 }
 
-static AST *parse_prefix(Lexer *lexer)
+// calls and indexing, which bind tighter than any prefix
+static ASTIndex parse_postfix(Parser *parser)
 {
-    if (!IS_PREFIX[lexer_peek(lexer).type]) {
-        return parse_block_or_brackets(lexer);
-    }
+    ASTIndex lhs = parse_block_or_brackets(parser);
 
-    AST *ast = ast_alloc();
+    loop {
+        const TokenType type = parser_peek(parser).type;
 
-    ast->type = AST_PREFIX;
-    ast->prefix = (ASTPrefix) {
-        .oper = lexer_next(lexer),
-        .node = parse_prefix(lexer)
-    };
+        if (type == TOKEN_LEFT_SQUARE) {
+            const size_t square = parser_token(parser);
+            parser_next(parser);
 
-    return ast;
-}
+            const ASTIndex index = parse_expr(parser);
 
-static AST *parse_function_calls(Lexer *lexer)
-{
-    AST *lhs = parse_prefix(lexer);
+            const Token token = parser_next(parser);
+            if (token.type != TOKEN_RIGHT_SQUARE) {
+                UNEXPECTED_TOKEN(token);
+            }
 
-    loop {
-        if (lexer_peek(lexer).type != TOKEN_LEFT_PAREN) {
-            return lhs;
+            lhs = ast_push(parser->ast, AST_INFIX, square, lhs, index);
+            continue;
         }
 
-        lexer_next(lexer);
-
-        AST *ast = ast_alloc();
+        if (type != TOKEN_LEFT_PAREN) {
+            return lhs;
+        }
 
-        ast->type = AST_FUNCTION_CALL;
-        ast->function_call = (ASTFunctionCall) {
-            .lhs = lhs,
-            .len = 0,
-            .cap = 256
-        };
+        const size_t paren = parser_token(parser);
+        parser_next(parser);
 
-        ast->function_call.arguments = malloc(sizeof(*ast->function_call.arguments) * ast->function_call.cap);
+        // the argument count goes first
+        const size_t arguments_start = parser->scratch_len;
+        parser_scratch_push(parser, 0);
 
-        if (ast->function_call.arguments == NULL) {
-            ALLOCATION_ERROR();
-        }
+        if (parser_peek(parser).type == TOKEN_RIGHT_PAREN) {
+            parser_next(parser);
+        } else {
+            loop {
+                parser_scratch_push(parser, parse_expr(parser));
 
-        loop {
-            AST *argument = parse_expr(lexer);
+                Token token = parser_next(parser);
 
-            if (ast->function_call.len >= ast->function_call.cap) {
-                while (ast->function_call.len >= ast->function_call.cap) {
-                    ast->function_call.cap *= 2;
+                if (token.type == TOKEN_RIGHT_PAREN) {
+                    break;
                 }
-                ast->function_call.arguments = realloc(ast->function_call.arguments, sizeof(*ast->function_call.arguments) * ast->function_call.cap);
-
 
-                if (ast->function_call.arguments == NULL) {
-                    ALLOCATION_ERROR();
+                if (token.type != TOKEN_COMMA) {
+                    UNEXPECTED_TOKEN(token);
                 }
             }
+        }
 
-            ast->function_call.arguments[ast->function_call.len++] = argument;
+        parser->scratch[arguments_start] = parser->scratch_len - arguments_start - 1;
 
-            Token token = lexer_next(lexer);
+        const uint32_t arguments = parser_scratch_pop(parser, arguments_start);
 
-            if (token.type == TOKEN_RIGHT_PAREN) {
-                break;
-            }
+        lhs = ast_push(parser->ast, AST_FUNCTION_CALL, paren, lhs, arguments);
+    }
+}
 
-            if (token.type != TOKEN_COMMA) {
-                UNEXPECTED_TOKEN(token);
-            }
+// an array type, `[len]element`, is a prefix too
+static ASTIndex parse_prefix(Parser *parser)
+{
+    const TokenType type = parser_peek(parser).type;
+
+    if (type == TOKEN_LEFT_SQUARE) {
+        const size_t square = parser_token(parser);
+        parser_next(parser);
+
+        const ASTIndex len = parse_expr(parser);
+
+        const Token token = parser_next(parser);
+        if (token.type != TOKEN_RIGHT_SQUARE) {
+            UNEXPECTED_TOKEN(token);
         }
 
-        lhs = ast;
+        const ASTIndex element = parse_prefix(parser);
+
+        return ast_push(parser->ast, AST_PREFIX, square, element, len);
     }
+
+    if (!IS_PREFIX[type]) {
+        return parse_postfix(parser);
+    }
+
+    const size_t oper = parser_token(parser);
+    parser_next(parser);
+
+    const ASTIndex node = parse_prefix(parser);
+
+    return ast_push(parser->ast, AST_PREFIX, oper, node, AST_NULL);
 }
 
-static AST *parse_infix_DM_or_prefix(Lexer *lexer)
+static ASTIndex parse_infix_DM_or_prefix(Parser *parser)
 {
-    AST *lhs = parse_function_calls(lexer);
+    ASTIndex lhs = parse_prefix(parser);
 
     loop {
-        Token token = lexer_peek(lexer);
+        Token token = parser_peek(parser);
 
         if (token.type != TOKEN_OPER_MUL && token.type != TOKEN_OPER_DIV) {
             return lhs;
         }
 
-        AST *ast = ast_alloc();
+        const size_t oper = parser_token(parser);
+        parser_next(parser);
 
-        ast->type = AST_INFIX;
-        ast->infix = (ASTInfix) {
-            .oper = lexer_next(lexer),
-            .lhs = lhs,
-            .rhs = parse_function_calls(lexer)
-        };
+        const ASTIndex rhs = parse_prefix(parser);
 
-        lhs = ast;
+        lhs = ast_push(parser->ast, AST_INFIX, oper, lhs, rhs);
     }
 }
 
-static AST *parse_infix_AS_or_DM(Lexer *lexer)
+static ASTIndex parse_infix_AS_or_DM(Parser *parser)
 {
-    AST *lhs = parse_infix_DM_or_prefix(lexer);
+    ASTIndex lhs = parse_infix_DM_or_prefix(parser);
 
     loop {
-        Token token = lexer_peek(lexer);
+        Token token = parser_peek(parser);
 
         if (token.type != TOKEN_OPER_ADD && token.type != TOKEN_OPER_SUB) {
             return lhs;
         }
 
-        AST *ast = ast_alloc();
+        const size_t oper = parser_token(parser);
+        parser_next(parser);
 
-        ast->type = AST_INFIX;
-        ast->infix = (ASTInfix) {
-            .oper = lexer_next(lexer),
-            .lhs = lhs,
-            .rhs = parse_infix_DM_or_prefix(lexer)
-        };
+        const ASTIndex rhs = parse_infix_DM_or_prefix(parser);
 
-        lhs = ast;
+        lhs = ast_push(parser->ast, AST_INFIX, oper, lhs, rhs);
     }
 }
 
-static AST *parse_infix_condition_or_AS(Lexer *lexer)
+static ASTIndex parse_infix_condition_or_AS(Parser *parser)
 {
-    AST *lhs = parse_infix_AS_or_DM(lexer);
+    ASTIndex lhs = parse_infix_AS_or_DM(parser);
 
     loop {
-        Token token = lexer_peek(lexer);
+        Token token = parser_peek(parser);
 
         if (token.type != TOKEN_OPER_EQUALS
          && token.type != TOKEN_OPER_LT
@@ -211,115 +269,218 @@ static AST *parse_infix_condition_or_AS(Lexer *lexer)
             return lhs;
         }
 
-        AST *ast = ast_alloc();
+        const size_t oper = parser_token(parser);
+        parser_next(parser);
 
-        ast->type = AST_INFIX;
-        ast->infix = (ASTInfix) {
-            .oper = lexer_next(lexer),
-            .lhs = lhs,
-            .rhs = parse_infix_AS_or_DM(lexer)
-        };
+        const ASTIndex rhs = parse_infix_AS_or_DM(parser);
 
-        lhs = ast;
+        lhs = ast_push(parser->ast, AST_INFIX, oper, lhs, rhs);
     }
 }
 
-static AST *parse_if_statement(Lexer *lexer)
+static ASTIndex parse_if_statement(Parser *parser)
 {
-    Token token = lexer_next(lexer);
+    const size_t index = parser_token(parser);
+
+    Token token = parser_next(parser);
     if (token.type != TOKEN_IF) {
         UNEXPECTED_TOKEN(token);
     }
 
-    AST *ast = ast_alloc();
+    const ASTIndex condition = parse_expr(parser);
 
-    ast->type = AST_IF_STATEMENT;
-    ast->if_statement = (ASTIfStatement) {
-        .condition   = parse_expr(lexer),
-        .if_branch   = parse_block(lexer),
-        .else_branch = NULL
+    uint32_t branches[] = {
+        parse_block(parser),
+        AST_NULL
     };
 
-    if (lexer_peek(lexer).type == TOKEN_ELSE) {
-        lexer_next(lexer);
-        ast->if_statement.else_branch = parse_block(lexer);
+    if (parser_peek(parser).type == TOKEN_ELSE) {
+        parser_next(parser);
+        branches[1] = parse_block(parser);
     }
 
-    return ast;
+    const uint32_t extra = ast_push_extra(parser->ast, branches, ARRAY_LEN(branches));
+
+    return ast_push(parser->ast, AST_IF_STATEMENT, index, condition, extra);
 }
 
-static AST *parse_while_loop(Lexer *lexer)
+static ASTIndex parse_while_loop(Parser *parser)
 {
-    Token token = lexer_next(lexer);
+    const size_t index = parser_token(parser);
+
+    Token token = parser_next(parser);
     if (token.type != TOKEN_WHILE) {
         UNEXPECTED_TOKEN(token);
     }
 
-    AST *ast = ast_alloc();
+    const ASTIndex condition = parse_expr(parser);
+    const ASTIndex body      = parse_block(parser);
+
+    return ast_push(parser->ast, AST_WHILE_LOOP, index, condition, body);
+}
+
+ASTIndex parse_expr(Parser *parser)
+{
+    if (parser_peek(parser).type == TOKEN_IF) {
+        return parse_if_statement(parser);
+    }
+    return parse_infix_condition_or_AS(parser);
+}
+
+// `name: type`, a declaration without a value
+static ASTIndex parse_parameter(Parser *parser)
+{
+    const size_t name = parser_token(parser);
 
-    ast->type = AST_WHILE_LOOP;
-    ast->while_loop = (ASTWhileLoop) {
-        .condition = parse_expr(lexer),
-        .body      = parse_block(lexer)
+    {
+        const Token token = parser_next(parser);
+        if (token.type != TOKEN_IDENT) {
+            UNEXPECTED_TOKEN(token);
+        }
+    }
+
+    {
+        const Token token = parser_next(parser);
+        if (token.type != TOKEN_COLON) {
+            UNEXPECTED_TOKEN(token);
+        }
+    }
+
+    const ASTIndex type = parse_expr(parser);
+
+    // the value, then the binding
+    const uint32_t declaration[] = {
+        AST_NULL,
+        AST_NULL
     };
 
-    return ast;
+    const uint32_t extra = ast_push_extra(parser->ast, declaration, ARRAY_LEN(declaration));
+
+    return ast_push(parser->ast, AST_DECLARATION, name, type, extra);
 }
 
-AST *parse_expr(Lexer *lexer)
+// `fn name(parameter: type, ...): type = body`, without
+// the return type if it doesn't return anything
+static ASTIndex parse_function(Parser *parser)
 {
-    if (lexer_peek(lexer).type == TOKEN_IF) {
-        return parse_if_statement(lexer);
+    {
+        const Token token = parser_next(parser);
+        if (token.type != TOKEN_FN) {
+            UNEXPECTED_TOKEN(token);
+        }
+    }
+
+    const size_t name = parser_token(parser);
+
+    {
+        const Token token = parser_next(parser);
+        if (token.type != TOKEN_IDENT) {
+            UNEXPECTED_TOKEN(token);
+        }
+    }
+
+    {
+        const Token token = parser_next(parser);
+        if (token.type != TOKEN_LEFT_PAREN) {
+            UNEXPECTED_TOKEN(token);
+        }
+    }
+
+    // the body, the binding and the parameter count go first
+    const size_t start = parser->scratch_len;
+    parser_scratch_push(parser, AST_NULL);
+    parser_scratch_push(parser, AST_NULL);
+    parser_scratch_push(parser, 0);
+
+    if (parser_peek(parser).type == TOKEN_RIGHT_PAREN) {
+        parser_next(parser);
+    } else {
+        loop {
+            parser_scratch_push(parser, parse_parameter(parser));
+
+            Token token = parser_next(parser);
+
+            if (token.type == TOKEN_RIGHT_PAREN) {
+                break;
+            }
+
+            if (token.type != TOKEN_COMMA) {
+                UNEXPECTED_TOKEN(token);
+            }
+        }
+    }
+
+    ASTIndex return_type = AST_NULL;
+
+    if (parser_peek(parser).type == TOKEN_COLON) {
+        parser_next(parser);
+        return_type = parse_expr(parser);
+    }
+
+    {
+        const Token token = parser_next(parser);
+        if (token.type != TOKEN_ASSIGN) {
+            UNEXPECTED_TOKEN(token);
+        }
     }
-    return parse_infix_condition_or_AS(lexer);
+
+    parser->scratch[start + 2] = parser->scratch_len - start - 3;
+
+    const ASTIndex body = parse_expr(parser);
+    parser->scratch[start] = body;
+
+    const uint32_t extra = parser_scratch_pop(parser, start);
+
+    return ast_push(parser->ast, AST_FUNCTION, name, return_type, extra);
 }
 
-static AST *parse_statement(Lexer *lexer)
+static ASTIndex parse_statement(Parser *parser)
 {
-    if (lexer_peek(lexer).type == TOKEN_WHILE) {
-        return parse_while_loop(lexer);
+    if (parser_peek(parser).type == TOKEN_WHILE) {
+        return parse_while_loop(parser);
     }
 
-    AST *lhs = parse_expr(lexer);
+    if (parser_peek(parser).type == TOKEN_FN) {
+        return parse_function(parser);
+    }
 
-    Token token = lexer_peek(lexer);
+    ASTIndex lhs = parse_expr(parser);
+
+    Token token = parser_peek(parser);
     switch (token.type) {
         case TOKEN_ASSIGN: {
-            AST *ast = ast_alloc();
+            const size_t oper = parser_token(parser);
+            parser_next(parser);
 
-            ast->type  = AST_INFIX;
-            ast->infix = (ASTInfix) {
-                .oper = lexer_next(lexer),
-                .lhs  = lhs,
-                .rhs  = parse_expr(lexer)
-            };
-            
-            return ast;
+            const ASTIndex rhs = parse_expr(parser);
+
+            return ast_push(parser->ast, AST_INFIX, oper, lhs, rhs);
         }
 
         case TOKEN_COLON: {
-            lexer_next(lexer);
-            if (lhs->type != AST_NODE || lhs->node.type != TOKEN_IDENT) {
+            parser_next(parser);
+            if (ast_type(parser->ast, lhs) != AST_NODE || ast_token_type(parser->ast, lhs) != TOKEN_IDENT) {
                 UNEXPECTED_TOKEN(token);
             }
 
-            AST *type = parse_expr(lexer);
+            const ASTIndex type = parse_expr(parser);
 
-            AST *ast = ast_alloc();
-
-            ast->type  = AST_DECLARATION;
-            ast->declaration = (ASTDeclaration) {
-                .name = lhs->node,
-                .type = type
+            // the value, then the binding
+            uint32_t declaration[] = {
+                AST_NULL,
+                AST_NULL
             };
 
-            Token token = lexer_peek(lexer);
+            Token token = parser_peek(parser);
             if (token.type == TOKEN_ASSIGN) {
-                lexer_next(lexer);
-                ast->declaration.value = parse_expr(lexer);
+                parser_next(parser);
+                declaration[0] = parse_expr(parser);
             }
-            
-            return ast;
+
+            const uint32_t extra = ast_push_extra(parser->ast, declaration, ARRAY_LEN(declaration));
+
+            // named by the identifier's token
+            return ast_push(parser->ast, AST_DECLARATION, parser->ast->tokens[lhs], type, extra);
         }
 
         default: {
@@ -328,59 +489,61 @@ static AST *parse_statement(Lexer *lexer)
     }
 }
 
-AST *parse_statements(Lexer *lexer)
+ASTIndex parse_statements(Parser *parser)
 {
-    AST *ast = ast_alloc();
-
-    ast->type = AST_BLOCK;
-    ast->block = (ASTBlock) {
-        .len = 0,
-        .cap = 256
-    };
+    const size_t index = parser_token(parser);
 
-    ast->block.statements = malloc(sizeof(*ast->block.statements) * ast->block.cap);
-
-    if (ast->block.statements == NULL) {
-        ALLOCATION_ERROR();
-    }
+    const size_t statements_start = parser->scratch_len;
 
     loop {
-        if (IS_END[lexer_peek(lexer).type]) {
+        if (IS_END[parser_peek(parser).type]) {
             break;
         }
 
-        AST *statement = parse_statement(lexer);
-
-        ast->block.statements[ast->block.len++] = statement;
-
-        if (ast->block.len >= ast->block.cap) {
-            while (ast->block.len >= ast->block.cap) {
-                ast->block.cap *= 2;
-            }
-            ast->block.statements = realloc(ast->block.statements, sizeof(*ast->block.statements) * ast->block.cap);
-
-            if (ast->block.statements == NULL) {
-                ALLOCATION_ERROR();
-            }
-        }
+        parser_scratch_push(parser, parse_statement(parser));
 
-        Token token = lexer_next(lexer);
+        Token token = parser_next(parser);
         if (token.type != TOKEN_SEMICOLON) {
             UNEXPECTED_TOKEN(token);
         }
     }
 
-    return ast;
+    const size_t statements_len = parser->scratch_len - statements_start;
+
+    const uint32_t statements = parser_scratch_pop(parser, statements_start);
+
+    return ast_push(parser->ast, AST_BLOCK, index, statements, statements_len);
 }
 
-AST *parse(Lexer *lexer)
+AST parse(const TokenBuffer *tokens, Arena *arena)
 {
-    AST *ast = parse_statements(lexer);
+    AST ast = ast_new(tokens);
 
-    Token token = lexer_peek(lexer);
+    Parser parser = {
+        .tokens = tokens,
+        .pos    = 0,
+        .ast    = &ast,
+
+        .scratch_len = 0,
+        .scratch_cap = 256
+    };
+
+    parser.scratch = malloc(sizeof(*parser.scratch) * parser.scratch_cap);
+
+    if (parser.scratch == NULL) {
+        ALLOCATION_ERROR();
+    }
+
+    ast.root = parse_statements(&parser);
+
+    Token token = parser_peek(&parser);
     if (token.type != TOKEN_EOF) {
         UNEXPECTED_TOKEN(token);
     }
 
+    free(parser.scratch);
+
+    ast_move_to_arena(&ast, arena);
+
     return ast;
 }
@@ -9,7 +9,8 @@ static const bool IS_PREFIX[TOKEN_TYPES] = {
     [TOKEN_OPER_SUB]  = true,
     [TOKEN_NOT]       = true,
     [TOKEN_REFERENCE] = true,
-    [TOKEN_DEREFERENCE] = true
+    [TOKEN_DEREFERENCE] = true,
+    [TOKEN_BECOME]      = true
 };
 
 static const bool IS_NODE[TOKEN_TYPES] = {
@@ -24,6 +25,20 @@ static const bool IS_END[TOKEN_TYPES] = {
     [TOKEN_RIGHT_CURLY] = true
 };
 
-AST *parse(Lexer *lexer);
+typedef struct Parser
+{
+    const TokenBuffer *tokens;
+    size_t pos;
+
+    AST *ast;
+
+    // children of the blocks and calls being parsed,
+    // moved into the AST once their count is known
+    size_t scratch_len;
+    size_t scratch_cap;
+    ASTIndex *scratch;
+} Parser;
+
+AST parse(const TokenBuffer *tokens, Arena *arena);
 
 #endif // PARSER_H_
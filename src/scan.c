@@ -0,0 +1,295 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "scan.h"
+#include "utils.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_AVX2
+#endif
+
+static inline bool is_ident(char ch)
+{
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_';
+}
+
+static inline bool is_whitespace(char ch)
+{
+    return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t';
+}
+
+#ifdef __SSE2__
+
+// each mask function returns a bit per byte that should stop the scan
+
+static inline uint32_t whitespace_mask_sse2(__m128i block)
+{
+    const __m128i whitespace = _mm_or_si128(
+        _mm_or_si128(
+            _mm_cmpeq_epi8(block, _mm_set1_epi8(' ')),
+            _mm_cmpeq_epi8(block, _mm_set1_epi8('\n'))
+        ),
+        _mm_or_si128(
+            _mm_cmpeq_epi8(block, _mm_set1_epi8('\r')),
+            _mm_cmpeq_epi8(block, _mm_set1_epi8('\t'))
+        )
+    );
+
+    return ~_mm_movemask_epi8(whitespace) & 0xffff;
+}
+
+static inline uint32_t ident_mask_sse2(__m128i block)
+{
+    // setting 0x20 folds upper case letters onto lower case ones,
+    // bytes >= 0x80 are negative and fail both signed range checks
+    const __m128i lower = _mm_or_si128(block, _mm_set1_epi8(0x20));
+
+    const __m128i letter = _mm_and_si128(
+        _mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+        _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1))
+    );
+    const __m128i digit = _mm_and_si128(
+        _mm_cmpgt_epi8(block, _mm_set1_epi8('0' - 1)),
+        _mm_cmplt_epi8(block, _mm_set1_epi8('9' + 1))
+    );
+    const __m128i underscore = _mm_cmpeq_epi8(block, _mm_set1_epi8('_'));
+
+    const __m128i ident = _mm_or_si128(_mm_or_si128(letter, digit), underscore);
+
+    return ~_mm_movemask_epi8(ident) & 0xffff;
+}
+
+static inline uint32_t line_mask_sse2(__m128i block)
+{
+    return _mm_movemask_epi8(_mm_or_si128(
+        _mm_cmpeq_epi8(block, _mm_set1_epi8('\n')),
+        _mm_cmpeq_epi8(block, _mm_setzero_si128())
+    ));
+}
+
+static inline uint32_t string_mask_sse2(__m128i block)
+{
+    return _mm_movemask_epi8(_mm_or_si128(
+        _mm_or_si128(
+            _mm_cmpeq_epi8(block, _mm_set1_epi8('"')),
+            _mm_cmpeq_epi8(block, _mm_set1_epi8('\\'))
+        ),
+        _mm_cmpeq_epi8(block, _mm_setzero_si128())
+    ));
+}
+
+static inline size_t scan_sse2(const char *text, size_t pos, uint32_t (*stop_mask)(__m128i))
+{
+    const char *start = text + pos;
+    const char *block = (const char *) ((uintptr_t) start & ~(uintptr_t) 15);
+
+    // ignore the bytes before `start` in the first block
+    uint32_t mask = stop_mask(_mm_load_si128((const __m128i *) block)) >> (start - block);
+
+    if (mask != 0) {
+        return pos + __builtin_ctz(mask);
+    }
+
+    loop {
+        block += 16;
+
+        mask = stop_mask(_mm_load_si128((const __m128i *) block));
+
+        if (mask != 0) {
+            return (size_t) (block - text) + __builtin_ctz(mask);
+        }
+    }
+}
+
+#endif // __SSE2__
+
+#ifdef SCAN_AVX2
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline uint32_t whitespace_mask_avx2(__m256i block)
+{
+    const __m256i whitespace = _mm256_or_si256(
+        _mm256_or_si256(
+            _mm256_cmpeq_epi8(block, _mm256_set1_epi8(' ')),
+            _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n'))
+        ),
+        _mm256_or_si256(
+            _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\r')),
+            _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\t'))
+        )
+    );
+
+    return ~(uint32_t) _mm256_movemask_epi8(whitespace);
+}
+
+AVX2 static inline uint32_t ident_mask_avx2(__m256i block)
+{
+    const __m256i lower = _mm256_or_si256(block, _mm256_set1_epi8(0x20));
+
+    const __m256i letter = _mm256_and_si256(
+        _mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower)
+    );
+    const __m256i digit = _mm256_and_si256(
+        _mm256_cmpgt_epi8(block, _mm256_set1_epi8('0' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), block)
+    );
+    const __m256i underscore = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('_'));
+
+    const __m256i ident = _mm256_or_si256(_mm256_or_si256(letter, digit), underscore);
+
+    return ~(uint32_t) _mm256_movemask_epi8(ident);
+}
+
+AVX2 static inline uint32_t line_mask_avx2(__m256i block)
+{
+    return _mm256_movemask_epi8(_mm256_or_si256(
+        _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n')),
+        _mm256_cmpeq_epi8(block, _mm256_setzero_si256())
+    ));
+}
+
+AVX2 static inline uint32_t string_mask_avx2(__m256i block)
+{
+    return _mm256_movemask_epi8(_mm256_or_si256(
+        _mm256_or_si256(
+            _mm256_cmpeq_epi8(block, _mm256_set1_epi8('"')),
+            _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\\'))
+        ),
+        _mm256_cmpeq_epi8(block, _mm256_setzero_si256())
+    ));
+}
+
+AVX2 static inline size_t scan_avx2(const char *text, size_t pos, uint32_t (*stop_mask)(__m256i))
+{
+    const char *start = text + pos;
+    const char *block = (const char *) ((uintptr_t) start & ~(uintptr_t) 31);
+
+    uint32_t mask = stop_mask(_mm256_load_si256((const __m256i *) block)) >> (start - block);
+
+    if (mask != 0) {
+        return pos + __builtin_ctz(mask);
+    }
+
+    loop {
+        block += 32;
+
+        mask = stop_mask(_mm256_load_si256((const __m256i *) block));
+
+        if (mask != 0) {
+            return (size_t) (block - text) + __builtin_ctz(mask);
+        }
+    }
+}
+
+AVX2 static size_t scan_whitespace_avx2(const char *text, size_t pos)
+{
+    return scan_avx2(text, pos, whitespace_mask_avx2);
+}
+
+AVX2 static size_t scan_ident_avx2(const char *text, size_t pos)
+{
+    return scan_avx2(text, pos, ident_mask_avx2);
+}
+
+AVX2 static size_t scan_line_avx2(const char *text, size_t pos)
+{
+    return scan_avx2(text, pos, line_mask_avx2);
+}
+
+AVX2 static size_t scan_string_avx2(const char *text, size_t pos)
+{
+    return scan_avx2(text, pos, string_mask_avx2);
+}
+
+static inline bool has_avx2(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif // SCAN_AVX2
+
+size_t scan_whitespace(const char *text, size_t pos)
+{
+    // most tokens are separated by a single space, if any
+    if (!is_whitespace(text[pos])) {
+        return pos;
+    }
+    if (!is_whitespace(text[pos + 1])) {
+        return pos + 1;
+    }
+
+#ifdef SCAN_AVX2
+    if (has_avx2()) {
+        return scan_whitespace_avx2(text, pos);
+    }
+#endif
+
+#ifdef __SSE2__
+    return scan_sse2(text, pos, whitespace_mask_sse2);
+#else
+    while (is_whitespace(text[pos])) {
+        ++pos;
+    }
+
+    return pos;
+#endif
+}
+
+size_t scan_ident(const char *text, size_t pos)
+{
+#ifdef SCAN_AVX2
+    if (has_avx2()) {
+        return scan_ident_avx2(text, pos);
+    }
+#endif
+
+#ifdef __SSE2__
+    return scan_sse2(text, pos, ident_mask_sse2);
+#else
+    while (is_ident(text[pos])) {
+        ++pos;
+    }
+
+    return pos;
+#endif
+}
+
+size_t scan_line(const char *text, size_t pos)
+{
+#ifdef SCAN_AVX2
+    if (has_avx2()) {
+        return scan_line_avx2(text, pos);
+    }
+#endif
+
+#ifdef __SSE2__
+    return scan_sse2(text, pos, line_mask_sse2);
+#else
+    while (text[pos] != '\n' && text[pos] != '\0') {
+        ++pos;
+    }
+
+    return pos;
+#endif
+}
+
+size_t scan_string(const char *text, size_t pos)
+{
+#ifdef SCAN_AVX2
+    if (has_avx2()) {
+        return scan_string_avx2(text, pos);
+    }
+#endif
+
+#ifdef __SSE2__
+    return scan_sse2(text, pos, string_mask_sse2);
+#else
+    while (text[pos] != '"' && text[pos] != '\\' && text[pos] != '\0') {
+        ++pos;
+    }
+
+    return pos;
+#endif
+}
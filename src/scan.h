@@ -0,0 +1,25 @@
+#ifndef SCAN_H_
+#define SCAN_H_
+
+#include <stddef.h>
+
+// Byte scanning kernels for the lexer. Each one takes a NUL terminated
+// text and a starting position, and returns the position of the first
+// byte that ends the scan (the NUL always does).
+//
+// They load whole aligned 16 or 32 byte blocks, which never cross a page
+// boundary, so they are allowed to read past the terminator.
+
+// first byte that isn't ' ', '\n', '\r' or '\t'
+size_t scan_whitespace(const char *text, size_t pos);
+
+// first byte that isn't [a-zA-Z0-9_]
+size_t scan_ident(const char *text, size_t pos);
+
+// first '\n' (end of a line comment)
+size_t scan_line(const char *text, size_t pos);
+
+// first '"' or '\\' (inside a string literal)
+size_t scan_string(const char *text, size_t pos);
+
+#endif // SCAN_H_
@@ -8,62 +8,41 @@
 #include "types.h"
 #include "utils.h"
 
-uint32_t variable_id_hash(const void *_key)
+static bool ast_is_lvalue(const AST *ast, ASTIndex node)
 {
-    const VariableID *key = _key;
-
-    return key->scope_id ^ hash_string(key->name, key->name_len);
-}
-
-bool variable_id_equals(const void *_lhs, const void *_rhs)
-{
-    const VariableID *lhs = _lhs;
-    const VariableID *rhs = _rhs;
-
-    return lhs->scope_id == rhs->scope_id
-        && lhs->name_len == rhs->name_len
-        && strncmp(lhs->name, rhs->name, lhs->name_len) == 0;
+    return (ast_type(ast, node) == AST_PREFIX && ast_token_type(ast, node) == TOKEN_DEREFERENCE)
+        || (ast_type(ast, node) == AST_INFIX && ast_token_type(ast, node) == TOKEN_LEFT_SQUARE)
+        || (ast_type(ast, node) == AST_NODE && ast_token_type(ast, node) == TOKEN_IDENT);
 }
 
-static bool ast_is_lvalue(AST *ast)
+static void infer_type(TypeTable *types, AST *ast, ASTIndex node, const DataType *type)
 {
-    return (ast->type == AST_PREFIX && ast->prefix.oper.type == TOKEN_DEREFERENCE)
-        || (ast->type == AST_NODE && ast->node.type == TOKEN_IDENT);
-}
-
-static void infer_type(AST *ast, DataType *type, bool type_owned)
-{
-    if (ast->data_type->type != TYPE_NULL) {
-        if (type->type != TYPE_NULL && !data_type_equals(type, ast->data_type)) {
+    if (ast->data_types[node]->type != TYPE_NULL) {
+        if (type->type != TYPE_NULL && !data_type_equals(type, ast->data_types[node])) {
             ERROR("Data types are not the same.");
         }
-
-        if (type_owned) {
-            data_type_free(type);
-        }
         return;
     }
-    data_type_free(ast->data_type);
 
-    switch (ast->type) {
+    switch (ast_type(ast, node)) {
         case AST_NODE: {
             break;
         }
 
         case AST_PREFIX: {
-            switch (ast->prefix.oper.type) {
+            switch (ast_token_type(ast, node)) {
                 case TOKEN_REFERENCE: {
-                    infer_type(ast->prefix.node, type->dereference, false);
+                    infer_type(types, ast, ast_prefix_node(ast, node), type->dereference);
                     break;
                 }
 
                 case TOKEN_DEREFERENCE: {
-                    infer_type(ast->prefix.node, data_type_reference(data_type_copy(type)), true);
+                    infer_type(types, ast, ast_prefix_node(ast, node), data_type_reference(types, type));
                     break;
                 }
 
                 default: {
-                    infer_type(ast->prefix.node, type, false);
+                    infer_type(types, ast, ast_prefix_node(ast, node), type);
                     break;
                 }
             }
@@ -71,22 +50,23 @@ static void infer_type(AST *ast, DataType *type, bool type_owned)
         }
 
         case AST_INFIX: {
-            infer_type(ast->infix.lhs, type, false);
-            infer_type(ast->infix.rhs, type, false);
+            infer_type(types, ast, ast_infix_lhs(ast, node), type);
+            infer_type(types, ast, ast_infix_rhs(ast, node), type);
             break;
         }
 
         case AST_BLOCK: {
-            if (ast->block.len > 0) {
-                infer_type(ast->block.statements[ast->block.len - 1], type, false);
+            const size_t len = ast_block_len(ast, node);
+            if (len > 0) {
+                infer_type(types, ast, ast_block_statement(ast, node, len - 1), type);
             }
             break;
         }
 
         case AST_IF_STATEMENT: {
-            infer_type(ast->if_statement.if_branch, type, false);
-            if (ast->if_statement.else_branch != NULL) {
-                infer_type(ast->if_statement.else_branch, type, false);
+            infer_type(types, ast, ast_if_branch(ast, node), type);
+            if (ast_else_branch(ast, node) != AST_NULL) {
+                infer_type(types, ast, ast_else_branch(ast, node), type);
             }
             break;
         }
@@ -97,31 +77,154 @@ static void infer_type(AST *ast, DataType *type, bool type_owned)
     }
 
     if (type->type != TYPE_NULL) {
-        ast->data_type = type_owned ? type : data_type_copy(type);
+        ast->data_types[node] = type;
+        return;
+    }
+
+    ast->data_types[node] = data_type_type(TYPE_INT32);
+}
+
+// an array is only ever indexed, or has its address taken
+static void check_not_array(const DataType *data_type)
+{
+    if (data_type->type == TYPE_ARRAY) {
+        ERROR("You can only index an array, not use all of it.");
+    }
+}
+
+// A `become` has to be what the function returns: the body itself, the
+// last statement of a block that is, or either branch of an if that is.
+// That's the same whatever ends up inlined, so it's checked here rather
+// than on the calls that are left once the function is compiled.
+static void check_tail_position(const AST *ast, ASTIndex node, bool tail)
+{
+    if (node == AST_NULL) {
         return;
     }
 
-    if (type_owned) {
-        data_type_free(type);
+    switch (ast_type(ast, node)) {
+        case AST_NODE: {
+            break;
+        }
+
+        case AST_INFIX: {
+            check_tail_position(ast, ast_infix_lhs(ast, node), false);
+            check_tail_position(ast, ast_infix_rhs(ast, node), false);
+            break;
+        }
+
+        case AST_PREFIX: {
+            const ASTIndex operand = ast_prefix_node(ast, node);
+
+            if (ast_token_type(ast, node) == TOKEN_BECOME && !tail) {
+                const Token name = ast_token(ast, ast_function_call_lhs(ast, operand));
+                ERROR("Can't become `%.*s`, it isn't what the function returns.", (int) name.len, name.text);
+            }
+
+            check_tail_position(ast, operand, false);
+            break;
+        }
+
+        case AST_BLOCK: {
+            const size_t len = ast_block_len(ast, node);
+
+            for (size_t i = 0; i < len; ++i) {
+                check_tail_position(ast, ast_block_statement(ast, node, i), tail && i == len - 1);
+            }
+            break;
+        }
+
+        case AST_IF_STATEMENT: {
+            check_tail_position(ast, ast_if_condition(ast, node), false);
+            check_tail_position(ast, ast_if_branch(ast, node), tail);
+            check_tail_position(ast, ast_else_branch(ast, node), tail);
+            break;
+        }
+
+        case AST_WHILE_LOOP: {
+            check_tail_position(ast, ast_while_condition(ast, node), false);
+            check_tail_position(ast, ast_while_body(ast, node), false);
+            break;
+        }
+
+        case AST_FUNCTION_CALL: {
+            check_tail_position(ast, ast_function_call_lhs(ast, node), false);
+
+            for (size_t i = 0; i < ast_function_call_len(ast, node); ++i) {
+                check_tail_position(ast, ast_function_call_argument(ast, node, i), false);
+            }
+            break;
+        }
+
+        case AST_DECLARATION: {
+            check_tail_position(ast, ast_declaration_value(ast, node), false);
+            break;
+        }
+
+        case AST_FUNCTION: {
+            break;
+        }
+    }
+}
+
+// `array[index]`, where a constant index has to be in bounds
+static void symbol_table_scan_index(SymbolTable *table, AST *ast, ASTIndex node)
+{
+    TypeTable *types = table->types;
+
+    const DataType **data_types = ast->data_types;
+
+    const ASTIndex array = ast_infix_lhs(ast, node);
+    const ASTIndex index = ast_infix_rhs(ast, node);
+
+    symbol_table_scan(table, ast, array);
+    symbol_table_scan(table, ast, index);
+    infer_type(types, ast, array, data_type_type(TYPE_NULL));
+    infer_type(types, ast, index, data_type_type(TYPE_NULL));
+
+    if (data_types[array]->type != TYPE_ARRAY) {
+        ERROR("You can only index an array.");
+    }
+
+    if (!data_type_is_integer(data_types[index])) {
+        ERROR("An array index has to be an integer.");
     }
 
-    ast->data_type = data_type_type(TYPE_INT32);
+    if (ast_type(ast, index) == AST_NODE && ast_token_type(ast, index) == TOKEN_NUMBER) {
+        const Token token = ast_token(ast, index);
+
+        size_t value = 0;
+
+        for (size_t i = 0; i < token.len && value < data_types[array]->array.len; ++i) {
+            value = value * 10 + (size_t) (token.text[i] - '0');
+        }
+
+        if (value >= data_types[array]->array.len) {
+            ERROR("Array index is out of bounds.");
+        }
+    }
+
+    data_types[node] = data_types[array]->array.element;
 }
 
-void symbol_table_scan(SymbolTable *table, AST *ast)
+void symbol_table_scan(SymbolTable *table, AST *ast, ASTIndex node)
 {
-    switch (ast->type) {
+    TypeTable *types = table->types;
+
+    const DataType **data_types = ast->data_types;
+
+    switch (ast_type(ast, node)) {
         case AST_NODE: {
-            switch (ast->node.type) {
+            switch (ast_token_type(ast, node)) {
                 case TOKEN_IDENT: {
-                    Variable variable = symbol_table_variable(table, ast->node.len, ast->node.text);
-                    infer_type(ast, variable.data_type, false);
+                    Variable variable = symbol_table_variable(table, ast_token(ast, node).symbol);
+                    ast_set_binding(ast, node, variable.binding);
+                    infer_type(types, ast, node, variable.data_type);
                     break;
                 }
 
                 case TOKEN_STRING: {
-                    data_type_free(ast->data_type);
-                    ast->data_type = data_type_reference(data_type_type(TYPE_INT8));
+                    data_types[node] = data_type_reference(types, data_type_type(TYPE_INT8));
                     break;
                 }
 
@@ -137,31 +240,49 @@ void symbol_table_scan(SymbolTable *table, AST *ast)
         }
 
         case AST_PREFIX: {
-            symbol_table_scan(table, ast->prefix.node);
-            infer_type(ast->prefix.node, data_type_type(TYPE_NULL), true);
+            const ASTIndex operand = ast_prefix_node(ast, node);
+
+            symbol_table_scan(table, ast, operand);
+            infer_type(types, ast, operand, data_type_type(TYPE_NULL));
 
-            data_type_free(ast->data_type);
-            switch (ast->node.type) {
+            switch (ast_token_type(ast, node)) {
                 case TOKEN_REFERENCE: {
-                    if (!ast_is_lvalue(ast->prefix.node)) {
+                    if (!ast_is_lvalue(ast, operand)) {
                         ERROR("You can only reference an lvalue.");
                     }
 
-                    ast->data_type = data_type_reference(data_type_copy(ast->prefix.node->data_type));
+                    data_types[node] = data_type_reference(types, data_types[operand]);
                     break;
                 }
 
                 case TOKEN_DEREFERENCE: {
-                    if (ast->prefix.node->data_type->type != TYPE_REFERENCE) {
+                    if (data_types[operand]->type != TYPE_REFERENCE) {
                         ERROR("You can only dereference a reference.");
                     }
 
-                    ast->data_type = data_type_copy(ast->prefix.node->data_type->dereference);
+                    data_types[node] = data_types[operand]->dereference;
+                    break;
+                }
+
+                // whether it's in tail position is checked with the rest of the
+                // function, whether it can really be a tail call only once it's compiled
+                case TOKEN_BECOME: {
+                    if (ast_type(ast, operand) != AST_FUNCTION_CALL) {
+                        ERROR("You can only become a function call.");
+                    }
+
+                    if (table->function == AST_NULL) {
+                        ERROR("You can only use `become` in a function.");
+                    }
+
+                    data_types[node] = data_types[operand];
                     break;
                 }
 
                 default: {
-                    ast->data_type = data_type_copy(ast->prefix.node->data_type);
+                    check_not_array(data_types[operand]);
+
+                    data_types[node] = data_types[operand];
                     break;
                 }
             }
@@ -169,108 +290,253 @@ void symbol_table_scan(SymbolTable *table, AST *ast)
         }
 
         case AST_INFIX: {
-            symbol_table_scan(table, ast->infix.lhs);
-            symbol_table_scan(table, ast->infix.rhs);
-            infer_type(ast->infix.lhs, ast->infix.rhs->data_type, false);
-            infer_type(ast->infix.rhs, ast->infix.lhs->data_type, false);
+            const ASTIndex lhs = ast_infix_lhs(ast, node);
+            const ASTIndex rhs = ast_infix_rhs(ast, node);
+
+            if (ast_token_type(ast, node) == TOKEN_LEFT_SQUARE) {
+                symbol_table_scan_index(table, ast, node);
+                break;
+            }
+
+            symbol_table_scan(table, ast, lhs);
+            symbol_table_scan(table, ast, rhs);
+            infer_type(types, ast, lhs, data_types[rhs]);
+            infer_type(types, ast, rhs, data_types[lhs]);
 
-            data_type_free(ast->data_type);
-            ast->data_type = data_type_copy(ast->infix.lhs->data_type);
+            check_not_array(data_types[lhs]);
+            check_not_array(data_types[rhs]);
+
+            if (ast_token_type(ast, node) == TOKEN_ASSIGN && !ast_is_lvalue(ast, lhs)) {
+                ERROR("You can only assign to an lvalue.");
+            }
+
+            data_types[node] = data_types[lhs];
             break;
         }
 
         case AST_BLOCK: {
+            const size_t len = ast_block_len(ast, node);
+
             symbol_table_begin_scope(table);
-            for (size_t i = 0; i < ast->block.len; ++i) {
-                symbol_table_scan(table, ast->block.statements[i]);
-                infer_type(ast->block.statements[i], data_type_type(TYPE_NULL), true);
+            for (size_t i = 0; i < len; ++i) {
+                const ASTIndex statement = ast_block_statement(ast, node, i);
+                symbol_table_scan(table, ast, statement);
+                infer_type(types, ast, statement, data_type_type(TYPE_NULL));
+                check_not_array(data_types[statement]);
             }
             symbol_table_end_scope(table);
 
-            data_type_free(ast->data_type);
-            if (ast->block.len > 0) {
-                ast->data_type = data_type_copy(ast->block.statements[ast->block.len - 1]->data_type);
+            if (len > 0) {
+                data_types[node] = data_types[ast_block_statement(ast, node, len - 1)];
             } else {
-                ast->data_type = data_type_type(TYPE_VOID);
+                data_types[node] = data_type_type(TYPE_VOID);
             }
             break;
         }
 
         case AST_IF_STATEMENT: {
-            symbol_table_scan(table, ast->if_statement.condition);
+            const ASTIndex condition   = ast_if_condition(ast, node);
+            const ASTIndex if_branch   = ast_if_branch(ast, node);
+            const ASTIndex else_branch = ast_else_branch(ast, node);
+
+            symbol_table_scan(table, ast, condition);
 
-            symbol_table_scan(table, ast->if_statement.if_branch);
+            symbol_table_scan(table, ast, if_branch);
 
-            infer_type(ast->if_statement.condition, data_type_type(TYPE_NULL), true);
+            infer_type(types, ast, condition, data_type_type(TYPE_NULL));
+            check_not_array(data_types[condition]);
 
-            if (ast->if_statement.else_branch != NULL) {
-                symbol_table_scan(table, ast->if_statement.else_branch);
-                infer_type(ast->if_statement.else_branch, ast->if_statement.if_branch->data_type, false);
+            if (else_branch != AST_NULL) {
+                symbol_table_scan(table, ast, else_branch);
+                infer_type(types, ast, else_branch, data_types[if_branch]);
             }
 
-            data_type_free(ast->data_type);
-            ast->data_type = data_type_copy(ast->if_statement.if_branch->data_type);
+            data_types[node] = data_types[if_branch];
             break;
         }
 
         case AST_WHILE_LOOP: {
-            symbol_table_scan(table, ast->while_loop.condition);
-            symbol_table_scan(table, ast->while_loop.body);
-            infer_type(ast->while_loop.condition, data_type_type(TYPE_NULL), true);
-            infer_type(ast->while_loop.body, data_type_type(TYPE_NULL), true);
+            const ASTIndex condition = ast_while_condition(ast, node);
+            const ASTIndex body      = ast_while_body(ast, node);
+
+            symbol_table_scan(table, ast, condition);
+            symbol_table_scan(table, ast, body);
+            infer_type(types, ast, condition, data_type_type(TYPE_NULL));
+            infer_type(types, ast, body, data_type_type(TYPE_NULL));
+            check_not_array(data_types[condition]);
             break;
         }
 
         case AST_FUNCTION_CALL: {
-            symbol_table_scan(table, ast->function_call.lhs);
-            infer_type(ast->function_call.lhs, data_type_type(TYPE_NULL), true);
+            const ASTIndex function = ast_function_call_lhs(ast, node);
+            const size_t len = ast_function_call_len(ast, node);
 
-            if (ast->function_call.lhs->data_type->type != TYPE_FUNCTION) {
+            symbol_table_scan(table, ast, function);
+            infer_type(types, ast, function, data_type_type(TYPE_NULL));
+
+            const DataType *function_type = data_types[function];
+
+            if (function_type->type != TYPE_FUNCTION) {
                 ERROR("You can only call a function.");
             }
 
-            if (ast->function_call.lhs->data_type->function.len != ast->function_call.len) {
+            if (function_type->function.len != len) {
                 ERROR("Wrong number of function arguments provided.");
             }
 
-            for (size_t i = 0; i < ast->function_call.len; ++i) {
-                symbol_table_scan(table, ast->function_call.arguments[i]);
-                infer_type(ast->function_call.arguments[i], ast->function_call.lhs->data_type->function.arguments[i], false);
+            for (size_t i = 0; i < len; ++i) {
+                const ASTIndex argument = ast_function_call_argument(ast, node, i);
+                symbol_table_scan(table, ast, argument);
+                infer_type(types, ast, argument, function_type->function.arguments[i]);
+                check_not_array(data_types[argument]);
             }
 
-            data_type_free(ast->data_type);
-            ast->data_type = data_type_copy(ast->function_call.lhs->data_type->function.return_type);
+            data_types[node] = function_type->function.return_type;
             break;
         }
 
         case AST_DECLARATION: {
-            Variable variable = {
-                .data_type = data_type_new(ast->declaration.type)
-            };
+            const ASTIndex type  = ast_declaration_type(ast, node);
+            const ASTIndex value = ast_declaration_value(ast, node);
+
+            // the type expression is typed as the type it names
+            data_types[type] = data_type_new(types, ast, type);
 
-            symbol_table_add_variable(table, ast->declaration.name.len, ast->declaration.name.text, variable);
+            Variable variable = symbol_table_add_variable(table, ast_token(ast, node).symbol, data_types[type]);
+            ast_set_binding(ast, node, variable.binding);
 
-            if (ast->declaration.value != NULL) {
-                symbol_table_scan(table, ast->declaration.value);
-                infer_type(ast->declaration.value, variable.data_type, false);
+            if (value != AST_NULL && variable.data_type->type == TYPE_ARRAY) {
+                ERROR("Arrays start out zeroed, they can't be initialized.");
             }
 
-            data_type_free(ast->data_type);
-            ast->data_type = data_type_type(TYPE_VOID);
+            if (value != AST_NULL) {
+                symbol_table_scan(table, ast, value);
+                infer_type(types, ast, value, variable.data_type);
+                check_not_array(data_types[value]);
+            }
+
+            data_types[node] = data_type_type(TYPE_VOID);
             break;
         }
+
+        case AST_FUNCTION: {
+            const ASTIndex body = ast_function_body(ast, node);
+            const ASTIndex return_type = ast_function_return_type(ast, node);
+
+            // symbol_table_declare_functions only sees the top of the program
+            if (ast_binding(ast, node) == AST_NULL) {
+                ERROR("Functions can only be defined at the top of the program.");
+            }
+
+            const size_t scopes_base = table->scopes_base;
+            table->scopes_base = table->scopes_len;
+            table->function = node;
+
+            symbol_table_begin_scope(table);
+
+            for (size_t i = 0; i < ast_function_len(ast, node); ++i) {
+                const ASTIndex parameter = ast_function_parameter(ast, node, i);
+
+                symbol_table_scan(table, ast, parameter);
+
+                if (data_types[ast_declaration_type(ast, parameter)]->type == TYPE_ARRAY) {
+                    ERROR("Functions can't take arrays.");
+                }
+            }
+
+            symbol_table_scan(table, ast, body);
+
+            if (return_type != AST_NULL && data_types[return_type]->type != TYPE_VOID) {
+                infer_type(types, ast, body, data_types[return_type]);
+            } else {
+                infer_type(types, ast, body, data_type_type(TYPE_NULL));
+            }
+
+            check_not_array(data_types[body]);
+            check_tail_position(ast, body, true);
+
+            symbol_table_end_scope(table);
+
+            table->scopes_base = scopes_base;
+            table->function = AST_NULL;
+
+            data_types[node] = data_type_type(TYPE_VOID);
+            break;
+        }
+    }
+}
+
+void symbol_table_declare_functions(SymbolTable *table, AST *ast, ASTIndex node)
+{
+    TypeTable *types = table->types;
+
+    for (size_t i = 0; i < ast_block_len(ast, node); ++i) {
+        const ASTIndex function = ast_block_statement(ast, node, i);
+
+        if (ast_type(ast, function) != AST_FUNCTION) {
+            continue;
+        }
+
+        const size_t len = ast_function_len(ast, function);
+        const DataType **arguments = malloc(sizeof(*arguments) * (len + 1));
+
+        if (arguments == NULL) {
+            ALLOCATION_ERROR();
+        }
+
+        // the type expressions are typed as the types they name
+        for (size_t j = 0; j < len; ++j) {
+            const ASTIndex type = ast_declaration_type(ast, ast_function_parameter(ast, function, j));
+
+            ast->data_types[type] = data_type_new(types, ast, type);
+            arguments[j] = ast->data_types[type];
+        }
+
+        const ASTIndex return_type = ast_function_return_type(ast, function);
+        const DataType *returns = data_type_type(TYPE_VOID);
+
+        if (return_type != AST_NULL) {
+            ast->data_types[return_type] = data_type_new(types, ast, return_type);
+            returns = ast->data_types[return_type];
+        }
+
+        if (returns->type == TYPE_ARRAY) {
+            ERROR("Functions can't return arrays.");
+        }
+
+        const Symbol symbol = ast_token(ast, function).symbol;
+
+        const VariableID id = {
+            .scope_id = table->scopes[table->scopes_len - 1],
+            .symbol   = symbol
+        };
+
+        if (variable_map_get(&table->symbols, &id) != NULL) {
+            const InternName name = intern_name(table->interns, symbol);
+            ERROR("`%.*s` is already defined.", (int) name.len, name.text);
+        }
+
+        const Variable variable = symbol_table_add_variable(
+            table,
+            symbol,
+            data_type_function(types, len, arguments, returns)
+        );
+
+        ast_set_binding(ast, function, variable.binding);
+
+        free(arguments);
     }
 }
 
-SymbolTable symbol_table_new(void)
+SymbolTable symbol_table_new(TypeTable *types, const InternTable *interns)
 {
     SymbolTable table = {
-        .symbols = hashmap_new(
-            variable_id_hash,
-            variable_id_equals,
-            sizeof(VariableID),
-            sizeof(Variable)
-        ),
+        .types = types,
+        .interns = interns,
+        .symbols = variable_map_new(),
+        .bindings_len = 0,
+        .scopes_base  = 0,
+        .function     = AST_NULL,
         .scopes_len   = 1,
         .scopes_cap   = 16
     };
@@ -286,47 +552,31 @@ SymbolTable symbol_table_new(void)
     return table;
 }
 
-Variable symbol_table_variable(SymbolTable *table, size_t name_len, const char *name)
+Variable symbol_table_variable(SymbolTable *table, Symbol symbol)
 {
     for (size_t i = 0; i < table->scopes_len; ++i) {
-        const size_t index = table->scopes_len - i - 1;
-
-        const VariableID id = {
-            .scope_id = table->scopes[index],
-            .name_len = name_len,
-            .name     = (char *) name
-        };
-
-        Variable *variable = hashmap_get(&table->symbols, &id);
+        size_t index = table->scopes_len - i - 1;
 
-        if (variable != NULL) {
-            return *variable;
+        // from a function's own scopes straight to the first one
+        if (index < table->scopes_base) {
+            index = 0;
+            i = table->scopes_len;
         }
-    }
-
-    ERROR("Variable `%.*s` was not defined.", (int) name_len, name);
-}
-
-VariableID symbol_table_variable_id(SymbolTable *table, size_t name_len, const char *name)
-{
-    // check every variable scope starting from the current scope
-    for (size_t i = 0; i < table->scopes_len; ++i) {
-        const size_t index = table->scopes_len - i - 1;
 
         const VariableID id = {
             .scope_id = table->scopes[index],
-            .name_len = name_len,
-            .name     = (char *) name
+            .symbol   = symbol
         };
 
-        Variable *variable = hashmap_get(&table->symbols, &id);
+        Variable *variable = variable_map_get(&table->symbols, &id);
 
         if (variable != NULL) {
-            return id;
+            return *variable;
         }
     }
 
-    ERROR("Variable `%.*s` was not defined.", (int) name_len, name);
+    const InternName name = intern_name(table->interns, symbol);
+    ERROR("Variable `%.*s` was not defined.", (int) name.len, name.text);
 }
 
 void symbol_table_begin_scope(SymbolTable *table)
@@ -347,15 +597,22 @@ void symbol_table_begin_scope(SymbolTable *table)
     table->scopes[table->scopes_len++] = ++table->scope_id;
 }
 
-void symbol_table_add_variable(SymbolTable *table, size_t name_len, const char *name, Variable variable)
+Variable symbol_table_add_variable(SymbolTable *table, Symbol symbol, const DataType *data_type)
 {
+    // the innermost open scope, not the last one opened
     VariableID variable_id = {
-        .scope_id = table->scope_id,
-        .name_len = name_len,
-        .name     = (char *) name
+        .scope_id = table->scopes[table->scopes_len - 1],
+        .symbol   = symbol
+    };
+
+    Variable variable = {
+        .data_type = data_type,
+        .binding   = table->bindings_len++
     };
 
-    hashmap_insert(&table->symbols, &variable_id, &variable);
+    variable_map_insert(&table->symbols, &variable_id, &variable);
+
+    return variable;
 }
 
 void symbol_table_end_scope(SymbolTable *table)
@@ -369,15 +626,7 @@ void symbol_table_end_scope(SymbolTable *table)
 
 void symbol_table_free(SymbolTable *table)
 {
-    for (size_t i = 0; i < HASHMAP_SIZE; ++i) {
-        HashMapEntry *bucket = table->symbols.buckets[i];
-        while (bucket != NULL) {
-            data_type_free(((Variable *) bucket->value)->data_type);
-            bucket = bucket->next;
-        }
-    }
-
-    hashmap_free(&table->symbols);
+    variable_map_free(&table->symbols);
 
     free(table->scopes);
 }
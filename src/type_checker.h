@@ -2,6 +2,7 @@
 #define VARIABLE_H_
 
 #include <stddef.h>
+#include "intern.h"
 #include "parser.h"
 #include "hashmap.h"
 #include "types.h"
@@ -9,39 +10,73 @@
 typedef struct VariableID
 {
     size_t scope_id;
-
-    size_t name_len;
-    char *name;
+    Symbol symbol;
 } VariableID;
 
 typedef struct Variable
 {
-    DataType *data_type;
+    const DataType *data_type;
+
+    // every declaration gets its own index, in order
+    size_t binding;
 } Variable;
 
+static inline uint32_t variable_id_hash(const VariableID *id)
+{
+    return hash_integer(((uint64_t) id->scope_id << 32) ^ id->symbol);
+}
+
+static inline bool variable_id_equals(const VariableID *lhs, const VariableID *rhs)
+{
+    return lhs->scope_id == rhs->scope_id && lhs->symbol == rhs->symbol;
+}
+
+#define HASHMAP_NAME   VariableMap
+#define HASHMAP_PREFIX variable_map
+#define HASHMAP_KEY    VariableID
+#define HASHMAP_VALUE  Variable
+#define HASHMAP_HASH   variable_id_hash
+#define HASHMAP_EQUALS variable_id_equals
+#include "hashmap_template.h"
+
 typedef struct SymbolTable
 {
-    HashMap symbols;
+    TypeTable *types;
+
+    // only needed to name variables in errors
+    const InternTable *interns;
+
+    VariableMap symbols;
 
     size_t scope_id;
 
+    size_t bindings_len;
+
+    // the outermost of the scopes that a name is looked up in, besides
+    // the first one, so a function only sees its own and the functions
+    size_t scopes_base;
+
+    // the function that's being scanned, AST_NULL for the program
+    ASTIndex function;
+
     size_t scopes_len;
     size_t scopes_cap;
     size_t *scopes;
 } SymbolTable;
 
-uint32_t variable_id_hash(const void *_key);
-bool variable_id_equals(const void *_lhs, const void *_rhs);
+SymbolTable symbol_table_new(TypeTable *types, const InternTable *interns);
 
-SymbolTable symbol_table_new(void);
+// Adds every function defined in the block, which is the whole
+// program, before anything is scanned, so that they can be called
+// from anywhere, even before they're defined or from themselves.
+void symbol_table_declare_functions(SymbolTable *table, AST *ast, ASTIndex node);
 
-void symbol_table_scan(SymbolTable *table, AST *ast);
+void symbol_table_scan(SymbolTable *table, AST *ast, ASTIndex node);
 
-Variable symbol_table_variable(SymbolTable *table, size_t name_len, const char *name);
-VariableID symbol_table_variable_id(SymbolTable *table, size_t name_len, const char *name);
+Variable symbol_table_variable(SymbolTable *table, Symbol symbol);
 
 void symbol_table_begin_scope(SymbolTable *table);
-void symbol_table_add_variable(SymbolTable *table, size_t name_len, const char *name, Variable variable);
+Variable symbol_table_add_variable(SymbolTable *table, Symbol symbol, const DataType *data_type);
 void symbol_table_end_scope(SymbolTable *table);
 
 void symbol_table_free(SymbolTable *table);
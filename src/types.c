@@ -3,160 +3,289 @@
 #include "utils.h"
 #include "ast.h"
 
-DataType *data_type_type(DataTypeType type)
+static const DataType PRIMITIVE_TYPES[DATA_TYPES] = {
+    [TYPE_NULL]  = { .type = TYPE_NULL },
+    [TYPE_VOID]  = { .type = TYPE_VOID },
+    [TYPE_INT8]  = { .type = TYPE_INT8 },
+    [TYPE_INT16] = { .type = TYPE_INT16 },
+    [TYPE_INT32] = { .type = TYPE_INT32 },
+    [TYPE_INT64] = { .type = TYPE_INT64 }
+};
+
+uint32_t data_type_hash(const DataType *const *_type)
 {
-    DataType *data_type = malloc(sizeof(DataType));
+    const DataType *type = *_type;
 
-    if (data_type == NULL) {
-        ALLOCATION_ERROR();
-    }
+    // the components are already interned, so their addresses identify them
+    switch (type->type) {
+        case TYPE_REFERENCE: {
+            return hash_integer(((uint64_t) TYPE_REFERENCE << 56) ^ (uintptr_t) type->dereference);
+        }
 
-    data_type->type = type;
+        case TYPE_ARRAY: {
+            const uint32_t hash = hash_integer(((uint64_t) TYPE_ARRAY << 56) ^ (uintptr_t) type->array.element);
+            return hash_integer(((uint64_t) hash << 32) ^ type->array.len);
+        }
 
-    return data_type;
+        case TYPE_FUNCTION: {
+            uint32_t hash = hash_integer((uintptr_t) type->function.return_type);
+            for (size_t i = 0; i < type->function.len; ++i) {
+                hash = hash_integer(((uint64_t) hash << 32) ^ (uintptr_t) type->function.arguments[i]);
+            }
+            return hash;
+        }
+
+        default: {
+            return hash_integer(type->type);
+        }
+    }
 }
 
-DataType *data_type_reference(DataType *dereference)
+bool data_type_shallow_equals(const DataType *const *_lhs, const DataType *const *_rhs)
 {
-    DataType *data_type = data_type_type(TYPE_REFERENCE);
+    const DataType *lhs = *_lhs;
+    const DataType *rhs = *_rhs;
+
+    if (lhs->type != rhs->type) {
+        return false;
+    }
+
+    switch (lhs->type) {
+        case TYPE_REFERENCE: {
+            return lhs->dereference == rhs->dereference;
+        }
+
+        case TYPE_ARRAY: {
+            return lhs->array.element == rhs->array.element && lhs->array.len == rhs->array.len;
+        }
 
-    data_type->dereference = dereference;
-    
-    return data_type;
+        case TYPE_FUNCTION: {
+            return lhs->function.return_type == rhs->function.return_type
+                && lhs->function.len == rhs->function.len
+                && memcmp(
+                    lhs->function.arguments,
+                    rhs->function.arguments,
+                    sizeof(*lhs->function.arguments) * lhs->function.len
+                ) == 0;
+        }
+
+        default: {
+            return true;
+        }
+    }
 }
 
-DataType *data_type_function(size_t arguments_len, size_t arguments_cap, DataType **arguments, DataType *return_type)
+TypeTable type_table_new(Arena *arena)
 {
-    DataType *data_type = data_type_type(TYPE_FUNCTION);
+    TypeTable types = {
+        .arena = arena,
+        .types = data_type_map_new()
+    };
 
-    data_type->function.len = arguments_len;
-    data_type->function.cap = arguments_cap;
-    data_type->function.arguments = arguments;
-    data_type->function.return_type = return_type;
+    return types;
+}
 
-    return data_type;
+void type_table_free(TypeTable *types)
+{
+    data_type_map_free(&types->types);
 }
 
-DataType *data_type_new(const AST *ast)
+// returns the interned copy of `type`, interning it if it's new
+static const DataType *type_table_intern(TypeTable *types, const DataType *type)
 {
-    switch (ast->type) {
-        case AST_NODE: {
-            if (ast->node.type == TOKEN_IDENT) {
-                if (strncmp(ast->node.text, "s8", ast->node.len) == 0) {
-                    return data_type_type(TYPE_INT8);
-                } else if (strncmp(ast->node.text, "s16", ast->node.len) == 0) {
-                    return data_type_type(TYPE_INT16);
-                } else if (strncmp(ast->node.text, "s32", ast->node.len) == 0
-                       || strncmp(ast->node.text, "int", ast->node.len) == 0) {
-                    return data_type_type(TYPE_INT32);
-                } else if (strncmp(ast->node.text, "s64", ast->node.len) == 0) {
-                    return data_type_type(TYPE_INT64);
-                } else if (strncmp(ast->node.text, "void", ast->node.len) == 0) {
-                    return data_type_type(TYPE_VOID);
-                } else if (strncmp(ast->node.text, "string", ast->node.len) == 0) {
-                    return data_type_reference(data_type_type(TYPE_INT8));
-                }
-            }
-            break;
-        }
+    const DataType **interned = data_type_map_get(&types->types, &type);
 
-        case AST_PREFIX: {
-            switch (ast->prefix.oper.type) {
-                case TOKEN_REFERENCE: {
-                    return data_type_reference(data_type_new(ast->prefix.node));
-                }
+    if (interned != NULL) {
+        return *interned;
+    }
 
-                default: {
-                    break;
-                }
-            }
-            break;
-        }
+    DataType *copy = arena_copy(types->arena, type, sizeof(*type));
 
-        case AST_FUNCTION_CALL: {
-            break;
-        }
+    if (copy->type == TYPE_FUNCTION) {
+        copy->function.arguments = arena_copy(
+            types->arena,
+            type->function.arguments,
+            sizeof(*type->function.arguments) * type->function.len
+        );
+    }
 
-        default: {
-            break;
-        }
+    const DataType *key = copy;
+    data_type_map_insert(&types->types, &key, &key);
+
+    return copy;
+}
+
+const DataType *data_type_type(DataTypeType type)
+{
+    if (type == TYPE_REFERENCE || type == TYPE_ARRAY || type == TYPE_FUNCTION) {
+        UNREACHABLE();
     }
-    ERROR("Bad type.");
+
+    return &PRIMITIVE_TYPES[type];
 }
 
-DataType *data_type_copy(const DataType *type)
+const DataType *data_type_reference(TypeTable *types, const DataType *dereference)
 {
-    switch (type->type) {
-        case TYPE_REFERENCE: {
-            return data_type_reference(data_type_copy(type->dereference));
+    const DataType type = {
+        .type = TYPE_REFERENCE,
+        .dereference = dereference
+    };
+
+    return type_table_intern(types, &type);
+}
+
+const DataType *data_type_array(TypeTable *types, size_t len, const DataType *element)
+{
+    const DataType type = {
+        .type = TYPE_ARRAY,
+        .array.len = len,
+        .array.element = element
+    };
+
+    return type_table_intern(types, &type);
+}
+
+const DataType *data_type_function(TypeTable *types, size_t arguments_len, const DataType *const *arguments, const DataType *return_type)
+{
+    const DataType type = {
+        .type = TYPE_FUNCTION,
+        .function.len = arguments_len,
+        .function.arguments = arguments,
+        .function.return_type = return_type
+    };
+
+    return type_table_intern(types, &type);
+}
+
+size_t data_type_size(const DataType *data_type)
+{
+    switch (data_type->type) {
+        case TYPE_INT8: {
+            return 1;
         }
 
-        case TYPE_FUNCTION: {
-            DataType **arguments = malloc(sizeof(*arguments) * type->function.cap);
+        case TYPE_INT16: {
+            return 2;
+        }
 
-            if (arguments == NULL) {
-                ALLOCATION_ERROR();
-            }
+        case TYPE_INT32: {
+            return 4;
+        }
 
-            for (size_t i = 0; i < type->function.len; ++i) {
-                arguments[i] = data_type_copy(type->function.arguments[i]);
-            }
+        case TYPE_INT64:
+        case TYPE_REFERENCE:
+        case TYPE_FUNCTION: {
+            return 8;
+        }
 
-            return data_type_function(type->function.len, type->function.cap, arguments, data_type_copy(type->function.return_type));
+        case TYPE_ARRAY: {
+            return data_type->array.len * data_type_size(data_type->array.element);
         }
 
         default: {
-            return data_type_type(type->type);
+            return 0;
         }
     }
 }
 
-bool data_type_equals(const DataType *lhs, const DataType *rhs)
+// `[len]element`, where the length has to be a number
+static const DataType *data_type_new_array(TypeTable *types, const AST *ast, ASTIndex node)
 {
-    if (lhs->type != rhs->type) {
-        return false;
+    const ASTIndex len_node = ast_array_type_len(ast, node);
+
+    if (ast_type(ast, len_node) != AST_NODE || ast_token_type(ast, len_node) != TOKEN_NUMBER) {
+        ERROR("An array's length has to be a number.");
     }
 
-    switch (lhs->type) {
-        case TYPE_REFERENCE: {
-            return data_type_equals(lhs->dereference, rhs->dereference);
-        }
+    const Token token = ast_token(ast, len_node);
+    const DataType *element = data_type_new(types, ast, ast_prefix_node(ast, node));
 
-        case TYPE_FUNCTION: {
-            if (!data_type_equals(lhs->function.return_type, rhs->function.return_type)
-                || lhs->function.len != rhs->function.len) {
-                return false;
-            }
+    if (element->type == TYPE_VOID) {
+        ERROR("Bad type.");
+    }
 
-            for (size_t i = 0; i < lhs->function.len; ++i) {
-                if (!data_type_equals(lhs->function.arguments[i], rhs->function.arguments[i])) {
-                    return false;
-                }
-            }
+    const size_t element_size = data_type_size(element);
 
-            return true;
-        }
+    // it has to fit on the stack, see DATA_TYPE_MAX_SIZE
+    size_t len = 0;
 
-        default: {
-            return true;
+    for (size_t i = 0; i < token.len; ++i) {
+        len = len * 10 + (size_t) (token.text[i] - '0');
+
+        if (len * element_size > DATA_TYPE_MAX_SIZE) {
+            ERROR("Array is too big, it can take up at most %zu bytes.", DATA_TYPE_MAX_SIZE);
         }
     }
+
+    if (len == 0) {
+        ERROR("An array can't be empty.");
+    }
+
+    return data_type_array(types, len, element);
 }
 
-void data_type_free(DataType *type)
+const DataType *data_type_new(TypeTable *types, const AST *ast, ASTIndex node)
 {
-    switch (type->type) {
-        case TYPE_REFERENCE: {
-            data_type_free(type->dereference);
+    switch (ast_type(ast, node)) {
+        case AST_NODE: {
+            const Token token = ast_token(ast, node);
+
+            if (token.type != TOKEN_IDENT) {
+                break;
+            }
+
+            switch (token.symbol) {
+                case SYMBOL_S8: {
+                    return data_type_type(TYPE_INT8);
+                }
+
+                case SYMBOL_S16: {
+                    return data_type_type(TYPE_INT16);
+                }
+
+                // int is an alias for s32
+                case SYMBOL_S32:
+                case SYMBOL_INT: {
+                    return data_type_type(TYPE_INT32);
+                }
+
+                case SYMBOL_S64: {
+                    return data_type_type(TYPE_INT64);
+                }
+
+                case SYMBOL_VOID: {
+                    return data_type_type(TYPE_VOID);
+                }
+
+                case SYMBOL_STRING: {
+                    return data_type_reference(types, data_type_type(TYPE_INT8));
+                }
+
+                default: {
+                    break;
+                }
+            }
             break;
         }
 
-        case TYPE_FUNCTION: {
-            data_type_free(type->function.return_type);
-            for (size_t i = 0; i < type->function.len; ++i) {
-                data_type_free(type->function.arguments[i]);
+        case AST_PREFIX: {
+            switch (ast_token_type(ast, node)) {
+                case TOKEN_REFERENCE: {
+                    return data_type_reference(types, data_type_new(types, ast, ast_prefix_node(ast, node)));
+                }
+
+                case TOKEN_LEFT_SQUARE: {
+                    return data_type_new_array(types, ast, node);
+                }
+
+                default: {
+                    break;
+                }
             }
-            free(type->function.arguments);
+            break;
+        }
+
+        case AST_FUNCTION_CALL: {
             break;
         }
 
@@ -164,6 +293,5 @@ void data_type_free(DataType *type)
             break;
         }
     }
-
-    free(type);
+    ERROR("Bad type.");
 }
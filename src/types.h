@@ -2,9 +2,13 @@
 #define TYPES_H_
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdbool.h>
+#include "arena.h"
+#include "hashmap.h"
 
 typedef struct AST AST;
+typedef uint32_t ASTIndex;
 
 typedef enum DataTypeType {
     TYPE_NULL,
@@ -15,6 +19,8 @@ typedef enum DataTypeType {
 
     TYPE_REFERENCE,
 
+    TYPE_ARRAY,
+
     TYPE_INT8,
     TYPE_INT16,
     TYPE_INT32,
@@ -23,26 +29,70 @@ typedef enum DataTypeType {
     DATA_TYPES,
 } DataTypeType;
 
+// the most the arrays of a stack frame can take up together, well
+// below the 8 MiB stack that a program usually gets, since there's
+// nothing that grows the stack or checks that it didn't overflow
+#define DATA_TYPE_MAX_SIZE ((size_t) 1 << 20)
+
+// Data types are interned: there is only ever one instance of each
+// distinct type, so they are immutable and compared by pointer.
 typedef struct DataType
 {
     DataTypeType type;
     union {
-        struct DataType *dereference;
+        const struct DataType *dereference;
+        struct {
+            size_t len;
+            const struct DataType *element;
+        } array;
         struct {
             size_t len;
-            size_t cap;
-            struct DataType **arguments;
-            struct DataType *return_type;
+            const struct DataType *const *arguments;
+            const struct DataType *return_type;
         } function;
     };
 } DataType;
 
-DataType *data_type_type(DataTypeType type);
-DataType *data_type_reference(DataType *dereference);
-DataType *data_type_function(size_t arguments_len, size_t arguments_cap, DataType **arguments, DataType *return_type);
-DataType *data_type_new(const AST *ast);
-DataType *data_type_copy(const DataType *type);
-bool data_type_equals(const DataType *lhs, const DataType *rhs);
-void data_type_free(DataType *type);
+uint32_t data_type_hash(const DataType *const *type);
+bool data_type_shallow_equals(const DataType *const *lhs, const DataType *const *rhs);
+
+// every composite type made so far, keyed by its components
+#define HASHMAP_NAME   DataTypeMap
+#define HASHMAP_PREFIX data_type_map
+#define HASHMAP_KEY    const DataType *
+#define HASHMAP_VALUE  const DataType *
+#define HASHMAP_HASH   data_type_hash
+#define HASHMAP_EQUALS data_type_shallow_equals
+#include "hashmap_template.h"
+
+typedef struct TypeTable
+{
+    Arena *arena;
+    DataTypeMap types;
+} TypeTable;
+
+TypeTable type_table_new(Arena *arena);
+void type_table_free(TypeTable *types);
+
+// only for types without components
+const DataType *data_type_type(DataTypeType type);
+
+const DataType *data_type_reference(TypeTable *types, const DataType *dereference);
+const DataType *data_type_array(TypeTable *types, size_t len, const DataType *element);
+const DataType *data_type_function(TypeTable *types, size_t arguments_len, const DataType *const *arguments, const DataType *return_type);
+const DataType *data_type_new(TypeTable *types, const AST *ast, ASTIndex node);
+
+// in bytes, as it's laid out in memory
+size_t data_type_size(const DataType *data_type);
+
+static inline bool data_type_is_integer(const DataType *data_type)
+{
+    return data_type->type >= TYPE_INT8 && data_type->type <= TYPE_INT64;
+}
+
+static inline bool data_type_equals(const DataType *lhs, const DataType *rhs)
+{
+    return lhs == rhs;
+}
 
 #endif // TYPES_H_
@@ -0,0 +1,81 @@
+#!/bin/sh
+# Compiles every program in examples/ with both backends, the NASM text
+# assembled with nasm and linked with ld, and the executable that --elf
+# writes directly, then runs both and checks that they agree: either
+# neither compiles, or they exit with the same code and print the same.
+#
+# A program whose last line ends in a comment that's just a number,
+# like `a; // 6`, has to exit with that number too.
+#
+# usage: tests/backends.sh [compiler] [examples...]
+# NASM and LD can be set to use another assembler or linker.
+
+COMPILER=${1:-build/repo}
+[ $# -gt 0 ] && shift
+[ $# -eq 0 ] && set -- examples/*.oil
+
+NASM=${NASM:-nasm}
+LD=${LD:-ld}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+failed=0
+
+fail()
+{
+    echo "FAIL $1: $2"
+    failed=$((failed + 1))
+}
+
+for program in "$@"; do
+    name=$(basename "$program" .oil)
+
+    "$COMPILER" "$program" "$TMP/$name.asm" > /dev/null 2>&1
+    nasm_compiled=$?
+    "$COMPILER" "$program" "$TMP/$name.elf" --elf > /dev/null 2>&1
+    elf_compiled=$?
+
+    if [ $nasm_compiled -ne 0 ] || [ $elf_compiled -ne 0 ]; then
+        if [ $nasm_compiled -eq 0 ] || [ $elf_compiled -eq 0 ]; then
+            fail "$program" "only one backend compiled it"
+        else
+            echo "ok   $program (doesn't compile)"
+        fi
+        continue
+    fi
+
+    if ! "$NASM" -f elf64 "$TMP/$name.asm" -o "$TMP/$name.o" || ! "$LD" "$TMP/$name.o" -o "$TMP/$name"; then
+        fail "$program" "the NASM output doesn't assemble"
+        continue
+    fi
+
+    timeout 10 "$TMP/$name" > "$TMP/$name.nasm.out"
+    nasm_exit=$?
+    timeout 10 "$TMP/$name.elf" > "$TMP/$name.elf.out"
+    elf_exit=$?
+
+    if [ $nasm_exit -ne $elf_exit ]; then
+        fail "$program" "exit code $nasm_exit with nasm, $elf_exit with --elf"
+        continue
+    fi
+
+    if ! cmp -s "$TMP/$name.nasm.out" "$TMP/$name.elf.out"; then
+        fail "$program" "the output is different"
+        continue
+    fi
+
+    expected=$(tail -n 1 "$program" | sed -n 's|.*// *\([0-9][0-9]*\) *$|\1|p')
+
+    if [ -n "$expected" ] && [ $nasm_exit -ne $((expected % 256)) ]; then
+        fail "$program" "exit code $nasm_exit, expected $expected"
+        continue
+    fi
+
+    echo "ok   $program (exit $nasm_exit)"
+done
+
+if [ $failed -ne 0 ]; then
+    echo "$failed failed"
+    exit 1
+fi
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Compiles tests/peephole.oil with --stats and checks that every
+# peephole rule fired on it at least once, since the rules only see
+# the output of everything before them and could quietly stop matching.
+#
+# usage: tests/peephole.sh [compiler]
+
+COMPILER=${1:-build/repo}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+if ! "$COMPILER" tests/peephole.oil "$TMP/peephole.asm" --stats --inline-budget 0 2> "$TMP/stats"; then
+    cat "$TMP/stats"
+    echo "FAIL tests/peephole.oil: doesn't compile"
+    exit 1
+fi
+
+failed=0
+
+for rule in "self move" "store to load" "redundant test"; do
+    hits=$(sed -n "s/^peephole: $rule  *\([0-9]*\) hits$/\1/p" "$TMP/stats")
+
+    if [ -z "$hits" ] || [ "$hits" -eq 0 ]; then
+        echo "FAIL peephole: $rule never fired"
+        failed=$((failed + 1))
+    else
+        echo "ok   peephole: $rule, $hits hits"
+    fi
+done
+
+if [ $failed -ne 0 ]; then
+    echo "$failed failed"
+    exit 1
+fi